@@ -0,0 +1,8 @@
+// Time looking up a global as the number of globals grows - this should stay roughly flat
+var sizes = [10,100,250,500,1000];
+var defined = 0;
+for (var s in sizes) {
+  while (defined < sizes[s]) eval("var g"+(defined++)+"=1");
+  eval("function probe() { var t=getTime(); for (var i=0;i<10000;i++) g"+(defined-1)+"; return getTime()-t; }");
+  console.log(sizes[s]+" globals: "+Math.round(probe()*100000000/10000)/100+"us per lookup");
+}
@@ -57,6 +57,13 @@ The HTTP server request
 }
 The 'data' event is called when data is received. If a handler is defined with `X.on('data', function(data) { ... })` then it will be called, otherwise data will be stored in an internal buffer, where it can be retrieved with `X.read()`
 */
+/*JSON{
+  "type" : "event",
+  "class" : "httpSRq",
+  "name" : "end"
+}
+Called when all of the body of the request has been received, and passed on with the `data` event. If the request had no `Content-Length` or `Transfer-Encoding: chunked` header, it is only known to be complete when the connection closes (except for `GET` and `HEAD` requests, which have no body).
+*/
 /*JSON{
   "type" : "event",
   "class" : "httpSRq",
@@ -111,7 +118,7 @@ The HTTP server response
   "class" : "httpSRs",
   "name" : "drain"
 }
-An event that is fired when the buffer is empty and it can accept more data to send. 
+An event that is fired when the buffer is empty (or nearly empty, if a lot was written) and it can accept more data to send. 
 */
 /*JSON{
   "type" : "event",
@@ -133,7 +140,7 @@ The HTTP client request
   "class" : "httpCRq",
   "name" : "drain"
 }
-An event that is fired when the buffer is empty and it can accept more data to send. 
+An event that is fired when the buffer is empty (or nearly empty, if a lot was written) and it can accept more data to send. 
 */
 
 /*JSON{
@@ -153,6 +160,13 @@ The HTTP client response
 }
 The 'data' event is called when data is received. If a handler is defined with `X.on('data', function(data) { ... })` then it will be called, otherwise data will be stored in an internal buffer, where it can be retrieved with `X.read()`
 */
+/*JSON{
+  "type" : "event",
+  "class" : "httpCRs",
+  "name" : "end"
+}
+Called when all of the body of the response has been received, and passed on with the `data` event. If the response had no `Content-Length` or `Transfer-Encoding: chunked` header, it is only known to be complete when the connection closes.
+*/
 /*JSON{
   "type" : "event",
   "class" : "httpCRs",
@@ -214,6 +228,8 @@ Pipe this to a stream (an object with a 'write' method)
 Create an HTTP Server
 
 When a request to the server is made, the callback is called. In the callback you can use the methods on the response (httpSRs) to send data. You can also add `request.on('data',function() { ... })` to listen for POSTed data
+
+If an HTTP/1.1 client asks for it, the connection is kept open for more requests after the response. Unless you give a `Content-Length` header, the response is then sent with chunked encoding so the client knows where it ends. Idle connections are closed when the server is closed.
 */
 
 JsVar *jswrap_http_createServer(JsVar *callback) {
@@ -247,7 +263,8 @@ var options = {
     port: 80,            // (optional) port, defaults to 80
     path: '/',           // path sent to server
     method: 'GET',       // HTTP command sent to server (must be uppercase 'GET', 'POST', etc)
-    headers: { key : value, key : value } // (optional) HTTP headers
+    headers: { key : value, key : value }, // (optional) HTTP headers
+    agent: false         // (optional) set to false to close the connection afterwards, rather than keeping it open
   };
 require("http").request(options, function(res) {
   res.on('data', function(data) {
@@ -261,6 +278,8 @@ require("http").request(options, function(res) {
 
 You can easily pre-populate `options` from a URL using `var options = url.parse("http://www.example.com/foo.html")`
 
+Connections are kept open after the response (with `Connection: keep-alive`) if the server allows it, and are reused for the next request to the same host and port. A few idle connections are kept for each host, and they're closed if the server closes them.
+
 */
 
 /*JSON{
@@ -350,7 +369,7 @@ Stop listening for new HTTP connections
   "name" : "write",
   "generate" : "jswrap_httpSRs_write",
   "params" : [
-    ["data","JsVar","A string containing data to send"]
+    ["data","JsVar","A string or typed array containing data to send (typed arrays are sent as raw bytes)"]
   ],
   "return" : ["bool","For note compatibility, the boolean false. When the send buffer is empty, a `drain` event will be sent"]
 }*/
@@ -365,7 +384,7 @@ bool jswrap_httpSRs_write(JsVar *parent, JsVar *data) {
   "name" : "end",
   "generate" : "jswrap_httpSRs_end",
   "params" : [
-    ["data","JsVar","A string containing data to send"]
+    ["data","JsVar","A string or typed array containing data to send (typed arrays are sent as raw bytes)"]
   ]
 }*/
 void jswrap_httpSRs_end(JsVar *parent, JsVar *data) {
@@ -398,7 +417,7 @@ void jswrap_httpSRs_writeHead(JsVar *parent, int statusCode, JsVar *headers) {
   "name" : "write",
   "generate" : "jswrap_net_socket_write",
   "params" : [
-    ["data","JsVar","A string containing data to send"]
+    ["data","JsVar","A string or typed array containing data to send (typed arrays are sent as raw bytes)"]
   ],
   "return" : ["bool","For note compatibility, the boolean false. When the send buffer is empty, a `drain` event will be sent"]
 }*/
@@ -410,7 +429,7 @@ void jswrap_httpSRs_writeHead(JsVar *parent, int statusCode, JsVar *headers) {
   "name" : "end",
   "generate" : "jswrap_net_socket_end",
   "params" : [
-    ["data","JsVar","A string containing data to send"]
+    ["data","JsVar","A string or typed array containing data to send (typed arrays are sent as raw bytes)"]
   ]
 }
 Finish this HTTP request - optional data to append as an argument
@@ -64,6 +64,20 @@ require("NetworkJS").create({
     // Send data (as string). Returns the number of bytes sent - 0 is ok.
     // Less than 0
     return data.length;
+  },
+  // The following are optional, and are only needed for the 'dgram' module
+  createDgram : function(port) {
+    // Create a UDP socket receiving on the given port (any port if 0) and return its index, or -1 on failure
+    return -1;
+  },
+  sendTo : function(sckt, data, host, port) {
+    // Send one datagram (as string) to the given host and port. Returns the number of bytes sent,
+    // 0 if busy (it'll be tried again), or less than 0 on failure
+    return data.length;
+  },
+  recvFrom : function(sckt, maxLen) {
+    // Receive a datagram. Returns {data:string, host:"1.2.3.4", port:int}, or undefined if there are none
+    return undefined;
   }
 });
 ```
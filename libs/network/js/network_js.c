@@ -137,6 +137,77 @@ int net_js_send(JsNetwork *net, int sckt, const void *buf, size_t len) {
   return r;
 }
 
+/// Get a host address as a string to pass to JS (using the last name we looked up if needed)
+static JsVar *net_js_getHostString(uint32_t host) {
+  JsVar *hostVar = 0;
+  if (host==0xFFFFFFFF)
+    hostVar = jsvObjectGetChild(execInfo.hiddenRoot, JSNET_DNS_NAME, 0);
+  if (!hostVar)
+    hostVar = networkGetAddressAsString((unsigned char *)&host, 4,10,'.');
+  return hostVar;
+}
+
+/// Create a datagram socket bound to the given port (or any port if 0). Returns >=0 on success
+int net_js_createdgram(JsNetwork *net, unsigned short port) {
+  NOT_USED(net);
+  JsVar *args[1] = {
+      jsvNewFromInteger(port)
+  };
+  JsVar *res = callFn("createDgram", 1, args);
+  jsvUnLock(args[0]);
+  int sckt = jsvIsNumeric(res) ? (int)jsvGetInteger(res) : -1; // -1 if there's no createDgram
+  jsvUnLock(res);
+  return sckt;
+}
+
+/// Send one datagram to the given address. returns nBytes on success, 0 if busy, or -1 on failure
+int net_js_sendto(JsNetwork *net, int sckt, const void *buf, size_t len, uint32_t host, unsigned short port) {
+  NOT_USED(net);
+  JsVar *args[4] = {
+      jsvNewFromInteger(sckt),
+      jsvNewFromEmptyString(),
+      net_js_getHostString(host),
+      jsvNewFromInteger(port)
+  };
+  jsvAppendStringBuf(args[1], buf, len);
+  int r = jsvGetIntegerAndUnLock(callFn("sendTo", 4, args));
+  jsvUnLockMany(4, args);
+  return r;
+}
+
+/** Receive up to count datagrams, each into its own 'size' bytes of buf.
+ * returns the number received, 0 on no data, or -1 on failure */
+int net_js_recvdgrams(JsNetwork *net, int sckt, char *buf, size_t size, JsNetworkDgram *dgrams, int count) {
+  NOT_USED(net);
+  int n = 0;
+  while (n<count) {
+    JsVar *args[2] = {
+        jsvNewFromInteger(sckt),
+        jsvNewFromInteger((JsVarInt)size),
+    };
+    JsVar *res = callFn("recvFrom", 2, args);
+    jsvUnLockMany(2, args);
+    if (!jsvIsObject(res)) { // no more data
+      jsvUnLock(res);
+      break;
+    }
+    JsVar *data = jsvObjectGetChild(res, "data", 0);
+    size_t len = jsvIsString(data) ? jsvGetStringLength(data) : 0;
+    if (len > size) len = size; // truncated
+    dgrams[n].len = len ? jsvGetStringChars(data, 0, &buf[(size_t)n*size], len) : 0;
+    jsvUnLock(data);
+    char host[32];
+    JsVar *hostVar = jsvObjectGetChild(res, "host", 0);
+    jsvGetString(hostVar, host, sizeof(host));
+    jsvUnLock(hostVar);
+    dgrams[n].host = networkParseIPAddress(host);
+    dgrams[n].port = (unsigned short)jsvGetIntegerAndUnLock(jsvObjectGetChild(res, "port", 0));
+    jsvUnLock(res);
+    n++;
+  }
+  return n;
+}
+
 // ------------------------------------------------------------------------------------------------------------------------
 
 void netSetCallbacks_js(JsNetwork *net) {
@@ -148,5 +219,8 @@ void netSetCallbacks_js(JsNetwork *net) {
   net->gethostbyname = net_js_gethostbyname;
   net->recv = net_js_recv;
   net->send = net_js_send;
+  net->createdgram = net_js_createdgram;
+  net->sendto = net_js_sendto;
+  net->recvdgrams = net_js_recvdgrams;
 }
 
@@ -293,7 +293,7 @@ Pipe this to a stream (an object with a 'write' method)
   "class" : "Socket",
   "name" : "drain"
 }
-An event that is fired when the buffer is empty and it can accept more data to send. 
+An event that is fired when the buffer is empty (or nearly empty, if a lot was written) and it can accept more data to send. 
 */
 
 
@@ -429,7 +429,7 @@ void jswrap_net_server_close(JsVar *parent) {
   "name" : "write",
   "generate" : "jswrap_net_socket_write",
   "params" : [
-    ["data","JsVar","A string containing data to send"]
+    ["data","JsVar","A string or typed array containing data to send (typed arrays are sent as raw bytes)"]
   ],
   "return" : ["bool","For note compatibility, the boolean false. When the send buffer is empty, a `drain` event will be sent"]
 }*/
@@ -447,7 +447,7 @@ bool jswrap_net_socket_write(JsVar *parent, JsVar *data) {
   "name" : "end",
   "generate" : "jswrap_net_socket_end",
   "params" : [
-    ["data","JsVar","A string containing data to send"]
+    ["data","JsVar","A string or typed array containing data to send (typed arrays are sent as raw bytes)"]
   ]
 }
 Close this socket - optional data to append as an argument
@@ -460,3 +460,151 @@ void jswrap_net_socket_end(JsVar *parent, JsVar *data) {
   clientRequestEnd(&net, parent);
   networkFree(&net);
 }
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
+/*JSON{
+  "type" : "library",
+  "class" : "dgram"
+}
+This library allows you to send and receive UDP datagrams - with no connection to set up first
+
+In order to use this, you will need an extra module to get network connectivity (that supports datagrams).
+
+This is designed to be a cut-down version of the [node.js library](http://nodejs.org/api/dgram.html). For instance:
+
+```
+var dgram = require("dgram");
+var s = dgram.createSocket("udp4", function(msg, rinfo) {
+  console.log("Got "+JSON.stringify(msg)+" from "+rinfo.address+":"+rinfo.port);
+});
+s.bind(1234);
+s.send("Hello", 1234, "localhost");
+```
+*/
+
+/*JSON{
+  "type" : "class",
+  "library" : "dgram",
+  "class" : "dgramSocket"
+}
+A UDP socket created by `require('dgram').createSocket`
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "dgramSocket",
+  "name" : "message",
+  "params" : [
+    ["msg","JsVar","A string containing the datagram"],
+    ["rinfo","JsVar","An object containing the `address` and `port` it was sent from, its `size`, and `family` (always `IPv4`)"]
+  ]
+}
+Called when a datagram is received. Datagrams that are too big (more than 4kB on Linux) are truncated.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "dgramSocket",
+  "name" : "listening"
+}
+Called when the socket has been bound to a port (either by `bind` or by the first `send`)
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "dgramSocket",
+  "name" : "close"
+}
+Called when the socket is closed
+*/
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "dgram",
+  "name" : "createSocket",
+  "generate" : "jswrap_dgram_createSocket",
+  "params" : [
+    ["type","JsVar","The type of socket - only `'udp4'` is supported"],
+    ["callback","JsVar","An optional `function(msg, rinfo)` that will be called when a datagram is received"]
+  ],
+  "return" : ["JsVar","Returns a new dgramSocket Object"],
+  "return_object" : "dgramSocket"
+}
+Create a UDP socket
+*/
+JsVar *jswrap_dgram_createSocket(JsVar *type, JsVar *callback) {
+  JsVar *typeStr = jsvIsObject(type) ? jsvObjectGetChild(type, "type", 0) : jsvLockAgain(type);
+  bool isUdp4 = jsvIsStringEqual(typeStr, "udp4");
+  jsvUnLock(typeStr);
+  if (!isUdp4) {
+    jsError("Only 'udp4' sockets are supported");
+    return 0;
+  }
+  JsVar *skippedCallback = jsvSkipName(callback);
+  if (!jsvIsUndefined(skippedCallback) && !jsvIsFunction(skippedCallback)) {
+    jsError("Expecting Callback Function but got %t", skippedCallback);
+    jsvUnLock(skippedCallback);
+    return 0;
+  }
+  jsvUnLock(skippedCallback);
+  return dgramNew(jsvIsUndefined(callback) ? 0 : callback);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "dgramSocket",
+  "name" : "bind",
+  "generate" : "jswrap_dgram_socket_bind",
+  "params" : [
+    ["port","int32","The port to receive datagrams on (or 0 for any port)"],
+    ["callback","JsVar","An optional function that is called when the socket is bound"]
+  ]
+}
+Start receiving datagrams on the given port. This isn't needed just to send datagrams - a socket is bound to any free port when it first sends.
+*/
+void jswrap_dgram_socket_bind(JsVar *parent, int port, JsVar *callback) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+
+  dgramBind(&net, parent, port, callback);
+  networkFree(&net);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "dgramSocket",
+  "name" : "send",
+  "generate" : "jswrap_dgram_socket_send",
+  "params" : [
+    ["msg","JsVar","A string or typed array containing the datagram to send (typed arrays are sent as raw bytes)"],
+    ["port","int32","The port to send to"],
+    ["address","JsVar","The host name or IP address to send to (default is `localhost`)"],
+    ["callback","JsVar","An optional function that is called when the datagram has been sent"]
+  ]
+}
+Send a datagram. Nothing is set up with the destination first, so there's no guarantee that it arrives.
+*/
+void jswrap_dgram_socket_send(JsVar *parent, JsVar *msg, int port, JsVar *address, JsVar *callback) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+
+  dgramSend(&net, parent, msg, port, address, callback);
+  networkFree(&net);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "dgramSocket",
+  "name" : "close",
+  "generate" : "jswrap_dgram_socket_close"
+}
+Stop receiving datagrams, and close the socket
+*/
+void jswrap_dgram_socket_close(JsVar *parent) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+
+  dgramClose(&net, parent);
+  networkFree(&net);
+}
@@ -33,3 +33,8 @@ void jswrap_net_socket_end(JsVar *parent, JsVar *data);
 
 
 
+
+JsVar *jswrap_dgram_createSocket(JsVar *type, JsVar *callback);
+void jswrap_dgram_socket_bind(JsVar *parent, int port, JsVar *callback);
+void jswrap_dgram_socket_send(JsVar *parent, JsVar *msg, int port, JsVar *address, JsVar *callback);
+void jswrap_dgram_socket_close(JsVar *parent);
@@ -11,6 +11,9 @@
  * Implementation of JsNetwork for Linux
  * ----------------------------------------------------------------------------
  */
+#ifdef __linux__
+#define _GNU_SOURCE // for recvmmsg
+#endif
 #include "network.h"
 #include "network_linux.h"
 
@@ -26,6 +29,7 @@
 #else
  #include <sys/socket.h>
  #include <sys/select.h>
+ #include <sys/uio.h>
  #include <arpa/inet.h>
  #include <netdb.h>
  #include <netinet/in.h>
@@ -36,9 +40,84 @@
  typedef struct sockaddr_in sockaddr_in;
  typedef int SOCKET;
 #endif
+#ifdef NET_LINUX_EPOLL
+ #include <sys/epoll.h>
+ #include <stdlib.h>
+#endif
 
  #define closesocket(SOCK) close(SOCK)
 
+#ifdef NET_LINUX_EPOLL
+/* Rather than doing a select() on each socket every time we want to use it,
+ * all sockets are added (edge triggered) to one epoll fd. Each idle (or while
+ * we're asleep in jshSleep) we do one epoll_wait, and remember which sockets
+ * are ready in netReady. recv/send/accept then only make a syscall for sockets
+ * that are ready, and clear the flag when the socket has no more to give. */
+#define NET_READY_READ  1
+#define NET_READY_WRITE 2
+#define NET_EPOLL_EVENTS 64 ///< How many events to get per epoll_wait
+
+static int netEpollFd = -1;
+static unsigned char *netReady = 0; ///< NET_READY_* flags, indexed by socket
+static int netReadyCount = 0; ///< Number of entries in netReady
+
+static void net_linux_set_ready(int sckt, unsigned char flags) {
+  if (sckt >= netReadyCount) {
+    if (!flags) return;
+    int newCount = (sckt+64) & ~63;
+    unsigned char *r = realloc(netReady, (size_t)newCount);
+    if (!r) return;
+    memset(&r[netReadyCount], 0, (size_t)(newCount-netReadyCount));
+    netReady = r;
+    netReadyCount = newCount;
+  }
+  netReady[sckt] = flags;
+}
+
+static unsigned char net_linux_get_ready(int sckt) {
+  return (sckt>=0 && sckt<netReadyCount) ? netReady[sckt] : 0;
+}
+
+/// Make the socket non-blocking and start watching it
+static void net_linux_watch(int sckt) {
+  fcntl(sckt, F_SETFL, fcntl(sckt, F_GETFL, 0) | O_NONBLOCK);
+  if (netEpollFd<0) netEpollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (netEpollFd<0) return;
+  net_linux_set_ready(sckt, 0);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.fd = sckt;
+  epoll_ctl(netEpollFd, EPOLL_CTL_ADD, sckt, &ev);
+}
+
+/// Wait up to timeoutMs for sockets to become ready, and mark the ones that are. Returns false if we're not watching anything
+static bool net_linux_poll(int timeoutMs) {
+  if (netEpollFd<0) return false;
+  struct epoll_event events[NET_EPOLL_EVENTS];
+  int n = epoll_wait(netEpollFd, events, NET_EPOLL_EVENTS, timeoutMs);
+  int i;
+  for (i=0;i<n;i++) {
+    unsigned char flags = net_linux_get_ready(events[i].data.fd);
+    // on errors/hangups, make recv/send find out about it
+    if (events[i].events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR)) flags |= NET_READY_READ;
+    if (events[i].events & (EPOLLOUT|EPOLLHUP|EPOLLERR)) flags |= NET_READY_WRITE;
+    net_linux_set_ready(events[i].data.fd, flags);
+  }
+  return true;
+}
+#endif
+
+/// Sleep for up to usecs, but wake early if a socket becomes ready. Returns false if there are no sockets to wait for
+bool net_linux_sleep(unsigned int usecs) {
+#ifdef NET_LINUX_EPOLL
+  return net_linux_poll((int)(usecs/1000));
+#else
+  NOT_USED(usecs);
+  return false;
+#endif
+}
+
 
 /// Get an IP address from a name. Sets out_ip_addr to 0 on failure
 void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_addr) {
@@ -51,6 +130,9 @@ void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_a
 /// Called on idle. Do any checks required for this device
 void net_linux_idle(JsNetwork *net) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  net_linux_poll(0);
+#endif
 }
 
 /// Call just before returning to idle loop. This checks for errors and tries to recover. Returns true if no errors.
@@ -71,6 +153,9 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
 
     sckt = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (sckt<0) return sckt; // error
+#ifdef NET_LINUX_EPOLL
+    net_linux_watch(sckt); // so we don't block while connecting
+#endif
 
     // turn on non-blocking mode
     #ifdef WIN_OS
@@ -124,12 +209,20 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
     }
 
     // Make the socket listen
+#ifdef NET_LINUX_EPOLL
+    // we only accept when idle, so a burst of connects made from JS can easily overflow a small backlog
+    nret = listen(sckt, SOMAXCONN);
+#else
     nret = listen(sckt, 10); // 10 connections (but this ignored on CC30000)
+#endif
     if (nret == SOCKET_ERROR) {
       jsError("Socket listen failed");
       closesocket(sckt);
       return -1;
     }
+#ifdef NET_LINUX_EPOLL
+    net_linux_watch(sckt);
+#endif
   }
 
 #ifdef SO_NOSIGPIPE
@@ -145,12 +238,27 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
 /// destroys the given socket
 void net_linux_closesocket(JsNetwork *net, int sckt) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  net_linux_set_ready(sckt, 0); // closing removes it from netEpollFd
+#endif
   closesocket(sckt);
 }
 
 /// If the given server socket can accept a connection, return it (or return < 0)
 int net_linux_accept(JsNetwork *net, int sckt) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  if (!(net_linux_get_ready(sckt) & NET_READY_READ)) return -1;
+  int theClient = accept(sckt,0,0);
+  if (theClient<0) {
+    // no more clients waiting (we'll get another event when there are)
+    if (errno==EAGAIN || errno==EWOULDBLOCK)
+      net_linux_set_ready(sckt, 0);
+    return -1;
+  }
+  net_linux_watch(theClient);
+  return theClient;
+#else
   // TODO: look for unreffed servers?
   fd_set s;
   FD_ZERO(&s);
@@ -166,11 +274,26 @@ int net_linux_accept(JsNetwork *net, int sckt) {
     return theClient;
   }
   return -1;
+#endif
 }
 
 /// Receive data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_linux_recv(JsNetwork *net, int sckt, void *buf, size_t len) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  unsigned char ready = net_linux_get_ready(sckt);
+  if (!(ready & NET_READY_READ)) return 0;
+  int num = (int)recv(sckt,buf,len,0);
+  if (num<0) {
+    if (errno!=EAGAIN && errno!=EWOULDBLOCK) return -1; // we probably disconnected
+    // nothing left - wait for the next event. We can't stop before this as a close may have come in with the data
+    net_linux_set_ready(sckt, (unsigned char)(ready & ~NET_READY_READ));
+    num = 0;
+  } else if (num==0) {
+    return -1; // connection is closed
+  }
+  return num;
+#else
   int num = 0;
   fd_set s;
   FD_ZERO(&s);
@@ -190,11 +313,21 @@ int net_linux_recv(JsNetwork *net, int sckt, void *buf, size_t len) {
   }
 
   return num;
+#endif
 }
 
 /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
-int net_linux_send(JsNetwork *net, int sckt, const void *buf, size_t len) {
-  NOT_USED(net);
+#if !defined(SO_NOSIGPIPE) && defined(MSG_NOSIGNAL)
+#define NET_LINUX_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NET_LINUX_SEND_FLAGS 0
+#endif
+
+/// Can we send on this socket right now? returns 1 if so, 0 if not, or -1 on failure
+static int net_linux_send_ready(int sckt) {
+#ifdef NET_LINUX_EPOLL
+  return (net_linux_get_ready(sckt) & NET_READY_WRITE) ? 1 : 0;
+#else
   fd_set writefds;
   FD_ZERO(&writefds);
   FD_SET(sckt, &writefds);
@@ -205,17 +338,136 @@ int net_linux_send(JsNetwork *net, int sckt, const void *buf, size_t len) {
   if (n==SOCKET_ERROR ) {
      // we probably disconnected so just get rid of this
     return -1;
-  } else if (FD_ISSET(sckt, &writefds)) {
-    int flags = 0;
-#if !defined(SO_NOSIGPIPE) && defined(MSG_NOSIGNAL)
-    flags |= MSG_NOSIGNAL;
+  }
+  return FD_ISSET(sckt, &writefds) ? 1 : 0;
+#endif
+}
+
+/// Deal with what send returned - it's not an error if the send buffer was just full
+static int net_linux_sent(int sckt, int n) {
+#ifdef NET_LINUX_EPOLL
+  if (n<0) {
+    if (errno!=EAGAIN && errno!=EWOULDBLOCK) return -1; // we probably disconnected
+    // the buffer is full - wait for the next event
+    net_linux_set_ready(sckt, (unsigned char)(net_linux_get_ready(sckt) & ~NET_READY_WRITE));
+    n = 0;
+  }
+#else
+  NOT_USED(sckt);
 #endif
-    n = (int)send(sckt, buf, len, flags);
-    return n;
-  } else
-    return 0; // just not ready
+  return n;
+}
+
+int net_linux_send(JsNetwork *net, int sckt, const void *buf, size_t len) {
+  NOT_USED(net);
+  int n = net_linux_send_ready(sckt);
+  if (n<=0) return n; // error, or just not ready
+  return net_linux_sent(sckt, (int)send(sckt, buf, len, NET_LINUX_SEND_FLAGS));
+}
+
+#ifndef WIN32
+int net_linux_sendv(JsNetwork *net, int sckt, const JsNetworkBuf *bufs, int count) {
+  NOT_USED(net);
+  int n = net_linux_send_ready(sckt);
+  if (n<=0) return n; // error, or just not ready
+  struct iovec iov[count];
+  int i;
+  for (i=0;i<count;i++) {
+    iov[i].iov_base = (void*)bufs[i].buf;
+    iov[i].iov_len = bufs[i].len;
+  }
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = (size_t)count;
+  return net_linux_sent(sckt, (int)sendmsg(sckt, &msg, NET_LINUX_SEND_FLAGS));
 }
 
+/// Create a datagram socket bound to the given port (or any port if 0). Returns >=0 on success
+int net_linux_createdgram(JsNetwork *net, unsigned short port) {
+  NOT_USED(net);
+  int sckt = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sckt<0) {
+    jsError("Socket creation failed");
+    return -1;
+  }
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(port);
+  if (bind(sckt, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+    jsError("Socket bind failed");
+    closesocket(sckt);
+    return -1;
+  }
+#ifdef NET_LINUX_EPOLL
+  net_linux_watch(sckt);
+#else
+  fcntl(sckt, F_SETFL, fcntl(sckt, F_GETFL, 0) | O_NONBLOCK);
+#endif
+  return sckt;
+}
+
+/// Send one datagram to the given address. returns nBytes on success, 0 if busy, or -1 on failure
+int net_linux_sendto(JsNetwork *net, int sckt, const void *buf, size_t len, uint32_t host, unsigned short port) {
+  NOT_USED(net);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = (in_addr_t)host;
+  addr.sin_port = htons(port);
+  // datagrams go out whole (or not at all), so there's no point waiting to be told we can write
+  int n = (int)sendto(sckt, buf, len, NET_LINUX_SEND_FLAGS, (struct sockaddr*)&addr, sizeof(addr));
+  if (n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) n = 0; // the buffer is full - try again later
+  return n;
+}
+
+/** Receive up to count datagrams, each into its own 'size' bytes of buf.
+ * returns the number received, 0 on no data, or -1 on failure */
+int net_linux_recvdgrams(JsNetwork *net, int sckt, char *buf, size_t size, JsNetworkDgram *dgrams, int count) {
+  NOT_USED(net);
+  sockaddr_in addrs[count];
+  int i, n;
+#ifdef NET_LINUX_EPOLL
+  unsigned char ready = net_linux_get_ready(sckt);
+  if (!(ready & NET_READY_READ)) return 0;
+  // get as many datagrams as we can with one call
+  struct mmsghdr msgs[count];
+  struct iovec iov[count];
+  memset(msgs, 0, sizeof(msgs));
+  for (i=0;i<count;i++) {
+    iov[i].iov_base = &buf[(size_t)i*size];
+    iov[i].iov_len = size;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+  }
+  n = recvmmsg(sckt, msgs, (unsigned int)count, MSG_DONTWAIT, 0);
+  if (n<0) {
+    if (errno!=EAGAIN && errno!=EWOULDBLOCK) return -1;
+    // nothing left - wait for the next event
+    net_linux_set_ready(sckt, (unsigned char)(ready & ~NET_READY_READ));
+    return 0;
+  }
+  for (i=0;i<n;i++) dgrams[i].len = msgs[i].msg_len;
+#else
+  // just get one datagram at a time
+  socklen_t addrLen = sizeof(addrs[0]);
+  int num = (int)recvfrom(sckt, buf, size, MSG_DONTWAIT, (struct sockaddr*)&addrs[0], &addrLen);
+  if (num<0) return (errno==EAGAIN || errno==EWOULDBLOCK) ? 0 : -1;
+  dgrams[0].len = (size_t)num;
+  n = 1;
+#endif
+  for (i=0;i<n;i++) {
+    dgrams[i].host = (uint32_t)addrs[i].sin_addr.s_addr;
+    dgrams[i].port = ntohs(addrs[i].sin_port);
+  }
+  return n;
+}
+#endif
+
 void netSetCallbacks_linux(JsNetwork *net) {
   net->idle = net_linux_idle;
   net->checkError = net_linux_checkError;
@@ -225,4 +477,13 @@ void netSetCallbacks_linux(JsNetwork *net) {
   net->gethostbyname = net_linux_gethostbyname;
   net->recv = net_linux_recv;
   net->send = net_linux_send;
+#ifndef WIN32
+  net->sendv = net_linux_sendv;
+  net->createdgram = net_linux_createdgram;
+  net->sendto = net_linux_sendto;
+  net->recvdgrams = net_linux_recvdgrams;
+#endif
+#ifdef NET_LINUX_EPOLL
+  net->wakesFromSleep = true; // see net_linux_sleep
+#endif
 }
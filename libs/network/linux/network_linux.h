@@ -13,4 +13,10 @@
  */
 #include "network.h"
 
+#if defined(__linux__) && !defined(WIN32)
+#define NET_LINUX_EPOLL // wait for all sockets with one epoll fd rather than a select() per socket
+#endif
+
 void netSetCallbacks_linux(JsNetwork *net);
+/// Sleep for up to usecs, but wake early if a socket becomes ready. Returns false if there are no sockets to wait for
+bool net_linux_sleep(unsigned int usecs);
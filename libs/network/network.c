@@ -193,6 +193,11 @@ bool networkGetFromVar(JsNetwork *net) {
 
   // Now we know which kind of network we are working with, invoke the corresponding initialization
   // function to set the callbacks for this network tyoe.
+  net->wakesFromSleep = false;
+  net->sendv = 0;
+  net->createdgram = 0;
+  net->sendto = 0;
+  net->recvdgrams = 0;
   switch (net->data.type) {
 #if defined(USE_CC3000)
   case JSNETWORKTYPE_CC3000 : netSetCallbacks_cc3000(net); break;
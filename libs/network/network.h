@@ -46,6 +46,18 @@ typedef struct {
   Pin pinCS, pinIRQ, pinEN;
 } PACKED_FLAGS JsNetworkData;
 
+/// One of the buffers of data handed to JsNetwork.sendv
+typedef struct {
+  const void *buf;
+  size_t len;
+} JsNetworkBuf;
+
+/// Where a datagram received by JsNetwork.recvdgrams came from, and how long it was
+typedef struct {
+  size_t len;
+  uint32_t host;
+  unsigned short port;
+} JsNetworkDgram;
 
 // Here we assume that IP addresses are stored IN ORDER - eg. 192.168.1.1 = [192,168,1,1] - CC3000 does it backwards
 typedef struct JsNetwork {
@@ -70,6 +82,21 @@ typedef struct JsNetwork {
   int (*recv)(struct JsNetwork *net, int sckt, void *buf, size_t len);
   /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
   int (*send)(struct JsNetwork *net, int sckt, const void *buf, size_t len);
+
+  /// Send data from several buffers in one go if possible (may be 0). returns nBytes on success, 0 on no data, or -1 on failure
+  int (*sendv)(struct JsNetwork *net, int sckt, const JsNetworkBuf *bufs, int count);
+
+  // Datagram (UDP) sockets - these may all be 0 if the network doesn't support them
+  /// Create a datagram socket bound to the given port (or any port if 0). Returns >=0 on success. Closed with closesocket
+  int (*createdgram)(struct JsNetwork *net, unsigned short port);
+  /// Send one datagram to the given address. returns nBytes on success, 0 if busy, or -1 on failure
+  int (*sendto)(struct JsNetwork *net, int sckt, const void *buf, size_t len, uint32_t host, unsigned short port);
+  /** Receive up to count datagrams, each into its own 'size' bytes of buf (longer ones are truncated), and
+   * say where they came from in dgrams. returns the number received, 0 on no data, or -1 on failure */
+  int (*recvdgrams)(struct JsNetwork *net, int sckt, char *buf, size_t size, JsNetworkDgram *dgrams, int count);
+
+  /// If true, jshSleep wakes up when a socket is ready, so we don't have to stay busy just because we have sockets
+  bool wakesFromSleep;
 } PACKED_FLAGS JsNetwork;
 
 // ---------------------------------- these are in network.c
@@ -21,8 +21,12 @@
 #define HTTP_NAME_PORT "port"
 #define HTTP_NAME_SOCKET "sckt"
 #define HTTP_NAME_HAD_HEADERS "hdrs"
+#define HTTP_NAME_PARSER "prsr" // HttpParser state
 #define HTTP_NAME_RECEIVE_DATA "dRcv"
+#define HTTP_NAME_PIPELINED "dPipe" // data received after the end of the last request on the socket, which is the start of the next
 #define HTTP_NAME_SEND_DATA "dSnd"
+#define HTTP_NAME_SEND_QUEUE "dSndQ" // things to send before dSnd, which we keep a reference to rather than copying
+#define HTTP_NAME_SEND_OFFSET "dSndI" // how much of the first thing in dSndQ (or dSnd) we've sent already
 #define HTTP_NAME_RESPONSE_VAR "res"
 #define HTTP_NAME_OPTIONS_VAR "opt"
 #define HTTP_NAME_SERVER_VAR "svr"
@@ -31,14 +35,50 @@
 #define HTTP_NAME_HEADERS "hdr"
 #define HTTP_NAME_CLOSENOW "closeNow"
 #define HTTP_NAME_CLOSE "close" // close after sending
+#define HTTP_NAME_KEEP_ALIVE "ka" // the connection can be used for another request after this one
+#define HTTP_NAME_HEAD "head" // the response is to a HEAD request, so has no body
 #define HTTP_NAME_ON_CONNECT JS_EVENT_PREFIX"connect"
 #define HTTP_NAME_ON_CLOSE JS_EVENT_PREFIX"close"
 #define HTTP_NAME_ON_END JS_EVENT_PREFIX"end"
 #define HTTP_NAME_ON_DRAIN JS_EVENT_PREFIX"drain"
+#define HTTP_NAME_ON_MESSAGE JS_EVENT_PREFIX"message"
+#define HTTP_NAME_ON_LISTENING JS_EVENT_PREFIX"listening"
 
 #define HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS "HttpCC"
 #define HTTP_ARRAY_HTTP_SERVERS "HttpS"
 #define HTTP_ARRAY_HTTP_SERVER_CONNECTIONS "HttpSC"
+#define HTTP_ARRAY_HTTP_POOL "HttpP" // idle keep-alive client sockets, in an array for each "host:port"
+#define HTTP_ARRAY_DGRAM_SOCKETS "HttpD" // bound datagram sockets
+
+/// The most idle keep-alive sockets we keep for each host
+#define HTTP_POOL_MAX_SOCKETS 4
+
+/// The most data we read from or write to a socket in one go
+#ifndef SOCKET_BUFFER_SIZE
+#ifdef LINUX
+#define SOCKET_BUFFER_SIZE 16384
+#else
+#define SOCKET_BUFFER_SIZE 64
+#endif
+#endif
+/// Received data at least this big goes into a flat string (quicker to make, and smaller)
+#define SOCKET_FLAT_STRING_MIN 256
+/// Strings at least this big are queued up to send as they are, rather than being copied
+#define SOCKET_SEND_BY_REF_MIN 256
+/// The most buffers we hand to JsNetwork.sendv in one go
+#define SOCKET_SEND_BUFS 16
+/// We fire 'drain' when the amount of data waiting to be sent drops to this
+#define SOCKET_SEND_LOW_WATER SOCKET_BUFFER_SIZE
+/// The most datagrams we receive in one go, and the biggest datagram we can receive (longer ones are truncated)
+#ifndef SOCKET_DGRAM_SIZE
+#ifdef LINUX
+#define SOCKET_DGRAM_BATCH 8
+#define SOCKET_DGRAM_SIZE 4096
+#else
+#define SOCKET_DGRAM_BATCH 1
+#define SOCKET_DGRAM_SIZE 256
+#endif
+#endif
 
 // -----------------------------
 
@@ -61,37 +101,16 @@ static void httpAppendHeaders(JsVar *string, JsVar *headerObject) {
   // free headers
 }
 
-// httpParseHeaders(&receiveData, reqVar, true) // server
-// httpParseHeaders(&receiveData, resVar, false) // client
-bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer) {
-  // find /r/n/r/n
-  int newlineIdx = 0;
-  int strIdx = 0;
-  int headerEnd = -1;
+// httpParseHeaders(headerData, reqVar, true) // server
+// httpParseHeaders(headerData, resVar, false) // client
+/// Parse the headers (everything up to and including the blank line) into objectForData
+static void httpParseHeaders(JsVar *headerData, JsVar *objectForData, bool isServer) {
   JsvStringIterator it;
-  jsvStringIteratorNew(&it, *receiveData, 0);
-  while (jsvStringIteratorHasChar(&it)) {
-    char ch = jsvStringIteratorGetChar(&it);
-    if (ch == '\r') {
-      if (newlineIdx==0) newlineIdx=1;
-      else if (newlineIdx==2) newlineIdx=3;
-    } else if (ch == '\n') {
-      if (newlineIdx==1) newlineIdx=2;
-      else if (newlineIdx==3) {
-        headerEnd = strIdx+1;
-      }
-    } else newlineIdx=0;
-    jsvStringIteratorNext(&it);
-    strIdx++;
-  }
-  jsvStringIteratorFree(&it);
-  // skip if we have no header
-  if (headerEnd<0) return false;
   // Now parse the header
   JsVar *vHeaders = jsvNewWithFlags(JSV_OBJECT);
-  if (!vHeaders) return true;
+  if (!vHeaders) return;
   jsvUnLock(jsvAddNamedChild(objectForData, vHeaders, "headers"));
-  strIdx = 0;
+  int strIdx = 0;
   int firstSpace = -1;
   int secondSpace = -1;
   int firstEOL = -1;
@@ -99,7 +118,7 @@ bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer)
   int lastLineStart = 0;
   int colonPos = 0;
   //jsiConsolePrintStringVar(receiveData);
-  jsvStringIteratorNew(&it, *receiveData, 0);
+  jsvStringIteratorNew(&it, headerData, 0);
     while (jsvStringIteratorHasChar(&it)) {
       char ch = jsvStringIteratorGetChar(&it);
       if (ch==' ' || ch=='\r') {
@@ -112,11 +131,11 @@ bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer)
         if (lineNumber>0 && colonPos>lastLineStart && lastLineStart<strIdx) {
           JsVar *hVal = jsvNewFromEmptyString();
           if (hVal)
-            jsvAppendStringVar(hVal, *receiveData, (size_t)colonPos+2, (size_t)(strIdx-(colonPos+2)));
+            jsvAppendStringVar(hVal, headerData, (size_t)colonPos+2, (size_t)(strIdx-(colonPos+2)));
           JsVar *hKey = jsvNewFromEmptyString();
           if (hKey) {
             jsvMakeIntoVariableName(hKey, hVal);
-            jsvAppendStringVar(hKey, *receiveData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
+            jsvAppendStringVar(hKey, headerData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
             jsvAddName(vHeaders, hKey);
             jsvUnLock(hKey);
           }
@@ -136,24 +155,21 @@ bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer)
   jsvUnLock(vHeaders);
   // try and pull out methods/etc
   if (isServer) {
-    jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(*receiveData, 0, (size_t)firstSpace));
-    jsvObjectSetChildAndUnLock(objectForData, "url", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(headerData, 0, (size_t)firstSpace));
+    jsvObjectSetChildAndUnLock(objectForData, "url", jsvNewFromStringVar(headerData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
+    if (firstEOL > secondSpace+6) // skip 'HTTP/'
+      jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(headerData, (size_t)(secondSpace+6), (size_t)(firstEOL-(secondSpace+6))));
   } else {
-    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(*receiveData, 5, (size_t)firstSpace-5));
-    jsvObjectSetChildAndUnLock(objectForData, "statusCode", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
-    jsvObjectSetChildAndUnLock(objectForData, "statusMessage", jsvNewFromStringVar(*receiveData, (size_t)(secondSpace+1), (size_t)(firstEOL-(secondSpace+1))));
-  }
-  // strip out the header
-  JsVar *afterHeaders = jsvNewFromStringVar(*receiveData, (size_t)headerEnd, JSVAPPENDSTRINGVAR_MAXLENGTH);
-  jsvUnLock(*receiveData);
-  *receiveData = afterHeaders;
-  return true;
+    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(headerData, 5, (size_t)firstSpace-5));
+    jsvObjectSetChildAndUnLock(objectForData, "statusCode", jsvNewFromStringVar(headerData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "statusMessage", jsvNewFromStringVar(headerData, (size_t)(secondSpace+1), (size_t)(firstEOL-(secondSpace+1))));
+  }
 }
 
-size_t httpStringGet(JsVar *v, char *str, size_t len) {
+size_t httpStringGet(JsVar *v, size_t idx, char *str, size_t len) {
   size_t l = len;
   JsvStringIterator it;
-  jsvStringIteratorNew(&it, v, 0);
+  jsvStringIteratorNew(&it, v, idx);
   while (jsvStringIteratorHasChar(&it)) {
     if (l--==0) {
       jsvStringIteratorFree(&it);
@@ -191,6 +207,356 @@ void _socketConnectionKill(JsNetwork *net, JsVar *connection) {
 
 // -----------------------------
 
+/// Make a new string containing the data we just received
+static JsVar *socketNewStringFromBuf(const char *buf, size_t len) {
+  if (len >= SOCKET_FLAT_STRING_MIN) {
+    JsVar *s = jsvNewFlatStringOfLength((unsigned int)len);
+    if (s) {
+      memcpy(jsvGetFlatStringPointer(s), buf, len);
+      return s;
+    }
+  }
+  JsVar *s = jsvNewFromEmptyString();
+  if (s) jsvAppendStringBuf(s, buf, len);
+  return s;
+}
+
+/** Append data we just received to receiveData (which may be 0), returning the new string
+ * (which may not be receiveData, as flat strings can't be appended to) */
+static JsVar *socketAppendReceiveData(JsVar *receiveData, const char *buf, size_t len) {
+  if (!receiveData || jsvIsEmptyString(receiveData)) {
+    jsvUnLock(receiveData);
+    return socketNewStringFromBuf(buf, len);
+  }
+  if (jsvIsFlatString(receiveData)) {
+    JsVar *s = jsvNewFromStringVar(receiveData, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    jsvUnLock(receiveData);
+    receiveData = s;
+    if (!receiveData) return 0;
+  }
+  jsvAppendStringBuf(receiveData, buf, len);
+  return receiveData;
+}
+
+// -----------------------------
+
+/// Where we are in the HTTP request/response we're receiving
+typedef enum {
+  HTTPP_HEADERS,        ///< Waiting for the blank line at the end of the headers
+  HTTPP_BODY_CLOSE,     ///< No length given - the body ends when the connection closes
+  HTTPP_BODY_LENGTH,    ///< Content-Length given, with 'remaining' bytes left
+  HTTPP_CHUNK_SIZE,     ///< Reading the hex size of a chunk into 'remaining'
+  HTTPP_CHUNK_EXT,      ///< Skipping chunk extensions until the end of the line
+  HTTPP_CHUNK_DATA,     ///< Reading a chunk, with 'remaining' bytes left
+  HTTPP_CHUNK_DATA_END, ///< Skipping the newline after a chunk
+  HTTPP_TRAILER,        ///< Skipping any headers after the last chunk
+  HTTPP_DONE,           ///< Got the whole body (anything after this isn't part of it)
+} PACKED_FLAGS HttpParseState;
+
+/// Parser state for each HTTP connection (stored in a flat string, so it can be updated in place)
+typedef struct {
+  uint32_t headerLength; ///< How much of the header we've scanned so far
+  uint32_t remaining; ///< Bytes left in the body or chunk
+  HttpParseState state;
+  unsigned char newlines; ///< How many characters of "\r\n\r\n" we've matched
+  bool ended; ///< Have we told the user that the body is complete?
+} HttpParser;
+
+/// Flags returned by httpParseData
+typedef enum {
+  HTTPP_GOT_HEADERS = 1, ///< We just got the end of the headers
+  HTTPP_GOT_BODY = 2, ///< We have all of the body (see HttpParser.ended)
+} HttpParseResult;
+
+/// Get the parser for this connection, creating it if needed
+static HttpParser *httpGetParser(JsVar *connection) {
+  JsVar *v = jsvObjectGetChild(connection, HTTP_NAME_PARSER, 0);
+  if (!v) {
+    v = jsvNewFlatStringOfLength(sizeof(HttpParser)); // zeroed, so HTTPP_HEADERS
+    if (!v) return 0;
+    jsvObjectSetChild(connection, HTTP_NAME_PARSER, v);
+  }
+  // the flat string is referenced by the connection, so the pointer stays valid while we use it
+  HttpParser *p = (HttpParser*)jsvGetFlatStringPointer(v);
+  jsvUnLock(v);
+  return p;
+}
+
+/// Compare two strings, ignoring case (header names and some values aren't case sensitive)
+static bool httpStrEqualNoCase(const char *a, const char *b) {
+  while (*a && *b) {
+    char ca = *a++, cb = *b++;
+    if (ca>='A' && ca<='Z') ca = (char)(ca+'a'-'A');
+    if (cb>='A' && cb<='Z') cb = (char)(cb+'a'-'A');
+    if (ca!=cb) return false;
+  }
+  return *a==*b;
+}
+
+/// Is the header called 'name' (any case) in the headers object equal to value (any case)? Or if value==0, return its integer value (or -1)
+static JsVarInt httpGetHeader(JsVar *headers, const char *name, const char *value) {
+  JsVarInt result = value ? 0 : -1;
+  if (!jsvIsObject(headers)) return result;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, headers);
+  while (jsvObjectIteratorHasValue(&it)) {
+    char buf[20];
+    JsVar *k = jsvObjectIteratorGetKey(&it);
+    jsvGetString(k, buf, sizeof(buf));
+    jsvUnLock(k);
+    if (httpStrEqualNoCase(buf, name)) {
+      JsVar *v = jsvObjectIteratorGetValue(&it);
+      if (value) {
+        jsvGetString(v, buf, sizeof(buf));
+        result = httpStrEqualNoCase(buf, value);
+      } else
+        result = jsvGetInteger(v);
+      jsvUnLock(v);
+      break;
+    }
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  return result;
+}
+
+/// Work out how the body after the headers we just parsed is delimited
+static HttpParseState httpGetBodyState(HttpParser *p, JsVar *objectForData, bool isServer) {
+  JsVar *headers = jsvObjectGetChild(objectForData, "headers", 0);
+  bool chunked = httpGetHeader(headers, "Transfer-Encoding", "chunked");
+  JsVarInt length = httpGetHeader(headers, "Content-Length", 0);
+  jsvUnLock(headers);
+  if (isServer) {
+    // requests that don't normally have a body
+    if (!chunked && length<0 &&
+        (jsvIsStringEqualAndUnLock(jsvObjectGetChild(objectForData, "method", 0), "GET") ||
+         jsvIsStringEqualAndUnLock(jsvObjectGetChild(objectForData, "method", 0), "HEAD")))
+      return HTTPP_DONE;
+  } else {
+    // responses that never have a body
+    JsVarInt code = jsvGetIntegerAndUnLock(jsvObjectGetChild(objectForData, "statusCode", 0));
+    if ((code>=100 && code<200) || code==204 || code==304) return HTTPP_DONE;
+  }
+  if (chunked) {
+    p->remaining = 0;
+    return HTTPP_CHUNK_SIZE;
+  }
+  if (length>0) {
+    p->remaining = (uint32_t)length;
+    return HTTPP_BODY_LENGTH;
+  }
+  return length==0 ? HTTPP_DONE : HTTPP_BODY_CLOSE;
+}
+
+/** Can the connection be kept open after the request/response whose headers have just been
+ * parsed into objectForData? It can't if its body is only ended by the connection closing. */
+static bool httpIsKeepAlive(JsVar *connection, JsVar *objectForData) {
+  JsVar *v = jsvObjectGetChild(connection, HTTP_NAME_PARSER, 0);
+  if (!v) return false;
+  HttpParseState state = ((HttpParser*)jsvGetFlatStringPointer(v))->state;
+  jsvUnLock(v);
+  if (state==HTTPP_BODY_CLOSE) return false;
+  JsVar *headers = jsvObjectGetChild(objectForData, "headers", 0);
+  bool close = httpGetHeader(headers, "Connection", "close");
+  bool keepAlive = httpGetHeader(headers, "Connection", "keep-alive");
+  jsvUnLock(headers);
+  if (close) return false;
+  // HTTP/1.1 is keep-alive unless we're told otherwise, HTTP/1.0 isn't
+  return keepAlive || jsvIsStringEqualAndUnLock(jsvObjectGetChild(objectForData, "httpVersion", 0), "1.1");
+}
+
+/** Feed data we just received through the parser for this HTTP connection. While we're
+ * in the headers they're collected in *receiveData, and parsed into objectForData when
+ * complete. After that, *receiveData gets just the body (with any chunk framing removed).
+ * Each byte is only looked at once, however it arrives. Returns HttpParseResult flags, and
+ * sets *used to the number of bytes that were part of this request/response. */
+static int httpParseData(JsVar *connection, JsVar **receiveData, JsVar *objectForData, bool isServer, const char *buf, size_t len, size_t *used) {
+  *used = len;
+  HttpParser *p = httpGetParser(connection);
+  if (!p) return 0; // out of memory
+  int result = 0;
+  size_t i = 0;
+  while (i<len && p->state!=HTTPP_DONE) {
+    char ch = buf[i];
+    switch (p->state) {
+    case HTTPP_HEADERS:
+    case HTTPP_TRAILER: {
+      // look for \r\n\r\n
+      size_t start = i;
+      while (i<len && p->newlines<4) {
+        ch = buf[i++];
+        if (ch=='\r') p->newlines = (p->newlines==2) ? 3 : 1;
+        else if (ch=='\n' && (p->newlines==1 || p->newlines==3)) p->newlines++;
+        else p->newlines = 0;
+      }
+      if (p->state==HTTPP_TRAILER) {
+        if (p->newlines==4) p->state = HTTPP_DONE;
+        break;
+      }
+      *receiveData = socketAppendReceiveData(*receiveData, &buf[start], i-start);
+      p->headerLength += (uint32_t)(i-start);
+      if (p->newlines==4) {
+        if (*receiveData) httpParseHeaders(*receiveData, objectForData, isServer);
+        jsvUnLock(*receiveData);
+        *receiveData = jsvNewFromEmptyString();
+        p->state = httpGetBodyState(p, objectForData, isServer);
+        result |= HTTPP_GOT_HEADERS;
+      }
+    } break;
+    case HTTPP_BODY_CLOSE:
+      *receiveData = socketAppendReceiveData(*receiveData, &buf[i], len-i);
+      i = len;
+      break;
+    case HTTPP_BODY_LENGTH:
+    case HTTPP_CHUNK_DATA: {
+      size_t n = len-i;
+      if (n > p->remaining) n = p->remaining;
+      *receiveData = socketAppendReceiveData(*receiveData, &buf[i], n);
+      i += n;
+      p->remaining -= (uint32_t)n;
+      if (!p->remaining)
+        p->state = (p->state==HTTPP_CHUNK_DATA) ? HTTPP_CHUNK_DATA_END : HTTPP_DONE;
+    } break;
+    case HTTPP_CHUNK_SIZE:
+    case HTTPP_CHUNK_EXT:
+      i++;
+      if (ch=='\n') {
+        if (p->remaining) {
+          p->state = HTTPP_CHUNK_DATA;
+        } else { // last chunk - we're already at the start of a line
+          p->state = HTTPP_TRAILER;
+          p->newlines = 2;
+        }
+      } else if (p->state==HTTPP_CHUNK_SIZE && ch!='\r') {
+        int d = chtod(ch);
+        if (d>=0 && d<16) p->remaining = p->remaining*16 + (uint32_t)d;
+        else p->state = HTTPP_CHUNK_EXT;
+      }
+      break;
+    case HTTPP_CHUNK_DATA_END:
+      i++;
+      if (ch=='\n') p->state = HTTPP_CHUNK_SIZE;
+      break;
+    default:
+      i = len;
+      break;
+    }
+  }
+  if (p->state==HTTPP_DONE) result |= HTTPP_GOT_BODY;
+  *used = i;
+  return result;
+}
+
+/// Have we received all of the request/response on this connection?
+static bool httpIsDone(JsVar *connection) {
+  JsVar *v = jsvObjectGetChild(connection, HTTP_NAME_PARSER, 0);
+  bool done = v && ((HttpParser*)jsvGetFlatStringPointer(v))->state==HTTPP_DONE;
+  jsvUnLock(v);
+  return done;
+}
+
+/** If we have the whole body of this HTTP request/response, and it has all been passed on
+ * to 'stream' (the request/response object), the connection is finished with it. 'end' is
+ * fired on the stream - but if nothing has read the body yet it stays in the stream's buffer,
+ * and 'end' is fired once it has been read. Returns true if we're finished (now or earlier) */
+static bool httpEndIfDone(JsVar *connection, JsVar *stream) {
+  JsVar *v = jsvObjectGetChild(connection, HTTP_NAME_PARSER, 0);
+  if (!v) return false;
+  HttpParser *p = (HttpParser*)jsvGetFlatStringPointer(v);
+  if (p->state==HTTPP_DONE && !p->ended) {
+    // wait until nothing is waiting in receiveData
+    JsVar *receiveData = jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_DATA, 0);
+    if (jsvIsEmptyString(receiveData)) {
+      p->ended = true;
+      jswrap_stream_endWhenRead(stream);
+    }
+    jsvUnLock(receiveData);
+  }
+  bool ended = p->ended;
+  jsvUnLock(v);
+  return ended;
+}
+
+// -----------------------------
+
+/// Get the array of idle keep-alive sockets (as sckt+1) for the host and port in these HTTP client options
+static JsVar *httpPoolGetSockets(JsVar *options, bool create) {
+  JsVar *pool = jsvObjectGetChild(execInfo.hiddenRoot, HTTP_ARRAY_HTTP_POOL, create?JSV_OBJECT:0);
+  if (!pool) return 0;
+  JsVar *host = jsvObjectGetChild(options, "host", 0);
+  int port = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
+  JsVar *key = jsvVarPrintf("%v:%d", host, port ? port : 80);
+  jsvUnLock(host);
+  JsVar *sockets = 0;
+  JsVar *keyName = key ? jsvFindChildFromVar(pool, key, create) : 0;
+  if (keyName) {
+    sockets = jsvSkipName(keyName);
+    if (!sockets && create) {
+      sockets = jsvNewWithFlags(JSV_ARRAY);
+      jsvSetValueOfName(keyName, sockets);
+    }
+  }
+  jsvUnLock3(keyName, key, pool);
+  return sockets;
+}
+
+/// Take an idle keep-alive socket to this host from the pool, or return -1
+static int httpPoolTake(JsVar *options) {
+  JsVar *sockets = httpPoolGetSockets(options, false);
+  int sckt = -1;
+  if (sockets)
+    sckt = (int)jsvGetIntegerAndUnLock(jsvSkipNameAndUnLock(jsvArrayPop(sockets)))-1;
+  jsvUnLock(sockets);
+  return sckt;
+}
+
+/// Put a socket that's finished with into the pool for the next request. Returns false if the pool is full
+static bool httpPoolAdd(JsVar *options, int sckt) {
+  JsVar *sockets = httpPoolGetSockets(options, true);
+  bool added = false;
+  if (sockets && jsvGetArrayLength(sockets) < HTTP_POOL_MAX_SOCKETS) {
+    jsvArrayPushAndUnLock(sockets, jsvNewFromInteger(sckt+1));
+    added = true;
+  }
+  jsvUnLock(sockets);
+  return added;
+}
+
+/** Close any pooled sockets that the server has closed (or sent us something unexpected on).
+ * If closeAll, close them all. Returns true if we closed any. */
+static bool httpPoolIdle(JsNetwork *net, bool closeAll) {
+  JsVar *pool = jsvObjectGetChild(execInfo.hiddenRoot, HTTP_ARRAY_HTTP_POOL, 0);
+  if (!pool) return false;
+  bool wasBusy = false;
+  JsvObjectIterator hostIt;
+  jsvObjectIteratorNew(&hostIt, pool);
+  while (jsvObjectIteratorHasValue(&hostIt)) {
+    JsVar *sockets = jsvObjectIteratorGetValue(&hostIt);
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, sockets);
+    while (jsvObjectIteratorHasValue(&it)) {
+      int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectIteratorGetValue(&it))-1;
+      char buf[1];
+      if (closeAll || net->recv(net, sckt, buf, sizeof(buf))!=0) {
+        wasBusy = true;
+        net->closesocket(net, sckt);
+        JsVar *name = jsvObjectIteratorGetKey(&it);
+        jsvObjectIteratorNext(&it);
+        jsvRemoveChild(sockets, name);
+        jsvUnLock(name);
+      } else
+        jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    jsvUnLock(sockets);
+    jsvObjectIteratorNext(&hostIt);
+  }
+  jsvObjectIteratorFree(&hostIt);
+  if (closeAll) jsvRemoveAllChildren(pool);
+  jsvUnLock(pool);
+  return wasBusy;
+}
+
 NO_INLINE static void _socketCloseAllConnectionsFor(JsNetwork *net, char *name) {
   JsVar *arr = socketGetArray(name, false);
   if (!arr) return;
@@ -212,29 +578,224 @@ NO_INLINE static void _socketCloseAllConnections(JsNetwork *net) {
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVER_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVERS);
+  _socketCloseAllConnectionsFor(net, HTTP_ARRAY_DGRAM_SOCKETS);
+  httpPoolIdle(net, true);
+}
+
+// -----------------------------
+
+/// Get the length in bytes of something we're going to send (a String or ArrayBuffer)
+static size_t socketSendItemLength(JsVar *item) {
+  if (jsvIsArrayBuffer(item))
+    return jsvGetArrayBufferLength(item) * JSV_ARRAYBUFFER_GET_SIZE(item->varData.arraybuffer.type);
+  return jsvGetStringLength(item);
 }
 
-bool socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData) {
-  char buf[64];
+/// Get a pointer to the data of something we're going to send, or 0 if it's not stored all in one block
+static const char *socketSendItemPointer(JsVar *item) {
+  if (jsvIsArrayBuffer(item))
+    return jsvGetArrayBufferPointer(item);
+  if (jsvIsFlatString(item) && !jsvGetLastChild(item))
+    return jsvGetFlatStringPointer(item);
+  return 0;
+}
 
-  int a=1;
-  if (!jsvIsEmptyString(*sendData)) {
-    size_t bufLen = httpStringGet(*sendData, buf, sizeof(buf));
-    a = net->send(net, sckt, buf, bufLen);
-    // Now cut what we managed to send off the beginning of sendData
-    if (a>0) {
-      JsVar *newSendData = 0;
-      if (a < (int)jsvGetStringLength(*sendData)) {
-        // we didn't send all of it... cut out what we did send
-        newSendData = jsvNewFromStringVar(*sendData, (size_t)a, JSVAPPENDSTRINGVAR_MAXLENGTH);
-      } else {
-        // we sent all of it! Issue a drain event
-        jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
-      }
+/// Copy up to len bytes from idx of something we're going to send into str, returning the amount copied
+static size_t socketSendItemGet(JsVar *item, size_t idx, char *str, size_t len) {
+  if (!jsvIsArrayBuffer(item))
+    return httpStringGet(item, idx, str, len);
+  JsVar *s = jsvGetArrayBufferBackingString(item);
+  len = httpStringGet(s, item->varData.arraybuffer.byteOffset + idx, str, len);
+  jsvUnLock(s);
+  return len;
+}
+
+/** Add data to what we're going to send on this connection. Small things are appended to
+ * sendData, but big Strings and ArrayBuffers are queued up as they are (without copying) -
+ * in which case *sendData is queued before them and set to 0, so any more data goes after. */
+static void socketAppendSendData(JsVar *connection, JsVar **sendData, JsVar *data) {
+  if (jsvIsArrayBuffer(data) ||
+      (jsvIsString(data) && (jsvIsFlatString(data) || jsvGetStringLength(data)>=SOCKET_SEND_BY_REF_MIN))) {
+    JsVar *queue = jsvObjectGetChild(connection, HTTP_NAME_SEND_QUEUE, JSV_ARRAY);
+    if (!queue) return; // out of memory
+    if (*sendData) {
+      if (!jsvIsEmptyString(*sendData))
+        jsvArrayPush(queue, *sendData);
+      jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, 0);
       jsvUnLock(*sendData);
-      *sendData = newSendData;
+      *sendData = 0;
+    }
+    /* A String in the queue has more than one reference, so it won't be appended to in place.
+     * ArrayBuffers could still be modified before they are sent, as in node.js */
+    jsvArrayPush(queue, data);
+    jsvUnLock(queue);
+    return;
+  }
+  if (!*sendData) {
+    *sendData = jsvNewFromEmptyString();
+    if (!*sendData) return; // out of memory
+    jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, *sendData);
+  }
+  JsVar *s = jsvAsString(data, false);
+  if (s) jsvAppendStringVarComplete(*sendData, s);
+  jsvUnLock(s);
+}
+
+/// Append a string of data to send (see socketAppendSendData)
+static void socketAppendSendString(JsVar *connection, JsVar **sendData, const char *str) {
+  JsVar *s = jsvNewFromString(str);
+  if (s) socketAppendSendData(connection, sendData, s);
+  jsvUnLock(s);
+}
+
+/** Append data to send as one chunk of a 'chunked' HTTP body (prefixed with its length).
+ * Empty data is ignored, as an empty chunk would end the body */
+static void socketAppendChunk(JsVar *connection, JsVar **sendData, JsVar *data) {
+  JsVar *s = jsvIsArrayBuffer(data) ? jsvLockAgain(data) : jsvAsString(data, false);
+  size_t len = s ? socketSendItemLength(s) : 0;
+  if (len) {
+    JsVar *prefix = jsvVarPrintf("%x\r\n", len);
+    if (prefix) socketAppendSendData(connection, sendData, prefix);
+    jsvUnLock(prefix);
+    socketAppendSendData(connection, sendData, s);
+    socketAppendSendString(connection, sendData, "\r\n");
+  }
+  jsvUnLock(s);
+}
+
+/// Do we have any data waiting to be sent on this connection?
+static bool socketHasSendData(JsVar *connection) {
+  JsVar *queue = jsvObjectGetChild(connection, HTTP_NAME_SEND_QUEUE, 0);
+  JsVar *sendData = jsvObjectGetChild(connection, HTTP_NAME_SEND_DATA, 0);
+  bool hasData = queue || (sendData && !jsvIsEmptyString(sendData));
+  jsvUnLock2(queue, sendData);
+  return hasData;
+}
+
+/// The buffers we're about to send from
+typedef struct {
+  JsNetworkBuf bufs[SOCKET_SEND_BUFS];
+  int count, maxCount;
+  char *copyBuf; ///< Where we copy data that isn't stored in one block
+  size_t copyUsed;
+  size_t len; ///< Total length of bufs
+  bool full; ///< We can't add anything more (so must not skip to the next item)
+} SocketSendBufs;
+
+/// Add what's left of item (from offset) to the buffers to send, and return its length
+static size_t socketSendBufsAdd(SocketSendBufs *b, JsVar *item, size_t offset) {
+  size_t len = socketSendItemLength(item);
+  if (offset >= len) return 0;
+  len -= offset;
+  if (b->full) return len;
+  const char *ptr = socketSendItemPointer(item);
+  size_t n = len;
+  if (ptr) {
+    ptr += offset; // no need to copy
+  } else {
+    if (n > SOCKET_BUFFER_SIZE-b->copyUsed) n = SOCKET_BUFFER_SIZE-b->copyUsed;
+    ptr = &b->copyBuf[b->copyUsed];
+    n = socketSendItemGet(item, offset, &b->copyBuf[b->copyUsed], n);
+    b->copyUsed += n;
+  }
+  if (n) {
+    b->bufs[b->count].buf = ptr;
+    b->bufs[b->count].len = n;
+    b->count++;
+    b->len += n;
+  }
+  b->full = n<len || b->count>=b->maxCount;
+  return len;
+}
+
+/** Send as much of the data waiting on this connection as we can, in one go. wasBusy is set if we sent
+ * anything. Returns false on error */
+bool socketSendData(JsNetwork *net, JsVar *connection, int sckt, bool *wasBusy) {
+  char buf[SOCKET_BUFFER_SIZE];
+  SocketSendBufs b;
+  b.count = 0;
+  b.maxCount = net->sendv ? SOCKET_SEND_BUFS : 1;
+  b.copyBuf = buf;
+  b.copyUsed = 0;
+  b.len = 0;
+  b.full = false;
+
+  // rather than cutting what we sent off the front of the data each time, we keep track of how much we sent
+  size_t offset = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_SEND_OFFSET, 0));
+  JsVar *queue = jsvObjectGetChild(connection, HTTP_NAME_SEND_QUEUE, 0);
+  JsVar *sendData = jsvObjectGetChild(connection, HTTP_NAME_SEND_DATA, 0);
+  /* How much we have waiting to send. We only need to know this exactly when it's
+   * near the low water mark, so we stop counting if there's a lot more */
+  size_t pending = 0;
+  size_t itemOffset = offset;
+  if (queue) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, queue);
+    while (jsvObjectIteratorHasValue(&it) && !(b.full && pending > b.len+SOCKET_SEND_LOW_WATER)) {
+      JsVar *item = jsvObjectIteratorGetValue(&it);
+      pending += socketSendBufsAdd(&b, item, itemOffset);
+      itemOffset = 0;
+      jsvUnLock(item);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+  }
+  if (sendData && !(b.full && pending > b.len+SOCKET_SEND_LOW_WATER))
+    pending += socketSendBufsAdd(&b, sendData, itemOffset);
+
+  int a = 1;
+  if (!pending) {
+    // just empty strings - nothing to send
+    jsvObjectSetChild(connection, HTTP_NAME_SEND_QUEUE, 0);
+    jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, 0);
+  } else if (b.count) {
+    if (b.count>1)
+      a = net->sendv(net, sckt, b.bufs, b.count);
+    else
+      a = net->send(net, sckt, b.bufs[0].buf, b.bufs[0].len);
+  }
+  if (a>0) {
+    *wasBusy = true;
+    size_t sent = (size_t)a;
+    size_t newOffset = offset + sent;
+    // take off everything we've sent completely
+    while (queue && jsvGetFirstChild(queue)) {
+      JsVar *item = jsvSkipNameAndUnLock(jsvLock(jsvGetFirstChild(queue)));
+      size_t len = socketSendItemLength(item);
+      jsvUnLock(item);
+      if (newOffset < len) break;
+      newOffset -= len;
+      jsvUnLock(jsvArrayPopFirst(queue));
+    }
+    if (queue && !jsvGetFirstChild(queue)) {
+      jsvObjectSetChild(connection, HTTP_NAME_SEND_QUEUE, 0);
+      jsvUnLock(queue);
+      queue = 0;
+    }
+    if (!queue && sendData) {
+      size_t length = jsvGetStringLength(sendData);
+      if (newOffset >= length) {
+        jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, 0);
+        newOffset = 0;
+      } else if (newOffset*2 >= length) {
+        /* Most of sendData has been sent, so cut it off the front. Doing this
+         * only when we're over half way means we don't copy more than we send. */
+        JsVar *newSendData = jsvNewFromStringVar(sendData, newOffset, JSVAPPENDSTRINGVAR_MAXLENGTH);
+        if (newSendData) { // otherwise out of memory - just keep what we had
+          jsvObjectSetChildAndUnLock(connection, HTTP_NAME_SEND_DATA, newSendData);
+          newOffset = 0;
+        }
+      }
     }
+    if (newOffset != offset)
+      jsvObjectSetChildAndUnLock(connection, HTTP_NAME_SEND_OFFSET, newOffset ? jsvNewFromInteger((JsVarInt)newOffset) : 0);
+    /* Issue a drain event when we've sent everything - or when we get low, if there was a lot,
+     * so more data can be written while the rest is still being sent */
+    size_t left = pending - sent;
+    if (left==0 || (pending>SOCKET_SEND_LOW_WATER && left<=SOCKET_SEND_LOW_WATER))
+      jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
   }
+  jsvUnLock2(queue, sendData);
   if (a<0) { // could just be busy which is ok
     jsError("Socket error %d while sending", a);
     return false;
@@ -264,17 +825,43 @@ void socketKill(JsNetwork *net) {
 
 // -----------------------------
 
+/** Make a new request/response pair to handle the next request that arrives on the given socket.
+ * keptAlive is set if the socket has already been used for a request, and pipelined is any
+ * data that was received after the end of that request (or 0) */
+static void httpServerNewRequest(JsVar *server, int sckt, bool keptAlive, JsVar *pipelined) {
+  JsVar *req = jspNewObject(0, "httpSRq");
+  JsVar *res = jspNewObject(0, "httpSRs");
+  if (res && req) { // out of memory?
+    socketSetType(req, ST_HTTP);
+    JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
+    if (arr) {
+      jsvArrayPush(arr, req);
+      jsvUnLock(arr);
+    }
+    jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
+    jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
+    jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    if (keptAlive) jsvObjectSetChildAndUnLock(req, HTTP_NAME_KEEP_ALIVE, jsvNewFromBool(true));
+    if (pipelined) jsvObjectSetChild(req, HTTP_NAME_PIPELINED, pipelined);
+    // on response
+    jsvObjectSetChildAndUnLock(res, HTTP_NAME_CODE, jsvNewFromInteger(200));
+    jsvObjectSetChildAndUnLock(res, HTTP_NAME_HEADERS, jsvNewWithFlags(JSV_OBJECT));
+  }
+  jsvUnLock2(req, res);
+}
+
+/// Returns true if we did something (or if we have sockets and the network needs polling)
 bool socketServerConnectionsIdle(JsNetwork *net) {
-  char buf[64];
+  char buf[SOCKET_BUFFER_SIZE];
 
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS,false);
   if (!arr) return false;
 
-  bool hadSockets = false;
+  bool wasBusy = false;
   JsvObjectIterator it;
   jsvObjectIteratorNew(&it, arr);
   while (jsvObjectIteratorHasValue(&it)) {
-    hadSockets = true;
+    if (!net->wakesFromSleep) wasBusy = true;
     // Get connection, socket, and socket type
     // For normal sockets, socket==connection, but for HTTP we split it into a request and a response
     JsVar *connection = jsvObjectIteratorGetValue(&it);
@@ -283,24 +870,46 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
 
     int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
     bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
+    bool keepAlive = false;
 
     if (!closeConnectionNow) {
-      int num = net->recv(net, sckt, buf,sizeof(buf));
+      int parsed = 0;
+      int num;
+      JsVar *pipelined = 0;
+      if (httpIsDone(connection)) {
+        // leave anything after this request in the socket until we've replied to it
+        num = 0;
+      } else if ((pipelined = jsvObjectGetChild(connection, HTTP_NAME_PIPELINED, 0))) {
+        // the start of this request arrived with the end of the last one
+        num = (int)jsvGetStringChars(pipelined, 0, buf, sizeof(buf));
+        jsvUnLock(pipelined);
+        jsvRemoveNamedChild(connection, HTTP_NAME_PIPELINED);
+      } else
+        num = net->recv(net, sckt, buf,sizeof(buf));
       if (num<0) {
         // we probably disconnected so just get rid of this
         closeConnectionNow = true;
       } else {
         // add it to our request string
         if (num>0) {
+          wasBusy = true;
           JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
           JsVar *oldReceiveData = receiveData;
-          if (!receiveData) receiveData = jsvNewFromEmptyString();
+          size_t used;
+          parsed = httpParseData(connection, &receiveData, connection, true, buf, (size_t)num, &used);
+          if (used < (size_t)num) // keep the rest for the next request on this socket
+            jsvObjectSetChildAndUnLock(connection, HTTP_NAME_PIPELINED, socketNewStringFromBuf(&buf[used], (size_t)num-used));
           if (receiveData) {
-            jsvAppendStringBuf(receiveData, buf, (size_t)num);
             bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
-            if (!hadHeaders && httpParseHeaders(&receiveData, connection, true)) {
+            if (parsed & HTTPP_GOT_HEADERS) {
               hadHeaders = true;
               jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+              // we need HTTP/1.1 so we can use chunked encoding for our reply
+              if (httpIsKeepAlive(connection, connection) &&
+                  jsvIsStringEqualAndUnLock(jsvObjectGetChild(connection, "httpVersion", 0), "1.1"))
+                jsvObjectSetChildAndUnLock(socket, HTTP_NAME_KEEP_ALIVE, jsvNewFromBool(true));
+              if (jsvIsStringEqualAndUnLock(jsvObjectGetChild(connection, "method", 0), "HEAD"))
+                jsvObjectSetChildAndUnLock(socket, HTTP_NAME_HEAD, jsvNewFromBool(true));
               JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
               JsVar *args[2] = { connection, socket };
               jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, args, (socketType==ST_HTTP) ? 2 : 1);
@@ -314,27 +923,33 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
                 receiveData = 0;
               }
             }
-            // if received data changed, update it
-            if (receiveData != oldReceiveData)
-              jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
-            jsvUnLock(receiveData);
           }
+          // if received data changed, update it
+          if (receiveData != oldReceiveData)
+            jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
+          jsvUnLock(receiveData);
         }
       }
+      // don't fire 'end' until the request callback has had a chance to add listeners
+      bool requestEnded = !(parsed & HTTPP_GOT_HEADERS) && httpEndIfDone(connection, connection);
+      if (requestEnded) num = 0; // the request is complete, so we're not waiting for more
 
       // send data if possible
-      JsVar *sendData = jsvObjectGetChild(socket,HTTP_NAME_SEND_DATA,0);
-      if (sendData) {
-          if (!socketSendData(net, socket, sckt, &sendData))
-            closeConnectionNow = true;
-        jsvObjectSetChild(socket, HTTP_NAME_SEND_DATA, sendData); // socketSendData prob updated sendData
+      bool hasSendData = socketHasSendData(socket);
+      if (hasSendData) {
+        if (!socketSendData(net, socket, sckt, &wasBusy))
+          closeConnectionNow = true;
+        hasSendData = socketHasSendData(socket);
       }
       // only close if we want to close, have no data to send, and aren't receiving data
-      if (jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_CLOSE,0)) && !sendData && num<=0)
+      if (jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_CLOSE,0)) && !hasSendData && num<=0) {
         closeConnectionNow = true;
-      jsvUnLock(sendData);
+        // if we're keeping the connection alive, we just wait for the next request on it
+        keepAlive = requestEnded && jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_KEEP_ALIVE,0));
+      }
     }
     if (closeConnectionNow) {
+      wasBusy = true;
       // send out any data that we were POSTed
       JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
       bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
@@ -347,7 +962,19 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
       jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CLOSE, &connection, 1);
       jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, &socket, 1);
 
-      _socketConnectionKill(net, connection);
+      if (keepAlive) {
+        // wait for the next request on this socket (if the server is still open)
+        JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
+        if (jsvGetIntegerAndUnLock(jsvObjectGetChild(server,HTTP_NAME_SOCKET,0))>0) {
+          JsVar *pipelined = jsvObjectGetChild(connection, HTTP_NAME_PIPELINED, 0);
+          httpServerNewRequest(server, sckt, true, pipelined);
+          jsvUnLock(pipelined);
+        } else
+          keepAlive = false;
+        jsvUnLock(server);
+      }
+      if (!keepAlive)
+        _socketConnectionKill(net, connection);
       JsVar *connectionName = jsvObjectIteratorGetKey(&it);
       jsvObjectIteratorNext(&it);
       jsvRemoveChild(arr, connectionName);
@@ -359,7 +986,7 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
   jsvObjectIteratorFree(&it);
   jsvUnLock(arr);
 
-  return hadSockets;
+  return wasBusy;
 }
 
 
@@ -375,23 +1002,25 @@ void socketClientPushReceiveData(JsVar *connection, JsVar *socket, JsVar **recei
   }
 }
 
+/// Returns true if we did something (or if we have sockets and the network needs polling)
 bool socketClientConnectionsIdle(JsNetwork *net) {
-  char buf[64];
+  char buf[SOCKET_BUFFER_SIZE];
 
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS,false);
   if (!arr) return false;
 
-  bool hadSockets = false;
+  bool wasBusy = false;
   JsvObjectIterator it;
   jsvObjectIteratorNew(&it, arr);
   while (jsvObjectIteratorHasValue(&it)) {
-    hadSockets = true;
+    if (!net->wakesFromSleep) wasBusy = true;
     // Get connection, socket, and socket type
     // For normal sockets, socket==connection, but for HTTP we split it into a request and a response
     JsVar *connection = jsvObjectIteratorGetValue(&it);
     SocketType socketType = socketGetType(connection);
     JsVar *socket = (socketType==ST_HTTP) ? jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0) : jsvLockAgain(connection);
     bool socketClosed = false;
+    bool keepAlive = false;
     JsVar *receiveData = 0;
 
     int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
@@ -408,18 +1037,18 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
         socketClientPushReceiveData(connection, socket, &receiveData);
 
       if (!closeConnectionNow) {
-        JsVar *sendData = jsvObjectGetChild(connection,HTTP_NAME_SEND_DATA,0);
         // send data if possible
-        if (sendData) {
-          bool b = socketSendData(net, connection, sckt, &sendData);
-          if (!b)
+        bool hasSendData = socketHasSendData(connection);
+        if (hasSendData) {
+          if (!socketSendData(net, connection, sckt, &wasBusy))
             closeConnectionNow = true;
-          jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, sendData); // _http_send prob updated sendData
+          hasSendData = socketHasSendData(connection);
         } else {
           if (jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSE, false)))
             closeConnectionNow = true;
         }
         // Now read data if possible (and we have space for it)
+        int parsed = 0;
         if (!receiveData || !hadHeaders) {
           int num = net->recv(net, sckt, buf, sizeof(buf));
           if (num<0) {
@@ -428,36 +1057,53 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
           } else {
             // add it to our request string
             if (num>0) {
-              if (!receiveData) {
-                receiveData = jsvNewFromEmptyString();
-                jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
-              }
-              if (receiveData) { // could be out of memory
-                jsvAppendStringBuf(receiveData, buf, (size_t)num);
-                if (socketType==ST_HTTP && !hadHeaders) {
-                  JsVar *resVar = jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0);
-                  if (httpParseHeaders(&receiveData, resVar, false)) {
-                    hadHeaders = true;
-                    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
-                    jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &resVar, 1);
-                  }
-                  jsvUnLock(resVar);
-                  jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
+              wasBusy = true;
+              JsVar *oldReceiveData = receiveData;
+              if (socketType==ST_HTTP) {
+                JsVar *resVar = jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0);
+                size_t used; // a server shouldn't send anything after the response, so the rest is ignored
+                parsed = httpParseData(connection, &receiveData, resVar, false, buf, (size_t)num, &used);
+                if (parsed & HTTPP_GOT_HEADERS) {
+                  hadHeaders = true;
+                  jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+                  jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &resVar, 1);
                 }
-              }
+                jsvUnLock(resVar);
+              } else
+                receiveData = socketAppendReceiveData(receiveData, buf, (size_t)num);
+              if (receiveData != oldReceiveData)
+                jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
             }
           }
         }
-        jsvUnLock(sendData);
+        /* If we've got the whole response and passed it all on, we're finished with the
+         * socket - even if nothing has read the body from the response yet (but not until
+         * the response callback has had a chance to add listeners) */
+        if (socketType==ST_HTTP && !closeConnectionNow && !(parsed & HTTPP_GOT_HEADERS) &&
+            httpEndIfDone(connection, socket)) {
+          closeConnectionNow = true;
+          // if we sent all our request and the server is happy, we can use the connection again
+          keepAlive = !hasSendData &&
+              jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_KEEP_ALIVE, 0)) &&
+              httpIsKeepAlive(connection, socket);
+        }
       }
 
       if (closeConnectionNow) {
         socketClientPushReceiveData(connection, socket, &receiveData);
+        wasBusy = true;
         if (!receiveData) {
           if (socketType != ST_HTTP)
             jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_END, &socket, 1);
           jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, &socket, 1);
 
+          if (keepAlive) {
+            // put the socket back in the pool rather than closing it
+            JsVar *options = jsvObjectGetChild(connection, HTTP_NAME_OPTIONS_VAR, 0);
+            if (httpPoolAdd(options, sckt))
+              jsvObjectSetChild(connection, HTTP_NAME_SOCKET, 0);
+            jsvUnLock(options);
+          }
           _socketConnectionKill(net, connection);
           JsVar *connectionName = jsvObjectIteratorGetKey(&it);
           jsvObjectIteratorNext(&it);
@@ -476,9 +1122,105 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
   }
   jsvUnLock(arr);
 
-  return hadSockets;
+  return wasBusy;
+}
+
+
+// -----------------------------
+
+/** Send the datagrams queued up on this socket (until the network is busy). The queue
+ * holds objects of {data,host,port,cb}. Returns true if we sent anything */
+static bool dgramSendQueued(JsNetwork *net, JsVar *sock, int sckt) {
+  JsVar *queue = jsvObjectGetChild(sock, HTTP_NAME_SEND_QUEUE, 0);
+  if (!queue) return false;
+  bool wasBusy = false;
+  while (jsvGetFirstChild(queue)) {
+    JsVar *dgram = jsvSkipNameAndUnLock(jsvLock(jsvGetFirstChild(queue)));
+    JsVar *data = jsvObjectGetChild(dgram, "data", 0);
+    size_t len = socketSendItemLength(data);
+    char buf[SOCKET_DGRAM_SIZE];
+    const char *ptr = socketSendItemPointer(data);
+    JsVar *flat = 0;
+    if (!ptr) {
+      // the datagram must go in one go, so get it all in one place
+      if (len <= sizeof(buf)) {
+        ptr = buf;
+      } else {
+        flat = jsvNewFlatStringOfLength((unsigned int)len);
+        if (flat) ptr = jsvGetFlatStringPointer(flat);
+      }
+      if (ptr) len = socketSendItemGet(data, 0, (char*)ptr, len);
+    }
+    int a = -1; // if we fail, we drop the datagram
+    if (ptr) {
+      char hostName[128];
+      JsVar *hostVar = jsvObjectGetChild(dgram, "host", 0);
+      jsvGetString(hostVar, hostName, sizeof(hostName));
+      jsvUnLock(hostVar);
+      uint32_t host_addr = 0;
+      networkGetHostByName(net, hostName, &host_addr);
+      unsigned short port = (unsigned short)jsvGetIntegerAndUnLock(jsvObjectGetChild(dgram, "port", 0));
+      if (host_addr) {
+        a = net->sendto(net, sckt, ptr, len, host_addr, port);
+        if (a<0) jsError("Socket error %d while sending", a);
+      } else
+        jsError("Unable to locate host");
+    } else
+      jsError("Not enough memory to send datagram");
+    jsvUnLock2(data, flat);
+    if (a==0) { // busy - try again later
+      jsvUnLock(dgram);
+      break;
+    }
+    wasBusy = true;
+    jsvUnLock(jsvArrayPopFirst(queue));
+    JsVar *cb = jsvObjectGetChild(dgram, "cb", 0);
+    if (jsvIsFunction(cb)) jsiQueueEvents(sock, cb, 0, 0);
+    jsvUnLock2(cb, dgram);
+  }
+  if (!jsvGetFirstChild(queue))
+    jsvObjectSetChild(sock, HTTP_NAME_SEND_QUEUE, 0);
+  jsvUnLock(queue);
+  return wasBusy;
 }
 
+/// Send and receive datagrams on all the bound datagram sockets. Returns true if we did anything
+static bool socketDgramsIdle(JsNetwork *net) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_DGRAM_SOCKETS, false);
+  if (!arr) return false;
+  bool wasBusy = false;
+  char buf[SOCKET_DGRAM_SIZE*SOCKET_DGRAM_BATCH];
+  JsNetworkDgram dgrams[SOCKET_DGRAM_BATCH];
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    if (!net->wakesFromSleep) wasBusy = true;
+    JsVar *sock = jsvObjectIteratorGetValue(&it);
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(sock,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    if (dgramSendQueued(net, sock, sckt)) wasBusy = true;
+    int n = net->recvdgrams(net, sckt, buf, SOCKET_DGRAM_SIZE, dgrams, SOCKET_DGRAM_BATCH);
+    int i;
+    for (i=0;i<n;i++) {
+      wasBusy = true;
+      JsVar *args[2];
+      args[0] = socketNewStringFromBuf(&buf[i*SOCKET_DGRAM_SIZE], dgrams[i].len);
+      args[1] = jsvNewWithFlags(JSV_OBJECT);
+      if (args[1]) {
+        jsvObjectSetChildAndUnLock(args[1], "address", networkGetAddressAsString((unsigned char *)&dgrams[i].host, 4, 10, '.'));
+        jsvObjectSetChildAndUnLock(args[1], "family", jsvNewFromString("IPv4"));
+        jsvObjectSetChildAndUnLock(args[1], "port", jsvNewFromInteger(dgrams[i].port));
+        jsvObjectSetChildAndUnLock(args[1], "size", jsvNewFromInteger((JsVarInt)dgrams[i].len));
+      }
+      jsiQueueObjectCallbacks(sock, HTTP_NAME_ON_MESSAGE, args, 2);
+      jsvUnLock2(args[0], args[1]);
+    }
+    jsvUnLock(sock);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(arr);
+  return wasBusy;
+}
 
 bool socketIdle(JsNetwork *net) {
   if (networkState != NETWORKSTATE_ONLINE) {
@@ -486,38 +1228,24 @@ bool socketIdle(JsNetwork *net) {
     _socketCloseAllConnections(net);
     return false;
   }
-  bool hadSockets = false;
+  bool wasBusy = false;
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVERS,false);
   if (arr) {
     JsvObjectIterator it;
     jsvObjectIteratorNew(&it, arr);
     while (jsvObjectIteratorHasValue(&it)) {
-      hadSockets = true;
+      if (!net->wakesFromSleep) wasBusy = true;
 
       JsVar *server = jsvObjectIteratorGetValue(&it);
       int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(server,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
 
-      int theClient = net->accept(net, sckt);
-      if (theClient >= 0) {
+      // accept everything that's waiting, so a burst of connections doesn't overflow the listen backlog
+      int theClient;
+      while ((theClient = net->accept(net, sckt)) >= 0) {
+        wasBusy = true;
         SocketType socketType = socketGetType(server);
         if (socketType == ST_HTTP) {
-          JsVar *req = jspNewObject(0, "httpSRq");
-          JsVar *res = jspNewObject(0, "httpSRs");
-          if (res && req) { // out of memory?
-            socketSetType(req, ST_HTTP);
-            JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
-            if (arr) {
-              jsvArrayPush(arr, req);
-              jsvUnLock(arr);
-            }
-            jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
-            jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
-            jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(theClient+1));
-            // on response
-            jsvObjectSetChildAndUnLock(res, HTTP_NAME_CODE, jsvNewFromInteger(200));
-            jsvObjectSetChildAndUnLock(res, HTTP_NAME_HEADERS, jsvNewWithFlags(JSV_OBJECT));
-          }
-          jsvUnLock2(req, res);
+          httpServerNewRequest(server, theClient, false, 0);
         } else {
           // Normal sockets
           JsVar *sock = jspNewObject(0, "Socket");
@@ -542,10 +1270,24 @@ bool socketIdle(JsNetwork *net) {
     jsvUnLock(arr);
   }
 
-  if (socketServerConnectionsIdle(net)) hadSockets = true;
-  if (socketClientConnectionsIdle(net)) hadSockets = true;
+  if (socketServerConnectionsIdle(net)) wasBusy = true;
+  if (socketClientConnectionsIdle(net)) wasBusy = true;
+  if (httpPoolIdle(net, false)) wasBusy = true;
+  if (socketDgramsIdle(net)) wasBusy = true;
   net->checkError(net);
-  return hadSockets;
+  return wasBusy;
+}
+
+bool socketHasConnections() {
+  const char *arrays[] = { HTTP_ARRAY_HTTP_SERVERS, HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS, HTTP_ARRAY_DGRAM_SOCKETS };
+  unsigned int i;
+  for (i=0;i<sizeof(arrays)/sizeof(arrays[0]);i++) {
+    JsVar *arr = socketGetArray(arrays[i], false);
+    bool empty = !arr || jsvArrayIsEmpty(arr);
+    jsvUnLock(arr);
+    if (!empty) return true;
+  }
+  return false;
 }
 
 // -----------------------------
@@ -581,6 +1323,33 @@ void serverClose(JsNetwork *net, JsVar *server) {
   if (arr) {
     // close socket
     _socketConnectionKill(net, server);
+    // close any kept-alive connections that are just waiting for another request
+    JsVar *connections = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS,false);
+    if (connections) {
+      JsvObjectIterator it;
+      jsvObjectIteratorNew(&it, connections);
+      while (jsvObjectIteratorHasValue(&it)) {
+        JsVar *connection = jsvObjectIteratorGetValue(&it);
+        JsVar *connectionServer = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
+        JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
+        bool idle = connectionServer==server &&
+            jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_KEEP_ALIVE,0)) &&
+            !jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0)) &&
+            jsvIsEmptyString(receiveData);
+        jsvUnLock2(connectionServer, receiveData);
+        if (idle) {
+          _socketConnectionKill(net, connection);
+          JsVar *connectionName = jsvObjectIteratorGetKey(&it);
+          jsvObjectIteratorNext(&it);
+          jsvRemoveChild(connections, connectionName);
+          jsvUnLock(connectionName);
+        } else
+          jsvObjectIteratorNext(&it);
+        jsvUnLock(connection);
+      }
+      jsvObjectIteratorFree(&it);
+      jsvUnLock(connections);
+    }
     // remove from array
     JsVar *idx = jsvGetArrayIndexOf(arr, server, true);
     if (idx) {
@@ -630,9 +1399,26 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
     if (options) {
       JsVar *method = jsvObjectGetChild(options, "method", 0);
       JsVar *path = jsvObjectGetChild(options, "path", 0);
-      sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: close\r\n", method, path);
-      jsvUnLock2(method, path);
+      // keep the connection open for another request, unless we're asked not to with agent:false
+      JsVar *agent = jsvObjectGetChild(options, "agent", 0);
+      bool keepAlive = !jsvIsBoolean(agent) || jsvGetBool(agent);
+      jsvUnLock(agent);
       JsVar *headers = jsvObjectGetChild(options, "headers", 0);
+      if (httpGetHeader(headers, "Connection", "close")) keepAlive = false;
+      if (keepAlive) {
+        jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_KEEP_ALIVE, jsvNewFromBool(true));
+        sendData = jsvVarPrintf("%v %v HTTP/1.1\r\nUser-Agent: Espruino "JS_VERSION"\r\n", method, path);
+        if (!httpGetHeader(headers, "Connection", "keep-alive"))
+          jsvAppendString(sendData, "Connection: keep-alive\r\n");
+        // the server must know where any body we send ends - so chunk it if we weren't given a length
+        if (data && httpGetHeader(headers, "Content-Length", 0)<0 &&
+            !httpGetHeader(headers, "Transfer-Encoding", "chunked")) {
+          jsvAppendString(sendData, "Transfer-Encoding: chunked\r\n");
+          jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+        }
+      } else
+        sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: close\r\n", method, path);
+      jsvUnLock2(method, path);
       bool hasHostHeader = false;
       if (jsvIsObject(headers)) {
         JsVar *hostHeader = jsvObjectGetChild(headers, "Host", 0);
@@ -663,17 +1449,13 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
     jsvUnLock(options);
   }
   if (data && sendData) {
-    JsVar *s = jsvAsString(data, false);
-    if (s) {
-      if (socketType == ST_HTTP &&
-          jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
-        // If we asked to send 'chunked' data, we need to wrap it up,
-        // prefixed with the length
-        jsvAppendPrintf(sendData, "%x\r\n%v\r\n", jsvGetStringLength(s), s);
-      } else {
-        jsvAppendStringVarComplete(sendData,s);
-      }
-      jsvUnLock(s);
+    if (socketType == ST_HTTP &&
+        jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
+      // If we asked to send 'chunked' data, we need to wrap it up,
+      // prefixed with the length
+      socketAppendChunk(httpClientReqVar, &sendData, data);
+    } else {
+      socketAppendSendData(httpClientReqVar, &sendData, data);
     }
   }
   jsvUnLock(sendData);
@@ -692,6 +1474,15 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
   SocketType socketType = socketGetType(httpClientReqVar);
 
   JsVar *options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, false);
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_KEEP_ALIVE, 0))) {
+    // can we reuse an idle connection to this host?
+    int sckt = httpPoolTake(options);
+    if (sckt>=0) {
+      jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+      jsvUnLock(options);
+      return;
+    }
+  }
   unsigned short port = (unsigned short)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
   if (port==0) port=80;
 
@@ -737,24 +1528,23 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
 void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar) {
   SocketType socketType = socketGetType(httpClientReqVar);
   if (socketType == ST_HTTP) {
-    JsVar *finalData = 0;
-    if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
-      // If we were asked to send 'chunked' data, we need to finish up
-      finalData = jsvNewFromString("");
-    }
+    bool chunked = jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0));
     // on HTTP, this actually means we connect
     // force sendData to be made
-    clientRequestWrite(net, httpClientReqVar, finalData);
-    jsvUnLock(finalData);
+    clientRequestWrite(net, httpClientReqVar, 0);
+    if (chunked) {
+      // If we were asked to send 'chunked' data, we need to finish up with an empty chunk
+      JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
+      socketAppendSendString(httpClientReqVar, &sendData, "0\r\n\r\n");
+      jsvUnLock(sendData);
+    }
     clientRequestConnect(net, httpClientReqVar);
   } else {
     // on normal sockets, we actually request close after all data sent
     jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CLOSE, jsvNewFromBool(true));
     // if we never sent any data, make sure we close 'now'
-    JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
-    if (!sendData || jsvIsEmptyString(sendData))
+    if (!socketHasSendData(httpClientReqVar))
       jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
-    jsvUnLock(sendData);
   }
 }
 
@@ -779,15 +1569,35 @@ void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar
 }
 
 
+/// Responses to HEAD, and 1xx/204/304 responses, must not have a body
+static bool serverResponseHasNoBody(JsVar *httpServerResponseVar) {
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_HEAD, 0)))
+    return true;
+  JsVarInt code = jsvGetIntegerAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CODE, 0));
+  return (code>=100 && code<200) || code==204 || code==304;
+}
+
 void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
+  bool noBody = serverResponseHasNoBody(httpServerResponseVar);
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
   if (!sendData) {
     // no sendData, so no headers - add them!
     JsVar *sendHeaders = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_HEADERS, 0);
     if (sendHeaders) {
-      sendData = jsvVarPrintf("HTTP/1.0 %d OK\r\nServer: Espruino "JS_VERSION"\r\n", jsvGetIntegerAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CODE, 0)));
+      bool keepAlive = jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_KEEP_ALIVE, 0));
+      if (keepAlive && httpGetHeader(sendHeaders, "Connection", "close")) {
+        keepAlive = false;
+        jsvObjectSetChild(httpServerResponseVar, HTTP_NAME_KEEP_ALIVE, 0);
+      }
+      sendData = jsvVarPrintf("HTTP/1.%d %d OK\r\nServer: Espruino "JS_VERSION"\r\n", keepAlive?1:0, jsvGetIntegerAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CODE, 0)));
       httpAppendHeaders(sendData, sendHeaders);
+      // to keep the connection open the client must know where the body ends - so chunk it if we weren't given a length
+      if (keepAlive && !noBody && httpGetHeader(sendHeaders, "Content-Length", 0)<0 &&
+          !httpGetHeader(sendHeaders, "Transfer-Encoding", "chunked")) {
+        jsvAppendString(sendData, "Transfer-Encoding: chunked\r\n");
+        jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+      }
       jsvObjectSetChild(httpServerResponseVar, HTTP_NAME_HEADERS, 0);
       jsvUnLock(sendHeaders);
       // finally add ending newline
@@ -798,16 +1608,99 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
     }
     jsvObjectSetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, sendData);
   }
-  if (sendData && !jsvIsUndefined(data)) {
-    JsVar *s = jsvAsString(data, false);
-    if (s) jsvAppendStringVarComplete(sendData,s);
-    jsvUnLock(s);
+  if (sendData && !jsvIsUndefined(data) && !noBody) {
+    if (!jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CHUNKED, 0)))
+      socketAppendSendData(httpServerResponseVar, &sendData, data);
+    else
+      socketAppendChunk(httpServerResponseVar, &sendData, data);
   }
   jsvUnLock(sendData);
 }
 
 void serverResponseEnd(JsVar *httpServerResponseVar) {
   serverResponseWrite(httpServerResponseVar, 0); // force connection->sendData to be created even if data not called
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CHUNKED, 0)) &&
+      !jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CLOSE, 0))) {
+    // send the last (empty) chunk
+    JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
+    socketAppendSendString(httpServerResponseVar, &sendData, "0\r\n\r\n");
+    jsvUnLock(sendData);
+  }
   jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_CLOSE, jsvNewFromBool(true));
 }
 
+// -----------------------------
+
+JsVar *dgramNew(JsVar *callback) {
+  JsVar *sock = jspNewObject(0, "dgramSocket");
+  if (!sock) return 0; // out of memory
+  if (callback) jsvObjectSetChild(sock, HTTP_NAME_ON_MESSAGE, callback); // no unlock needed
+  return sock;
+}
+
+void dgramBind(JsNetwork *net, JsVar *sock, int port, JsVar *callback) {
+  if (!net->createdgram) {
+    jsError("Datagrams aren't supported by this network");
+    return;
+  }
+  if (jsvGetIntegerAndUnLock(jsvObjectGetChild(sock, HTTP_NAME_SOCKET, 0))>0) {
+    jsError("Socket is already bound");
+    return;
+  }
+  JsVar *arr = socketGetArray(HTTP_ARRAY_DGRAM_SOCKETS, true);
+  if (!arr) return; // out of memory
+
+  int sckt = net->createdgram(net, (unsigned short)port);
+  if (sckt<0) {
+    jsError("Unable to create socket\n");
+  } else {
+    jsvObjectSetChildAndUnLock(sock, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    // add to list of sockets to receive from
+    jsvArrayPush(arr, sock);
+    jsiQueueObjectCallbacks(sock, HTTP_NAME_ON_LISTENING, 0, 0);
+    if (jsvIsFunction(callback)) jsiQueueEvents(sock, callback, 0, 0);
+  }
+  jsvUnLock(arr);
+  net->checkError(net);
+}
+
+void dgramSend(JsNetwork *net, JsVar *sock, JsVar *data, int port, JsVar *address, JsVar *callback) {
+  // bind to any port if we haven't already
+  if (jsvGetIntegerAndUnLock(jsvObjectGetChild(sock, HTTP_NAME_SOCKET, 0))<=0) {
+    dgramBind(net, sock, 0, 0);
+    if (jsvGetIntegerAndUnLock(jsvObjectGetChild(sock, HTTP_NAME_SOCKET, 0))<=0)
+      return; // failed
+  }
+  JsVar *dgram = jsvNewWithFlags(JSV_OBJECT);
+  JsVar *queue = jsvObjectGetChild(sock, HTTP_NAME_SEND_QUEUE, JSV_ARRAY);
+  if (dgram && queue) {
+    // strings and typed arrays are kept as they are, anything else is sent as a string
+    jsvObjectSetChildAndUnLock(dgram, "data", (jsvIsString(data) || jsvIsArrayBuffer(data)) ? jsvLockAgain(data) : jsvAsString(data, false));
+    jsvObjectSetChildAndUnLock(dgram, "host", jsvIsUndefined(address) ? jsvNewFromString("localhost") : jsvAsString(address, false));
+    jsvObjectSetChildAndUnLock(dgram, "port", jsvNewFromInteger(port));
+    if (jsvIsFunction(callback)) jsvObjectSetChild(dgram, "cb", callback);
+    jsvArrayPush(queue, dgram);
+  }
+  jsvUnLock2(dgram, queue);
+  // try and send it right away
+  int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(sock, HTTP_NAME_SOCKET, 0))-1;
+  dgramSendQueued(net, sock, sckt);
+  net->checkError(net);
+}
+
+void dgramClose(JsNetwork *net, JsVar *sock) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_DGRAM_SOCKETS, false);
+  if (!arr) return;
+  JsVar *idx = jsvGetArrayIndexOf(arr, sock, true);
+  if (idx) {
+    // send anything we can before we go
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(sock, HTTP_NAME_SOCKET, 0))-1;
+    dgramSendQueued(net, sock, sckt);
+    jsvObjectSetChild(sock, HTTP_NAME_SEND_QUEUE, 0);
+    _socketConnectionKill(net, sock);
+    jsvRemoveChild(arr, idx);
+    jsvUnLock(idx);
+    jsiQueueObjectCallbacks(sock, HTTP_NAME_ON_CLOSE, &sock, 1);
+  }
+  jsvUnLock(arr);
+}
@@ -29,7 +29,10 @@ typedef enum {
 // -----------------------------
 void socketInit();
 void socketKill(JsNetwork *net);
+/// Returns true if we did something (or if we have sockets and the network needs polling)
 bool socketIdle(JsNetwork *net);
+/// Are there any servers or connections open (that could cause code to run later)?
+bool socketHasConnections();
 
 // -----------------------------
 JsVar *serverNew(SocketType socketType, JsVar *callback);
@@ -45,4 +48,10 @@ void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar
 void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data);
 void serverResponseEnd(JsVar *httpServerResponseVar);
 
+// -----------------------------
+JsVar *dgramNew(JsVar *callback);
+void dgramBind(JsNetwork *net, JsVar *sock, int port, JsVar *callback);
+void dgramSend(JsNetwork *net, JsVar *sock, JsVar *data, int port, JsVar *address, JsVar *callback);
+void dgramClose(JsNetwork *net, JsVar *sock);
+
 #endif // SOCKETSERVER_H
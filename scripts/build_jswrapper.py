@@ -429,6 +429,35 @@ for className in builtins:
 codeOut("  return &jswSymbolTables["+builtins["parent"]["indexName"]+"];")
 codeOut('}')
 
+codeOut('')
+codeOut('')
+codeOut('#ifdef JSPARSE_PROFILER')
+codeOut('bool jswGetBuiltInFunctionName(void *functionPtr, const char **className, const char **name) {')
+codeOut('  static const char *classNames[] = {')
+for b in builtins:
+  builtin = builtins[b]
+  if builtin["className"]=="global":
+    codeOut('    0,')
+  elif builtin["isProto"]:
+    codeOut('    "'+builtin["className"]+'.prototype",')
+  else:
+    codeOut('    "'+builtin["className"]+'",')
+codeOut('  };')
+codeOut('  unsigned int t, s;')
+codeOut('  for (t=0;t<sizeof(jswSymbolTables)/sizeof(JswSymList);t++) {')
+codeOut('    const JswSymList *list = &jswSymbolTables[t];')
+codeOut('    for (s=0;s<list->symbolCount;s++) {')
+codeOut('      if ((void*)list->symbols[s].functionPtr == functionPtr) {')
+codeOut('        *className = classNames[t];')
+codeOut('        *name = &list->symbolChars[list->symbols[s].strOffset];')
+codeOut('        return true;')
+codeOut('      }')
+codeOut('    }')
+codeOut('  }')
+codeOut('  return false;')
+codeOut('}')
+codeOut('#endif')
+
 codeOut('')
 codeOut('')
 
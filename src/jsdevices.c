@@ -368,6 +368,16 @@ bool jshIsTopEvent(IOEventFlags eventType) {
   return IOEVENTFLAGS_GETTYPE(ioBuffer[ioTail].flags) == eventType;
 }
 
+int jshGetTopEventsOfType(IOEventFlags eventType) {
+  int count = 0;
+  unsigned char i = ioTail;
+  while (i!=ioHead && IOEVENTFLAGS_GETTYPE(ioBuffer[i].flags) == eventType) {
+    count++;
+    i = (unsigned char)((i+1) & IOBUFFERMASK);
+  }
+  return count;
+}
+
 int jshGetEventsUsed() {
   int spaceUsed = (ioHead >= ioTail) ? ((int)ioHead-(int)ioTail) : /*or rolled*/((int)ioHead+IOBUFFERMASK+1-(int)ioTail);
   return spaceUsed;
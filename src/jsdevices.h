@@ -114,6 +114,8 @@ bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result); ///< returns
 bool jshHasEvents();
 /// Check if the top event is for the given device
 bool jshIsTopEvent(IOEventFlags eventType);
+/// How many events in a row at the top of the queue are for the given device?
+int jshGetTopEventsOfType(IOEventFlags eventType);
 
 /// How many event blocks are left? compare this to IOBUFFERMASK
 int jshGetEventsUsed();
@@ -21,6 +21,8 @@
 #include "jswrap_stream.h"
 #include "jswrap_flash.h" // load and save to flash
 #include "jswrap_object.h" // jswrap_object_keys_or_property_names
+#include "jswrap_arraybuffer.h" // jswrap_typedarray_constructor
+#include "jsprofile.h"
 
 #ifdef ARM
 #define CHAR_DELETE_SEND 0x08
@@ -64,6 +66,300 @@ unsigned char loopsIdling; ///< How many times around the loop have we been enti
 bool interruptedDuringEvent; ///< Were we interrupted while executing an event? If so may want to clear timers
 // ----------------------------------------------------------------------------
 
+/* Each timer object in timerArray has a 'time' - the value of jshGetSystemTime
+ * when it should next be run. To find the next timer without looking at them
+ * all, we keep a binary heap of them (sorted by time) in a flat string. After
+ * the heap is a small hash table from each timer to its position in the heap,
+ * so a timer can be changed or removed without searching the heap for it.
+ * Timers are always removed from the heap as soon as they're removed from
+ * timerArray, so the heap never refers to something that has been freed. If
+ * there's not enough memory for it, we just search timerArray instead. */
+#ifdef JSI_TIMER_HEAP
+#define JSI_TIMER_HEAP_MIN_SIZE 8
+#define JSI_TIMER_HEAP_RETRY 64 ///< After failing to allocate the heap, how many idle loops before we try again
+typedef struct {
+  JsSysTime time; ///< When the timer should next run
+  JsVarRef name; ///< The timer's NAME in timerArray
+  JsVarRef timer; ///< The timer object itself
+} JsiTimerHeapEntry;
+
+typedef struct {
+  JsVarRef timer; ///< The timer object, or 0 if this slot is empty
+  JsVarRef index; ///< The timer's index in jsiTimerHeapEntries
+} JsiTimerHeapSlot;
+
+static JsVar *jsiTimerHeap = 0; ///< The flat string that jsiTimerHeapEntries and jsiTimerHeapSlots are stored in (or 0 if there's no heap)
+static JsiTimerHeapEntry *jsiTimerHeapEntries;
+static JsiTimerHeapSlot *jsiTimerHeapSlots; ///< Hash table (with jsiTimerHeapSize*2 slots) used to find a timer's index in the heap
+static unsigned int jsiTimerHeapCount; ///< How many entries are used
+static unsigned int jsiTimerHeapSize; ///< How many entries there is space for (always a power of 2)
+static unsigned char jsiTimerHeapBackoff = 0; ///< Don't try and build a heap until this is 0
+
+static void jsiTimerHeapFree() {
+  jsvUnLock(jsiTimerHeap);
+  jsiTimerHeap = 0;
+}
+
+/// Find the slot the given timer is in, or the empty slot it should go in if it's not in the heap
+static unsigned int jsiTimerHeapFindSlot(JsVarRef timer) {
+  unsigned int mask = jsiTimerHeapSize*2 - 1;
+  unsigned int s = ((uint32_t)timer * 2654435761u) & mask;
+  while (jsiTimerHeapSlots[s].timer && jsiTimerHeapSlots[s].timer != timer)
+    s = (s+1) & mask;
+  return s;
+}
+
+/// Put the given entry at index i of the heap, and update the hash table to say where it is
+static void jsiTimerHeapSetEntry(unsigned int i, JsiTimerHeapEntry *e) {
+  jsiTimerHeapEntries[i] = *e;
+  JsiTimerHeapSlot *slot = &jsiTimerHeapSlots[jsiTimerHeapFindSlot(e->timer)];
+  slot->timer = e->timer;
+  slot->index = (JsVarRef)i;
+}
+
+/// Remove the given timer from the hash table, moving later slots back so they can still be found
+static void jsiTimerHeapRemoveSlot(JsVarRef timer) {
+  unsigned int mask = jsiTimerHeapSize*2 - 1;
+  unsigned int s = jsiTimerHeapFindSlot(timer);
+  unsigned int j = s;
+  while (true) {
+    j = (j+1) & mask;
+    if (!jsiTimerHeapSlots[j].timer) break;
+    unsigned int home = ((uint32_t)jsiTimerHeapSlots[j].timer * 2654435761u) & mask;
+    // if the slot we emptied is between this one's home and where it is, move it back
+    if (((j-home) & mask) >= ((j-s) & mask)) {
+      jsiTimerHeapSlots[s] = jsiTimerHeapSlots[j];
+      s = j;
+    }
+  }
+  jsiTimerHeapSlots[s].timer = 0;
+}
+
+/// Make a new heap with space for the given number of timers (a power of 2), copying what was in the old one
+static bool jsiTimerHeapNew(unsigned int size) {
+  bool hadHeap = jsiTimerHeap!=0;
+  JsVar *heap = jsvNewFlatStringOfLength((unsigned int)(size*(sizeof(JsiTimerHeapEntry)+2*sizeof(JsiTimerHeapSlot))));
+  if (!heap || (hadHeap && !jsiTimerHeap)) {
+    // we're low on memory (or freeing memory threw away the old heap) - just search timerArray for now
+    jsvUnLock(heap);
+    jsiTimerHeapFree();
+    jsiTimerHeapBackoff = JSI_TIMER_HEAP_RETRY;
+    return false;
+  }
+  JsiTimerHeapEntry *oldEntries = jsiTimerHeapEntries;
+  jsiTimerHeapEntries = (JsiTimerHeapEntry*)jsvGetFlatStringPointer(heap);
+  jsiTimerHeapSlots = (JsiTimerHeapSlot*)&jsiTimerHeapEntries[size];
+  jsiTimerHeapSize = size;
+  memset(jsiTimerHeapSlots, 0, size*2*sizeof(JsiTimerHeapSlot));
+  if (hadHeap) {
+    unsigned int i;
+    for (i=0;i<jsiTimerHeapCount;i++)
+      jsiTimerHeapSetEntry(i, &oldEntries[i]);
+  } else
+    jsiTimerHeapCount = 0;
+  jsvUnLock(jsiTimerHeap);
+  jsiTimerHeap = heap;
+  return true;
+}
+
+/// Move the entry at i towards the top of the heap until it's in the right place
+static void jsiTimerHeapSiftUp(unsigned int i) {
+  JsiTimerHeapEntry e = jsiTimerHeapEntries[i];
+  while (i>0) {
+    unsigned int parent = (i-1)/2;
+    if (jsiTimerHeapEntries[parent].time <= e.time) break;
+    jsiTimerHeapSetEntry(i, &jsiTimerHeapEntries[parent]);
+    i = parent;
+  }
+  jsiTimerHeapSetEntry(i, &e);
+}
+
+/// Move the entry at i away from the top of the heap until it's in the right place
+static void jsiTimerHeapSiftDown(unsigned int i) {
+  JsiTimerHeapEntry e = jsiTimerHeapEntries[i];
+  while (true) {
+    unsigned int child = i*2+1;
+    if (child >= jsiTimerHeapCount) break;
+    if (child+1 < jsiTimerHeapCount && jsiTimerHeapEntries[child+1].time < jsiTimerHeapEntries[child].time)
+      child++;
+    if (e.time <= jsiTimerHeapEntries[child].time) break;
+    jsiTimerHeapSetEntry(i, &jsiTimerHeapEntries[child]);
+    i = child;
+  }
+  jsiTimerHeapSetEntry(i, &e);
+}
+
+static void jsiTimerHeapInsert(JsSysTime time, JsVarRef name, JsVarRef timer) {
+  if (!jsiTimerHeap) return;
+  if (jsiTimerHeapCount == jsiTimerHeapSize &&
+      !jsiTimerHeapNew(jsiTimerHeapSize*2))
+    return;
+  JsiTimerHeapEntry e;
+  e.time = time;
+  e.name = name;
+  e.timer = timer;
+  jsiTimerHeapSetEntry(jsiTimerHeapCount, &e);
+  jsiTimerHeapSiftUp(jsiTimerHeapCount++);
+}
+
+/// Get the index in the heap of the given timer object, or -1 if it's not in it
+static int jsiTimerHeapFind(JsVarRef timer) {
+  JsiTimerHeapSlot *slot = &jsiTimerHeapSlots[jsiTimerHeapFindSlot(timer)];
+  return slot->timer ? (int)slot->index : -1;
+}
+
+/// Remove the given timer object from the heap (if it is in it)
+static void jsiTimerHeapRemove(JsVarRef timer) {
+  if (!jsiTimerHeap) return;
+  int i = jsiTimerHeapFind(timer);
+  if (i<0) return;
+  jsiTimerHeapRemoveSlot(timer);
+  if ((unsigned int)i < --jsiTimerHeapCount) {
+    jsiTimerHeapSetEntry((unsigned int)i, &jsiTimerHeapEntries[jsiTimerHeapCount]);
+    jsiTimerHeapSiftUp((unsigned int)i);
+    jsiTimerHeapSiftDown((unsigned int)i);
+  }
+}
+
+/// Put everything in timerArray into a new heap
+static void jsiTimerHeapBuild(JsVar *timerArrayPtr) {
+  unsigned int size = JSI_TIMER_HEAP_MIN_SIZE;
+  while (size < (unsigned int)jsvGetChildren(timerArrayPtr)) size *= 2;
+  if (!jsiTimerHeapNew(size)) return;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, timerArrayPtr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *timerName = jsvObjectIteratorGetKey(&it);
+    JsVar *timerPtr = jsvSkipName(timerName);
+    jsiTimerHeapInsert((JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0)),
+                       jsvGetRef(timerName), jsvGetRef(timerPtr));
+    jsvUnLock2(timerPtr, timerName);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+}
+#endif
+
+/* When a pin changes, we need to find the watches for it. Rather than looking
+ * at every watch in watchArray, we keep a table of them (with their settings)
+ * in a flat string, sorted by EXTI channel. It's thrown away whenever the
+ * watches change (see jsiWatchesChanged) and rebuilt when next needed. */
+#define JSI_WATCH_CHANNELS (EV_EXTI_MAX+1-EV_EXTI0)
+typedef struct {
+  JsVarInt id; ///< The watch's index in watchArray
+  JsVarInt debounce; ///< Debounce time (from jshGetTimeFromMilliseconds), or 0
+  JsVarRef watch; ///< The watch object itself
+  Pin pin;
+  signed char edge; ///< 1 = rising, -1 = falling, 0 = both
+  bool recur;
+  bool batch; ///< Call back with all the pending edges at once
+} JsiWatchInfo;
+
+static JsVar *jsiWatchTable = 0; ///< The flat string that jsiWatchInfos is stored in (or 0 if there's no table)
+static JsiWatchInfo *jsiWatchInfos;
+static unsigned int jsiWatchChannelStart[JSI_WATCH_CHANNELS+1]; ///< The watches for EXTI channel c are jsiWatchInfos[jsiWatchChannelStart[c]..jsiWatchChannelStart[c+1]-1]
+
+void jsiWatchesChanged() {
+  jsvUnLock(jsiWatchTable);
+  jsiWatchTable = 0;
+}
+
+/// Get the settings for a watch
+static void jsiWatchGetInfo(JsVar *watchName, JsVar *watchPtr, JsiWatchInfo *info) {
+  info->id = jsvGetInteger(watchName);
+  info->debounce = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
+  info->watch = jsvGetRef(watchPtr);
+  info->pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+  info->edge = (signed char)jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "edge", 0));
+  info->recur = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr, "recur", 0));
+  info->batch = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr, "batch", 0));
+}
+
+/// Which EXTI channel do events for this pin arrive on? Returns JSI_WATCH_CHANNELS if none
+static unsigned int jsiWatchGetChannel(Pin pin) {
+  IOEvent event;
+  unsigned int c;
+  for (c=0;c<JSI_WATCH_CHANNELS;c++) {
+    event.flags = (IOEventFlags)(EV_EXTI0+c);
+    if (jshIsEventForPin(&event, pin)) return c;
+  }
+  return JSI_WATCH_CHANNELS;
+}
+
+static void jsiWatchTableBuild(JsVar *watchArrayPtr) {
+  unsigned int count = (unsigned int)jsvGetChildren(watchArrayPtr);
+  JsVar *table = jsvNewFlatStringOfLength((unsigned int)((count ? count : 1)*sizeof(JsiWatchInfo)));
+  if (!table) return; // we'll just search watchArray
+  JsiWatchInfo *infos = (JsiWatchInfo*)jsvGetFlatStringPointer(table);
+  // Count the watches for each channel, then put each one in its place
+  unsigned int pass, c;
+  unsigned int used[JSI_WATCH_CHANNELS+1];
+  for (c=0;c<=JSI_WATCH_CHANNELS;c++) {
+    used[c] = 0;
+    jsiWatchChannelStart[c] = 0;
+  }
+  for (pass=0;pass<2;pass++) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, watchArrayPtr);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *watchName = jsvObjectIteratorGetKey(&it);
+      JsVar *watchPtr = jsvSkipName(watchName);
+      JsiWatchInfo info;
+      jsiWatchGetInfo(watchName, watchPtr, &info);
+      c = jsiWatchGetChannel(info.pin);
+      if (c<JSI_WATCH_CHANNELS) {
+        if (pass==0) jsiWatchChannelStart[c+1]++;
+        else infos[jsiWatchChannelStart[c] + used[c]++] = info;
+      }
+      jsvUnLock2(watchPtr, watchName);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    if (pass==0) {
+      jsiWatchChannelStart[0] = 0;
+      for (c=0;c<JSI_WATCH_CHANNELS;c++)
+        jsiWatchChannelStart[c+1] += jsiWatchChannelStart[c];
+    }
+  }
+  jsiWatchTable = table;
+  jsiWatchInfos = infos;
+}
+
+/** Find the first watch for the given EXTI channel with an id after lastId
+ * (watches are always in order of id). Returns false if there isn't one. */
+static bool jsiWatchFind(JsVar *watchArrayPtr, unsigned int channel, JsVarInt lastId, JsiWatchInfo *info) {
+  if (!jsiWatchTable) jsiWatchTableBuild(watchArrayPtr);
+  if (jsiWatchTable) {
+    unsigned int i;
+    for (i=jsiWatchChannelStart[channel];i<jsiWatchChannelStart[channel+1];i++) {
+      if (jsiWatchInfos[i].id > lastId) {
+        *info = jsiWatchInfos[i];
+        return true;
+      }
+    }
+    return false;
+  }
+  // Not enough memory for the table - search watchArray
+  bool found = false;
+  IOEvent event;
+  event.flags = (IOEventFlags)(EV_EXTI0+channel);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, watchArrayPtr);
+  while (!found && jsvObjectIteratorHasValue(&it)) {
+    JsVar *watchName = jsvObjectIteratorGetKey(&it);
+    if (jsvGetInteger(watchName) > lastId) {
+      JsVar *watchPtr = jsvSkipName(watchName);
+      jsiWatchGetInfo(watchName, watchPtr, info);
+      found = jshIsEventForPin(&event, info->pin);
+      jsvUnLock(watchPtr);
+    }
+    jsvUnLock(watchName);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  return found;
+}
+
 #ifdef USE_DEBUGGER
 void jsiDebuggerLine(JsVar *line);
 #endif
@@ -418,9 +714,16 @@ void jsiSoftInit() {
 
   jsiStatus &= ~JSIS_ALLOW_DEEP_SLEEP;
 
+  // Make sure we set up lastIdleTime, as this could be used
+  // when adding an interval from onInit (called below)
+  jsiLastIdleTime = jshGetSystemTime();
+  jsiTimeSinceCtrlC = 0xFFFFFFFF;
+
   // Load timer/watch arrays
   timerArray = _jsiInitNamedArray(JSI_TIMERS_NAME);
   watchArray = _jsiInitNamedArray(JSI_WATCHES_NAME);
+  // Timers are saved with the time relative to when they were saved
+  jsiTimersShift(jsiLastIdleTime);
 
   // Now run initialisation code
   JsVar *initCode = jsvObjectGetChild(execInfo.hiddenRoot, JSI_INIT_CODE_NAME, 0);
@@ -445,14 +748,6 @@ void jsiSoftInit() {
     jsvUnLock(watchArrayPtr);
   }
 
-  // Timers are stored by time in the future now, so no need
-  // to fiddle with them.
-
-  // Make sure we set up lastIdleTime, as this could be used
-  // when adding an interval from onInit (called below)
-  jsiLastIdleTime = jshGetSystemTime();
-  jsiTimeSinceCtrlC = 0xFFFFFFFF;
-
   // And look for onInit function
   JsVar *onInit = jsvObjectGetChild(execInfo.root, JSI_ONINIT_NAME, 0);
   if (onInit) {
@@ -644,6 +939,9 @@ void jsiSoftKill() {
 
   // kill any wrapped stuff
   jswKill();
+#ifdef JSPARSE_PROFILER
+  jsprofStop();
+#endif
   // Stop all active timer tasks
   jstReset();
   // Unref Watches/etc
@@ -652,6 +950,11 @@ void jsiSoftKill() {
     events=0;
   }
   if (timerArray) {
+#ifdef JSI_TIMER_HEAP
+    jsiTimerHeapFree();
+#endif
+    // Save timers with the time relative to now, as the system time will be different when they're loaded
+    jsiTimersShift(-jsiLastIdleTime);
     jsvUnRefRef(timerArray);
     timerArray=0;
   }
@@ -671,6 +974,7 @@ void jsiSoftKill() {
     jsvUnRef(watchArrayPtr);
     jsvUnLock(watchArrayPtr);
     watchArray=0;
+    jsiWatchesChanged();
   }
   // Save initialisation information
   JsVar *initCode = jsvNewFromEmptyString();
@@ -795,6 +1099,27 @@ int jsiCountBracketsInInput() {
 
 /// Tries to get rid of some memory (by clearing command history). Returns true if it got rid of something, false if it didn't.
 bool jsiFreeMoreMemory() {
+#ifdef JSVAR_HASH_INDEX
+  // Indexes only make finding things faster, and they get rebuilt when needed
+  if (jsvFreeHashIndexes()) return true;
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+  if (jsvFreeArrayIndexes()) return true;
+#endif
+#ifdef JSVAR_STRING_INDEX
+  if (jsvFreeStringIndexes()) return true;
+#endif
+  if (jsiWatchTable) {
+    jsiWatchesChanged(); // it'll get rebuilt when needed
+    return true;
+  }
+#ifdef JSI_TIMER_HEAP
+  if (jsiTimerHeap) {
+    jsiTimerHeapFree();
+    jsiTimerHeapBackoff = JSI_TIMER_HEAP_RETRY;
+    return true;
+  }
+#endif
   JsVar *history = jsvObjectGetChild(execInfo.hiddenRoot, JSI_HISTORY_NAME, 0);
   if (!history) return 0;
   JsVar *item = jsvArrayPopFirst(history);
@@ -1569,10 +1894,307 @@ void jsiHandleIOEventForConsole(IOEvent *event) {
   jsiSetBusy(BUSY_INTERACTIVE, false);
 }
 
+/// Get the NAME (in timerArray) of the timer that should run next, and the time it should run at
+static JsVar *jsiTimerGetNext(JsVar *timerArrayPtr, JsSysTime *time) {
+#ifdef JSI_TIMER_HEAP
+  if (jsiTimerHeap) {
+    if (!jsiTimerHeapCount) return 0;
+    *time = jsiTimerHeapEntries[0].time;
+    return jsvLock(jsiTimerHeapEntries[0].name);
+  }
+#endif
+  JsVar *nextName = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, timerArrayPtr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
+    JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
+    jsvUnLock(timerPtr);
+    if (!nextName || timerTime < *time) {
+      jsvUnLock(nextName);
+      nextName = jsvObjectIteratorGetKey(&it);
+      *time = timerTime;
+    }
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  return nextName;
+}
+
+/// How many timers are there?
+static unsigned int jsiTimerCount(JsVar *timerArrayPtr) {
+#ifdef JSI_TIMER_HEAP
+  if (jsiTimerHeap) return jsiTimerHeapCount;
+#endif
+  return (unsigned int)jsvGetChildren(timerArrayPtr);
+}
+
+/** Run the given timer (which is due), and then either remove it or set it up to run again.
+ * 'now' is the time this pass of the idle loop is running timers up to */
+static void jsiTimerExecute(JsVar *timerName, JsSysTime timerTime, JsSysTime now) {
+  JsVar *timerPtr = jsvSkipName(timerName);
+  JsVar *timerCallback = jsvObjectGetChild(timerPtr, "callback", 0);
+  JsVar *watchPtr = jsvObjectGetChild(timerPtr, "watch", 0); // for debounce - may be undefined
+  bool exec = true;
+  JsVar *data = 0;
+  if (watchPtr) {
+    data = jsvNewWithFlags(JSV_OBJECT);
+    // if we were from a watch then we were delayed by the debounce time...
+    if (data) {
+      JsVarInt delay = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
+      // Create the 'time' variable that will be passed to the user
+      JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(timerTime-delay)/1000);
+      // if it was a watch, set the last state up
+      bool state = jsvGetBoolAndUnLock(jsvObjectSetChild(data, "state", jsvObjectGetChild(watchPtr, "state", 0)));
+      exec = jsiShouldExecuteWatch(watchPtr, state);
+      // set up the lastTime variable of data to what was in the watch
+      jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+      // set up the watches lastTime to this one
+      jsvObjectSetChild(watchPtr, "lastTime", timePtr); // don't unlock
+      jsvObjectSetChildAndUnLock(data, "time", timePtr);
+    }
+  }
+  JsVar *interval = jsvObjectGetChild(timerPtr, "interval", 0);
+  if (exec) {
+    bool execResult;
+    if (data) {
+      execResult = jsiExecuteEventCallback(0, timerCallback, 1, &data);
+    } else {
+      JsVar *argsArray = jsvObjectGetChild(timerPtr, "args", 0);
+      execResult = jsiExecuteEventCallbackArgsArray(0, timerCallback, argsArray);
+      jsvUnLock(argsArray);
+    }
+    if (!execResult && interval) {
+      jsError("Ctrl-C while processing interval - removing it.");
+      jsErrorFlags |= JSERR_CALLBACK;
+      // by setting interval to 0, we now think we've for a Timeout,
+      // which will get removed.
+      jsvUnLock(interval);
+      interval = 0;
+    }
+  }
+  jsvUnLock(data);
+  if (watchPtr) { // if we had a watch pointer, be sure to remove us from it
+    jsvObjectSetChild(watchPtr, "timeout", 0);
+    // Deal with non-recurring watches
+    if (exec) {
+      bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
+      if (!watchRecurring) {
+        JsVar *watchArrayPtr = jsvLock(watchArray);
+        JsVar *watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
+        if (watchNamePtr) {
+          jsvRemoveChild(watchArrayPtr, watchNamePtr);
+          jsvUnLock(watchNamePtr);
+          jsiWatchesChanged();
+        }
+        jsvUnLock(watchArrayPtr);
+        Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+        if (!jsiIsWatchingPin(pin))
+          jshPinWatch(pin, false);
+      }
+    }
+    jsvUnLock(watchPtr);
+  }
+
+  // Beware... the callback may have already removed us!
+  if (jsvGetRefs(timerName)) {
+    if (interval) {
+      JsSysTime nextTime = timerTime + jsvGetLongInteger(interval);
+      /* If we're running behind, don't run again until the next time around
+       * the idle loop - or we'd keep coming back to the top of the heap and
+       * stop other timers that are due from running */
+      if (nextTime <= now) nextTime = now+1;
+      jsiTimerSetTime(timerPtr, nextTime);
+    } else {
+      jsiTimerRemove(timerName);
+    }
+  }
+  jsvUnLock3(interval, timerCallback, timerPtr);
+}
+
+/** Work out event time. Events time is only stored in 32 bits, so we need to
+ * use the correct 'high' 32 bits from the current time.
+ *
+ * We know that the current time is always newer than the event time, so
+ * if the bottom 32 bits of the current time is less than the bottom
+ * 32 bits of the event time, we need to subtract a full 32 bits worth
+ * from the current time.
+ */
+static JsSysTime jsiGetEventTime(IOEvent *event) {
+  JsSysTime time = jshGetSystemTime();
+  if (((unsigned int)time) < (unsigned int)event->data.time)
+    time = time - 0x100000000LL;
+  // finally, mask in the event's time
+  return (time & ~0xFFFFFFFFLL) | (JsSysTime)event->data.time;
+}
+
+/// Call a watch's callback with the given data object, and remove the watch if it doesn't repeat
+static void jsiExecuteWatch(JsVar *watchPtr, JsiWatchInfo *info, JsVar *data) {
+  bool watchRecurring = info->recur;
+  JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
+  if (!jsiExecuteEventCallback(0, watchCallback, 1, &data) && watchRecurring) {
+    jsError("Ctrl-C while processing watch - removing it.");
+    jsErrorFlags |= JSERR_CALLBACK;
+    watchRecurring = false;
+  }
+  jsvUnLock(watchCallback);
+  if (!watchRecurring) {
+    // free all - but the callback may have removed the watch already
+    JsVar *watchArrayPtr = jsvLock(watchArray);
+    JsVar *watchName = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
+    if (watchName) {
+      jsvRemoveChild(watchArrayPtr, watchName);
+      jsvUnLock(watchName);
+      jsiWatchesChanged();
+    }
+    jsvUnLock(watchArrayPtr);
+    if (!jsiIsWatchingPin(info->pin))
+      jshPinWatch(info->pin, false);
+  }
+}
+
+/// Handle a single pin change for a single watch
+static void jsiHandleWatchEvent(JsiWatchInfo *info, JsSysTime eventTime, bool pinIsHigh) {
+  JsVar *watchPtr = jsvLock(info->watch);
+  bool executeNow = false;
+  if (info->debounce<=0) {
+    executeNow = true;
+  } else { // Debouncing - use timeouts to ensure we only fire at the right time
+    // store the current state of the pin
+    bool oldWatchState = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr, "state",0));
+    jsvObjectSetChildAndUnLock(watchPtr, "state", jsvNewFromBool(pinIsHigh));
+
+    JsVar *timeout = jsvObjectGetChild(watchPtr, "timeout", 0);
+    if (timeout) { // if we had a timeout, update the callback time
+      JsSysTime timeoutTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timeout, "time", 0));
+      jsiTimerSetTime(timeout, eventTime + info->debounce);
+      if (eventTime > timeoutTime) {
+        // timeout should have fired, but we didn't get around to executing it!
+        // Do it now (with the old timeout time)
+        executeNow = true;
+        eventTime = timeoutTime - info->debounce;
+        pinIsHigh = oldWatchState;
+      }
+    } else { // else create a new timeout
+      timeout = jsvNewWithFlags(JSV_OBJECT);
+      if (timeout) {
+        jsvObjectSetChild(timeout, "watch", watchPtr); // no unlock
+        jsvObjectSetChildAndUnLock(timeout, "time", jsvNewFromLongInteger(eventTime + info->debounce));
+        jsvObjectSetChildAndUnLock(timeout, "callback", jsvObjectGetChild(watchPtr, "callback", 0));
+        jsvObjectSetChildAndUnLock(timeout, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+        jsvObjectSetChildAndUnLock(timeout, "pin", jsvNewFromPin(info->pin));
+        // Add to timer array
+        jsiTimerAdd(timeout);
+        // Add to our watch
+        jsvObjectSetChild(watchPtr, "timeout", timeout); // no unlock
+      }
+    }
+    jsvUnLock(timeout);
+  }
+
+  // If we want to execute this watch right now...
+  if (executeNow) {
+    JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(eventTime)/1000);
+    if (info->edge==0 || // any edge
+        (pinIsHigh && info->edge>0) || // rising edge
+        (!pinIsHigh && info->edge<0)) { // falling edge
+      JsVar *data = jsvNewWithFlags(JSV_OBJECT);
+      if (data) {
+        jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+        // set both data.time, and watch.lastTime in one go
+        jsvObjectSetChild(data, "time", timePtr); // no unlock
+        jsvObjectSetChildAndUnLock(data, "pin", jsvNewFromPin(info->pin));
+        jsvObjectSetChildAndUnLock(data, "state", jsvNewFromBool(pinIsHigh));
+      }
+      jsiExecuteWatch(watchPtr, info, data);
+      jsvUnLock(data);
+    }
+    jsvObjectSetChildAndUnLock(watchPtr, "lastTime", timePtr);
+  }
+  jsvUnLock(watchPtr);
+}
+
+/** Handle the event, and any others for the same pin right after it, with one
+ * call to a watch that has `batch:true` set. `e.times` is a Float64Array of
+ * the time of each edge that matches the watch's `edge`. Returns false (without
+ * handling the event) if there wasn't enough memory */
+static bool jsiHandleWatchEventBatch(JsiWatchInfo *info, IOEvent *event) {
+  IOEventFlags eventType = IOEVENTFLAGS_GETTYPE(event->flags);
+  int count = 1 + jshGetTopEventsOfType(eventType);
+  JsVar *times = jsvNewTypedArray(ARRAYBUFFERVIEW_FLOAT64, count);
+  if (!times) return false;
+  JsvArrayBufferIterator it;
+  jsvArrayBufferIteratorNew(&it, times, 0);
+  int n = 0;
+  bool state = false; // the state after the last edge we used
+  JsVarFloat time = 0; // the time of the last edge we used
+  while (true) {
+    bool pinIsHigh = (event->flags&EV_EXTI_IS_HIGH)!=0;
+    if (info->edge==0 || (pinIsHigh && info->edge>0) || (!pinIsHigh && info->edge<0)) {
+      state = pinIsHigh;
+      time = jshGetMillisecondsFromTime(jsiGetEventTime(event))/1000;
+      jsvArrayBufferIteratorSetFloatValue(&it, time);
+      jsvArrayBufferIteratorNext(&it);
+      n++;
+    }
+    if (--count<=0 || !jshPopIOEvent(event)) break;
+  }
+  jsvArrayBufferIteratorFree(&it);
+  if (n) {
+    JsVar *watchPtr = jsvLock(info->watch);
+    JsVar *timePtr = jsvNewFromFloat(time);
+    JsVar *data = jsvNewWithFlags(JSV_OBJECT);
+    if (data) {
+      jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+      jsvObjectSetChild(data, "time", timePtr); // no unlock
+      jsvObjectSetChildAndUnLock(data, "pin", jsvNewFromPin(info->pin));
+      jsvObjectSetChildAndUnLock(data, "state", jsvNewFromBool(state));
+      // if edges were filtered out, only pass on the ones we used
+      if (n < (int)jsvGetArrayBufferLength(times)) {
+        JsVar *buffer = jsvLock(jsvGetFirstChild(times));
+        jsvObjectSetChildAndUnLock(data, "times", jswrap_typedarray_constructor(ARRAYBUFFERVIEW_FLOAT64, buffer, 0, n));
+        jsvUnLock(buffer);
+      } else
+        jsvObjectSetChild(data, "times", times); // no unlock
+    }
+    jsiExecuteWatch(watchPtr, info, data);
+    jsvObjectSetChild(watchPtr, "lastTime", timePtr);
+    jsvUnLock3(data, timePtr, watchPtr);
+  }
+  jsvUnLock(times);
+  return true;
+}
+
+/// Call the watches for the pin that this EXTI event is from
+static void jsiHandleIOEventForWatches(IOEvent *event) {
+  unsigned int channel = (unsigned int)(IOEVENTFLAGS_GETTYPE(event->flags) - EV_EXTI0);
+  JsSysTime eventTime = jsiGetEventTime(event);
+  bool pinIsHigh = (event->flags&EV_EXTI_IS_HIGH)!=0;
+  JsVar *watchArrayPtr = jsvLock(watchArray);
+  JsiWatchInfo info, next;
+  /* Callbacks could add or remove watches (so jsiWatchInfos may change), so
+   * after each one we look for the next watch by its id */
+  bool found = jsiWatchFind(watchArrayPtr, channel, -1, &info);
+  if (found && info.batch && info.debounce<=0 &&
+      !jsiWatchFind(watchArrayPtr, channel, info.id, &next)) {
+    // Only one watch for the pin, and it wants to know about all the edges at once
+    if (jsiHandleWatchEventBatch(&info, event))
+      found = false;
+  }
+  while (found) {
+    jsiHandleWatchEvent(&info, eventTime, pinIsHigh);
+    found = jsiWatchFind(watchArrayPtr, channel, info.id, &info);
+  }
+  jsvUnLock(watchArrayPtr);
+}
+
 void jsiIdle() {
   // This is how many times we have been here and not done anything.
   // It will be zeroed if we do stuff later
   if (loopsIdling<255) loopsIdling++;
+#ifdef JSPARSE_PROFILER
+  jsprofSamplePending = false; // don't put samples from when we weren't running any code on the next line we run
+#endif
 
   // Handle hardware-related idle stuff (like checking for pin events)
   bool wasBusy = false;
@@ -1597,110 +2219,7 @@ void jsiIdle() {
       }
       jsvUnLock(usartClass);
     } else if (DEVICE_IS_EXTI(eventType)) { // ---------------------------------------------------------------- PIN WATCH
-      // we have an event... find out what it was for...
-      // Check everything in our Watch array
-      JsVar *watchArrayPtr = jsvLock(watchArray);
-      JsvObjectIterator it;
-      jsvObjectIteratorNew(&it, watchArrayPtr);
-      while (jsvObjectIteratorHasValue(&it)) {
-        bool hasDeletedWatch = false;
-        JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
-        Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
-
-        if (jshIsEventForPin(&event, pin)) {
-          /** Work out event time. Events time is only stored in 32 bits, so we need to
-           * use the correct 'high' 32 bits from the current time.
-           *
-           * We know that the current time is always newer than the event time, so
-           * if the bottom 32 bits of the current time is less than the bottom
-           * 32 bits of the event time, we need to subtract a full 32 bits worth
-           * from the current time.
-           */
-          JsSysTime time = jshGetSystemTime();
-          if (((unsigned int)time) < (unsigned int)event.data.time)
-            time = time - 0x100000000LL;
-          // finally, mask in the event's time
-          JsSysTime eventTime = (time & ~0xFFFFFFFFLL) | (JsSysTime)event.data.time;
-
-          // Now actually process the event
-          bool pinIsHigh = (event.flags&EV_EXTI_IS_HIGH)!=0;
-
-          bool executeNow = false;
-          JsVarInt debounce = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
-          if (debounce<=0) {
-            executeNow = true;
-          } else { // Debouncing - use timeouts to ensure we only fire at the right time
-            // store the current state of the pin
-            bool oldWatchState = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr, "state",0));
-            jsvObjectSetChildAndUnLock(watchPtr, "state", jsvNewFromBool(pinIsHigh));
-
-            JsVar *timeout = jsvObjectGetChild(watchPtr, "timeout", 0);
-            if (timeout) { // if we had a timeout, update the callback time
-              JsSysTime timeoutTime = jsiLastIdleTime + (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timeout, "time", 0));
-              jsvUnLock(jsvObjectSetChild(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiLastIdleTime) + debounce)));
-              if (eventTime > timeoutTime) {
-                // timeout should have fired, but we didn't get around to executing it!
-                // Do it now (with the old timeout time)
-                executeNow = true;
-                eventTime = timeoutTime - debounce;
-                pinIsHigh = oldWatchState;
-              }
-            } else { // else create a new timeout
-              timeout = jsvNewWithFlags(JSV_OBJECT);
-              if (timeout) {
-                jsvObjectSetChild(timeout, "watch", watchPtr); // no unlock
-                jsvObjectSetChildAndUnLock(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiLastIdleTime) + debounce));
-                jsvObjectSetChildAndUnLock(timeout, "callback", jsvObjectGetChild(watchPtr, "callback", 0));
-                jsvObjectSetChildAndUnLock(timeout, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-                jsvObjectSetChildAndUnLock(timeout, "pin", jsvNewFromPin(pin));
-                // Add to timer array
-                jsiTimerAdd(timeout);
-                // Add to our watch
-                jsvObjectSetChild(watchPtr, "timeout", timeout); // no unlock
-              }
-            }
-            jsvUnLock(timeout);
-          }
-
-          // If we want to execute this watch right now...
-          if (executeNow) {
-            JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(eventTime)/1000);
-            if (jsiShouldExecuteWatch(watchPtr, pinIsHigh)) { // edge triggering
-              JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
-              bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
-              JsVar *data = jsvNewWithFlags(JSV_OBJECT);
-              if (data) {
-                jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-                // set both data.time, and watch.lastTime in one go
-                jsvObjectSetChild(data, "time", timePtr); // no unlock
-                jsvObjectSetChildAndUnLock(data, "pin", jsvNewFromPin(pin));
-                jsvObjectSetChildAndUnLock(data, "state", jsvNewFromBool(pinIsHigh));
-              }
-              if (!jsiExecuteEventCallback(0, watchCallback, 1, &data) && watchRecurring) {
-                jsError("Ctrl-C while processing watch - removing it.");
-                jsErrorFlags |= JSERR_CALLBACK;
-                watchRecurring = false;
-              }
-              jsvUnLock(data);
-              if (!watchRecurring) {
-                // free all
-                jsvObjectIteratorRemoveAndGotoNext(&it, watchArrayPtr);
-                hasDeletedWatch = true;
-                if (!jsiIsWatchingPin(pin))
-                  jshPinWatch(pin, false);
-              }
-              jsvUnLock(watchCallback);
-            }
-            jsvObjectSetChildAndUnLock(watchPtr, "lastTime", timePtr);
-          }
-        }
-
-        jsvUnLock(watchPtr);
-        if (!hasDeletedWatch)
-          jsvObjectIteratorNext(&it);
-      }
-      jsvObjectIteratorFree(&it);
-      jsvUnLock(watchArrayPtr);
+      jsiHandleIOEventForWatches(&event);
     }
   }
 
@@ -1725,109 +2244,33 @@ void jsiIdle() {
 
   jsiStatus = jsiStatus & ~JSIS_TIMERS_CHANGED;
   JsVar *timerArrayPtr = jsvLock(timerArray);
-  JsvObjectIterator it;
-  jsvObjectIteratorNew(&it, timerArrayPtr);
-  while (jsvObjectIteratorHasValue(&it) && !(jsiStatus & JSIS_TIMERS_CHANGED)) {
-    bool hasDeletedTimer = false;
-    JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
-    JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
-    JsSysTime timeUntilNext = timerTime - timePassed;
-
-    if (timeUntilNext<=0) {
-      // we're now doing work
-      jsiSetBusy(BUSY_INTERACTIVE, true);
-      wasBusy = true;
-      JsVar *timerCallback = jsvObjectGetChild(timerPtr, "callback", 0);
-      JsVar *watchPtr = jsvObjectGetChild(timerPtr, "watch", 0); // for debounce - may be undefined
-      bool exec = true;
-      JsVar *data = 0;
-      if (watchPtr) {
-        data = jsvNewWithFlags(JSV_OBJECT);
-        // if we were from a watch then we were delayed by the debounce time...
-        if (data) {
-          JsVarInt delay = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
-          // Create the 'time' variable that will be passed to the user
-          JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(jsiLastIdleTime+timeUntilNext-delay)/1000);
-          // if it was a watch, set the last state up
-          bool state = jsvGetBoolAndUnLock(jsvObjectSetChild(data, "state", jsvObjectGetChild(watchPtr, "state", 0)));
-          exec = jsiShouldExecuteWatch(watchPtr, state);
-          // set up the lastTime variable of data to what was in the watch
-          jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-          // set up the watches lastTime to this one
-          jsvObjectSetChild(watchPtr, "lastTime", timePtr); // don't unlock
-          jsvObjectSetChildAndUnLock(data, "time", timePtr);
-        }
-      }
-      JsVar *interval = jsvObjectGetChild(timerPtr, "interval", 0);
-      if (exec) {
-        bool execResult;
-        if (data) {
-          execResult = jsiExecuteEventCallback(0, timerCallback, 1, &data);
-        } else {
-          JsVar *argsArray = jsvObjectGetChild(timerPtr, "args", 0);
-          execResult = jsiExecuteEventCallbackArgsArray(0, timerCallback, argsArray);
-          jsvUnLock(argsArray);
-        }
-        if (!execResult && interval) {
-          jsError("Ctrl-C while processing interval - removing it.");
-          jsErrorFlags |= JSERR_CALLBACK;
-          // by setting interval to 0, we now think we've for a Timeout,
-          // which will get removed.
-          jsvUnLock(interval);
-          interval = 0;
-        }
-      }
-      jsvUnLock(data);
-      if (watchPtr) { // if we had a watch pointer, be sure to remove us from it
-        jsvObjectSetChild(watchPtr, "timeout", 0);
-        // Deal with non-recurring watches
-        if (exec) {
-          bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
-          if (!watchRecurring) {
-            JsVar *watchArrayPtr = jsvLock(watchArray);
-            JsVar *watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
-            if (watchNamePtr) {
-              jsvRemoveChild(watchArrayPtr, watchNamePtr);
-              jsvUnLock(watchNamePtr);
-            }
-            jsvUnLock(watchArrayPtr);
-            Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
-            if (!jsiIsWatchingPin(pin))
-              jshPinWatch(pin, false);
-          }
-        }
-        jsvUnLock(watchPtr);
-      }
-
-      if (interval) {
-        timeUntilNext = timeUntilNext + jsvGetLongIntegerAndUnLock(interval);
-      } else {
-        // free
-        // Beware... may have already been removed!
-        jsvObjectIteratorRemoveAndGotoNext(&it, timerArrayPtr);
-        hasDeletedTimer = true;
-        timeUntilNext = -1;
-      }
-      jsvUnLock(timerCallback);
-
-    }
-    // update the time until the next timer
-    if (timeUntilNext>=0 && timeUntilNext < minTimeUntilNext)
-      minTimeUntilNext = timeUntilNext;
-    // update the timer's time
-    if (!hasDeletedTimer) {
-      jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(timeUntilNext));
-      jsvObjectIteratorNext(&it);
-    }
-    jsvUnLock(timerPtr);
+#ifdef JSI_TIMER_HEAP
+  if (!jsiTimerHeap && !jsvArrayIsEmpty(timerArrayPtr)) {
+    if (jsiTimerHeapBackoff) jsiTimerHeapBackoff--;
+    else jsiTimerHeapBuild(timerArrayPtr);
+  }
+#endif
+  /* Run the timers that are due in order. Each one may set up other timers, so
+   * only run as many as there were to begin with. An interval that's running
+   * behind is put after 'time' (see jsiTimerExecute), so it only runs once. */
+  unsigned int timersToRun = jsiTimerCount(timerArrayPtr);
+  JsSysTime timerTime = 0;
+  JsVar *timerName = jsiTimerGetNext(timerArrayPtr, &timerTime);
+  while (timerName && timerTime<=time && timersToRun>0) {
+    timersToRun--;
+    // we're now doing work
+    jsiSetBusy(BUSY_INTERACTIVE, true);
+    wasBusy = true;
+    jsiTimerExecute(timerName, timerTime, time);
+    jsvUnLock(timerName);
+    timerName = jsiTimerGetNext(timerArrayPtr, &timerTime);
+  }
+  // update the time until the next timer
+  if (timerName) {
+    minTimeUntilNext = (timerTime>time) ? timerTime-time : 0;
+    jsvUnLock(timerName);
   }
-  jsvObjectIteratorFree(&it);
   jsvUnLock(timerArrayPtr);
-  /* We might have left the timers loop with stuff to do because the contents of it
-   * changed. It's not a big deal because it could only have changed because a timer
-   * got executed - so `wasBusy` got set and we know we're going to go around the
-   * loop again before sleeping.
-   */ 
 
   // Check for events that might need to be processed from other libraries
   if (jswIdle()) wasBusy = true;
@@ -1893,15 +2336,30 @@ void jsiIdle() {
   /* if we've been around this loop, there is nothing to do, and
    * we have a spare 10ms then let's do some Garbage Collection
    * just in case. */
+#ifdef JSVAR_INCREMENTAL_GC
+  /* Only do a little at a time, so we don't delay timers and events. Once
+   * started, we keep going each time around the loop until we're done. */
+  if ((loopsIdling==1 &&
+       minTimeUntilNext > jshGetTimeFromMilliseconds(10)) ||
+      jsvGarbageCollectInProgress()) {
+    jsiSetBusy(BUSY_INTERACTIVE, true);
+    jsvGarbageCollectStep();
+    jsiSetBusy(BUSY_INTERACTIVE, false);
+  }
+#else
   if (loopsIdling==1 &&
       minTimeUntilNext > jshGetTimeFromMilliseconds(10)) {
     jsiSetBusy(BUSY_INTERACTIVE, true);
     jsvGarbageCollect();
     jsiSetBusy(BUSY_INTERACTIVE, false);
   }
+#endif
 
   // Go to sleep!
   if (loopsIdling>1 && // once around the idle loop without having done any work already (just in case)
+#ifdef JSVAR_INCREMENTAL_GC
+      !jsvGarbageCollectInProgress() && // still collecting garbage
+#endif
 #ifdef USB
       !jshIsUSBSERIALConnected() && // if USB is on, no point sleeping (later, sleep might be more drastic)
 #endif
@@ -2006,7 +2464,7 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data) {
     JsVar *timerInterval = jsvObjectGetChild(timer, "interval", 0);
     user_callback(timerInterval ? "setInterval(" : "setTimeout(", user_data);
     jsiDumpJSON(user_callback, user_data, timerCallback, 0);
-    cbprintf(user_callback, user_data, ", %f);\n", jshGetMillisecondsFromTime(timerInterval ? jsvGetLongInteger(timerInterval) : jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timer, "time", 0))));
+    cbprintf(user_callback, user_data, ", %f);\n", jshGetMillisecondsFromTime(timerInterval ? jsvGetLongInteger(timerInterval) : (jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timer, "time", 0)) - jsiLastIdleTime)));
     jsvUnLock2(timerInterval, timerCallback);
     // next
     jsvUnLock(timer);
@@ -2047,10 +2505,80 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data) {
 JsVarInt jsiTimerAdd(JsVar *timerPtr) {
   JsVar *timerArrayPtr = jsvLock(timerArray);
   JsVarInt itemIndex = jsvArrayAddToEnd(timerArrayPtr, timerPtr, 1) - 1;
+#ifdef JSI_TIMER_HEAP
+  if (jsiTimerHeap && jsvGetLastChild(timerArrayPtr))
+    jsiTimerHeapInsert((JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0)),
+                       jsvGetLastChild(timerArrayPtr), jsvGetRef(timerPtr));
+#endif
   jsvUnLock(timerArrayPtr);
   return itemIndex;
 }
 
+void jsiTimerSetTime(JsVar *timerPtr, JsSysTime time) {
+  jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(time));
+#ifdef JSI_TIMER_HEAP
+  if (jsiTimerHeap) {
+    JsVarRef timer = jsvGetRef(timerPtr);
+    int i = jsiTimerHeapFind(timer);
+    if (i>=0) {
+      jsiTimerHeapEntries[i].time = time;
+      jsiTimerHeapSiftUp((unsigned int)i);
+      jsiTimerHeapSiftDown((unsigned int)i);
+      return;
+    }
+    // not in the heap (it's not been added to timerArray yet) - find its name and add it
+    JsVar *timerArrayPtr = jsvLock(timerArray);
+    JsVar *timerName = jsvGetArrayIndexOf(timerArrayPtr, timerPtr, true);
+    if (timerName) {
+      jsiTimerHeapInsert(time, jsvGetRef(timerName), timer);
+      jsvUnLock(timerName);
+    }
+    jsvUnLock(timerArrayPtr);
+  }
+#endif
+}
+
+void jsiTimerRemove(JsVar *timerName) {
+  JsVar *timerArrayPtr = jsvLock(timerArray);
+  if (timerName) {
+#ifdef JSI_TIMER_HEAP
+    jsiTimerHeapRemove(jsvGetFirstChild(timerName));
+#endif
+    jsvRemoveChild(timerArrayPtr, timerName);
+  } else {
+#ifdef JSI_TIMER_HEAP
+    if (jsiTimerHeap) {
+      jsiTimerHeapCount = 0;
+      memset(jsiTimerHeapSlots, 0, jsiTimerHeapSize*2*sizeof(JsiTimerHeapSlot));
+    }
+#endif
+    jsvRemoveAllChildren(timerArrayPtr);
+  }
+  jsvUnLock(timerArrayPtr);
+}
+
+void jsiTimersShift(JsSysTime diff) {
+  JsVar *timerArrayPtr = jsvLock(timerArray);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, timerArrayPtr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
+    JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
+    jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(timerTime + diff));
+    jsvUnLock(timerPtr);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(timerArrayPtr);
+#ifdef JSI_TIMER_HEAP
+  // every timer moves by the same amount, so the heap stays in order
+  unsigned int i;
+  if (jsiTimerHeap)
+    for (i=0;i<jsiTimerHeapCount;i++)
+      jsiTimerHeapEntries[i].time += diff;
+#endif
+}
+
 void jsiTimersChanged() {
   jsiStatus |= JSIS_TIMERS_CHANGED;
 }
@@ -136,8 +136,12 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data);
 extern JsVarRef timerArray; // Linked List of timers to check and run
 extern JsVarRef watchArray; // Linked List of input watches to check and run
 
-extern JsVarInt jsiTimerAdd(JsVar *timerPtr);
+extern JsVarInt jsiTimerAdd(JsVar *timerPtr); ///< Add a timer object (whose 'time' is already set) to timerArray - return its index
+extern void jsiTimerSetTime(JsVar *timerPtr, JsSysTime time); ///< Set the system time (from jshGetSystemTime) when a timer should next run
+extern void jsiTimerRemove(JsVar *timerName); ///< Remove the timer with the given NAME in timerArray, or all timers if 0
+extern void jsiTimersShift(JsSysTime diff); ///< Add the given amount to the time of every timer (eg. if the system time changes)
 extern void jsiTimersChanged(); // Flag timers changed so we can skip out of the loop if needed
+extern void jsiWatchesChanged(); ///< Call whenever watchArray is changed
 // end for jswrap_interactive/io.c ------------------------------------------------
 
 #ifdef USE_DEBUGGER
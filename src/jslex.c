@@ -21,6 +21,9 @@ JslCharPos jslCharPosClone(JslCharPos *pos) {
   JslCharPos p;
   p.it = jsvStringIteratorClone(&pos->it);
   p.currCh = pos->currCh;
+#ifdef JSLEX_TOKEN_CACHE
+  p.tokenCachePos = pos->tokenCachePos;
+#endif
   return p;
 }
 
@@ -200,7 +203,25 @@ static ALWAYS_INLINE void jslSingleChar(JsLex *lex) {
   jslGetNextCh(lex);
 }
 
+#ifdef JSLEX_TOKEN_CACHE
+static void jslGetNextCachedToken(JsLex *lex);
+#endif
+
+/// How many tokens have been lexed (see jslGetTokenCount)
+static unsigned int jslTokenCount = 0;
+
+unsigned int jslGetTokenCount() {
+  return jslTokenCount;
+}
+
 void jslGetNextToken(JsLex *lex) {
+  jslTokenCount++;
+#ifdef JSLEX_TOKEN_CACHE
+  if (lex->tokenCache) {
+    jslGetNextCachedToken(lex);
+    return;
+  }
+#endif
   jslGetNextToken_start:
   // Skip whitespace
   while (isWhitespace(lex->currCh))
@@ -547,6 +568,12 @@ void jslInit(JsLex *lex, JsVar *var) {
   lex->tokenl = 0;
   lex->tokenValue = 0;
   lex->lineNumberOffset = 0;
+#ifdef JSLEX_TOKEN_CACHE
+  lex->tokenStart.tokenCachePos = 0;
+  lex->tokenCache = 0;
+  lex->tokenCacheData = 0;
+  lex->tokenCachePos = 0;
+#endif
   // set up iterator
   jsvStringIteratorNew(&lex->it, lex->sourceVar, 0);
   jsvUnLock(lex->it.var); // see jslGetNextCh
@@ -561,12 +588,29 @@ void jslKill(JsLex *lex) {
     jsvUnLock(lex->tokenValue);
     lex->tokenValue = 0;
   }
+#ifdef JSLEX_TOKEN_CACHE
+  jsvUnLock(lex->tokenCache);
+  lex->tokenCache = 0;
+#endif
   jsvUnLock(lex->sourceVar);
   lex->tokenStart.it.var = 0;
   lex->tokenStart.currCh = 0;
 }
 
+#ifdef JSLEX_TOKEN_CACHE
+static size_t jslFindCachedToken(JsLex *lex, size_t start, size_t *tokenStart);
+static void jslSeekToCachedToken(JsLex *lex, size_t pos, size_t start);
+#endif
+
 void jslSeekTo(JsLex *lex, size_t seekToChar) {
+#ifdef JSLEX_TOKEN_CACHE
+  if (lex->tokenCache) {
+    size_t start;
+    size_t pos = jslFindCachedToken(lex, seekToChar, &start);
+    jslSeekToCachedToken(lex, pos, start);
+    return;
+  }
+#endif
   if (lex->it.var) jsvLockAgain(lex->it.var); // see jslGetNextCh
   jsvStringIteratorFree(&lex->it);
   jsvStringIteratorNew(&lex->it, lex->sourceVar, seekToChar);
@@ -577,6 +621,18 @@ void jslSeekTo(JsLex *lex, size_t seekToChar) {
 }
 
 void jslSeekToP(JsLex *lex, JslCharPos *seekToChar) {
+#ifdef JSLEX_TOKEN_CACHE
+  if (lex->tokenCache) {
+    size_t start = jsvStringIteratorGetIndex(&seekToChar->it)-1;
+    size_t pos;
+    if (seekToChar->tokenCachePos)
+      pos = seekToChar->tokenCachePos-1;
+    else // position was taken before we started replaying tokens
+      pos = jslFindCachedToken(lex, start, &start);
+    jslSeekToCachedToken(lex, pos, start);
+    return;
+  }
+#endif
   if (lex->it.var) jsvLockAgain(lex->it.var); // see jslGetNextCh
   jsvStringIteratorFree(&lex->it);
   lex->it = jsvStringIteratorClone(&seekToChar->it);
@@ -710,6 +766,12 @@ int jslGetTokenLength(JsLex *lex) {
 JsVar *jslGetTokenValueAsVar(JsLex *lex) {
   if (lex->tokenValue) {
     return jsvLockAgain(lex->tokenValue);
+  } else if (lex->tk == LEX_STR) {
+    // strings replayed from a token cache only get a JsVar when they're needed
+    lex->tokenValue = jsvNewFromEmptyString();
+    if (!lex->tokenValue) return 0;
+    jsvAppendStringBuf(lex->tokenValue, lex->token, lex->tokenl);
+    return jsvLockAgain(lex->tokenValue);
   } else {
     assert(lex->tokenl < JSLEX_MAX_TOKEN_LENGTH);
     lex->token[lex->tokenl]  = 0; // add final null
@@ -742,7 +804,16 @@ bool jslMatch(JsLex *lex, int expected_tk) {
   return true;
 }
 
-JsVar *jslNewFromLexer(JslCharPos *charFrom, size_t charTo) {
+JsVar *jslNewFromLexer(JsLex *lex, JslCharPos *charFrom, size_t charTo) {
+#ifdef JSLEX_TOKEN_CACHE
+  if (charFrom->tokenCachePos) {
+    // position of a replayed token - we only have the index
+    size_t charStart = jsvStringIteratorGetIndex(&charFrom->it)-1;
+    return jsvNewFromStringVar(lex->sourceVar, charStart, charTo-charStart);
+  }
+#else
+  NOT_USED(lex);
+#endif
   // Create a var
   JsVar *var = jsvNewFromEmptyString();
   if (!var) { // out of memory
@@ -779,6 +850,258 @@ JsVar *jslNewFromLexer(JslCharPos *charFrom, size_t charTo) {
   return var;
 }
 
+#ifdef JSLEX_TOKEN_CACHE
+/* Token cache format. The first JsVarRef is the ref of the source string,
+ * followed by the source string's length (so we can tell if the ref has
+ * been reused for different code), then every token is stored as:
+ *
+ *   - 1 byte token type. Under 0x80 it's the character itself, JSL_TC_ESCAPE
+ *     means the next byte is the character, otherwise it's 0x80+(tk-LEX_ID)
+ *   - The distance of the token's first character from the first character of
+ *     the previous token, 7 bits per byte, with the top bit set if more follow
+ *   - For IDs, numbers and strings: 1 byte length and then the token's text. If
+ *     JSL_TC_TRUNCATED is set in the length, the string was too big for 'token'
+ *     and has to be re-lexed from the source if we need its value.
+ *
+ * The last token is always LEX_EOF or LEX_UNFINISHED_COMMENT.
+ */
+#define JSL_TC_HEADER (sizeof(JsVarRef)+sizeof(size_t))
+/// The most bytes a single token can take up
+#define JSL_TC_MAX_TOKEN (2 + (sizeof(size_t)*8+6)/7 + 1 + JSLEX_MAX_TOKEN_LENGTH)
+#define JSL_TC_ESCAPE 0xFF
+#define JSL_TC_TRUNCATED 0x80
+
+static ALWAYS_INLINE bool jslTokenHasValue(int tk) {
+  return tk==LEX_ID || tk==LEX_INT || tk==LEX_FLOAT || tk==LEX_STR;
+}
+
+static ALWAYS_INLINE bool jslTokenIsLast(int tk) {
+  return tk==LEX_EOF || tk==LEX_UNFINISHED_COMMENT;
+}
+
+/// Write the lexer's current token to buf, returning the amount of bytes used (at most JSL_TC_MAX_TOKEN)
+static size_t jslTokenCacheWrite(JsLex *lex, unsigned char *buf, size_t lastStart) {
+  size_t n = 0;
+  int tk = lex->tk;
+  if (tk>=0 && tk<0x80) {
+    buf[n] = (unsigned char)tk;
+    n++;
+  } else if (tk<LEX_ID) { // top-bit-set characters
+    buf[n] = JSL_TC_ESCAPE;
+    buf[n+1] = (unsigned char)tk;
+    n+=2;
+  } else {
+    buf[n] = (unsigned char)(0x80 + tk - LEX_ID);
+    n++;
+  }
+  size_t delta = jsvStringIteratorGetIndex(&lex->tokenStart.it) - 1 - lastStart;
+  do {
+    unsigned char b = (unsigned char)(delta & 0x7F);
+    delta >>= 7;
+    if (delta) b |= 0x80;
+    buf[n] = b;
+    n++;
+  } while (delta);
+  if (jslTokenHasValue(tk)) {
+    unsigned char l = lex->tokenl;
+    if (tk==LEX_STR && jsvGetStringLength(lex->tokenValue)!=l)
+      l |= JSL_TC_TRUNCATED;
+    buf[n] = l;
+    memcpy(&buf[n+1], lex->token, lex->tokenl);
+    n += 1 + (size_t)lex->tokenl;
+  }
+  return n;
+}
+
+JsVar *jslNewTokenCache(JsVar *source) {
+  size_t sourceLen = jsvGetStringLength(source);
+  // Tokens are usually a bit bigger than the code they came from - we grow this if not
+  size_t bufLen = JSL_TC_HEADER + sourceLen + sourceLen/2 + JSL_TC_MAX_TOKEN;
+  JsVar *tokenCache = jsvNewFlatStringOfLength((unsigned int)bufLen);
+  if (!tokenCache) return 0;
+  unsigned char *buf = (unsigned char*)jsvGetFlatStringPointer(tokenCache);
+  JsVarRef sourceRef = jsvGetRef(source);
+  memcpy(buf, &sourceRef, sizeof(JsVarRef));
+  memcpy(&buf[sizeof(JsVarRef)], &sourceLen, sizeof(size_t));
+
+  JsLex lex;
+  jslInit(&lex, source);
+  size_t n = JSL_TC_HEADER;
+  size_t lastStart = 0;
+  bool ok = true;
+  while (true) {
+    if (n+JSL_TC_MAX_TOKEN > bufLen) {
+      bufLen *= 2;
+      JsVar *bigger = jsvNewFlatStringOfLength((unsigned int)bufLen);
+      if (!bigger) {
+        ok = false;
+        break;
+      }
+      memcpy(jsvGetFlatStringPointer(bigger), buf, n);
+      jsvUnLock(tokenCache);
+      tokenCache = bigger;
+      buf = (unsigned char*)jsvGetFlatStringPointer(tokenCache);
+    }
+    n += jslTokenCacheWrite(&lex, &buf[n], lastStart);
+    if (jslTokenIsLast(lex.tk)) break;
+    lastStart = jsvStringIteratorGetIndex(&lex.tokenStart.it) - 1;
+    jslGetNextToken(&lex);
+  }
+  /* If we hit EOF before the end of the string (out of memory when
+   * lexing a string, or a 0 character) just let the normal lexer handle it */
+  if (lex.tk==LEX_EOF && lex.currCh) ok = false;
+  jslKill(&lex);
+  if (!ok) {
+    jsvUnLock(tokenCache);
+    return 0;
+  }
+  jsvTruncateFlatString(tokenCache, n); // give back what we didn't use
+  return tokenCache;
+}
+
+bool jslIsTokenCacheFor(JsVar *tokenCache, JsVar *source) {
+  if (!jsvIsFlatString(tokenCache) || jsvGetCharactersInVar(tokenCache)<JSL_TC_HEADER)
+    return false;
+  const char *data = jsvGetFlatStringPointer(tokenCache);
+  JsVarRef sourceRef;
+  size_t sourceLen;
+  memcpy(&sourceRef, data, sizeof(JsVarRef));
+  memcpy(&sourceLen, &data[sizeof(JsVarRef)], sizeof(size_t));
+  return sourceRef == jsvGetRef(source) && sourceLen == jsvGetStringLength(source);
+}
+
+/// Decode the type of the cached token at data[*pos] and the distance from the previous token. Moves *pos on to the token's value
+static short jslTokenCacheDecode(const unsigned char *data, size_t *pos, size_t *delta) {
+  size_t p = *pos;
+  short tk;
+  unsigned char b = data[p++];
+  if (b<0x80) tk = b;
+  else if (b==JSL_TC_ESCAPE) tk = (char)data[p++]; // same as the lexer's lex->tk = lex->currCh
+  else tk = (short)(LEX_ID + b - 0x80);
+  size_t d = 0;
+  unsigned int shift = 0;
+  do {
+    b = data[p++];
+    d |= (size_t)(b&0x7F) << shift;
+    shift += 7;
+  } while (b&0x80);
+  *delta = d;
+  *pos = p;
+  return tk;
+}
+
+/// For a string that was too long to fit in 'token', lex it again from the source to get its whole value
+static NO_INLINE JsVar *jslGetLongCachedString(JsLex *lex, size_t start) {
+  JsLex strLex;
+  jslInit(&strLex, lex->sourceVar);
+  jslSeekTo(&strLex, start);
+  JsVar *value = strLex.tokenValue ? jsvLockAgain(strLex.tokenValue) : 0;
+  jslKill(&strLex);
+  return value;
+}
+
+/// Replay the next token from the token cache
+static void jslGetNextCachedToken(JsLex *lex) {
+  const unsigned char *data = lex->tokenCacheData;
+  size_t tokenPos = lex->tokenCachePos;
+  size_t p = tokenPos;
+  size_t delta;
+  lex->tokenl = 0;
+  if (lex->tokenValue) {
+    jsvUnLock(lex->tokenValue);
+    lex->tokenValue = 0;
+  }
+  size_t lastStart = jsvStringIteratorGetIndex(&lex->tokenStart.it) - 1;
+  lex->tokenLastStart = lastStart;
+  lex->tk = jslTokenCacheDecode(data, &p, &delta);
+  size_t start = lastStart + delta;
+  if (jslTokenHasValue(lex->tk)) {
+    unsigned char l = data[p++];
+    lex->tokenl = l & (unsigned char)~JSL_TC_TRUNCATED;
+    memcpy(lex->token, &data[p], lex->tokenl);
+    p += lex->tokenl;
+    if (l & JSL_TC_TRUNCATED)
+      lex->tokenValue = jslGetLongCachedString(lex, start);
+  }
+  if (jslTokenIsLast(lex->tk)) {
+    // we stay on the last token, so don't move on if we're already there
+    if (lex->tokenStart.tokenCachePos == tokenPos+1) start = lastStart;
+  } else
+    lex->tokenCachePos = p;
+  lex->tokenStart.it.var = 0;
+  lex->tokenStart.it.varIndex = start+1; // +1 as the iterator is normally one char ahead of the token
+  lex->tokenStart.it.charIdx = 0;
+  lex->tokenStart.it.charsInVar = 0;
+  lex->tokenStart.currCh = 0;
+  lex->tokenStart.tokenCachePos = tokenPos+1;
+}
+
+/** Find the cached token that starts at character 'start' (or the next token after
+ * it if there isn't one). Returns its position and sets tokenStart to its actual start */
+static size_t jslFindCachedToken(JsLex *lex, size_t start, size_t *tokenStart) {
+  const unsigned char *data = lex->tokenCacheData;
+  size_t pos = JSL_TC_HEADER;
+  size_t s = 0;
+  while (true) {
+    size_t p = pos;
+    size_t delta;
+    short tk = jslTokenCacheDecode(data, &p, &delta);
+    s += delta;
+    if (s>=start || jslTokenIsLast(tk)) break;
+    if (jslTokenHasValue(tk))
+      p += 1 + (data[p] & (unsigned char)~JSL_TC_TRUNCATED);
+    pos = p;
+  }
+  *tokenStart = s;
+  return pos;
+}
+
+/// Make the cached token at 'pos', which starts at character 'start', the current token
+static void jslSeekToCachedToken(JsLex *lex, size_t pos, size_t start) {
+  size_t p = pos;
+  size_t delta;
+  jslTokenCacheDecode(lex->tokenCacheData, &p, &delta);
+  lex->tokenCachePos = pos;
+  lex->tokenStart.it.varIndex = start + 1 - delta; // so jslGetNextCachedToken gets the right start
+  lex->tokenStart.it.charIdx = 0;
+  lex->tokenStart.tokenCachePos = 0;
+  jslGetNextCachedToken(lex);
+}
+
+bool jslSetTokenCache(JsLex *lex, JsVar *tokenCache) {
+  if (lex->tokenCache || !jslIsTokenCacheFor(tokenCache, lex->sourceVar)) return false;
+  lex->tokenCache = jsvLockAgain(tokenCache);
+  lex->tokenCacheData = (const unsigned char*)jsvGetFlatStringPointer(tokenCache);
+  // find the token we're currently on
+  size_t start;
+  size_t pos = jslFindCachedToken(lex, jsvStringIteratorGetIndex(&lex->tokenStart.it) - 1, &start);
+  size_t p = pos;
+  size_t delta;
+  short tk = jslTokenCacheDecode(lex->tokenCacheData, &p, &delta);
+  if (tk != lex->tk || start != jsvStringIteratorGetIndex(&lex->tokenStart.it) - 1) {
+    // shouldn't happen, but if it does we can carry on lexing characters
+    jsvUnLock(lex->tokenCache);
+    lex->tokenCache = 0;
+    return false;
+  }
+  if (jslTokenHasValue(tk))
+    p += 1 + (lex->tokenCacheData[p] & (unsigned char)~JSL_TC_TRUNCATED);
+  if (!jslTokenIsLast(tk)) lex->tokenCachePos = p;
+  else lex->tokenCachePos = pos;
+  // we don't need to lex characters any more
+  if (lex->it.var) jsvLockAgain(lex->it.var); // see jslGetNextCh
+  jsvStringIteratorFree(&lex->it);
+  lex->it.var = 0;
+  lex->tokenStart.it.var = 0;
+  lex->tokenStart.it.varIndex = start+1;
+  lex->tokenStart.it.charIdx = 0;
+  lex->tokenStart.it.charsInVar = 0;
+  lex->tokenStart.currCh = 0;
+  lex->tokenStart.tokenCachePos = pos+1;
+  return true;
+}
+#endif
+
 /// Return the line number at the current character position (this isn't fast as it searches the string)
 unsigned int jslGetLineNumber(struct JsLex *lex) {
   size_t line;
@@ -88,6 +88,9 @@ typedef enum LEX_TYPES {
 typedef struct JslCharPos {
   JsvStringIterator it;
   char currCh;
+#ifdef JSLEX_TOKEN_CACHE
+  size_t tokenCachePos; ///< If nonzero, 1 + the offset of this token in JsLex.tokenCache (it.var will be 0)
+#endif
 } JslCharPos;
 
 void jslCharPosFree(JslCharPos *pos);
@@ -117,6 +120,14 @@ typedef struct JsLex
    */
   JsVar *sourceVar; // the actual string var
   JsvStringIterator it; // Iterator for the string
+#ifdef JSLEX_TOKEN_CACHE
+  /* If set, we're not lexing characters from sourceVar but replaying
+   * tokens that were pre-lexed with jslNewTokenCache. 'it' is unused
+   * and tokenStart only holds the character index (see jslGetNextCachedToken) */
+  JsVar *tokenCache; ///< Flat string of pre-lexed tokens for sourceVar
+  const unsigned char *tokenCacheData; ///< Pointer to the data in tokenCache
+  size_t tokenCachePos; ///< Offset in tokenCacheData of the next token to read
+#endif
 } JsLex;
 
 void jslInit(JsLex *lex, JsVar *var);
@@ -136,8 +147,18 @@ bool jslIsIDOrReservedWord(JsLex *lex);
 // Only for more 'internal' use
 void jslSeek(JsLex *lex, JslCharPos seekToChar); // like jslSeekTo, but doesn't pre-fill characters
 void jslGetNextToken(JsLex *lex); ///< Get the text token from our text string
-
-JsVar *jslNewFromLexer(JslCharPos *charFrom, size_t charTo); // Create a new STRING from part of the lexer
+unsigned int jslGetTokenCount(); ///< Get how many tokens have been lexed since we started - for benchmarking
+
+JsVar *jslNewFromLexer(JsLex *lex, JslCharPos *charFrom, size_t charTo); // Create a new STRING from part of the lexer
+
+#ifdef JSLEX_TOKEN_CACHE
+/// Lex all of the given string and return a flat string of tokens that can be replayed with jslSetTokenCache (or 0 if it can't be made)
+JsVar *jslNewTokenCache(JsVar *source);
+/// Is the given token cache (from jslNewTokenCache) still valid for the given source string?
+bool jslIsTokenCacheFor(JsVar *tokenCache, JsVar *source);
+/// Make the lexer replay tokens from the given token cache from the current token onwards. Returns false if this wasn't possible
+bool jslSetTokenCache(JsLex *lex, JsVar *tokenCache);
+#endif
 
 /// Return the line number at the current character position (this isn't fast as it searches the string)
 unsigned int jslGetLineNumber(struct JsLex *lex);
@@ -15,6 +15,7 @@
 #include "jsinteractive.h"
 #include "jswrapper.h"
 #include "jsnative.h"
+#include "jsprofile.h"
 #include "jswrap_object.h" // for function_replacewith
 #include "jswrap_functions.h" // insane check for eval in jspeFunctionCall
 #include "jswrap_json.h" // for jsfPrintJSON
@@ -388,7 +389,7 @@ NO_INLINE JsVar *jspeFunctionDefinition(bool parseNamedFunction) {
   // Then create var and set
   if (actuallyCreateFunction) {
     // code var
-    JsVar *funcCodeVar = jslNewFromLexer(&funcBegin, (size_t)(execInfo.lex->tokenLastStart+1));
+    JsVar *funcCodeVar = jslNewFromLexer(execInfo.lex, &funcBegin, (size_t)(execInfo.lex->tokenLastStart+1));
     jsvUnLock2(jsvAddNamedChild(funcVar, funcCodeVar, JSPARSE_FUNCTION_CODE_NAME), funcCodeVar);
     // scope var
     JsVar *funcScopeVar = jspeiGetScopesAsVar();
@@ -547,6 +548,13 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
 
       if (nativePtr) {
+#ifdef JSPARSE_PROFILER
+        if (jsprofRunning) {
+          JsSysTime startTime = jshGetSystemTime();
+          returnVar = jsnCallFunction(nativePtr, function->varData.native.argTypes, thisVar, argPtr, argCount);
+          jsprofNativeCall(nativePtr, jshGetSystemTime() - startTime);
+        } else
+#endif
         returnVar = jsnCallFunction(nativePtr, function->varData.native.argTypes, thisVar, argPtr, argCount);
       } else {
         assert(0); // in case something went horribly wrong
@@ -573,6 +581,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
       JsVar *functionScope = 0;
       JsVar *functionCode = 0;
+#ifdef JSLEX_TOKEN_CACHE
+      JsVar *functionTokens = 0;
+#endif
       JsVar *functionInternalName = 0;
       uint16_t functionLineNumber = 0;
 
@@ -660,6 +671,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_NAME_NAME)) functionInternalName = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_THIS_NAME)) thisVar = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_LINENUMBER_NAME)) functionLineNumber = (uint16_t)jsvGetIntegerAndUnLock(jsvSkipName(param));
+#ifdef JSLEX_TOKEN_CACHE
+          else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_TOKENS_NAME)) functionTokens = jsvSkipName(param);
+#endif
           else if (jsvIsFunctionParameter(param)) {
             JsVar *paramName = jsvCopy(param);
             // paramName is already a name (it's a function parameter)
@@ -734,6 +748,22 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
             JsLex newLex;
             jslInit(&newLex, functionCode);
             newLex.lineNumberOffset = functionLineNumber;
+#ifdef JSLEX_TOKEN_CACHE
+            // Lex the function's code once, and then just replay the tokens on each call
+            if (!functionTokens || !jslSetTokenCache(&newLex, functionTokens)) {
+              jsvUnLock(functionTokens);
+              functionTokens = jslNewTokenCache(functionCode);
+              if (functionTokens) {
+                jsvObjectSetChild(function, JSPARSE_FUNCTION_TOKENS_NAME, functionTokens);
+                jslSetTokenCache(&newLex, functionTokens);
+              }
+            }
+            jsvUnLock(functionTokens);
+            functionTokens = 0;
+#endif
+            // newLex has its own lock on the code - don't keep another while the function runs, as it limits how deep we can recurse
+            jsvUnLock(functionCode);
+            functionCode = 0;
 
             oldLex = execInfo.lex;
             execInfo.lex = &newLex;
@@ -799,6 +829,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
         execInfo.scopeCount = oldScopeCount;
       }
       jsvUnLock(functionCode);
+#ifdef JSLEX_TOKEN_CACHE
+      jsvUnLock(functionTokens);
+#endif
 
       /* get the real return var before we remove it from our function */
       returnVar = jsvSkipNameAndUnLock(returnVarName);
@@ -979,6 +1012,87 @@ JsVar *jspCallNamedFunction(JsVar *object, char* name, int argCount, JsVar **arg
   return r;
 }
 
+#ifdef JSPARSE_INLINE_CACHE
+/* Inline caches for `a.b` in the code. For each place in the code (the
+ * source string and the position of the field name in it) we remember
+ * which built-in function was found on what type of object, so next time
+ * we don't need to search the prototype chain and the built-in symbol
+ * tables. The object's own fields are still checked each time, and entries
+ * are only used if jsvPrototypeVersion hasn't changed since. Objects
+ * aren't cached, as what they inherit depends on their __proto__ */
+#define JSPARSE_INLINE_CACHE_SIZE 256 ///< Must be a power of 2
+#define JSPARSE_INLINE_CACHE_NAME_LEN 16
+
+typedef struct {
+  JsVarRef source; ///< The code string that the lookup was in
+  size_t tokenPos; ///< The position of the field name in 'source'
+  unsigned int version; ///< jsvPrototypeVersion when this was filled in
+  JsVarFlags objectType; ///< What type of object the field was on (see jspGetInlineCacheType)
+  void (*objectPtr)(void); ///< If the object was a native function, its pointer
+  char name[JSPARSE_INLINE_CACHE_NAME_LEN]; ///< The field's name
+  void (*ptr)(void); ///< The built-in function that was found (or 0 if this entry is unused)
+  uint16_t argTypes; ///< The argument types of 'ptr'
+} JspInlineCache;
+
+static JspInlineCache jspInlineCaches[JSPARSE_INLINE_CACHE_SIZE];
+
+/// Get the type of object for the inline cache - or return 0 if it can't be cached
+static JsVarFlags jspGetInlineCacheType(JsVar *object) {
+  if (jsvIsObject(object)) return 0;
+  if (jsvIsString(object)) return JSV_STRING_0; // strings of all lengths are the same
+  if (jsvIsArrayBuffer(object)) // ArrayBuffers and their views have different functions
+    return object->varData.arraybuffer.type==ARRAYBUFFERVIEW_ARRAYBUFFER ? JSV_ARRAYBUFFER : (JSV_ARRAYBUFFER|JSV_NATIVE);
+  return (JsVarFlags)(object->flags & (JSV_VARTYPEMASK|JSV_NATIVE));
+}
+
+/// Like jspGetNamedField(object, name, true), but uses the inline cache for the current token
+static JsVar *jspGetNamedFieldCached(JsVar *object, const char *name) {
+  JsVarFlags objectType = jspGetInlineCacheType(object);
+  if (!objectType || strlen(name) >= JSPARSE_INLINE_CACHE_NAME_LEN)
+    return jspGetNamedField(object, name, true);
+  void (*objectPtr)(void) = jsvIsNativeFunction(object) ? object->varData.native.ptr : 0;
+  JsVarRef source = jsvGetRef(execInfo.lex->sourceVar);
+  size_t tokenPos = jsvStringIteratorGetIndex(&execInfo.lex->tokenStart.it)-1;
+  JspInlineCache *ic = &jspInlineCaches[(source*31 + tokenPos) & (JSPARSE_INLINE_CACHE_SIZE-1)];
+
+  if (ic->ptr && ic->source==source && ic->tokenPos==tokenPos &&
+      ic->version==jsvPrototypeVersion && ic->objectType==objectType &&
+      ic->objectPtr==objectPtr && strcmp(ic->name, name)==0) {
+    // It could still have been overridden on the object itself
+    JsVar *child = jsvHasChildren(object) ? jsvFindChildFromString(object, name, false) : 0;
+    if (child) return child;
+    // Otherwise do what jspGetNamedFieldInParents would have done
+    JsVar *fn = jsvNewNativeFunction(ic->ptr, ic->argTypes);
+    if (!fn) return 0; // out of memory
+    JsVar *nameVar = jsvNewFromString(name);
+    child = jsvCreateNewChild(object, nameVar, fn);
+    jsvUnLock2(nameVar, fn);
+    return child;
+  }
+
+  unsigned int version = jsvPrototypeVersion;
+  JsVar *child = jspGetNamedField(object, name, true);
+  /* If we found a built-in, we'll have a new name pointing to a new
+   * native function, which nothing else references. Anything in the
+   * object or its prototypes would be referenced by them too */
+  if (child && jsvIsNewChild(child) && version==jsvPrototypeVersion) {
+    JsVar *fn = jsvSkipName(child);
+    if (jsvIsNativeFunction(fn) && jsvGetRefs(fn)==1 && !jsvGetFirstChild(fn)) {
+      ic->source = source;
+      ic->tokenPos = tokenPos;
+      ic->version = version;
+      ic->objectType = objectType;
+      ic->objectPtr = objectPtr;
+      strcpy(ic->name, name);
+      ic->ptr = fn->varData.native.ptr;
+      ic->argTypes = fn->varData.native.argTypes;
+    }
+    jsvUnLock(fn);
+  }
+  return child;
+}
+#endif
+
 NO_INLINE JsVar *jspeFactorMember(JsVar *a, JsVar **parentResult) {
   /* The parent if we're executing a method call */
   JsVar *parent = 0;
@@ -993,7 +1107,11 @@ NO_INLINE JsVar *jspeFactorMember(JsVar *a, JsVar **parentResult) {
         JsVar *aVar = jsvSkipName(a);
         JsVar *child = 0;
         if (aVar)
+#ifdef JSPARSE_INLINE_CACHE
+          child = jspGetNamedFieldCached(aVar, name);
+#else
           child = jspGetNamedField(aVar, name, true);
+#endif
         if (!child) {
           if (jsvHasChildren(aVar)) {
             // if no child found, create a pointer to where it could be
@@ -1809,6 +1927,19 @@ NO_INLINE JsVar *jspeStatementSwitch() {
   return 0;
 }
 
+#ifdef JSLEX_TOKEN_CACHE
+/** Loops seek back and re-parse their bodies on every iteration, so if
+ * we're executing one, make sure we're replaying pre-lexed tokens */
+static void jspEnsureTokenCache() {
+  if (!JSP_SHOULD_EXECUTE || execInfo.lex->tokenCache) return;
+  JsVar *tokens = jslNewTokenCache(execInfo.lex->sourceVar);
+  if (tokens) {
+    jslSetTokenCache(execInfo.lex, tokens);
+    jsvUnLock(tokens);
+  }
+}
+#endif
+
 NO_INLINE JsVar *jspeStatementDoOrWhile(bool isWhile) {
 #ifdef JSPARSE_MAX_LOOP_ITERATIONS
   int loopCount = JSPARSE_MAX_LOOP_ITERATIONS;
@@ -1817,8 +1948,10 @@ NO_INLINE JsVar *jspeStatementDoOrWhile(bool isWhile) {
   bool loopCond = true; // true for do...while loops
   bool hasHadBreak = false;
   JslCharPos whileCondStart;
+#ifdef JSLEX_TOKEN_CACHE
+  jspEnsureTokenCache();
+#endif
   // We do repetition by pulling out the string representing our statement
-  // there's definitely some opportunity for optimisation here
   JSP_ASSERT_MATCH(isWhile ? LEX_R_WHILE : LEX_R_DO);
   bool wasInLoop = (execInfo.execute&EXEC_IN_LOOP)!=0;
   if (isWhile) { // while loop
@@ -1894,6 +2027,9 @@ NO_INLINE JsVar *jspeStatementDoOrWhile(bool isWhile) {
 }
 
 NO_INLINE JsVar *jspeStatementFor() {
+#ifdef JSLEX_TOKEN_CACHE
+  jspEnsureTokenCache();
+#endif
   JSP_ASSERT_MATCH(LEX_R_FOR);
   JSP_MATCH('(');
   bool wasInLoop = (execInfo.execute&EXEC_IN_LOOP)!=0;
@@ -2217,6 +2353,10 @@ NO_INLINE JsVar *jspeStatementFunctionDecl() {
 }
 
 NO_INLINE JsVar *jspeStatement() {
+#ifdef JSPARSE_PROFILER
+  if (jsprofSamplePending && JSP_SHOULD_EXECUTE)
+    jsprofSample(execInfo.lex);
+#endif
 #ifdef USE_DEBUGGER
   if (execInfo.execute&EXEC_DEBUGGER_NEXT_LINE &&
       execInfo.lex->tk!=';' &&
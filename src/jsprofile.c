@@ -0,0 +1,244 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Profiler - samples which line of code is running, and times calls to
+ * built-in functions
+ * ----------------------------------------------------------------------------
+ */
+#include "jsprofile.h"
+#include "jshardware.h"
+#include "jswrapper.h"
+
+#ifdef JSPARSE_PROFILER
+
+#if defined(LINUX) && !defined(__MINGW32__)
+#include <signal.h>
+#include <sys/time.h>
+#define JSPROF_USE_ITIMER
+#endif
+
+#ifdef RESIZABLE_JSVARS
+#define JSPROF_LINES 512
+#define JSPROF_FUNCTIONS 256 // must be a power of 2
+#else
+#define JSPROF_LINES 32
+#define JSPROF_FUNCTIONS 16 // must be a power of 2
+#endif
+#define JSPROF_CODE_LENGTH 24 // how much of each line's code we remember
+#define JSPROF_SAMPLE_INTERVAL 10000 // microseconds between samples when we have our own timer
+
+/// A line of code that we took samples on
+typedef struct {
+  unsigned int line; ///< 1-based line number (relative to the function it's in if the code had no line numbers)
+  unsigned int samples; ///< How many samples were taken on this line
+  char code[JSPROF_CODE_LENGTH]; ///< The start of the code on the line (not 0-terminated if it's full)
+} JsprofLine;
+
+/// A native function that was called
+typedef struct {
+  void *function; ///< The native function, or 0 if this entry isn't used
+  unsigned int calls; ///< How many times it was called
+  JsSysTime time; ///< Total time spent in it
+} JsprofFunction;
+
+/// Everything we store while profiling - this goes in a flat string
+typedef struct {
+  JsSysTime startTime; ///< When profiling started
+  unsigned int samples; ///< Total samples (some may not be in 'lines' if it filled up)
+  unsigned int lineCount; ///< Number of used entries in 'lines'
+  JsprofLine lines[JSPROF_LINES];
+  JsprofFunction functions[JSPROF_FUNCTIONS]; ///< Hash table, indexed by the function pointer
+} JsprofData;
+
+volatile bool jsprofSamplePending = false;
+bool jsprofRunning = false;
+static JsVar *jsprofDataVar = 0; ///< The flat string that jsprofData is in
+static JsprofData *jsprofData = 0;
+
+#ifdef JSPROF_USE_ITIMER
+static void jsprofSignalHandler(int sig) {
+  NOT_USED(sig);
+  jsprofTick();
+}
+
+/// On Linux there's no SysTick, so we use a timer that sends us SIGPROF
+static void jsprofSetTimer(bool enabled) {
+  if (enabled) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = jsprofSignalHandler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+  }
+  struct itimerval t;
+  t.it_interval.tv_sec = 0;
+  t.it_interval.tv_usec = enabled ? JSPROF_SAMPLE_INTERVAL : 0;
+  t.it_value = t.it_interval;
+  setitimer(ITIMER_PROF, &t, NULL);
+}
+#endif
+
+bool jsprofStart() {
+  jsprofStop();
+  JsVar *data = jsvNewFlatStringOfLength((unsigned int)sizeof(JsprofData));
+  if (!data) return false;
+  jsprofDataVar = data;
+  jsprofData = (JsprofData*)jsvGetFlatStringPointer(data); // already zeroed
+  jsprofData->startTime = jshGetSystemTime();
+  jsprofSamplePending = false;
+  jsprofRunning = true;
+#ifdef JSPROF_USE_ITIMER
+  jsprofSetTimer(true);
+#endif
+  return true;
+}
+
+void jsprofStop() {
+  if (!jsprofDataVar) return;
+  jsprofRunning = false;
+#ifdef JSPROF_USE_ITIMER
+  jsprofSetTimer(false);
+#endif
+  jsprofSamplePending = false;
+  jsvUnLock(jsprofDataVar);
+  jsprofDataVar = 0;
+  jsprofData = 0;
+}
+
+void jsprofTick() {
+  if (jsprofRunning) jsprofSamplePending = true;
+}
+
+/// Copy the start of the code on the line beginning at lineStart (skipping indentation)
+static void jsprofGetCode(JsVar *source, size_t lineStart, char *code) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, source, lineStart);
+  while (jsvStringIteratorHasChar(&it) && isWhitespace(jsvStringIteratorGetChar(&it)) &&
+         jsvStringIteratorGetChar(&it)!='\n')
+    jsvStringIteratorNext(&it);
+  size_t i = 0;
+  while (i<JSPROF_CODE_LENGTH && jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    if (ch=='\n' || ch=='\r') break;
+    code[i++] = ch;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  if (i<JSPROF_CODE_LENGTH) memset(&code[i], 0, JSPROF_CODE_LENGTH-i);
+}
+
+void jsprofSample(JsLex *lex) {
+  jsprofSamplePending = false;
+  if (!jsprofData || !jsvIsString(lex->sourceVar)) return;
+  jsprofData->samples++;
+  // like the debugger, use the start of the token we're on (this works with the token cache too)
+  size_t pos = jsvStringIteratorGetIndex(&lex->tokenStart.it) - 1;
+  size_t line, col;
+  jsvGetLineAndCol(lex->sourceVar, pos, &line, &col);
+  char code[JSPROF_CODE_LENGTH];
+  jsprofGetCode(lex->sourceVar, pos+1-col, code);
+  if (lex->lineNumberOffset)
+    line += lex->lineNumberOffset - 1;
+  // Lines with the most samples are sorted to the front by jsprofGetProfile, so this is normally quick
+  unsigned int i;
+  for (i=0;i<jsprofData->lineCount;i++) {
+    JsprofLine *l = &jsprofData->lines[i];
+    if (l->line==line && !memcmp(l->code, code, JSPROF_CODE_LENGTH)) {
+      l->samples++;
+      return;
+    }
+  }
+  if (jsprofData->lineCount < JSPROF_LINES) {
+    JsprofLine *l = &jsprofData->lines[jsprofData->lineCount++];
+    l->line = (unsigned int)line;
+    l->samples = 1;
+    memcpy(l->code, code, JSPROF_CODE_LENGTH);
+  }
+}
+
+void jsprofNativeCall(void *function, JsSysTime time) {
+  if (!jsprofData) return;
+  unsigned int idx = (unsigned int)((size_t)function >> 2) & (JSPROF_FUNCTIONS-1);
+  unsigned int n;
+  for (n=0;n<JSPROF_FUNCTIONS;n++) {
+    JsprofFunction *f = &jsprofData->functions[idx];
+    if (f->function==function || !f->function) {
+      f->function = function;
+      f->calls++;
+      f->time += time;
+      return;
+    }
+    idx = (idx+1) & (JSPROF_FUNCTIONS-1);
+  }
+  // table full - just don't record it
+}
+
+JsVar *jsprofGetProfile() {
+  if (!jsprofData) return 0;
+  JsVar *profile = jsvNewWithFlags(JSV_OBJECT);
+  if (!profile) return 0;
+  jsvObjectSetChildAndUnLock(profile, "time", jsvNewFromFloat(jshGetMillisecondsFromTime(jshGetSystemTime() - jsprofData->startTime)/1000));
+  jsvObjectSetChildAndUnLock(profile, "samples", jsvNewFromInteger((JsVarInt)jsprofData->samples));
+
+  // Sort the lines so the ones with the most samples come first
+  unsigned int i, j;
+  for (i=1;i<jsprofData->lineCount;i++) {
+    JsprofLine l = jsprofData->lines[i];
+    for (j=i;j>0 && jsprofData->lines[j-1].samples < l.samples;j--)
+      jsprofData->lines[j] = jsprofData->lines[j-1];
+    jsprofData->lines[j] = l;
+  }
+  JsVar *lines = jsvNewWithFlags(JSV_ARRAY);
+  for (i=0;lines && i<jsprofData->lineCount;i++) {
+    JsprofLine *l = &jsprofData->lines[i];
+    JsVar *o = jsvNewWithFlags(JSV_OBJECT);
+    if (!o) break;
+    jsvObjectSetChildAndUnLock(o, "line", jsvNewFromInteger((JsVarInt)l->line));
+    size_t len = 0;
+    while (len<JSPROF_CODE_LENGTH && l->code[len]) len++;
+    JsVar *code = jsvNewFromEmptyString();
+    if (code) jsvAppendStringBuf(code, l->code, len);
+    jsvObjectSetChildAndUnLock(o, "code", code);
+    jsvObjectSetChildAndUnLock(o, "samples", jsvNewFromInteger((JsVarInt)l->samples));
+    jsvArrayPushAndUnLock(lines, o);
+  }
+  jsvObjectSetChildAndUnLock(profile, "lines", lines);
+
+  // The function table is hashed, so sort a list of indices into it, with the most time first
+  unsigned short *order = (unsigned short*)alloca(sizeof(unsigned short)*JSPROF_FUNCTIONS);
+  unsigned int count = 0;
+  for (i=0;i<JSPROF_FUNCTIONS;i++) {
+    if (!jsprofData->functions[i].function) continue;
+    JsSysTime t = jsprofData->functions[i].time;
+    for (j=count;j>0 && jsprofData->functions[order[j-1]].time < t;j--)
+      order[j] = order[j-1];
+    order[j] = (unsigned short)i;
+    count++;
+  }
+  JsVar *functions = jsvNewWithFlags(JSV_ARRAY);
+  for (i=0;functions && i<count;i++) {
+    JsprofFunction *f = &jsprofData->functions[order[i]];
+    JsVar *o = jsvNewWithFlags(JSV_OBJECT);
+    if (!o) break;
+    const char *className, *name;
+    if (jswGetBuiltInFunctionName(f->function, &className, &name))
+      jsvObjectSetChildAndUnLock(o, "name", className ? jsvVarPrintf("%s.%s", className, name) : jsvNewFromString(name));
+    else
+      jsvObjectSetChildAndUnLock(o, "name", jsvNewFromString("?"));
+    jsvObjectSetChildAndUnLock(o, "calls", jsvNewFromInteger((JsVarInt)f->calls));
+    jsvObjectSetChildAndUnLock(o, "time", jsvNewFromFloat(jshGetMillisecondsFromTime(f->time)/1000));
+    jsvArrayPushAndUnLock(functions, o);
+  }
+  jsvObjectSetChildAndUnLock(profile, "functions", functions);
+  return profile;
+}
+
+#endif // JSPARSE_PROFILER
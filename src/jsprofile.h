@@ -0,0 +1,45 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Profiler - samples which line of code is running, and times calls to
+ * built-in functions
+ * ----------------------------------------------------------------------------
+ */
+#ifndef JSPROFILE_H_
+#define JSPROFILE_H_
+
+#include "jsutils.h"
+#include "jsvar.h"
+#include "jslex.h"
+
+#ifdef JSPARSE_PROFILER
+
+/// Set by jsprofTick when it's time to take a sample - the parser then calls jsprofSample
+extern volatile bool jsprofSamplePending;
+/// Whether we're profiling or not
+extern bool jsprofRunning;
+
+/// Clear any profile we have and start profiling. Returns false if there wasn't enough memory
+bool jsprofStart();
+/// Stop profiling, and free the memory that was used for it
+void jsprofStop();
+/** Called from a timer interrupt or signal (eg. SysTick) - this doesn't record anything
+ * itself, but asks the parser to call jsprofSample at the next statement */
+void jsprofTick();
+/// Record a sample of what code the lexer is at now (called by the parser when jsprofSamplePending is set)
+void jsprofSample(JsLex *lex);
+/// Record a call to a native function that took the given amount of time
+void jsprofNativeCall(void *function, JsSysTime time);
+/// Return an object describing the profile so far, or undefined if not profiling
+JsVar *jsprofGetProfile();
+
+#endif // JSPARSE_PROFILER
+
+#endif /* JSPROFILE_H_ */
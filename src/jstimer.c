@@ -33,10 +33,10 @@ static void jstUtilTimerSetupBuffer(UtilTimerTask *task) {
   task->data.buffer.var = _jsvGetAddressOf(task->data.buffer.currentBuffer);
   if (jsvIsFlatString(task->data.buffer.var)) {
     task->data.buffer.charIdx = sizeof(JsVar);
-    task->data.buffer.endIdx =  (unsigned short)(sizeof(JsVar) + jsvGetCharactersInVar(task->data.buffer.var));
+    task->data.buffer.endIdx =  (JsVarArrayBufferIdx)(sizeof(JsVar) + jsvGetCharactersInVar(task->data.buffer.var));
   } else {
     task->data.buffer.charIdx = 0;
-    task->data.buffer.endIdx = (unsigned short)jsvGetCharactersInVar(task->data.buffer.var);
+    task->data.buffer.endIdx = (JsVarArrayBufferIdx)jsvGetCharactersInVar(task->data.buffer.var);
   }
 }
 
@@ -44,7 +44,7 @@ static void jstUtilTimerInterruptHandlerNextByte(UtilTimerTask *task) {
   // move to next element in var
   task->data.buffer.charIdx++;
   if (task->data.buffer.charIdx >= task->data.buffer.endIdx) {
-    task->data.buffer.charIdx = (unsigned short)(task->data.buffer.charIdx - task->data.buffer.endIdx);
+    task->data.buffer.charIdx = (JsVarArrayBufferIdx)(task->data.buffer.charIdx - task->data.buffer.endIdx);
     /* NOTE: We don't Lock/UnLock here. We assume that the string has already been
      * referenced elsewhere (in the Waveform class) so won't get freed. Why? Because
      * we can't lock easily. We could get an IRQ right as some other code was in the
@@ -52,7 +52,7 @@ static void jstUtilTimerInterruptHandlerNextByte(UtilTimerTask *task) {
      * out of sync. */
     if (jsvGetLastChild(task->data.buffer.var)) {
       task->data.buffer.var = _jsvGetAddressOf(jsvGetLastChild(task->data.buffer.var));
-      task->data.buffer.endIdx = (unsigned short)jsvGetCharactersInVar(task->data.buffer.var);
+      task->data.buffer.endIdx = (JsVarArrayBufferIdx)jsvGetCharactersInVar(task->data.buffer.var);
     } else { // else no more... move on to the next
       if (task->data.buffer.nextBuffer) {
         // flip buffers
@@ -66,8 +66,8 @@ typedef struct UtilTimerTaskBuffer {
   JsVarRef currentBuffer; ///< The current buffer we're reading from (or 0)
   JsVarRef nextBuffer; ///< Subsequent buffer to read from (or 0)
   unsigned short currentValue; ///< current value being written (for writes)
-  unsigned short charIdx; ///< Index of character in variable
-  unsigned short endIdx; ///< Final index before we skip to the next var
+  JsVarArrayBufferIdx charIdx; ///< Index of character in variable
+  JsVarArrayBufferIdx endIdx; ///< Final index before we skip to the next var
   union {
     JshPinFunction pinFunction; ///< Pin function to write to
     Pin pin; ///< Pin to read from
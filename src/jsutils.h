@@ -135,6 +135,10 @@ extern int isfinite ( double );
 #define JSVAR_DATA_STRING_LEN  4
 #endif
 #define JSVAR_DATA_STRING_MAX_LEN (JSVAR_DATA_STRING_LEN+(3*JSVARREF_SIZE)+JSVARREF_SIZE) // (JSVAR_DATA_STRING_LEN + sizeof(JsVarRef)*3 + sizeof(JsVarRefCounter))
+#if defined(RESIZABLE_JSVARS) && JSVAR_DATA_STRING_LEN>=8
+// There's room in the data area for 32 bit ArrayBuffer offsets and lengths (see JsVarDataArrayBufferView)
+#define JSV_ARRAYBUFFER_WIDE
+#endif
 
 typedef int32_t JsVarInt;
 typedef uint32_t JsVarIntUnsigned;
@@ -149,6 +153,28 @@ typedef int64_t JsSysTime;
 #define JSSYSTIME_INVALID ((JsSysTime)-1)
 
 #define JSLEX_MAX_TOKEN_LENGTH  64
+#if defined(RESIZABLE_JSVARS) && !defined(SAVE_ON_FLASH)
+// Keep pre-lexed tokens for function and loop bodies so they don't get re-lexed each time they run
+#define JSLEX_TOKEN_CACHE
+// Remember which built-in function each `a.b` in the code found, so it doesn't have to be searched for each time
+#define JSPARSE_INLINE_CACHE
+// Garbage collect a bit at a time when idle, so big heaps don't stop timers from running
+#define JSVAR_INCREMENTAL_GC
+#endif
+#ifndef SAVE_ON_FLASH
+// Build hash indexes for objects with lots of children (like the root scope) so finding a child doesn't search every one
+#define JSVAR_HASH_INDEX
+// Keep an index of where the elements of big arrays are, so `a[i]` doesn't have to search the whole array
+#define JSVAR_ARRAY_INDEX
+// Keep timers in a heap sorted by when they run, so the idle loop doesn't have to check them all
+#define JSI_TIMER_HEAP
+// Allow sampling which lines of code are running and timing calls to built-in functions (see E.getProfile)
+#define JSPARSE_PROFILER
+// Remember where the end of strings we append to is, so appending isn't O(n)
+#define JSVAR_STRING_TAIL_CACHE
+// Keep an index of where the blocks of long strings are, so `s[i]` doesn't have to walk the whole string
+#define JSVAR_STRING_INDEX
+#endif
 #define JS_ERROR_BUF_SIZE 64 // size of buffer error messages are written into
 #define JS_ERROR_TOKEN_BUF_SIZE 16 // see jslTokenAsString
 
@@ -175,6 +201,7 @@ typedef int64_t JsSysTime;
 #define JSPARSE_FUNCTION_THIS_NAME JS_HIDDEN_CHAR_STR"ths" // the 'this' variable - for bound functions
 #define JSPARSE_FUNCTION_NAME_NAME JS_HIDDEN_CHAR_STR"nam" // for named functions (a = function foo() { foo(); })
 #define JSPARSE_FUNCTION_LINENUMBER_NAME JS_HIDDEN_CHAR_STR"lin" // The line number offset of the function
+#define JSPARSE_FUNCTION_TOKENS_NAME JS_HIDDEN_CHAR_STR"tok" // Pre-lexed tokens for the function's code (see jslNewTokenCache)
 #define JS_EVENT_PREFIX "#on"
 
 #define JSPARSE_EXCEPTION_VAR "except" // when exceptions are thrown, they're stored in the root scope
@@ -209,8 +236,10 @@ typedef int64_t JsSysTime;
 #define ALWAYS_INLINE
 #endif
 
-/// Maximum amount of locks we ever expect to have on a variable (this could limit recursion) must be 2^n-1
-#define JSV_LOCK_MAX  15
+/** Maximum amount of locks we ever expect to have on a variable (this could limit recursion) must be 2^n-1.
+ * Each level of a recursive call keeps a lock on the function's code, so this limits recursion depth
+ * to around 60. It must still fit in JsVarFlags after the variable type bits (see jsvar.h) */
+#define JSV_LOCK_MAX  63
 
 /// preprocessor power of 2 - suitable up to 16 bits
 #define NEXT_POWER_2(X) \
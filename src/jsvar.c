@@ -33,6 +33,10 @@
 #ifdef RESIZABLE_JSVARS
 JsVar **jsVarBlocks = 0;
 unsigned int jsVarsSize = 0;
+/* Each time we grow, the new blocks are allocated together (so flat strings can span
+ * them) - these are the pointers we got back from malloc, so we can free them */
+static JsVar **jsVarChunks = 0;
+static unsigned int jsVarChunkCount = 0;
 #define JSVAR_BLOCK_SIZE 1024
 #define JSVAR_BLOCK_SHIFT 10
 #else
@@ -41,6 +45,9 @@ unsigned int jsVarsSize = JSVAR_CACHE_SIZE;
 #endif
 
 JsVarRef jsVarFirstEmpty; ///< reference of first unused variable (variables are in a linked list)
+#ifdef JSPARSE_INLINE_CACHE
+unsigned int jsvPrototypeVersion = 0;
+#endif
 
 /** Return a pointer - UNSAFE for null refs.
  * This is effectively a Lock without locking! */
@@ -89,6 +96,59 @@ void jsvSetPrevSibling(JsVar *v, JsVarRef r) {
 #endif
 
 
+static JsvMemoryStats jsvMemoryStats;
+
+#ifdef JSVAR_STRING_TAIL_CACHE
+/** The last StringExt of strings we appended to recently, so appending doesn't have
+ * to walk the whole string to find the end each time. Strings only ever get longer,
+ * so even if more was appended since, the end can be found by walking on from 'tail'.
+ * Entries are removed when the string is freed. */
+typedef struct {
+  JsVarRef str; ///< The string (or 0 if not used)
+  JsVarRef tail; ///< A StringExt in the string
+  size_t tailIndex; ///< The index in the string of the first character in 'tail'
+} JsvStringTail;
+#define JSV_STRING_TAILS 4
+static JsvStringTail jsvStringTails[JSV_STRING_TAILS];
+static unsigned char jsvStringTailNext; ///< The entry to replace next
+
+/// If we know a StringExt in this (non-flat) string, return it (and its index)
+JsVarRef jsvStringTailGet(JsVarRef str, size_t *tailIndex) {
+  int i;
+  for (i=0;i<JSV_STRING_TAILS;i++) {
+    if (jsvStringTails[i].str == str) {
+      assert(jsvIsStringExt(jsvGetAddressOf(jsvStringTails[i].tail)));
+      *tailIndex = jsvStringTails[i].tailIndex;
+      return jsvStringTails[i].tail;
+    }
+  }
+  return 0;
+}
+
+/// Remember the StringExt at the end of a string
+void jsvStringTailSet(JsVarRef str, JsVarRef tail, size_t tailIndex) {
+  int i;
+  for (i=0;i<JSV_STRING_TAILS;i++) {
+    if (jsvStringTails[i].str == str) break;
+  }
+  if (i==JSV_STRING_TAILS) {
+    i = jsvStringTailNext;
+    jsvStringTailNext = (unsigned char)((jsvStringTailNext+1) % JSV_STRING_TAILS);
+  }
+  jsvStringTails[i].str = str;
+  jsvStringTails[i].tail = tail;
+  jsvStringTails[i].tailIndex = tailIndex;
+}
+
+/// Forget about a string's tail (because it's being freed)
+static void jsvStringTailDrop(JsVarRef str) {
+  int i;
+  for (i=0;i<JSV_STRING_TAILS;i++)
+    if (jsvStringTails[i].str == str)
+      jsvStringTails[i].str = 0;
+}
+#endif
+
 // For debugging/testing ONLY - maximum # of vars we are allowed to use
 void jsvSetMaxVarsUsed(unsigned int size) {
 #ifdef RESIZABLE_JSVARS
@@ -103,6 +163,7 @@ void jsvSetMaxVarsUsed(unsigned int size) {
 void jsvCreateEmptyVarList() {
   jsVarFirstEmpty = 0;
   JsVar *lastEmpty = 0;
+  unsigned int usage = 0;
   JsVarRef i;
   for (i=1;i<=jsVarsSize;i++) {
     JsVar *var = jsvGetAddressOf(i);
@@ -113,11 +174,19 @@ void jsvCreateEmptyVarList() {
       else
         jsVarFirstEmpty = i;
       lastEmpty = var;
-    } else if (jsvIsFlatString(var)) {
-      // skip over used blocks for flat strings
-      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    } else {
+      usage++;
+      if (jsvIsFlatString(var)) {
+        // skip over used blocks for flat strings
+        unsigned int b = (unsigned int)jsvGetFlatStringBlocks(var);
+        i = (JsVarRef)(i+b);
+        usage += b;
+      }
     }
   }
+  // we've counted them anyway, so make sure our statistics are right
+  jsvMemoryStats.usage = usage;
+  if (usage > jsvMemoryStats.peak) jsvMemoryStats.peak = usage;
 }
 
 /* Removes the empty variable counter, cleaving clear runs of 0s
@@ -138,11 +207,38 @@ void jsvClearEmptyVarList() {
   }
 }
 
+#ifdef JSVAR_INCREMENTAL_GC
+static void jsvGCAbort();
+static void jsvGCBarrier(JsVar *var);
+static void jsvGCSkipFlatString(JsVar *var);
+#endif
+
 void jsvSoftInit() {
+#ifdef JSVAR_INCREMENTAL_GC
+  jsvGCAbort();
+#endif
   jsvCreateEmptyVarList();
+#ifdef JSPARSE_INLINE_CACHE
+  jsvPrototypeVersion++; // we may have loaded completely different variables
+#endif
+#ifdef JSVAR_STRING_TAIL_CACHE
+  memset(jsvStringTails, 0, sizeof(jsvStringTails)); // ...so these refs mean nothing now
+#endif
 }
 
 void jsvSoftKill() {
+#ifdef JSVAR_INCREMENTAL_GC
+  jsvGCAbort(); // don't save half-collected variables
+#endif
+#ifdef JSVAR_HASH_INDEX
+  jsvFreeHashIndexes(); // don't save these
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+  jsvFreeArrayIndexes();
+#endif
+#ifdef JSVAR_STRING_INDEX
+  jsvFreeStringIndexes();
+#endif
   jsvClearEmptyVarList();
 }
 
@@ -166,17 +262,37 @@ void jsvInit() {
   jsVarsSize = JSVAR_BLOCK_SIZE;
   jsVarBlocks = malloc(sizeof(JsVar*)); // just 1
   jsVarBlocks[0] = malloc(sizeof(JsVar) * JSVAR_BLOCK_SIZE);
+  jsVarChunks = malloc(sizeof(JsVar*));
+  jsVarChunks[0] = jsVarBlocks[0];
+  jsVarChunkCount = 1;
 #endif
 
   jsVarFirstEmpty = jsvInitJsVars(1/*first*/, jsVarsSize);
+  jsvMemoryStats.allocations = 0;
+  jsvMemoryStats.peak = 0;
   jsvSoftInit();
 }
 
 void jsvKill() {
+#ifdef JSVAR_INCREMENTAL_GC
+  jsvGCAbort();
+#endif
+#ifdef JSVAR_HASH_INDEX
+  jsvFreeHashIndexes();
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+  jsvFreeArrayIndexes();
+#endif
+#ifdef JSVAR_STRING_INDEX
+  jsvFreeStringIndexes();
+#endif
 #ifdef RESIZABLE_JSVARS
   unsigned int i;
-  for (i=0;i<jsVarsSize>>JSVAR_BLOCK_SHIFT;i++)
-    free(jsVarBlocks[i]);
+  for (i=0;i<jsVarChunkCount;i++)
+    free(jsVarChunks[i]);
+  free(jsVarChunks);
+  jsVarChunks = 0;
+  jsVarChunkCount = 0;
   free(jsVarBlocks);
   jsVarBlocks = 0;
   jsVarsSize = 0;
@@ -212,34 +328,53 @@ unsigned int jsvGetMemoryUsage() {
   return usage;
 }
 
+/// Get statistics about how many variables have been allocated
+void jsvGetMemoryStats(JsvMemoryStats *stats) {
+  *stats = jsvMemoryStats;
+}
+
 /// Get total amount of memory records
 unsigned int jsvGetMemoryTotal() {
   return jsVarsSize;
 }
 
-/// Try and allocate more memory - only works if RESIZABLE_JSVARS is defined
-void jsvSetMemoryTotal(unsigned int jsNewVarCount) {
+/// Try and allocate more memory - only works if RESIZABLE_JSVARS is defined. Returns false if we couldn't
+bool jsvSetMemoryTotal(unsigned int jsNewVarCount) {
 #ifdef RESIZABLE_JSVARS
-  if (jsNewVarCount <= jsVarsSize) return; // never allow us to have less!
+  if (jsNewVarCount <= jsVarsSize) return false; // never allow us to have less!
+  if (jsNewVarCount > JSVARREF_MAX-JSVAR_BLOCK_SIZE) return false; // we couldn't refer to them
   // When resizing, we just allocate a bunch more
   unsigned int oldSize = jsVarsSize;
   unsigned int oldBlockCount = jsVarsSize >> JSVAR_BLOCK_SHIFT;
   unsigned int newBlockCount = (jsNewVarCount+JSVAR_BLOCK_SIZE-1) >> JSVAR_BLOCK_SHIFT;
+  // resize block table (it doesn't matter if it's bigger than we need, if what's next fails)
+  JsVar **blocks = realloc(jsVarBlocks, sizeof(JsVar*)*newBlockCount);
+  if (!blocks) return false;
+  jsVarBlocks = blocks;
+  JsVar **chunks = realloc(jsVarChunks, sizeof(JsVar*)*(jsVarChunkCount+1));
+  if (!chunks) return false;
+  jsVarChunks = chunks;
+  // allocate more blocks - all in one go, so they're contiguous
+  JsVar *chunk = malloc(sizeof(JsVar) * JSVAR_BLOCK_SIZE * (newBlockCount-oldBlockCount));
+  if (!chunk) return false;
+  jsVarChunks[jsVarChunkCount++] = chunk;
   jsVarsSize = newBlockCount << JSVAR_BLOCK_SHIFT;
-  // resize block table
-  jsVarBlocks = realloc(jsVarBlocks, sizeof(JsVar*)*newBlockCount);
-  // allocate more blocks
   unsigned int i;
   for (i=oldBlockCount;i<newBlockCount;i++)
-    jsVarBlocks[i] = malloc(sizeof(JsVar) * JSVAR_BLOCK_SIZE);
-  /** and now reset all the newly allocated vars. We know jsVarFirstEmpty
-   * is 0 (because jsiFreeMoreMemory returned 0) so we can just assign it.  */
-  assert(!jsVarFirstEmpty);
-  jsVarFirstEmpty = jsvInitJsVars(oldSize+1, jsVarsSize-oldSize);
+    jsVarBlocks[i] = &chunk[(i-oldBlockCount) * JSVAR_BLOCK_SIZE];
+  /** and now reset all the newly allocated vars. If jsVarFirstEmpty is 0
+   * (because jsiFreeMoreMemory returned 0) we can just assign it. */
+  JsVarRef newEmpty = jsvInitJsVars(oldSize+1, jsVarsSize-oldSize);
+  if (jsVarFirstEmpty)
+    jsvCreateEmptyVarList(); // we were asked for contiguous space (see jsvNewFlatStringOfLength) - link the new vars in
+  else
+    jsVarFirstEmpty = newEmpty;
   // jsiConsolePrintf("Resized memory from %d blocks to %d\n", oldBlockCount, newBlockCount);
+  return true;
 #else
   NOT_USED(jsNewVarCount);
   assert(0);
+  return false;
 #endif
 }
 
@@ -259,6 +394,506 @@ void jsvShowAllocated() {
   }
 }
 
+#ifdef JSVAR_HASH_INDEX
+/* Objects with lots of children (like the root scope) get a hash index so
+ * that jsvFindChildFrom* doesn't have to compare against every child name.
+ * Each index is a flat string of JsVarRefs to the object's string NAMEs
+ * (open addressing with linear probing, 0 = empty). Integer names aren't
+ * indexed as they never match a string. Indexes are built lazily when a
+ * search walks past JSV_HASH_INDEX_MIN_CHILDREN children, are kept up to
+ * date by jsvAddName/jsvRemoveChild, and can be thrown away at any time. */
+#define JSV_HASH_INDEX_SLOTS 8 ///< Maximum number of objects we keep indexes for
+#define JSV_HASH_INDEX_MIN_CHILDREN 32 ///< Only index objects with more children than this
+#define JSV_HASH_INDEX_RETRY 256 ///< If we couldn't allocate an index, how many searches to wait before trying again
+
+typedef struct {
+  JsVarRef owner; ///< The object that is indexed
+  JsVar *index; ///< Flat string containing the table - kept locked
+  JsVarRef *table; ///< The data in 'index'
+  unsigned int mask; ///< Number of entries in the table - 1 (it's a power of 2)
+  unsigned int count; ///< Number of names in the table
+} JsvHashIndex;
+
+static JsvHashIndex jsvHashIndexes[JSV_HASH_INDEX_SLOTS];
+static unsigned int jsvHashIndexCount = 0; ///< How many of jsvHashIndexes are used (always the first ones)
+static unsigned int jsvHashIndexBackoff = 0; ///< Don't try and build an index until this is 0
+
+static ALWAYS_INLINE uint32_t jsvHashIndexAddChar(uint32_t hash, char ch) {
+  return (hash ^ (unsigned char)ch) * 16777619; // FNV-1a
+}
+
+static uint32_t jsvHashIndexHashString(const char *str) {
+  uint32_t hash = 2166136261u;
+  while (*str) hash = jsvHashIndexAddChar(hash, *(str++));
+  return hash;
+}
+
+/// Hash a string var - stopping at the first 0 character, like jsvIsBasicVarEqual does
+static uint32_t jsvHashIndexHashVar(JsVar *str) {
+  uint32_t hash = 2166136261u;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, 0);
+  char ch;
+  while ((ch = jsvStringIteratorGetChar(&it))) {
+    hash = jsvHashIndexAddChar(hash, ch);
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  return hash;
+}
+
+static JsvHashIndex *jsvHashIndexGet(JsVar *parent) {
+  JsVarRef ref = jsvGetRef(parent);
+  unsigned int i;
+  for (i=0;i<jsvHashIndexCount;i++)
+    if (jsvHashIndexes[i].owner == ref)
+      return &jsvHashIndexes[i];
+  return 0;
+}
+
+static void jsvHashIndexFree(JsvHashIndex *h) {
+  JsVar *index = h->index;
+  *h = jsvHashIndexes[--jsvHashIndexCount]; // keep the used ones at the start
+  jsvUnLock(index);
+}
+
+bool jsvFreeHashIndexes() {
+  bool freed = jsvHashIndexCount>0;
+  while (jsvHashIndexCount)
+    jsvHashIndexFree(&jsvHashIndexes[0]);
+  // we're probably low on memory, so don't rebuild them straight away
+  if (freed) jsvHashIndexBackoff = JSV_HASH_INDEX_RETRY;
+  return freed;
+}
+
+/// Add a string name to the index - returns false if there's no space
+static bool jsvHashIndexAdd(JsvHashIndex *h, JsVar *name) {
+  if ((h->count+1)*4 > (h->mask+1)*3) return false; // keep it under 75% full
+  unsigned int i = jsvHashIndexHashVar(name) & h->mask;
+  while (h->table[i]) i = (i+1) & h->mask;
+  h->table[i] = jsvGetRef(name);
+  h->count++;
+  return true;
+}
+
+/// Remove a string name from the index (if it's in it)
+static void jsvHashIndexRemove(JsvHashIndex *h, JsVar *name) {
+  JsVarRef ref = jsvGetRef(name);
+  unsigned int i = jsvHashIndexHashVar(name) & h->mask;
+  while (h->table[i] != ref) {
+    if (!h->table[i]) return; // not found
+    i = (i+1) & h->mask;
+  }
+  h->count--;
+  /* Move back any entries after this one that would no longer be
+   * found if we just left a gap (there are no 'deleted' markers) */
+  unsigned int j = i;
+  while (true) {
+    j = (j+1) & h->mask;
+    if (!h->table[j]) break;
+    unsigned int k = jsvHashIndexHashVar(jsvGetAddressOf(h->table[j])) & h->mask;
+    // if k is cyclically in (i,j] then this entry is still reachable
+    if ((i<=j) ? (i<k && k<=j) : (i<k || k<=j)) continue;
+    h->table[i] = h->table[j];
+    i = j;
+  }
+  h->table[i] = 0;
+}
+
+/// Try and build an index of the given object's children - may return 0
+static JsvHashIndex *jsvHashIndexBuild(JsVar *parent) {
+  if (jsvHashIndexBackoff) {
+    jsvHashIndexBackoff--;
+    return 0;
+  }
+  unsigned int count = 0;
+  JsVarRef childref = jsvGetFirstChild(parent);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsString(child)) count++;
+    childref = jsvGetNextSibling(child);
+  }
+  if (count <= JSV_HASH_INDEX_MIN_CHILDREN) {
+    // mostly integer names - not worth it, and don't keep counting them
+    jsvHashIndexBackoff = JSV_HASH_INDEX_RETRY;
+    return 0;
+  }
+  unsigned int size = 64;
+  while (size < count*2) size <<= 1;
+  JsVar *index = jsvNewFlatStringOfLength((unsigned int)(size*sizeof(JsVarRef)));
+  if (!index && count*4 < size*3/2) {
+    // try with less room to grow
+    size >>= 1;
+    index = jsvNewFlatStringOfLength((unsigned int)(size*sizeof(JsVarRef)));
+  }
+  if (!index) {
+    jsvHashIndexBackoff = JSV_HASH_INDEX_RETRY;
+    return 0;
+  }
+  if (jsvHashIndexCount == JSV_HASH_INDEX_SLOTS) {
+    // no space - throw away the index of the smallest object
+    JsvHashIndex *smallest = &jsvHashIndexes[0];
+    unsigned int i;
+    for (i=1;i<jsvHashIndexCount;i++)
+      if (jsvHashIndexes[i].count < smallest->count)
+        smallest = &jsvHashIndexes[i];
+    jsvHashIndexFree(smallest);
+  }
+  JsvHashIndex *h = &jsvHashIndexes[jsvHashIndexCount++];
+  h->owner = jsvGetRef(parent);
+  h->index = index;
+  h->table = (JsVarRef*)jsvGetFlatStringPointer(index); // already zeroed
+  h->mask = size-1;
+  h->count = 0;
+  childref = jsvGetFirstChild(parent);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsString(child)) jsvHashIndexAdd(h, child);
+    childref = jsvGetNextSibling(child);
+  }
+  return h;
+}
+#endif
+
+#ifdef JSVAR_ARRAY_INDEX
+/* Array elements are a linked list of integer NAMEs, so finding element i
+ * means walking the list. Big arrays that get searched get an index: a flat
+ * string of JsVarRefs where entry n is the NAME of element n<<shift. It only
+ * covers elements 0..count-1, where there are no holes. shift is normally 0
+ * so we go straight to the element, but if an array gets too big for the
+ * table we index every 2nd, 4th, ... element and walk forward from there.
+ * Elements added to the end or removed are handled by jsvAddName and
+ * jsvRemoveChild. Anything that renumbers elements is caught when the NAME
+ * we find doesn't have the index we expected, and the index is thrown away. */
+#define JSV_ARRAY_INDEX_SLOTS 8 ///< Maximum number of arrays we keep indexes for
+#define JSV_ARRAY_INDEX_MIN_ELEMENTS 32 ///< Only index arrays with more elements than this
+#define JSV_ARRAY_INDEX_MIN_ENTRIES 64 ///< Smallest table we'll allocate
+#define JSV_ARRAY_INDEX_MAX_ENTRIES 1024 ///< Biggest table we'll allocate - after this we index fewer elements
+#define JSV_ARRAY_INDEX_RETRY 256 ///< If we couldn't use an index, how many searches to wait before trying again
+
+typedef struct {
+  JsVarRef owner; ///< The array that is indexed
+  JsVar *index; ///< Flat string containing the table - kept locked
+  JsVarRef *table; ///< The data in 'index'
+  unsigned int size; ///< Number of entries in the table
+  unsigned int shift; ///< table[n] is the NAME of element n<<shift
+  JsVarInt count; ///< Elements 0..count-1 are all in the array
+} JsvArrayIndex;
+
+static JsvArrayIndex jsvArrayIndexes[JSV_ARRAY_INDEX_SLOTS];
+static unsigned int jsvArrayIndexCount = 0; ///< How many of jsvArrayIndexes are used (always the first ones)
+static unsigned int jsvArrayIndexBackoff = 0; ///< Don't try and build an index until this is 0
+
+static JsvArrayIndex *jsvArrayIndexGet(JsVar *arr) {
+  JsVarRef ref = jsvGetRef(arr);
+  unsigned int i;
+  for (i=0;i<jsvArrayIndexCount;i++)
+    if (jsvArrayIndexes[i].owner == ref)
+      return &jsvArrayIndexes[i];
+  return 0;
+}
+
+static void jsvArrayIndexFree(JsvArrayIndex *h) {
+  JsVar *index = h->index;
+  *h = jsvArrayIndexes[--jsvArrayIndexCount]; // keep the used ones at the start
+  jsvUnLock(index);
+}
+
+/// Throw away the index for this array (if there is one)
+static void jsvArrayIndexDrop(JsVar *arr) {
+  if (!jsvArrayIndexCount) return;
+  JsvArrayIndex *h = jsvArrayIndexGet(arr);
+  if (h) jsvArrayIndexFree(h);
+}
+
+bool jsvFreeArrayIndexes() {
+  bool freed = jsvArrayIndexCount>0;
+  while (jsvArrayIndexCount)
+    jsvArrayIndexFree(&jsvArrayIndexes[0]);
+  // we're probably low on memory, so don't rebuild them straight away
+  if (freed) jsvArrayIndexBackoff = JSV_ARRAY_INDEX_RETRY;
+  return freed;
+}
+
+/// Make room for another entry - with a bigger table, or by indexing half as many elements
+static void jsvArrayIndexGrow(JsvArrayIndex *h) {
+  if (h->size < JSV_ARRAY_INDEX_MAX_ENTRIES) {
+    JsVar *index = jsvNewFlatStringOfLength((unsigned int)(h->size*2*sizeof(JsVarRef)));
+    if (index) {
+      JsVarRef *table = (JsVarRef*)jsvGetFlatStringPointer(index);
+      memcpy(table, h->table, h->size*sizeof(JsVarRef));
+      jsvUnLock(h->index);
+      h->index = index;
+      h->table = table;
+      h->size *= 2;
+      return;
+    }
+  }
+  unsigned int n;
+  for (n=0;n<h->size/2;n++)
+    h->table[n] = h->table[n*2];
+  h->shift++;
+}
+
+/// An integer NAME was added to the array - add it to the index if it's the next element
+static void jsvArrayIndexAdd(JsvArrayIndex *h, JsVar *name) {
+  JsVarInt i = name->varData.integer;
+  if (i != h->count) {
+    // we already had this element? Something odd is going on, so don't trust the index
+    if (i>=0 && i<h->count) jsvArrayIndexFree(h);
+    return;
+  }
+  if (!(i & ((1<<h->shift)-1))) {
+    if ((unsigned int)(i>>h->shift) >= h->size) // i==count, so it's not negative
+      jsvArrayIndexGrow(h);
+    h->table[i>>h->shift] = jsvGetRef(name);
+  }
+  h->count++;
+}
+
+/// An integer NAME was removed from the array - there's now a hole there
+static void jsvArrayIndexRemove(JsvArrayIndex *h, JsVar *name) {
+  JsVarInt i = name->varData.integer;
+  if (i>=0 && i<h->count) h->count = i;
+}
+
+/// Try and build an index of the given array's elements - may return 0
+static JsvArrayIndex *jsvArrayIndexBuild(JsVar *arr) {
+  if (jsvArrayIndexBackoff) {
+    jsvArrayIndexBackoff--;
+    return 0;
+  }
+  // How many elements are there from 0 before the first hole?
+  JsVarInt count = 0;
+  JsVarRef childref = jsvGetFirstChild(arr);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsInt(child)) {
+      if (child->varData.integer != count) break;
+      count++;
+    }
+    childref = jsvGetNextSibling(child);
+  }
+  if (count <= JSV_ARRAY_INDEX_MIN_ELEMENTS) {
+    // sparse - not worth it, and don't keep counting
+    jsvArrayIndexBackoff = JSV_ARRAY_INDEX_RETRY;
+    return 0;
+  }
+  // leave room for the array to grow
+  unsigned int size = JSV_ARRAY_INDEX_MIN_ENTRIES;
+  while (size < (unsigned int)count*2 && size < JSV_ARRAY_INDEX_MAX_ENTRIES) size <<= 1;
+  JsVar *index;
+  while (!(index = jsvNewFlatStringOfLength((unsigned int)(size*sizeof(JsVarRef)))) &&
+         size > JSV_ARRAY_INDEX_MIN_ENTRIES)
+    size >>= 1;
+  if (!index) {
+    jsvArrayIndexBackoff = JSV_ARRAY_INDEX_RETRY;
+    return 0;
+  }
+  if (jsvArrayIndexCount == JSV_ARRAY_INDEX_SLOTS) {
+    // no space - throw away the index of the smallest array
+    JsvArrayIndex *smallest = &jsvArrayIndexes[0];
+    unsigned int i;
+    for (i=1;i<jsvArrayIndexCount;i++)
+      if (jsvArrayIndexes[i].count < smallest->count)
+        smallest = &jsvArrayIndexes[i];
+    jsvArrayIndexFree(smallest);
+  }
+  JsvArrayIndex *h = &jsvArrayIndexes[jsvArrayIndexCount++];
+  h->owner = jsvGetRef(arr);
+  h->index = index;
+  h->table = (JsVarRef*)jsvGetFlatStringPointer(index);
+  h->size = size;
+  h->shift = 0;
+  while ((unsigned int)((count-1)>>h->shift) >= size) h->shift++;
+  h->count = count;
+  JsVarInt mask = (1<<h->shift)-1;
+  childref = jsvGetFirstChild(arr);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsInt(child)) {
+      JsVarInt i = child->varData.integer;
+      if (i >= count) break;
+      if (!(i & mask)) h->table[i>>h->shift] = childref;
+    }
+    childref = jsvGetNextSibling(child);
+  }
+  return h;
+}
+
+/** Use (or build) an index to find the NAME of element i in the array.
+ * Returns 0 if it can't, in which case the array has to be searched */
+static JsVar *jsvArrayIndexFindName(JsVar *arr, JsVarInt i) {
+  if (i<0) return 0;
+  JsvArrayIndex *h = jsvArrayIndexCount ? jsvArrayIndexGet(arr) : 0;
+  if (h && i >= h->count) {
+    // there's a hole before i - if we wait, it may have been filled in
+    if (jsvArrayIndexBackoff) {
+      jsvArrayIndexBackoff--;
+      return 0;
+    }
+    jsvArrayIndexFree(h);
+    h = 0;
+  }
+  if (!h) {
+    h = jsvArrayIndexBuild(arr);
+    if (!h) return 0;
+    if (i >= h->count) {
+      jsvArrayIndexBackoff = JSV_ARRAY_INDEX_RETRY;
+      return 0;
+    }
+  }
+  JsVarRef childref = h->table[i>>h->shift];
+  JsVar *child = jsvGetAddressOf(childref);
+  // check the entry is still right - elements can get renumbered
+  if (jsvIsName(child) && jsvIsInt(child) && child->varData.integer == (i & ~(JsVarInt)((1<<h->shift)-1))) {
+    while (childref) {
+      child = jsvGetAddressOf(childref);
+      if (jsvIsInt(child)) { // there may be non-numeric names in the way
+        if (child->varData.integer == i) return jsvLock(childref);
+        if (child->varData.integer > i) break;
+      }
+      childref = jsvGetNextSibling(child);
+    }
+  }
+  jsvArrayIndexFree(h);
+  return 0;
+}
+#endif
+
+#ifdef JSVAR_STRING_INDEX
+/* Finding character i of a string means walking its StringExts, so long strings
+ * that get accessed at random get an index: a flat string of entries where entry
+ * n is block n<<shift of the string and the index of its first character. Strings
+ * only ever get longer, so entries stay right until the string is freed - anything
+ * appended after the last entry is found by walking on from it, and if that gets
+ * too far we build the index again. */
+#define JSV_STRING_INDEX_SLOTS 4 ///< Maximum number of strings we keep indexes for
+#define JSV_STRING_INDEX_MAX_ENTRIES 64 ///< Biggest table we'll allocate - after this we index fewer blocks
+#define JSV_STRING_INDEX_RETRY 64 ///< If we couldn't build an index, how many lookups to wait before trying again
+
+typedef struct {
+  JsVarRef block; ///< The string or StringExt
+  unsigned int index; ///< Index in the string of the first character in 'block'
+} JsvStringIndexEntry;
+
+typedef struct {
+  JsVarRef owner; ///< The string that is indexed
+  JsVar *index; ///< Flat string containing the table - kept locked
+  JsvStringIndexEntry *table; ///< The data in 'index'
+  unsigned int count; ///< Number of entries in the table
+  unsigned int shift; ///< table[n] is block n<<shift
+} JsvStringIndex;
+
+static JsvStringIndex jsvStringIndexes[JSV_STRING_INDEX_SLOTS];
+static unsigned int jsvStringIndexCount = 0; ///< How many of jsvStringIndexes are used (always the first ones)
+static unsigned int jsvStringIndexBackoff = 0; ///< Don't try and build an index until this is 0
+
+static void jsvStringIndexFree(JsvStringIndex *h) {
+  JsVar *index = h->index;
+  *h = jsvStringIndexes[--jsvStringIndexCount]; // keep the used ones at the start
+  jsvUnLock(index);
+}
+
+/// Throw away the index for this string (if there is one)
+static void jsvStringIndexDrop(JsVarRef str) {
+  unsigned int i;
+  for (i=0;i<jsvStringIndexCount;i++)
+    if (jsvStringIndexes[i].owner == str) {
+      jsvStringIndexFree(&jsvStringIndexes[i]);
+      return;
+    }
+}
+
+bool jsvFreeStringIndexes() {
+  bool freed = jsvStringIndexCount>0;
+  while (jsvStringIndexCount)
+    jsvStringIndexFree(&jsvStringIndexes[0]);
+  if (freed) jsvStringIndexBackoff = JSV_STRING_INDEX_RETRY;
+  return freed;
+}
+
+/// Try and build an index of the given string's blocks - may return 0
+static JsvStringIndex *jsvStringIndexBuild(JsVar *str) {
+  if (jsvStringIndexBackoff) {
+    jsvStringIndexBackoff--;
+    return 0;
+  }
+  unsigned int blocks = 0;
+  JsVarRef ref = jsvGetRef(str);
+  while (ref) {
+    blocks++;
+    ref = jsvGetLastChild(jsvGetAddressOf(ref));
+  }
+  unsigned int shift = 0;
+  while (((blocks-1)>>shift) >= JSV_STRING_INDEX_MAX_ENTRIES) shift++;
+  unsigned int count = ((blocks-1)>>shift) + 1;
+  JsVar *index = jsvNewFlatStringOfLength((unsigned int)(count*sizeof(JsvStringIndexEntry)));
+  if (!index) {
+    jsvStringIndexBackoff = JSV_STRING_INDEX_RETRY;
+    return 0;
+  }
+  if (jsvStringIndexCount == JSV_STRING_INDEX_SLOTS)
+    jsvStringIndexFree(&jsvStringIndexes[0]); // no space - throw away the oldest
+  JsvStringIndex *h = &jsvStringIndexes[jsvStringIndexCount++];
+  h->owner = jsvGetRef(str);
+  h->index = index;
+  h->table = (JsvStringIndexEntry*)jsvGetFlatStringPointer(index);
+  h->count = count;
+  h->shift = shift;
+  unsigned int n = 0, chars = 0;
+  ref = h->owner;
+  while (ref) {
+    JsVar *block = jsvGetAddressOf(ref);
+    if (!(n & ((1U<<shift)-1))) {
+      h->table[n>>shift].block = ref;
+      h->table[n>>shift].index = chars;
+    }
+    n++;
+    chars += (unsigned int)jsvGetCharactersInVar(block);
+    ref = jsvGetLastChild(block);
+  }
+  return h;
+}
+
+JsVarRef jsvStringIndexFind(JsVar *str, size_t idx, size_t *blockIndex) {
+  assert(jsvIsString(str) && !jsvIsFlatString(str));
+  JsVarRef owner = jsvGetRef(str);
+  JsvStringIndex *h = 0;
+  unsigned int i;
+  for (i=0;i<jsvStringIndexCount;i++)
+    if (jsvStringIndexes[i].owner == owner)
+      h = &jsvStringIndexes[i];
+  if (!h) {
+    h = jsvStringIndexBuild(str);
+    if (!h) return 0;
+  }
+  // binary search for the last entry at or before idx
+  unsigned int lo = 0, hi = h->count;
+  while (hi-lo > 1) {
+    unsigned int mid = (lo+hi)>>1;
+    if (h->table[mid].index <= idx) lo = mid;
+    else hi = mid;
+  }
+  JsVarRef ref = h->table[lo].block;
+  size_t blockIdx = h->table[lo].index;
+  if (lo == h->count-1) {
+    // the string may have been appended to since we built the index
+    unsigned int walked = 0;
+    JsVar *block = jsvGetAddressOf(ref);
+    while (jsvGetLastChild(block) && blockIdx + jsvGetCharactersInVar(block) <= idx) {
+      blockIdx += jsvGetCharactersInVar(block);
+      ref = jsvGetLastChild(block);
+      block = jsvGetAddressOf(ref);
+      walked++;
+    }
+    if (walked > (2U<<h->shift)) jsvStringIndexFree(h); // a lot has been added - rebuild next time
+  }
+  *blockIndex = blockIdx;
+  return ref;
+}
+#endif
+
 bool jsvHasCharacterData(const JsVar *v) {
   return jsvIsString(v) || jsvIsStringExt(v);
 }
@@ -299,6 +934,8 @@ JsVar *jsvNewWithFlags(JsVarFlags flags) {
     jshInterruptOff(); // to allow this to be used from an IRQ
     JsVar *v = jsvLock(jsVarFirstEmpty);
     jsVarFirstEmpty = jsvGetNextSibling(v); // move our reference to the next in the free list
+    jsvMemoryStats.allocations++;
+    if (++jsvMemoryStats.usage > jsvMemoryStats.peak) jsvMemoryStats.peak = jsvMemoryStats.usage;
     jshInterruptOn();
     jsvResetVariable(v, flags); // setup variable, and add one lock
     // return pointer
@@ -314,16 +951,15 @@ JsVar *jsvNewWithFlags(JsVarFlags flags) {
     return jsvNewWithFlags(flags);
   /* We couldn't claim any more memory by Garbage collecting... */
 #ifdef RESIZABLE_JSVARS
-  jsvSetMemoryTotal(jsVarsSize*2);
-  return jsvNewWithFlags(flags);
-#else
-  // On a micro, we're screwed.
+  if (jsvSetMemoryTotal(jsVarsSize*2))
+    return jsvNewWithFlags(flags);
+#endif
+  // On a micro (or if we couldn't get more), we're screwed.
   if (!(jsErrorFlags&JSERR_MEMORY))
     jsError("Out of Memory!");
   jsErrorFlags |= JSERR_MEMORY;
   jspSetInterrupted(true);
   return 0;
-#endif
 }
 
 ALWAYS_INLINE void jsvFreePtrInternal(JsVar *var) {
@@ -333,6 +969,7 @@ ALWAYS_INLINE void jsvFreePtrInternal(JsVar *var) {
   jshInterruptOff(); // to allow this to be used from an IRQ
   jsvSetNextSibling(var, jsVarFirstEmpty);
   jsVarFirstEmpty = jsvGetRef(var);
+  jsvMemoryStats.usage--;
   jshInterruptOn();
 }
 
@@ -360,6 +997,12 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
   if (jsvHasStringExt(var)) {
     // Free the string without recursing
     JsVarRef stringDataRef = jsvGetLastChild(var);
+#ifdef JSVAR_STRING_TAIL_CACHE
+    if (stringDataRef && jsvIsString(var)) jsvStringTailDrop(jsvGetRef(var));
+#endif
+#ifdef JSVAR_STRING_INDEX
+    if (stringDataRef && jsvStringIndexCount) jsvStringIndexDrop(jsvGetRef(var));
+#endif
     jsvSetLastChild(var, 0);
     while (stringDataRef) {
       JsVar *child = jsvGetAddressOf(stringDataRef);
@@ -384,6 +1027,15 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
     can be ints or strings */
 
   if (jsvHasChildren(var)) {
+#ifdef JSVAR_HASH_INDEX
+    if (jsvHashIndexCount) {
+      JsvHashIndex *h = jsvHashIndexGet(var);
+      if (h) jsvHashIndexFree(h);
+    }
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+    jsvArrayIndexDrop(var);
+#endif
     JsVarRef childref = jsvGetFirstChild(var);
     jsvSetFirstChild(var, 0);
     jsvSetLastChild(var, 0);
@@ -440,6 +1092,9 @@ ALWAYS_INLINE JsVar *jsvLock(JsVarRef ref) {
   //var->locks++;
   assert(jsvGetLocks(var) < JSV_LOCK_MAX);
   var->flags += JSV_LOCK_ONE;
+#ifdef JSVAR_INCREMENTAL_GC
+  if (var->flags & JSV_GARBAGE_COLLECT) jsvGCBarrier(var);
+#endif
 #ifdef DEBUG
   if (jsvGetLocks(var)==0) {
     jsError("Too many locks to Variable!");
@@ -506,6 +1161,9 @@ NO_INLINE void jsvUnLockMany(unsigned int count, JsVar **vars) {
 JsVar *jsvRef(JsVar *var) {
   assert(var && jsvHasRef(var));
   jsvSetRefs(var, (JsVarRefCounter)(jsvGetRefs(var)+1));
+#ifdef JSVAR_INCREMENTAL_GC
+  if (var->flags & JSV_GARBAGE_COLLECT) jsvGCBarrier(var);
+#endif
   return var;
 }
 
@@ -539,14 +1197,16 @@ JsVarRef jsvUnRefRef(JsVarRef ref) {
   return 0;
 }
 
-JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
-  // Work out how many blocks we need. One for the header, plus some for the characters
-  size_t blocks = 1 + ((byteLength+sizeof(JsVar)-1) / sizeof(JsVar));
-  // Now try and find them
+/// Make a flat string of 'blocks' blocks out of free variables, or return 0 if there isn't enough contiguous space
+static JsVar *jsvNewFlatStringFromFreeVars(unsigned int byteLength, size_t blocks) {
   unsigned int blockCount = 0;
   JsVarRef i;
   for (i=1;i<=jsVarsSize;i++)  {
     JsVar *var = jsvGetAddressOf(i);
+#ifdef RESIZABLE_JSVARS
+    // vars in blocks that were allocated separately aren't contiguous in memory
+    if (((i-1)&(JSVAR_BLOCK_SIZE-1))==0 && i>1 && var!=jsvGetAddressOf((JsVarRef)(i-1))+1) blockCount = 0;
+#endif
     if ((var->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
       blockCount++;
       if (blockCount>=blocks) { // Wohoo! We found enough blocks
@@ -554,8 +1214,12 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
         // Set up the header block (including one lock)
         jsvResetVariable(var, JSV_FLAT_STRING);
         var->varData.integer = (JsVarInt)byteLength;
+        jsvMemoryStats.allocations += (unsigned int)blocks;
         // clear data
         memset((char*)&var[1], 0, sizeof(JsVar)*(blocks-1));
+#ifdef JSVAR_INCREMENTAL_GC
+        jsvGCSkipFlatString(var);
+#endif
         // Now re-link all the free variables
         jsvCreateEmptyVarList();
         return var;
@@ -566,10 +1230,25 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
         i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     }
   }
-  // can't make it - return undefined
   return 0;
 }
 
+JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
+  // Work out how many blocks we need. One for the header, plus some for the characters
+  size_t blocks = 1 + ((byteLength+sizeof(JsVar)-1) / sizeof(JsVar));
+  // Now try and find them
+  JsVar *var = jsvNewFlatStringFromFreeVars(byteLength, blocks);
+#ifdef RESIZABLE_JSVARS
+  /* No space, but we can allocate more blocks of variables (they're allocated
+   * together, so they'll be contiguous and all free). Only try once - if we
+   * couldn't allocate them, or they still weren't enough, give up */
+  if (!var && blocks < JSVARREF_MAX && jsvSetMemoryTotal(jsVarsSize + (unsigned int)blocks))
+    var = jsvNewFlatStringFromFreeVars(byteLength, blocks);
+#endif
+  // can't make it - return undefined
+  return var;
+}
+
 JsVar *jsvNewFromString(const char *str) {
   // Create a var
   JsVar *first = jsvNewWithFlags(JSV_STRING_0);
@@ -758,13 +1437,17 @@ void *jsvGetNativeFunctionPtr(const JsVar *function) {
 
 /// Create a new ArrayBuffer backed by the given string. If length is not specified, it will be worked out
 JsVar *jsvNewArrayBufferFromString(JsVar *str, unsigned int lengthOrZero) {
+  if (lengthOrZero==0) lengthOrZero = (unsigned int)jsvGetStringLength(str);
+  if (lengthOrZero > JSV_ARRAYBUFFER_MAX_LENGTH) {
+    jsExceptionHere(JSET_ERROR, "ArrayBuffer too long\n");
+    return 0;
+  }
   JsVar *arr = jsvNewWithFlags(JSV_ARRAYBUFFER);
   if (!arr) return 0;
   jsvSetFirstChild(arr, jsvGetRef(jsvRef(str)));
   arr->varData.arraybuffer.type = ARRAYBUFFERVIEW_ARRAYBUFFER;
   arr->varData.arraybuffer.byteOffset = 0;
-  if (lengthOrZero==0) lengthOrZero = (unsigned int)jsvGetStringLength(str);
-  arr->varData.arraybuffer.length = (unsigned short)lengthOrZero;
+  arr->varData.arraybuffer.length = (JsVarArrayBufferIdx)lengthOrZero & JSV_ARRAYBUFFER_MAX_LENGTH; // checked above - the mask just tells the compiler it fits
   return arr;
 }
 
@@ -1061,6 +1744,14 @@ size_t jsvGetStringLength(const JsVar *v) {
 
   if (!jsvHasCharacterData(v)) return 0;
 
+#ifdef JSVAR_STRING_TAIL_CACHE
+  // if we know where the end is, start counting from there
+  if (jsvIsString(v) && jsvGetLastChild(v)) {
+    ref = jsvStringTailGet(jsvGetRef((JsVar*)v), &strLength);
+    if (ref) var = jsvLock(ref);
+  }
+#endif
+
   while (var) {
     JsVarRef refNext = jsvGetLastChild(var);
     strLength += jsvGetCharactersInVar(var);
@@ -1079,6 +1770,20 @@ size_t jsvGetFlatStringBlocks(const JsVar *v) {
   return ((size_t)v->varData.integer+sizeof(JsVar)-1) / sizeof(JsVar);
 }
 
+void jsvTruncateFlatString(JsVar *v, size_t byteLength) {
+  assert(jsvIsFlatString(v) && byteLength <= (size_t)v->varData.integer);
+  size_t count = jsvGetFlatStringBlocks(v);
+  v->varData.integer = (JsVarInt)byteLength;
+  size_t newCount = jsvGetFlatStringBlocks(v);
+  JsVarRef i = (JsVarRef)(jsvGetRef(v)+count);
+  // free the blocks we don't need from the end, like jsvFreePtr does
+  while (count-- > newCount) {
+    JsVar *p = jsvGetAddressOf(i--);
+    p->flags = JSV_UNUSED;
+    jsvFreePtrInternal(p);
+  }
+}
+
 char *jsvGetFlatStringPointer(JsVar *v) {
   assert(jsvIsFlatString(v));
   if (!jsvIsFlatString(v)) return 0;
@@ -1481,6 +2186,20 @@ JsVar *jsvGetArrayBufferBackingString(JsVar *arrayBuffer) {
   return arrayBuffer;
 }
 
+char *jsvGetArrayBufferPointer(JsVar *arrayBuffer) {
+  assert(jsvIsArrayBuffer(arrayBuffer));
+  JsVar *s = jsvGetArrayBufferBackingString(arrayBuffer);
+  char *ptr = 0;
+  if (jsvIsFlatString(s)) {
+    ptr = jsvGetFlatStringPointer(s) + arrayBuffer->varData.arraybuffer.byteOffset;
+    size_t size = JSV_ARRAYBUFFER_GET_SIZE(arrayBuffer->varData.arraybuffer.type);
+    if (((size_t)ptr) & (size-1)) ptr = 0; // not aligned
+  }
+  // the flat string is referenced by arrayBuffer, so it won't move or be freed while that is locked
+  jsvUnLock(s);
+  return ptr;
+}
+
 /** Get the item at the given location in the array buffer and return the result */
 JsVar *jsvArrayBufferGet(JsVar *arrayBuffer, size_t idx) {
   JsvArrayBufferIterator it;
@@ -1690,6 +2409,138 @@ int jsvCompareString(JsVar *va, JsVar *vb, size_t starta, size_t startb, bool eq
   return true;
 }
 
+/* Horspool search for a string of length m in a flat string, starting at
+ * characters startIdx..endIdx. 'skip' says how far to move on when the last
+ * character of the window is a particular character */
+static int jsvFindStringFlat(const unsigned char *str, const unsigned char *search, size_t m, const unsigned char *skip, size_t startIdx, size_t endIdx) {
+  if (m==1) {
+    const unsigned char *p = memchr(&str[startIdx], search[0], endIdx+1-startIdx);
+    return p ? (int)(p-str) : -1;
+  }
+  unsigned char lastCh = search[m-1];
+  size_t i = startIdx;
+  while (i<=endIdx) {
+    unsigned char ch = str[i+m-1];
+    if (ch==lastCh && !memcmp(&str[i], search, m-1)) return (int)i;
+    i += skip[ch];
+  }
+  return -1;
+}
+
+/* The same, but reading the string through one iterator. The last m characters are kept
+ * in 'window', which is 2*m long so we can write each one twice and always have them in order */
+static int jsvFindStringIterator(JsVar *str, const unsigned char *search, size_t m, const unsigned char *skip, size_t startIdx, size_t endIdx) {
+  unsigned char *window = (unsigned char*)alloca(m*2);
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, startIdx);
+  size_t head = 0; // window[head..head+m-1] is the text at i
+  size_t i = startIdx;
+  size_t toRead = m;
+  int result = -1;
+  while (true) {
+    while (toRead) {
+      if (!jsvStringIteratorHasChar(&it)) {
+        jsvStringIteratorFree(&it);
+        return -1;
+      }
+      unsigned char ch = (unsigned char)jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+      window[head] = window[head+m] = ch;
+      head = (head+1) % m;
+      toRead--;
+    }
+    unsigned char ch = window[head+m-1];
+    if (ch==search[m-1] && !memcmp(&window[head], search, m-1)) {
+      result = (int)i;
+      break;
+    }
+    i += skip[ch];
+    if (i>endIdx) break;
+    toRead = skip[ch];
+  }
+  jsvStringIteratorFree(&it);
+  return result;
+}
+
+void jsvStringSearchNew(JsvStringSearch *ss, JsVar *search) {
+  ss->search = search;
+  ss->length = jsvGetStringLength(search);
+  if (ss->length==0 || ss->length > JSV_STRING_SEARCH_MAX_LENGTH) return;
+  jsvGetStringChars(search, 0, (char*)ss->chars, ss->length);
+  memset(ss->skip, (int)ss->length, sizeof(ss->skip));
+  size_t i;
+  for (i=0;i<ss->length-1;i++)
+    ss->skip[ss->chars[i]] = (unsigned char)(ss->length-1-i);
+}
+
+int jsvStringSearchFind(JsvStringSearch *ss, JsVar *str, size_t startIdx, size_t endIdx) {
+  if (startIdx > endIdx) return -1;
+  if (ss->length==0) return (int)startIdx;
+  if (ss->length > JSV_STRING_SEARCH_MAX_LENGTH) {
+    // too long for our tables - slow, but simple! (relies on endIdx leaving room for the whole string)
+    size_t idx;
+    for (idx=startIdx;idx<=endIdx;idx++)
+      if (jsvCompareString(str, ss->search, idx, 0, true)==0)
+        return (int)idx;
+    return -1;
+  }
+  if (jsvIsFlatString(str)) {
+    size_t strLength = jsvGetStringLength(str);
+    if (ss->length > strLength) return -1;
+    if (endIdx > strLength-ss->length) endIdx = strLength-ss->length;
+    if (startIdx > endIdx) return -1;
+    return jsvFindStringFlat((unsigned char*)jsvGetFlatStringPointer(str), ss->chars, ss->length, ss->skip, startIdx, endIdx);
+  }
+  return jsvFindStringIterator(str, ss->chars, ss->length, ss->skip, startIdx, endIdx);
+}
+
+/* Search backwards for the last string of length m in str[] that starts at one
+ * of characters startIdx..endIdx */
+static int jsvFindLastStringFlat(const unsigned char *str, const unsigned char *search, size_t m, size_t startIdx, size_t endIdx) {
+  size_t i = endIdx+1;
+  while (i-- > startIdx) {
+    if (str[i]==search[0] && !memcmp(&str[i+1], &search[1], m-1)) return (int)i;
+  }
+  return -1;
+}
+
+#define JSV_FIND_LAST_CHUNK 64 ///< How many start positions jsvFindLastStringChunks copies out of the string at once
+/* The same, but for strings that aren't flat. We can't iterate backwards, so copy chunks
+ * (overlapping by m-1 characters) out of the string from the end and search those */
+static int jsvFindLastStringChunks(JsVar *str, const unsigned char *search, size_t m, size_t startIdx, size_t endIdx) {
+  unsigned char *buf = (unsigned char*)alloca(JSV_FIND_LAST_CHUNK+m-1);
+  size_t end = endIdx+1; // one after the last start position we haven't looked at
+  while (end > startIdx) {
+    size_t start = (end-startIdx > JSV_FIND_LAST_CHUNK) ? end-JSV_FIND_LAST_CHUNK : startIdx;
+    size_t len = end-start+m-1;
+    if (jsvGetStringChars(str, start, (char*)buf, len) != len) return -1;
+    int r = jsvFindLastStringFlat(buf, search, m, 0, end-start-1);
+    if (r>=0) return (int)start + r;
+    end = start;
+  }
+  return -1;
+}
+
+int jsvStringSearchFindLast(JsvStringSearch *ss, JsVar *str, size_t startIdx, size_t endIdx) {
+  if (startIdx > endIdx) return -1;
+  if (ss->length==0) return (int)endIdx;
+  size_t strLength = jsvGetStringLength(str);
+  if (ss->length > strLength) return -1;
+  if (endIdx > strLength-ss->length) endIdx = strLength-ss->length;
+  if (startIdx > endIdx) return -1;
+  if (ss->length > JSV_STRING_SEARCH_MAX_LENGTH) {
+    // too long for our tables - slow, but simple!
+    size_t idx = endIdx+1;
+    while (idx-- > startIdx)
+      if (jsvCompareString(str, ss->search, idx, 0, true)==0)
+        return (int)idx;
+    return -1;
+  }
+  if (jsvIsFlatString(str))
+    return jsvFindLastStringFlat((unsigned char*)jsvGetFlatStringPointer(str), ss->chars, ss->length, startIdx, endIdx);
+  return jsvFindLastStringChunks(str, ss->chars, ss->length, startIdx, endIdx);
+}
+
 /** Return a new string containing just the characters that are
  * shared between two strings. */
 JsVar *jsvGetCommonCharacters(JsVar *va, JsVar *vb) {
@@ -1838,6 +2689,26 @@ JsVar *jsvCopy(JsVar *src) {
   return dst;
 }
 
+#ifdef JSPARSE_INLINE_CACHE
+/** Could adding/removing this name from parent change what's found in a prototype chain?
+ * Objects are marked when they're set as a 'prototype' (see jsvMarkIfPrototype) so we
+ * use that to spot them - otherwise adding a local variable to a function's scope would
+ * invalidate all the caches. */
+static bool jsvIsPrototypeChange(JsVar *parent, JsVar *name) {
+  if (!jsvIsString(name)) return false; // integer indices don't matter
+  if (jsvIsRoot(parent)) return true; // eg. 'String' itself
+  if (jsvIsFunction(parent)) return jsvIsStringEqual(name, JSPARSE_PROTOTYPE_VAR);
+  return jsvIsPrototype(parent);
+}
+
+/// If name is 'prototype', mark the object it's being set to as a prototype (see jsvIsPrototype)
+static void jsvMarkIfPrototype(JsVar *name, JsVar *value) {
+  if (value && (value->flags&JSV_VARTYPEMASK)==JSV_OBJECT && !jsvIsPrototype(value) &&
+      jsvIsString(name) && jsvIsStringEqual(name, JSPARSE_PROTOTYPE_VAR))
+    value->flags = (JsVarFlags)(value->flags | JSV_NATIVE);
+}
+#endif
+
 void jsvAddName(JsVar *parent, JsVar *namedChild) {
   namedChild = jsvRef(namedChild); // ref here VERY important as adding to structure!
   assert(jsvIsName(namedChild));
@@ -1890,6 +2761,25 @@ void jsvAddName(JsVar *parent, JsVar *namedChild) {
     jsvSetFirstChild(parent, r);
     jsvSetLastChild(parent, r);
   }
+#ifdef JSVAR_HASH_INDEX
+  if (jsvHashIndexCount && jsvIsString(namedChild)) {
+    JsvHashIndex *h = jsvHashIndexGet(parent);
+    if (h && !jsvHashIndexAdd(h, namedChild))
+      jsvHashIndexFree(h); // full - a bigger one will be built when needed
+  }
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+  if (jsvArrayIndexCount && jsvIsArray(parent) && jsvIsInt(namedChild)) {
+    JsvArrayIndex *h = jsvArrayIndexGet(parent);
+    if (h) jsvArrayIndexAdd(h, namedChild);
+  }
+#endif
+#ifdef JSPARSE_INLINE_CACHE
+  if (!jsvIsNameWithValue(namedChild) && jsvGetFirstChild(namedChild))
+    jsvMarkIfPrototype(namedChild, jsvGetAddressOf(jsvGetFirstChild(namedChild)));
+  if (jsvIsPrototypeChange(parent, namedChild))
+    jsvPrototypeVersion++;
+#endif
 }
 
 JsVar *jsvAddNamedChild(JsVar *parent, JsVar *child, const char *name) {
@@ -1909,6 +2799,18 @@ JsVar *jsvSetNamedChild(JsVar *parent, JsVar *child, const char *name) {
 JsVar *jsvSetValueOfName(JsVar *name, JsVar *src) {
   assert(name && jsvIsName(name));
   assert(name!=src); // no infinite loops!
+#ifdef JSPARSE_INLINE_CACHE
+  /* This could have been something like `Array.prototype = ...` or
+   * `String = ...`. Built-in classes are functions, so only changes to
+   * those matter. New children aren't in anything yet (they'll be
+   * counted by jsvAddName). */
+  if (jsvIsString(name) && !jsvIsNewChild(name) &&
+      (jsvIsFunction(src) ||
+       (!jsvIsNameWithValue(name) && jsvGetFirstChild(name) && jsvIsFunction(jsvGetAddressOf(jsvGetFirstChild(name)))) ||
+       jsvIsStringEqual(name, JSPARSE_PROTOTYPE_VAR)))
+    jsvPrototypeVersion++;
+  jsvMarkIfPrototype(name, src);
+#endif
   // all is fine, so replace the existing child...
   /* Existing child may be null in the case of Z = 0 where
    * we create 'Z' and pass it down to '=' to have the value
@@ -1948,6 +2850,21 @@ JsVar *jsvSetValueOfName(JsVar *name, JsVar *src) {
   return name;
 }
 
+/** Array elements are kept sorted, before any other names (see jsvCompareInteger).
+ * This gets the first name after the elements - so a search for a string doesn't
+ * have to look at every element */
+static JsVarRef jsvGetFirstNonElementChild(JsVar *arr) {
+  JsVarRef childref = jsvGetLastChild(arr);
+  JsVarRef first = 0;
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsInt(child)) break;
+    first = childref;
+    childref = jsvGetPrevSibling(child);
+  }
+  return first;
+}
+
 JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool addIfNotFound) {
   /* Pull out first 4 bytes, and ensure that everything
    * is 0 padded so that we can do a nice speedy check. */
@@ -1973,18 +2890,45 @@ JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool addIfNotFoun
   }
 
   assert(jsvHasChildren(parent));
-  JsVarRef childref = jsvGetFirstChild(parent);
+#ifdef JSVAR_HASH_INDEX
+  JsvHashIndex *h = jsvHashIndexCount ? jsvHashIndexGet(parent) : 0;
+  if (h) {
+    unsigned int i = jsvHashIndexHashString(name) & h->mask;
+    while (h->table[i]) {
+      JsVar *child = jsvGetAddressOf(h->table[i]);
+      if (*(int*)fastCheck==*(int*)child->varData.str &&
+          jsvIsStringEqual(child, name))
+        return jsvLockAgain(child);
+      i = (i+1) & h->mask;
+    }
+  } else {
+    unsigned int searched = 0;
+#endif
+  JsVarRef childref = jsvIsArray(parent) ? jsvGetFirstNonElementChild(parent) : jsvGetFirstChild(parent);
   while (childref) {
     // Don't Lock here, just use GetAddressOf - to try and speed up the finding
     // TODO: We can do this now, but when/if we move to cacheing vars, it'll break
     JsVar *child = jsvGetAddressOf(childref);
     if (*(int*)fastCheck==*(int*)child->varData.str && // speedy check of first 4 bytes
         jsvIsStringEqual(child, name)) {
+#ifdef JSVAR_HASH_INDEX
+      if (searched > JSV_HASH_INDEX_MIN_CHILDREN && jsvIsObject(parent))
+        jsvHashIndexBuild(parent);
+#endif
       // found it! unlock parent but leave child locked
       return jsvLockAgain(child);
     }
     childref = jsvGetNextSibling(child);
+#ifdef JSVAR_HASH_INDEX
+    searched++;
+#endif
+  }
+#ifdef JSVAR_HASH_INDEX
+    // if that was slow, index the object so it's faster next time
+    if (searched > JSV_HASH_INDEX_MIN_CHILDREN && jsvIsObject(parent))
+      jsvHashIndexBuild(parent);
   }
+#endif
 
   JsVar *child = 0;
   if (addIfNotFound) {
@@ -1999,13 +2943,13 @@ JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool addIfNotFoun
 JsVar *jsvCreateNewChild(JsVar *parent, JsVar *index, JsVar *child) {
   JsVar *newChild = jsvAsName(index);
   assert(!jsvGetFirstChild(newChild));
-  if (child) jsvSetValueOfName(newChild, child);
   assert(!jsvGetNextSibling(newChild) && !jsvGetPrevSibling(newChild));
   // by setting the siblings as the same, we signal that if set,
   // we should be made a member of the given object
   JsVarRef r = jsvGetRef(jsvRef(jsvRef(parent)));
   jsvSetNextSibling(newChild, r);
   jsvSetPrevSibling(newChild, r);
+  if (child) jsvSetValueOfName(newChild, child);
 
   return newChild;
 }
@@ -2025,17 +2969,50 @@ JsVar *jsvAsName(JsVar *var) {
 /** Non-recursive finding */
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound) {
   JsVar *child;
-  JsVarRef childref = jsvGetFirstChild(parent);
+#ifdef JSVAR_ARRAY_INDEX
+  if (jsvIsArray(parent) && jsvIsInt(childName) && jsvGetArrayLength(parent) > JSV_ARRAY_INDEX_MIN_ELEMENTS) {
+    child = jsvArrayIndexFindName(parent, jsvGetInteger(childName));
+    if (child) return child;
+  }
+#endif
+#ifdef JSVAR_HASH_INDEX
+  JsvHashIndex *h = (jsvHashIndexCount && jsvIsString(childName)) ? jsvHashIndexGet(parent) : 0;
+  if (h) {
+    unsigned int i = jsvHashIndexHashVar(childName) & h->mask;
+    while (h->table[i]) {
+      child = jsvLock(h->table[i]);
+      if (jsvIsBasicVarEqual(child, childName))
+        return child;
+      jsvUnLock(child);
+      i = (i+1) & h->mask;
+    }
+  } else {
+    unsigned int searched = 0;
+#endif
+  JsVarRef childref = (jsvIsArray(parent) && jsvIsString(childName)) ? jsvGetFirstNonElementChild(parent) : jsvGetFirstChild(parent);
 
   while (childref) {
     child = jsvLock(childref);
     if (jsvIsBasicVarEqual(child, childName)) {
+#ifdef JSVAR_HASH_INDEX
+      if (searched > JSV_HASH_INDEX_MIN_CHILDREN && jsvIsObject(parent) && jsvIsString(childName))
+        jsvHashIndexBuild(parent);
+#endif
       // found it! unlock parent but leave child locked
       return child;
     }
     childref = jsvGetNextSibling(child);
     jsvUnLock(child);
+#ifdef JSVAR_HASH_INDEX
+    searched++;
+#endif
+  }
+#ifdef JSVAR_HASH_INDEX
+    // if that was slow, index the object so it's faster next time
+    if (searched > JSV_HASH_INDEX_MIN_CHILDREN && jsvIsObject(parent) && jsvIsString(childName))
+      jsvHashIndexBuild(parent);
   }
+#endif
 
   child = 0;
   if (addIfNotFound && childName) {
@@ -2076,6 +3053,22 @@ void jsvRemoveChild(JsVar *parent, JsVar *child) {
 
   jsvSetPrevSibling(child, 0);
   jsvSetNextSibling(child, 0);
+#ifdef JSVAR_HASH_INDEX
+  if (wasChild && jsvHashIndexCount && jsvIsString(child)) {
+    JsvHashIndex *h = jsvHashIndexGet(parent);
+    if (h) jsvHashIndexRemove(h, child);
+  }
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+  if (wasChild && jsvArrayIndexCount && jsvIsArray(parent) && jsvIsInt(child)) {
+    JsvArrayIndex *h = jsvArrayIndexGet(parent);
+    if (h) jsvArrayIndexRemove(h, child);
+  }
+#endif
+#ifdef JSPARSE_INLINE_CACHE
+  if (wasChild && jsvIsPrototypeChange(parent, child))
+    jsvPrototypeVersion++;
+#endif
   if (wasChild)
     jsvUnRef(child);
 }
@@ -2265,6 +3258,12 @@ JsVar *jsvGetArrayItem(const JsVar *arr, JsVarInt index) {
   // it's not in this array - don't search the whole lot...
   if (index > lastArrayIndex)
     return 0;
+#ifdef JSVAR_ARRAY_INDEX
+  if (lastArrayIndex > JSV_ARRAY_INDEX_MIN_ELEMENTS) {
+    JsVar *child = jsvArrayIndexFindName((JsVar*)arr, index);
+    if (child) return jsvSkipNameAndUnLock(child);
+  }
+#endif
   // otherwise is it more than halfway through?
   if (index > lastArrayIndex/2) {
     // it's in the final half of the array (probably) - search backwards
@@ -2416,6 +3415,9 @@ JsVar *jsvArrayPop(JsVar *arr) {
 /// Removes the first element of an array, and returns that element (or 0 if empty). DOES NOT RENUMBER.
 JsVar *jsvArrayPopFirst(JsVar *arr) {
   assert(jsvIsArray(arr));
+#ifdef JSVAR_ARRAY_INDEX
+  jsvArrayIndexDrop(arr); // we're about to make a hole at the start
+#endif
   if (jsvGetFirstChild(arr)) {
     JsVar *child = jsvLock(jsvGetFirstChild(arr));
     if (jsvGetFirstChild(arr) == jsvGetLastChild(arr))
@@ -2499,6 +3501,9 @@ JsVar *jsvArrayJoin(JsVar *arr, JsVar *filler) {
 /// Insert a new element before beforeIndex, DOES NOT UPDATE INDICES
 void jsvArrayInsertBefore(JsVar *arr, JsVar *beforeIndex, JsVar *element) {
   if (beforeIndex) {
+#ifdef JSVAR_ARRAY_INDEX
+    jsvArrayIndexDrop(arr); // elements are about to be renumbered
+#endif
     JsVar *idxVar = jsvMakeIntoVariableName(jsvNewFromInteger(0), element);
     if (!idxVar) return; // out of memory
 
@@ -2862,16 +3867,38 @@ void jsvTrace(JsVar *var, int indent) {
 }
 
 
-/** Recursively mark the variable */
-static void jsvGarbageCollectMarkUsed(JsVar *var) {
+/* Garbage collection: every used variable gets JSV_GARBAGE_COLLECT set, then
+ * it's cleared on everything that can be reached from a locked variable, and
+ * anything that still has it set is freed. Variables that have been marked
+ * but whose children haven't been looked at yet are kept on jsvGCStack. If
+ * that fills up, we just remember that it did, and afterwards look through
+ * all of memory for marked variables with unmarked children. */
+#ifdef RESIZABLE_JSVARS
+#define JSV_GC_STACK_SIZE 1024
+#else
+#define JSV_GC_STACK_SIZE 32
+#endif
+static JsVarRef jsvGCStack[JSV_GC_STACK_SIZE];
+static unsigned int jsvGCStackCount = 0;
+static bool jsvGCStackOverflowed = false;
+static JsvGarbageCollectStats jsvGCStats;
+
+/// Mark this variable as used, and remember that we need to look at its children
+static void jsvGCShade(JsVar *var) {
   var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+  if (jsvGCStackCount < JSV_GC_STACK_SIZE)
+    jsvGCStack[jsvGCStackCount++] = jsvGetRef(var);
+  else
+    jsvGCStackOverflowed = true;
+}
 
+/// Mark everything that this (already marked) variable links to
+static void jsvGCScan(JsVar *var) {
   if (jsvHasCharacterData(var)) {
-    // non-recursively scan strings
+    // StringExts only ever have one owner, so just mark them all now
     JsVarRef child = jsvGetLastChild(var);
     while (child) {
-      JsVar *childVar;
-      childVar = jsvGetAddressOf(child);
+      JsVar *childVar = jsvGetAddressOf(child);
       childVar->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
       child = jsvGetLastChild(childVar);
     }
@@ -2881,74 +3908,278 @@ static void jsvGarbageCollectMarkUsed(JsVar *var) {
     if (jsvGetFirstChild(var)) {
       JsVar *childVar = jsvGetAddressOf(jsvGetFirstChild(var));
       if (childVar->flags & JSV_GARBAGE_COLLECT)
-        jsvGarbageCollectMarkUsed(childVar);
+        jsvGCShade(childVar);
     }
   } else if (jsvHasChildren(var)) {
     JsVarRef child = jsvGetFirstChild(var);
     while (child) {
-      JsVar *childVar;
-      childVar = jsvGetAddressOf(child);
-      if (childVar->flags & JSV_GARBAGE_COLLECT)
-        jsvGarbageCollectMarkUsed(childVar);
+      JsVar *childVar = jsvGetAddressOf(child);
+      // Children are all names - which can only link to one thing - so do them now rather than using the stack
+      if (childVar->flags & JSV_GARBAGE_COLLECT) {
+        childVar->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+        jsvGCScan(childVar);
+      }
       child = jsvGetNextSibling(childVar);
     }
   }
 }
 
-/** Run a garbage collection sweep - return true if things have been freed */
-bool jsvGarbageCollect() {
+/// Get the next variable after i to look at when going through memory (skipping the data in flat strings)
+static ALWAYS_INLINE JsVarRef jsvGCNext(JsVarRef i) {
+  JsVar *var = jsvGetAddressOf(i);
+  if (jsvIsFlatString(var))
+    i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+  return (JsVarRef)(i+1);
+}
+
+/// Free a variable that garbage collection found wasn't used. Returns the number of blocks freed
+static unsigned int jsvGCFree(JsVarRef ref) {
+  JsVar *var = jsvGetAddressOf(ref);
+  if (jsvHasChildren(var)) {
+    // throw away anything that refers to this object by its ref
+#ifdef JSVAR_HASH_INDEX
+    if (jsvHashIndexCount) {
+      JsvHashIndex *h = jsvHashIndexGet(var);
+      if (h) jsvHashIndexFree(h);
+    }
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+    jsvArrayIndexDrop(var);
+#endif
+  }
+#ifdef JSVAR_STRING_TAIL_CACHE
+  if (jsvIsString(var) && jsvGetLastChild(var)) jsvStringTailDrop(ref);
+#endif
+#ifdef JSVAR_STRING_INDEX
+  if (jsvStringIndexCount && jsvIsString(var) && jsvGetLastChild(var)) jsvStringIndexDrop(ref);
+#endif
+  // if we're a flat string, there are more blocks to free
+  // work backwards, so our free list is in the right order
+  unsigned int count = jsvIsFlatString(var) ? 1 + (unsigned int)jsvGetFlatStringBlocks(var) : 1;
+  unsigned int n = count;
+  while (n-- > 0) {
+    var = jsvGetAddressOf((JsVarRef)(ref+n));
+    var->flags = JSV_UNUSED;
+    // add this to our free list
+    jsvSetNextSibling(var, jsVarFirstEmpty);
+    jsVarFirstEmpty = jsvGetRef(var);
+  }
+  jsvMemoryStats.usage -= count;
+  return count;
+}
+
+static void jsvGCUpdateStats(JsSysTime pause) {
+  jsvGCStats.totalTime += pause;
+  if (pause > jsvGCStats.maxPause) jsvGCStats.maxPause = pause;
+}
+
+void jsvGetGarbageCollectStats(JsvGarbageCollectStats *stats) {
+  *stats = jsvGCStats;
+}
+
+#ifdef JSVAR_INCREMENTAL_GC
+/* Incremental garbage collection does the same as jsvGarbageCollect, but a
+ * bit at a time from the idle loop, with JavaScript running in between.
+ * - JSV_GC_FLAG: set JSV_GARBAGE_COLLECT on everything. Anything allocated now has it set too.
+ * - JSV_GC_MARK: go through memory marking locked variables (and what they link to).
+ *   Anything allocated now is marked. To cope with JS running in between, jsvLock
+ *   and jsvRef mark what they're given, so a variable can't become reachable from
+ *   something we have already looked at without us knowing.
+ * - JSV_GC_RESCAN: if jsvGCStack overflowed, look for marked variables with unmarked children
+ * - JSV_GC_SWEEP: free anything not marked. Nothing can reach these any more, so
+ *   it doesn't matter what JS does in between. */
+typedef enum {
+  JSV_GC_IDLE,
+  JSV_GC_FLAG,
+  JSV_GC_MARK,
+  JSV_GC_RESCAN,
+  JSV_GC_SWEEP
+} JsvGCPhase;
+static JsvGCPhase jsvGCPhase = JSV_GC_IDLE;
+static JsVarRef jsvGCPos; ///< Where in memory we've got to
+static unsigned int jsvGCFreed; ///< How many vars this collection has freed so far
+static JsSysTime jsvGCTime; ///< How long this collection has taken so far
+static JsSysTime jsvGCSliceTime = -1; ///< How long jsvGarbageCollectStep should take (-1 = not set yet)
+
+/// Stop any garbage collection that is in progress
+static void jsvGCAbort() {
+  if (jsvGCPhase == JSV_GC_IDLE) return;
+  jsvGCPhase = JSV_GC_IDLE;
+  jsvGCStackCount = 0;
+  // don't leave anything marked as garbage
+  JsVarRef i;
+  for (i=1;i<=jsVarsSize;i=jsvGCNext(i))
+    jsvGetAddressOf(i)->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+}
+
+/// Called by jsvLock/jsvRef for variables with JSV_GARBAGE_COLLECT set
+static NO_INLINE void jsvGCBarrier(JsVar *var) {
+  // Something we may have already looked at could now point to this, so mark it
+  if (jsvGCPhase==JSV_GC_MARK || jsvGCPhase==JSV_GC_RESCAN)
+    jsvGCShade(var);
+}
+
+/// If a flat string has just been allocated over where we are in memory, skip it
+static void jsvGCSkipFlatString(JsVar *var) {
+  if (jsvGCPhase == JSV_GC_IDLE) return;
+  JsVarRef first = jsvGetRef(var);
+  JsVarRef last = (JsVarRef)(first+jsvGetFlatStringBlocks(var));
+  if (jsvGCPos>first && jsvGCPos<=last)
+    jsvGCPos = (JsVarRef)(last+1);
+  // anything on the stack that was freed and is now string data must be removed
+  unsigned int i, n = 0;
+  for (i=0;i<jsvGCStackCount;i++)
+    if (jsvGCStack[i]<first || jsvGCStack[i]>last)
+      jsvGCStack[n++] = jsvGCStack[i];
+  jsvGCStackCount = n;
+}
+
+bool jsvGarbageCollectInProgress() {
+  return jsvGCPhase != JSV_GC_IDLE;
+}
+
+JsSysTime jsvGetGarbageCollectSliceTime() {
+  if (jsvGCSliceTime<0) jsvGCSliceTime = jshGetTimeFromMilliseconds(1);
+  return jsvGCSliceTime;
+}
+
+void jsvSetGarbageCollectSliceTime(JsSysTime time) {
+  jsvGCSliceTime = time;
+}
+
+/// Do one small piece of garbage collection work
+static void jsvGCStepOne() {
+  JsVar *var;
+  switch (jsvGCPhase) {
+  case JSV_GC_IDLE:
+    jsvGCPhase = JSV_GC_FLAG;
+    jsvGCPos = 1;
+    jsvGCFreed = 0;
+    jsvGCTime = 0;
+    break;
+  case JSV_GC_FLAG:
+    if (jsvGCPos > jsVarsSize) {
+      jsvGCPhase = JSV_GC_MARK;
+      jsvGCPos = 1;
+      jsvGCStackCount = 0;
+      jsvGCStackOverflowed = false;
+      break;
+    }
+    var = jsvGetAddressOf(jsvGCPos);
+    if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED)
+      var->flags |= (JsVarFlags)JSV_GARBAGE_COLLECT;
+    jsvGCPos = jsvGCNext(jsvGCPos);
+    break;
+  case JSV_GC_MARK:
+  case JSV_GC_RESCAN:
+    if (jsvGCStackCount) {
+      jsvGCScan(jsvGetAddressOf(jsvGCStack[--jsvGCStackCount]));
+    } else if (jsvGCPos <= jsVarsSize) {
+      var = jsvGetAddressOf(jsvGCPos);
+      if (jsvGCPhase == JSV_GC_MARK) {
+        if ((var->flags & JSV_GARBAGE_COLLECT) && jsvGetLocks(var)>0)
+          jsvGCShade(var);
+      } else if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED && !(var->flags & JSV_GARBAGE_COLLECT))
+        jsvGCScan(var);
+      jsvGCPos = jsvGCNext(jsvGCPos);
+    } else {
+      // we've been all the way through memory
+      jsvGCPhase = jsvGCStackOverflowed ? JSV_GC_RESCAN : JSV_GC_SWEEP;
+      jsvGCStackOverflowed = false;
+      jsvGCPos = 1;
+    }
+    break;
+  case JSV_GC_SWEEP:
+    if (jsvGCPos > jsVarsSize) {
+      jsvGCPhase = JSV_GC_IDLE;
+      jsvGCStats.collections++;
+      jsvGCStats.freed = jsvGCFreed;
+      jsvGCStats.time = jsvGCTime;
+      break;
+    }
+    var = jsvGetAddressOf(jsvGCPos);
+    if (var->flags & JSV_GARBAGE_COLLECT) {
+      unsigned int blocks = jsvGCFree(jsvGCPos);
+      jsvGCFreed += blocks;
+      jsvGCPos = (JsVarRef)(jsvGCPos+blocks);
+    } else
+      jsvGCPos = jsvGCNext(jsvGCPos);
+    break;
+  }
+}
+
+bool jsvGarbageCollectStep() {
+  JsSysTime start = jshGetSystemTime();
+  JsSysTime sliceTime = jsvGetGarbageCollectSliceTime();
+  unsigned int n = 0;
+  do {
+    jsvGCStepOne();
+    // checking the time is slow, so only do it every so often
+  } while (jsvGCPhase!=JSV_GC_IDLE &&
+           ((++n & 63) || !sliceTime || jshGetSystemTime()-start < sliceTime));
+  JsSysTime pause = jshGetSystemTime()-start;
+  jsvGCTime += pause;
+  if (jsvGCPhase==JSV_GC_IDLE) jsvGCStats.time = jsvGCTime;
+  jsvGCUpdateStats(pause);
+  return jsvGCPhase != JSV_GC_IDLE;
+}
+#endif
+
+/** Run a garbage collection sweep - return the number of variables that have been freed */
+int jsvGarbageCollect() {
+  JsSysTime start = jshGetSystemTime();
+#ifdef JSVAR_INCREMENTAL_GC
+  jsvGCAbort(); // we're about to do the whole thing anyway
+#endif
   JsVarRef i;
   // clear garbage collect flags
-  for (i=1;i<=jsVarsSize;i++)  {
+  for (i=1;i<=jsVarsSize;i=jsvGCNext(i))  {
     JsVar *var = jsvGetAddressOf(i);
-    if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) { // if it is not unused
+    if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) // if it is not unused
       var->flags |= (JsVarFlags)JSV_GARBAGE_COLLECT;
-      // if we have a flat string, skip that many blocks
-      if (jsvIsFlatString(var))
-        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
-    }
   }
-  // recursively add 'native' vars
-  for (i=1;i<=jsVarsSize;i++)  {
+  // mark everything reachable from locked vars
+  jsvGCStackCount = 0;
+  jsvGCStackOverflowed = false;
+  for (i=1;i<=jsVarsSize;i=jsvGCNext(i))  {
     JsVar *var = jsvGetAddressOf(i);
     if ((var->flags & JSV_GARBAGE_COLLECT) && // not already GC'd
-        jsvGetLocks(var)>0) // or it is locked
-      jsvGarbageCollectMarkUsed(var);
-    // if we have a flat string, skip that many blocks
-    if (jsvIsFlatString(var))
-      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+        jsvGetLocks(var)>0) { // or it is locked
+      jsvGCShade(var);
+      while (jsvGCStackCount)
+        jsvGCScan(jsvGetAddressOf(jsvGCStack[--jsvGCStackCount]));
+    }
+  }
+  // if the stack filled up, find what we missed
+  while (jsvGCStackOverflowed) {
+    jsvGCStackOverflowed = false;
+    for (i=1;i<=jsVarsSize;i=jsvGCNext(i))  {
+      JsVar *var = jsvGetAddressOf(i);
+      if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED && !(var->flags & JSV_GARBAGE_COLLECT)) {
+        jsvGCScan(var);
+        while (jsvGCStackCount)
+          jsvGCScan(jsvGetAddressOf(jsvGCStack[--jsvGCStackCount]));
+      }
+    }
   }
   // now sweep for things that we can GC!
-  bool freedSomething = false;
-  for (i=1;i<=jsVarsSize;i++)  {
+  unsigned int freed = 0;
+  i = 1;
+  while (i<=jsVarsSize) {
     JsVar *var = jsvGetAddressOf(i);
     if (var->flags & JSV_GARBAGE_COLLECT) {
-      freedSomething = true;
-      if (jsvIsFlatString(var)) {
-        // if we're a flat string, there are more blocks to free
-        // work backwards, so our free list is in the right order
-        unsigned int count = 1 + (unsigned int)jsvGetFlatStringBlocks(var);
-        while (count-- > 0) {
-          var = jsvGetAddressOf(i+count);
-          var->flags = JSV_UNUSED;
-          // add this to our free list
-          jsvSetNextSibling(var, jsVarFirstEmpty);
-          jsVarFirstEmpty = jsvGetRef(var);
-        }
-      } else {
-        // otherwise just free 1 block
-        // free!
-        var->flags = JSV_UNUSED;
-        // add this to our free list
-        jsvSetNextSibling(var, jsVarFirstEmpty);
-        jsVarFirstEmpty = jsvGetRef(var);
-      }
-    } else if (jsvIsFlatString(var)) {
-      // if we have a flat string, skip that many blocks
-      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
-    }
+      unsigned int blocks = jsvGCFree(i);
+      freed += blocks;
+      i = (JsVarRef)(i+blocks);
+    } else
+      i = jsvGCNext(i);
   }
-  return freedSomething;
+  JsSysTime time = jshGetSystemTime()-start;
+  jsvGCStats.collections++;
+  jsvGCStats.freed = freed;
+  jsvGCStats.time = time;
+  jsvGCUpdateStats(time);
+  return (int)freed;
 }
 
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
@@ -72,13 +72,13 @@ typedef enum {
 
     JSV_VARTYPEMASK = NEXT_POWER_2(_JSV_VAR_END)-1, // probably this is 63
 
-    JSV_NATIVE      = JSV_VARTYPEMASK+1, ///< to specify this is a native function, root, function parameter, OR that it should not be freed
+    JSV_NATIVE      = JSV_VARTYPEMASK+1, ///< to specify this is a native function, root, function parameter, prototype object, OR that it should not be freed
     JSV_GARBAGE_COLLECT = JSV_NATIVE<<1, ///< When garbage collecting, this flag is true IF we should GC!
     JSV_IS_RECURSING = JSV_GARBAGE_COLLECT<<1, ///< used to stop recursive loops in jsvTrace
     JSV_LOCK_ONE    = JSV_IS_RECURSING<<1,
     JSV_LOCK_MASK   = JSV_LOCK_MAX * JSV_LOCK_ONE,
     JSV_LOCK_SHIFT  = GET_BIT_NUMBER(JSV_LOCK_ONE), ///< The amount of bits we must shift to get the number of locks - forced to be a constant
-    // 3 bits left over here on most systems
+    // 1 bit left over here on most systems (none with 32 bit JsVarRefs on a 64 bit platform)
     JSV_VARIABLEINFOMASK = JSV_VARTYPEMASK | JSV_NATIVE, // if we're copying a variable, this is all the stuff we want to copy
 } PACKED_FLAGS JsVarFlags; // aiming to get this in 2 bytes!
 
@@ -106,13 +106,27 @@ typedef enum {
 #define JSV_ARRAYBUFFER_IS_FLOAT(T) (((T)&ARRAYBUFFERVIEW_FLOAT)!=0)
 #define JSV_ARRAYBUFFER_IS_CLAMPED(T) (((T)&ARRAYBUFFERVIEW_CLAMPED)!=0)
 
+#ifdef JSV_ARRAYBUFFER_WIDE
+/* On big heaps we have 8 bytes, so can store a 32 bit offset and
+ * a 24 bit length - enough for audio captures and framebuffers */
+#define JSV_ARRAYBUFFER_MAX_LENGTH 0xFFFFFF
+typedef uint32_t JsVarArrayBufferIdx;
+
+typedef struct {
+  uint32_t byteOffset;
+  unsigned int length : 24;
+  JsVarDataArrayBufferViewType type;
+} PACKED_FLAGS JsVarDataArrayBufferView;
+#else
 #define JSV_ARRAYBUFFER_MAX_LENGTH 65535
+typedef unsigned short JsVarArrayBufferIdx;
 
 typedef struct {
   unsigned short byteOffset;
   unsigned short length;
   JsVarDataArrayBufferViewType type;
 } PACKED_FLAGS JsVarDataArrayBufferView;
+#endif
 
 /// Data for native functions
 typedef struct {
@@ -272,10 +286,20 @@ void jsvSoftKill(); ///< called when saving to flash
 JsVar *jsvFindOrCreateRoot(); ///< Find or create the ROOT variable item - used mainly if recovering from a saved state.
 unsigned int jsvGetMemoryUsage(); ///< Get number of memory records (JsVars) used
 unsigned int jsvGetMemoryTotal(); ///< Get total amount of memory records
+
+/// Statistics about variable allocation (see jsvGetMemoryStats)
+typedef struct {
+  unsigned int allocations; ///< How many memory records have been allocated since jsvInit
+  unsigned int usage; ///< How many memory records are in use right now
+  unsigned int peak; ///< The most memory records that have been in use at once since jsvInit
+} JsvMemoryStats;
+
+/// Get statistics about how many variables have been allocated
+void jsvGetMemoryStats(JsvMemoryStats *stats);
 bool jsvIsMemoryFull(); ///< Get whether memory is full or not
 void jsvShowAllocated(); ///< Show what is still allocated, for debugging memory problems
-/// Try and allocate more memory - only works if RESIZABLE_JSVARS is defined
-void jsvSetMemoryTotal(unsigned int jsNewVarCount);
+/// Try and allocate more memory - only works if RESIZABLE_JSVARS is defined. Returns false if we couldn't
+bool jsvSetMemoryTotal(unsigned int jsNewVarCount);
 
 
 // Note that jsvNew* don't REF a variable for you, but the do LOCK it
@@ -356,7 +380,8 @@ static ALWAYS_INLINE bool jsvIsObject(const JsVar *v) { return v && (((v->flags&
 static ALWAYS_INLINE bool jsvIsArray(const JsVar *v) { return v && (v->flags&JSV_VARTYPEMASK)==JSV_ARRAY; }
 static ALWAYS_INLINE bool jsvIsArrayBuffer(const JsVar *v) { return v && (v->flags&JSV_VARTYPEMASK)==JSV_ARRAYBUFFER; }
 static ALWAYS_INLINE bool jsvIsArrayBufferName(const JsVar *v) { return v && (v->flags&(JSV_VARTYPEMASK))==JSV_ARRAYBUFFERNAME; }
-static ALWAYS_INLINE bool jsvIsNative(const JsVar *v) { return v && (v->flags&JSV_NATIVE)!=0; }
+static ALWAYS_INLINE bool jsvIsNative(const JsVar *v) { return v && (v->flags&JSV_NATIVE)!=0 && (v->flags&JSV_VARTYPEMASK)!=JSV_OBJECT; }
+static ALWAYS_INLINE bool jsvIsPrototype(const JsVar *v) { return v && (v->flags&(JSV_NATIVE|JSV_VARTYPEMASK))==(JSV_NATIVE|JSV_OBJECT); } ///< Has this object been something's 'prototype'? (JSV_NATIVE on an object)
 static ALWAYS_INLINE bool jsvIsNativeFunction(const JsVar *v) { return v && (v->flags&(JSV_NATIVE|JSV_VARTYPEMASK))==(JSV_NATIVE|JSV_FUNCTION); }
 static ALWAYS_INLINE bool jsvIsUndefined(const JsVar *v) { return v==0; }
 static ALWAYS_INLINE bool jsvIsNull(const JsVar *v) { return v && (v->flags&JSV_VARTYPEMASK)==JSV_NULL; }
@@ -477,7 +502,12 @@ JsVar *jsvAsString(JsVar *var, bool unlockVar); ///< If var is a string, lock an
 JsVar *jsvAsFlatString(JsVar *var); ///< Create a flat string from the given variable (or return it if it is already a flat string). NOTE: THIS CONVERTS VIA A STRING
 bool jsvIsEmptyString(JsVar *v); ///< Returns true if the string is empty - faster than jsvGetStringLength(v)==0
 size_t jsvGetStringLength(const JsVar *v); ///< Get the length of this string, IF it is a string
+#ifdef JSVAR_STRING_TAIL_CACHE
+JsVarRef jsvStringTailGet(JsVarRef str, size_t *tailIndex); ///< If we know a StringExt near the end of this (non-flat) string, return it and set tailIndex to the index of its first character
+void jsvStringTailSet(JsVarRef str, JsVarRef tail, size_t tailIndex); ///< Remember the StringExt at the end of a string (so appending can start from there)
+#endif
 size_t jsvGetFlatStringBlocks(const JsVar *v); ///< return the number of blocks used by the given flat string
+void jsvTruncateFlatString(JsVar *v, size_t byteLength); ///< Make a flat string shorter, freeing any blocks at the end that are no longer needed
 char *jsvGetFlatStringPointer(JsVar *v); ///< Get a pointer to the data in this flat string
 size_t jsvGetLinesInString(JsVar *v); ///<  IN A STRING get the number of lines in the string (min=1)
 size_t jsvGetCharsOnLine(JsVar *v, size_t line); ///<  IN A STRING Get the number of characters on a line - lines start at 1
@@ -495,6 +525,26 @@ bool jsvIsStringEqualOrStartsWith(JsVar *var, const char *str, bool isStartsWith
 bool jsvIsStringEqual(JsVar *var, const char *str); ///< see jsvIsStringEqualOrStartsWith
 bool jsvIsStringEqualAndUnLock(JsVar *var, const char *str); ///< see jsvIsStringEqualOrStartsWith
 int jsvCompareString(JsVar *va, JsVar *vb, size_t starta, size_t startb, bool equalAtEndOfString); ///< Compare 2 strings, starting from the given character positions
+
+#ifdef RESIZABLE_JSVARS
+#define JSV_STRING_SEARCH_MAX_LENGTH 255 ///< Longer strings than this are searched for character by character
+#else
+#define JSV_STRING_SEARCH_MAX_LENGTH 32 ///< Longer strings than this are searched for character by character (keeps JsvStringSearch small on the stack)
+#endif
+/// For finding a string in other strings (see jsvStringSearchFind)
+typedef struct {
+  JsVar *search; ///< What we're looking for (not locked)
+  size_t length; ///< jsvGetStringLength(search)
+  unsigned char skip[256]; ///< How far to move on if the last character we're looking at is this one
+  unsigned char chars[JSV_STRING_SEARCH_MAX_LENGTH+1]; ///< The characters in 'search' (if it's short enough)
+} JsvStringSearch;
+/// Get ready to search for 'search' (which must be a string, and must stay locked while ss is used)
+void jsvStringSearchNew(JsvStringSearch *ss, JsVar *search);
+/// Find the first occurrence in 'str' that starts between startIdx and endIdx (inclusive), or return -1
+int jsvStringSearchFind(JsvStringSearch *ss, JsVar *str, size_t startIdx, size_t endIdx);
+/// Find the last occurrence in 'str' that starts between startIdx and endIdx (inclusive), or return -1
+int jsvStringSearchFindLast(JsvStringSearch *ss, JsVar *str, size_t startIdx, size_t endIdx);
+
 /// Return a new string containing just the characters that are shared between two strings.
 JsVar *jsvGetCommonCharacters(JsVar *va, JsVar *vb);
 int jsvCompareInteger(JsVar *va, JsVar *vb); ///< Compare 2 integers, >0 if va>vb,  <0 if va<vb. If compared with a non-integer, that gets put later
@@ -538,6 +588,9 @@ long long jsvGetLongIntegerAndUnLock(JsVar *v);
 size_t jsvGetArrayBufferLength(JsVar *arrayBuffer);
 /** Get the String the contains the data for this arrayBuffer */
 JsVar *jsvGetArrayBufferBackingString(JsVar *arrayBuffer);
+/** If the data for this arrayBuffer is in a flat string (and is correctly aligned for its element type),
+ * return a pointer to its first element. Otherwise return 0. The pointer is only valid while arrayBuffer is locked */
+char *jsvGetArrayBufferPointer(JsVar *arrayBuffer);
 /** Get the item at the given location in the array buffer and return the result */
 JsVar *jsvArrayBufferGet(JsVar *arrayBuffer, size_t index);
 /** Set the item at the given location in the array buffer */
@@ -612,6 +665,30 @@ JsVar *jsvSetNamedChild(JsVar *parent, JsVar *child, const char *name); // Add a
 JsVar *jsvSetValueOfName(JsVar *name, JsVar *src); // Set the value of a child created with jsvAddName,jsvAddNamedChild. Returns the UNLOCKED name argument
 JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool createIfNotFound); // Non-recursive finding of child with name. Returns a LOCKED var
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound); // Non-recursive finding of child with name. Returns a LOCKED var
+#ifdef JSPARSE_INLINE_CACHE
+/** Incremented whenever something changes that could alter what is found
+ * when looking in a prototype chain (see jspGetNamedFieldCached) */
+extern unsigned int jsvPrototypeVersion;
+#endif
+#ifdef JSVAR_HASH_INDEX
+/// Throw away the hash indexes used to speed up jsvFindChildFrom* on big objects - returns true if any memory was freed
+bool jsvFreeHashIndexes();
+#endif
+#ifdef JSVAR_ARRAY_INDEX
+/// Throw away the indexes used to speed up finding elements in big arrays - returns true if any memory was freed
+bool jsvFreeArrayIndexes();
+#endif
+
+#ifdef JSVAR_STRING_INDEX
+/// Only strings accessed past this character get an index (see jsvStringIndexFind)
+#define JSV_STRING_INDEX_MIN_CHARS 256
+/** Use (or build) an index to find the block (the string itself, or a StringExt) of a long
+ * non-flat string that contains character idx, and set blockIndex to the index of its first
+ * character. Returns 0 if it can't, in which case the string has to be walked. */
+JsVarRef jsvStringIndexFind(JsVar *str, size_t idx, size_t *blockIndex);
+/// Throw away the indexes used to speed up finding characters in long strings - returns true if any memory was freed
+bool jsvFreeStringIndexes();
+#endif
 
 /// Remove a child - note that the child MUST ACTUALLY BE A CHILD! and should be a name, not a value.
 void jsvRemoveChild(JsVar *parent, JsVar *child);
@@ -649,8 +726,32 @@ static ALWAYS_INLINE bool jsvArrayIsEmpty(JsVar *arr) { assert(jsvIsArray(arr));
 /** Write debug info for this Var out to the console */
 void jsvTrace(JsVar *var, int indent);
 
-/** Run a garbage collection sweep - return true if things have been freed */
-bool jsvGarbageCollect();
+/** Run a garbage collection sweep - return the number of variables that have been freed */
+int jsvGarbageCollect();
+
+/// Statistics about garbage collection (see jsvGetGarbageCollectStats)
+typedef struct {
+  unsigned int collections; ///< How many garbage collections have completed
+  unsigned int freed; ///< How many variables the last collection freed
+  JsSysTime time; ///< Total time spent in the last collection
+  JsSysTime maxPause; ///< The longest that garbage collection has stopped everything else for
+  JsSysTime totalTime; ///< Total time spent garbage collecting, over all collections
+} JsvGarbageCollectStats;
+
+/// Get statistics about garbage collection
+void jsvGetGarbageCollectStats(JsvGarbageCollectStats *stats);
+
+#ifdef JSVAR_INCREMENTAL_GC
+/** Do some garbage collection, for roughly jsvGetGarbageCollectSliceTime(). This will
+ * start a collection if one isn't in progress. Returns true if there's still more to do */
+bool jsvGarbageCollectStep();
+/// Is a garbage collection in progress (see jsvGarbageCollectStep)
+bool jsvGarbageCollectInProgress();
+/// Get the maximum time that jsvGarbageCollectStep will run for
+JsSysTime jsvGetGarbageCollectSliceTime();
+/// Set the maximum time that jsvGarbageCollectStep will run for - 0 means do the whole collection in one go
+void jsvSetGarbageCollectSliceTime(JsSysTime time);
+#endif
 
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
 JsVar *jsvStringTrimRight(JsVar *srcString);
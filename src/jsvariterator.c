@@ -153,6 +153,18 @@ void jsvStringIteratorNew(JsvStringIterator *it, JsVar *str, size_t startIdx) {
   } else {
     it->varIndex = 0;
     it->charIdx = startIdx;
+#ifdef JSVAR_STRING_INDEX
+    size_t blockIndex;
+    JsVarRef block;
+    if (startIdx >= JSV_STRING_INDEX_MIN_CHARS && jsvIsString(str) &&
+        (block = jsvStringIndexFind(str, startIdx, &blockIndex))) {
+      jsvUnLock(it->var);
+      it->var = jsvLock(block);
+      it->charsInVar = jsvGetCharactersInVar(it->var);
+      it->varIndex = blockIndex;
+      it->charIdx = startIdx - blockIndex;
+    }
+#endif
   }
   while (it->charIdx>0 && it->charIdx >= it->charsInVar) {
     it->charIdx -= it->charsInVar;
@@ -180,6 +192,21 @@ void jsvStringIteratorNext(JsvStringIterator *it) {
 
 void jsvStringIteratorGotoEnd(JsvStringIterator *it) {
   assert(it->var);
+#ifdef JSVAR_STRING_TAIL_CACHE
+  JsVarRef str = 0;
+  if (it->varIndex==0 && jsvIsString(it->var) && jsvGetLastChild(it->var)) {
+    // skip to where the end was last time
+    str = jsvGetRef(it->var);
+    size_t tailIndex;
+    JsVarRef tail = jsvStringTailGet(str, &tailIndex);
+    if (tail) {
+      jsvUnLock(it->var);
+      it->var = jsvLock(tail);
+      it->varIndex = tailIndex;
+      it->charsInVar = jsvGetCharactersInVar(it->var);
+    }
+  }
+#endif
   while (jsvGetLastChild(it->var)) {
     JsVar *next = jsvLock(jsvGetLastChild(it->var));
     jsvUnLock(it->var);
@@ -187,6 +214,9 @@ void jsvStringIteratorGotoEnd(JsvStringIterator *it) {
     it->varIndex += it->charsInVar;
     it->charsInVar = jsvGetCharactersInVar(it->var);
   }
+#ifdef JSVAR_STRING_TAIL_CACHE
+  if (str) jsvStringTailSet(str, jsvGetRef(it->var), it->varIndex);
+#endif
   if (it->charsInVar) it->charIdx = it->charsInVar-1;
   else it->charIdx = 0;
 }
@@ -231,6 +261,7 @@ void   jsvArrayBufferIteratorNew(JsvArrayBufferIterator *it, JsVar *arrayBuffer,
   it->type = arrayBuffer->varData.arraybuffer.type;
   it->byteLength = arrayBuffer->varData.arraybuffer.length * JSV_ARRAYBUFFER_GET_SIZE(it->type);
   it->byteOffset = arrayBuffer->varData.arraybuffer.byteOffset;
+  it->flatData = 0;
   JsVar *arrayBufferData = jsvGetArrayBufferBackingString(arrayBuffer);
 
   it->byteLength += it->byteOffset; // because we'll check if we have more bytes using this
@@ -241,14 +272,46 @@ void   jsvArrayBufferIteratorNew(JsvArrayBufferIterator *it, JsVar *arrayBuffer,
     return;
   }
   jsvStringIteratorNew(&it->it, arrayBufferData, (size_t)it->byteOffset);
+  // 'it' keeps the flat string locked, so this pointer stays valid until jsvArrayBufferIteratorFree
+  if (jsvIsFlatString(arrayBufferData))
+    it->flatData = jsvGetFlatStringPointer(arrayBufferData);
   jsvUnLock(arrayBufferData);
   it->hasAccessedElement = false;
 }
 
+/// Copy an element to/from flat string data, with a fixed size so the compiler can do it with a single load/store
+static ALWAYS_INLINE void jsvArrayBufferIteratorCopyData(char *dst, const char *src, unsigned int dataLen) {
+  switch (dataLen) {
+  case 1: *dst = *src; break;
+  case 2: memcpy(dst, src, 2); break;
+  case 4: memcpy(dst, src, 4); break;
+  case 8: memcpy(dst, src, 8); break;
+  default: assert(0); break;
+  }
+}
+
+/// Write the data for an element
+static void jsvArrayBufferIteratorSetValueData(JsvArrayBufferIterator *it, char *data) {
+  unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  if (it->flatData) {
+    jsvArrayBufferIteratorCopyData(&it->flatData[it->byteOffset], data, dataLen);
+    return;
+  }
+  for (i=0;i<dataLen;i++) {
+    jsvStringIteratorSetChar(&it->it, data[i]);
+    if (dataLen!=1) jsvStringIteratorNext(&it->it);
+  }
+  if (dataLen!=1) it->hasAccessedElement = true;
+}
+
 static void jsvArrayBufferIteratorGetValueData(JsvArrayBufferIterator *it, char *data) {
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
   assert(!it->hasAccessedElement); // we just haven't implemented this case yet
   unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  if (it->flatData) {
+    jsvArrayBufferIteratorCopyData(data, &it->flatData[it->byteOffset], dataLen);
+    return;
+  }
   for (i=0;i<dataLen;i++) {
     data[i] = jsvStringIteratorGetChar(&it->it);
     if (dataLen!=1) jsvStringIteratorNext(&it->it);
@@ -347,7 +410,7 @@ void jsvArrayBufferIteratorSetIntegerValue(JsvArrayBufferIterator *it, JsVarInt
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
   assert(!it->hasAccessedElement); // we just haven't implemented this case yet
   char data[8];
-  unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
 
   if (JSV_ARRAYBUFFER_IS_FLOAT(it->type)) {
     jsvArrayBufferIteratorFloatToData(data, dataLen, it->type, (JsVarFloat)v);
@@ -355,18 +418,29 @@ void jsvArrayBufferIteratorSetIntegerValue(JsvArrayBufferIterator *it, JsVarInt
     jsvArrayBufferIteratorIntToData(data, dataLen, it->type, v);
   }
 
-  for (i=0;i<dataLen;i++) {
-    jsvStringIteratorSetChar(&it->it, data[i]);
-    if (dataLen!=1) jsvStringIteratorNext(&it->it);
+  jsvArrayBufferIteratorSetValueData(it, data);
+}
+
+void jsvArrayBufferIteratorSetFloatValue(JsvArrayBufferIterator *it, JsVarFloat v) {
+  if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
+  assert(!it->hasAccessedElement); // we just haven't implemented this case yet
+  char data[8];
+  unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+
+  if (JSV_ARRAYBUFFER_IS_FLOAT(it->type)) {
+    jsvArrayBufferIteratorFloatToData(data, dataLen, it->type, v);
+  } else {
+    jsvArrayBufferIteratorIntToData(data, dataLen, it->type, (JsVarInt)v);
   }
-  if (dataLen!=1) it->hasAccessedElement = true;
+
+  jsvArrayBufferIteratorSetValueData(it, data);
 }
 
 void   jsvArrayBufferIteratorSetValue(JsvArrayBufferIterator *it, JsVar *value) {
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
   assert(!it->hasAccessedElement); // we just haven't implemented this case yet
   char data[8];
-  unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
 
   if (JSV_ARRAYBUFFER_IS_FLOAT(it->type)) {
     jsvArrayBufferIteratorFloatToData(data, dataLen, it->type, jsvGetFloat(value));
@@ -374,11 +448,7 @@ void   jsvArrayBufferIteratorSetValue(JsvArrayBufferIterator *it, JsVar *value)
     jsvArrayBufferIteratorIntToData(data, dataLen, it->type, jsvGetInteger(value));
   }
 
-  for (i=0;i<dataLen;i++) {
-    jsvStringIteratorSetChar(&it->it, data[i]);
-    if (dataLen!=1) jsvStringIteratorNext(&it->it);
-  }
-  if (dataLen!=1) it->hasAccessedElement = true;
+  jsvArrayBufferIteratorSetValueData(it, data);
 }
 
 void jsvArrayBufferIteratorSetByteValue(JsvArrayBufferIterator *it, char c) {
@@ -386,7 +456,8 @@ void jsvArrayBufferIteratorSetByteValue(JsvArrayBufferIterator *it, char c) {
     assert(0);
     return;
   }
-  jsvStringIteratorSetChar(&it->it, c);
+  if (it->flatData) it->flatData[it->byteOffset] = c;
+  else jsvStringIteratorSetChar(&it->it, c);
 }
 
 void jsvArrayBufferIteratorSetValueAndRewind(JsvArrayBufferIterator *it, JsVar *value) {
@@ -411,7 +482,10 @@ bool   jsvArrayBufferIteratorHasElement(JsvArrayBufferIterator *it) {
 void   jsvArrayBufferIteratorNext(JsvArrayBufferIterator *it) {
   it->index++;
   it->byteOffset += JSV_ARRAYBUFFER_GET_SIZE(it->type);
-  if (!it->hasAccessedElement) {
+  if (it->flatData) {
+    // keep 'it' in step in case anything reads from it directly
+    it->it.charIdx += JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  } else if (!it->hasAccessedElement) {
     unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
     while (dataLen--)
       jsvStringIteratorNext(&it->it);
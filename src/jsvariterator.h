@@ -188,6 +188,7 @@ typedef struct JsvArrayBufferIterator {
   size_t byteOffset;
   size_t index;
   bool hasAccessedElement;
+  char *flatData; ///< If the data is in a flat string, a pointer to the start of the string. Elements are then read/written here directly rather than with 'it'
 } JsvArrayBufferIterator;
 
 /* TODO: can we add it->getIntegerValue/etc that get set by jsvArrayBufferIteratorNew?
@@ -215,6 +216,7 @@ JsVarFloat jsvArrayBufferIteratorGetFloatValue(JsvArrayBufferIterator *it);
 void   jsvArrayBufferIteratorSetValue(JsvArrayBufferIterator *it, JsVar *value);
 void   jsvArrayBufferIteratorSetValueAndRewind(JsvArrayBufferIterator *it, JsVar *value);
 void   jsvArrayBufferIteratorSetIntegerValue(JsvArrayBufferIterator *it, JsVarInt value);
+void   jsvArrayBufferIteratorSetFloatValue(JsvArrayBufferIterator *it, JsVarFloat value);
 void   jsvArrayBufferIteratorSetByteValue(JsvArrayBufferIterator *it, char c); ///< special case for when we know we're writing to a byte array
 JsVar* jsvArrayBufferIteratorGetIndex(JsvArrayBufferIterator *it);
 bool   jsvArrayBufferIteratorHasElement(JsvArrayBufferIterator *it);
@@ -601,20 +601,84 @@ Returns true if the provided object is an array
  */
 
 
-NO_INLINE static JsVarInt _jswrap_array_sort_compare(JsVar *a, JsVar *b, JsVar *compareFn) {
-  if (compareFn) {
-    JsVar *args[2] = {a,b};
-    return jsvGetIntegerAndUnLock(jspeFunctionCall(compareFn, 0, 0, false, 2, args));
+/// One element being sorted by jswrap_array_sort
+typedef struct {
+  JsVar *var; ///< The (locked) name of the element, or its value for ArrayBuffers
+  JsVar *key; ///< If there's no compare function, the (locked) string to compare with - or 0 if the value is already a string
+} JswSortItem;
+
+/// How jswrap_array_sort compares elements
+typedef struct {
+  JsVar *compareFn; ///< The user's compare function, or 0
+  bool numeric; ///< With no compare function, compare as numbers (for ArrayBuffers) rather than as strings
+} JswSortInfo;
+
+NO_INLINE static int _jswrap_array_sort_compare(JswSortItem *a, JswSortItem *b, JswSortInfo *info) {
+  if (jspIsInterrupted()) return 0; // leave everything else where it is
+  if (info->compareFn) {
+    JsVar *args[2] = {jsvSkipName(a->var), jsvSkipName(b->var)};
+    JsVarFloat r = jsvGetFloatAndUnLock(jspeFunctionCall(info->compareFn, 0, 0, false, 2, args));
+    jsvUnLock2(args[0], args[1]);
+    return (r<0) ? -1 : ((r>0) ? 1 : 0);
+  } else if (info->numeric) {
+    JsVarFloat fa = jsvGetFloat(a->var);
+    JsVarFloat fb = jsvGetFloat(b->var);
+    return (fa<fb) ? -1 : ((fa>fb) ? 1 : 0);
   } else {
-    JsVar *sa = jsvAsString(a, false);
-    JsVar *sb = jsvAsString(b, false);
-    JsVarInt r = jsvCompareString(sa,sb, 0, 0, false);
+    JsVar *sa = a->key ? jsvLockAgain(a->key) : jsvSkipName(a->var);
+    JsVar *sb = b->key ? jsvLockAgain(b->key) : jsvSkipName(b->var);
+    int r = jsvCompareString(sa, sb, 0, 0, false);
     jsvUnLock2(sa, sb);
     return r;
   }
 }
 
-NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compareFn) {
+/** Stable merge sort of n items, using tmp (which must also hold n items). This
+ * does as few comparisons as we can (as each may be a call into JS), and already
+ * sorted runs are only compared once when they're merged. */
+static void _jswrap_array_sort_items(JswSortItem *items, JswSortItem *tmp, size_t n, JswSortInfo *info) {
+  JswSortItem *src = items, *dst = tmp;
+  size_t width;
+  for (width=1; width<n; width*=2) {
+    size_t lo;
+    for (lo=0; lo<n; lo+=width*2) {
+      size_t mid = lo+width, hi = lo+width*2;
+      if (mid>n) mid = n;
+      if (hi>n) hi = n;
+      if (mid<hi && _jswrap_array_sort_compare(&src[mid-1], &src[mid], info)<=0) {
+        // already in order
+        memcpy(&dst[lo], &src[lo], (hi-lo)*sizeof(JswSortItem));
+        continue;
+      }
+      size_t i = lo, j = mid, k = lo;
+      while (i<mid && j<hi)
+        dst[k++] = (_jswrap_array_sort_compare(&src[j], &src[i], info)<0) ? src[j++] : src[i++];
+      while (i<mid) dst[k++] = src[i++];
+      while (j<hi) dst[k++] = src[j++];
+    }
+    JswSortItem *t = src;
+    src = dst;
+    dst = t;
+  }
+  if (src!=items)
+    memcpy(items, src, n*sizeof(JswSortItem));
+}
+
+/// Compare two values (rather than JswSortItems), for _jswrap_array_sort_inplace
+static int _jswrap_array_sort_compare_values(JsVar *a, JsVar *b, JswSortInfo *info) {
+  JswSortItem ia = {a, 0}, ib = {b, 0};
+  if (!info->compareFn && !info->numeric) {
+    ia.key = jsvAsString(a, false);
+    ib.key = jsvAsString(b, false);
+  }
+  int r = _jswrap_array_sort_compare(&ia, &ib, info);
+  jsvUnLock2(ia.key, ib.key);
+  return r;
+}
+
+/** In-place quicksort of n elements starting at head. This isn't stable, and is slower than
+ * _jswrap_array_sort_items, but needs no memory - so it's used if we can't allocate the buffer */
+NO_INLINE static void _jswrap_array_sort_inplace(JsvIterator *head, int n, JswSortInfo *info) {
   if (n < 2) return; // sort done!
 
   JsvIterator pivot = jsvIteratorClone(head);
@@ -625,33 +689,19 @@ NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compar
    * swap the values over (hence moving pivot forwards)  */
 
   int nlo = 0, nhigh = 0;
-  JsvIterator it = jsvIteratorClone(head); //
+  JsvIterator it = jsvIteratorClone(head);
   jsvIteratorNext(&it);
 
-
   /* Partition and count sizes. */
   while (--n && !jspIsInterrupted()) {
     JsVar *itValue = jsvIteratorGetValue(&it);
-    JsVarInt cmp = _jswrap_array_sort_compare(itValue, pivotValue, compareFn);
+    int cmp = _jswrap_array_sort_compare_values(itValue, pivotValue, info);
     if (cmp<=0) {
       if (cmp<0) pivotLowest = false;
       nlo++;
-      /* 'it' <= 'pivot', so we need to move it behind.
-         In this diagram, P=pivot, L=it
-
-               l l l l l P h h h h h L
-                         |  \       /
-                          \  \_____/_
-                          _\______/  \
-                         / |         |
-                         | |         |
-               l l l l l L P h h h h h
-
-         It makes perfect sense now...
-       */
-      // first, get the old pivot value and overwrite it with the iterator value
+      /* 'it' <= 'pivot', so we need to move it behind - first overwrite the pivot
+       * with it, then move the pivot forwards, and put what was there in 'it' */
       jsvIteratorSetValue(&pivot, itValue); // no unlock needed
-      // now move pivot forwards, and set 'it' to the value the new pivot has
       jsvIteratorNext(&pivot);
       jsvUnLock(jsvIteratorSetValue(&it, jsvIteratorGetValue(&pivot)));
       // finally set the pivot iterator to the pivot's value again
@@ -665,23 +715,105 @@ NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compar
   }
   jsvIteratorFree(&it);
   jsvUnLock(pivotValue);
-
   if (jspIsInterrupted()) {
     jsvIteratorFree(&pivot);
     return;
   }
 
-  // now recurse. Do RHS first because we can
-  // free the pivot early if we do this
+  // now recurse. Do RHS first because we can free the pivot early if we do this
   jsvIteratorNext(&pivot);
-  _jswrap_array_sort(&pivot, nhigh, compareFn);
+  _jswrap_array_sort_inplace(&pivot, nhigh, info);
   jsvIteratorFree(&pivot);
-  // LHS
-  /* If the pivot is the lowest number in this chunk of numbers, then
-   * we know that anything to the left of it must be joint equal to it.
-   * In that casem there's no need to sort it. */
+  // LHS - if the pivot is the lowest value here, everything to the left of it is equal to it
   if (!pivotLowest)
-    _jswrap_array_sort(head, nlo, compareFn);
+    _jswrap_array_sort_inplace(head, nlo, info);
+}
+
+/* Numeric sort of typed array data in place - quicksort with a median of 3 pivot,
+ * falling back to heapsort if it goes too deep, and insertion sort for the last
+ * few elements. NaN goes at the end. */
+#define JSW_SORT_LT(A,B) ((A)<(B) || ((B)!=(B) && (A)==(A)))
+#define JSW_SORT_NUMERIC(T) \
+static void _jswrap_array_sort_heap_##T(T *d, size_t n) { \
+  size_t i = n/2, end = n; \
+  while (end>1) { \
+    T v; \
+    if (i>0) v = d[--i]; \
+    else { end--; v = d[end]; d[end] = d[0]; } \
+    size_t p = i, c; \
+    while ((c = p*2+1) < end) { \
+      if (c+1<end && JSW_SORT_LT(d[c], d[c+1])) c++; \
+      if (!JSW_SORT_LT(v, d[c])) break; \
+      d[p] = d[c]; \
+      p = c; \
+    } \
+    d[p] = v; \
+  } \
+} \
+static void _jswrap_array_sort_##T(T *d, size_t n, int depth) { \
+  while (n>16) { \
+    if (depth-- <= 0) { \
+      _jswrap_array_sort_heap_##T(d, n); \
+      return; \
+    } \
+    T a = d[0], b = d[n/2], c = d[n-1], p; \
+    if (JSW_SORT_LT(a,b)) p = JSW_SORT_LT(b,c) ? b : (JSW_SORT_LT(a,c) ? c : a); \
+    else p = JSW_SORT_LT(a,c) ? a : (JSW_SORT_LT(b,c) ? c : b); \
+    size_t i = 0, j = n-1; \
+    while (true) { \
+      while (JSW_SORT_LT(d[i], p)) i++; \
+      while (JSW_SORT_LT(p, d[j])) j--; \
+      if (i>=j) break; \
+      T t = d[i]; d[i] = d[j]; d[j] = t; \
+      i++; j--; \
+    } \
+    /* [0..j] and [j+1..n) - recurse on the smaller half so the stack stays small */ \
+    if (j+1 < n-(j+1)) { \
+      _jswrap_array_sort_##T(d, j+1, depth); \
+      d += j+1; n -= j+1; \
+    } else { \
+      _jswrap_array_sort_##T(d+j+1, n-(j+1), depth); \
+      n = j+1; \
+    } \
+  } \
+  size_t i, j; \
+  for (i=1;i<n;i++) { \
+    T v = d[i]; \
+    for (j=i; j>0 && JSW_SORT_LT(v, d[j-1]); j--) d[j] = d[j-1]; \
+    d[j] = v; \
+  } \
+}
+JSW_SORT_NUMERIC(uint8_t)
+JSW_SORT_NUMERIC(int8_t)
+JSW_SORT_NUMERIC(uint16_t)
+JSW_SORT_NUMERIC(int16_t)
+JSW_SORT_NUMERIC(uint32_t)
+JSW_SORT_NUMERIC(int32_t)
+JSW_SORT_NUMERIC(float)
+JSW_SORT_NUMERIC(double)
+
+/// Sort the data of a typed array numerically, in place. Returns false if the data isn't somewhere we can get at directly
+static bool _jswrap_array_sort_arraybuffer(JsVar *array) {
+  char *data = jsvGetArrayBufferPointer(array);
+  if (!data) return false;
+  size_t n = jsvGetArrayBufferLength(array);
+  int depth = 0;
+  size_t i;
+  for (i=n; i; i>>=1) depth += 2;
+#define JSW_SORT(T) _jswrap_array_sort_##T((T*)data, n, depth)
+  switch (array->varData.arraybuffer.type & (ARRAYBUFFERVIEW_MASK_SIZE|ARRAYBUFFERVIEW_SIGNED|ARRAYBUFFERVIEW_FLOAT)) {
+  case ARRAYBUFFERVIEW_UINT8: JSW_SORT(uint8_t); break;
+  case ARRAYBUFFERVIEW_INT8: JSW_SORT(int8_t); break;
+  case ARRAYBUFFERVIEW_UINT16: JSW_SORT(uint16_t); break;
+  case ARRAYBUFFERVIEW_INT16: JSW_SORT(int16_t); break;
+  case ARRAYBUFFERVIEW_UINT32: JSW_SORT(uint32_t); break;
+  case ARRAYBUFFERVIEW_INT32: JSW_SORT(int32_t); break;
+  case ARRAYBUFFERVIEW_FLOAT32: JSW_SORT(float); break;
+  case ARRAYBUFFERVIEW_FLOAT64: JSW_SORT(double); break;
+  default: return false;
+  }
+#undef JSW_SORT
+  return true;
 }
 
 /*JSON{
@@ -695,39 +827,114 @@ NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compar
   ],
   "return" : ["JsVar","This array object"]
 }
-Do an in-place quicksort of the array
+Do an in-place, stable sort of the array. With no compare function, elements are compared as strings.
+If there isn't enough free memory for a stable sort, a slower quicksort that needs no extra memory is used instead.
  */
 JsVar *jswrap_array_sort (JsVar *array, JsVar *compareFn) {
   if (!jsvIsUndefined(compareFn) && !jsvIsFunction(compareFn)) {
     jsExceptionHere(JSET_ERROR, "Expecting compare function, got %t", compareFn);
     return 0;
   }
-  JsvIterator it;
-
-  /* Arrays can be sparse and the iterators don't handle this
-    (we're not going to mess with indices) so we have to count
-     up the number of elements manually.
-
-     FIXME: sort is broken for sparse arrays anyway (it basically
-     ignores all the 'undefined' entries). I wonder whether just
-     compacting the array down to start from 0 before we start would
-     fix this?
-   */
-  int n=0;
-  if (jsvIsArray(array) || jsvIsObject(array)) {
+  JswSortInfo info;
+  info.compareFn = jsvIsUndefined(compareFn) ? 0 : compareFn;
+  info.numeric = jsvIsArrayBuffer(array);
+  if (info.numeric && !info.compareFn && _jswrap_array_sort_arraybuffer(array))
+    return jsvLockAgain(array);
+  if (!jsvIsArray(array) && !jsvIsObject(array) && !jsvIsArrayBuffer(array))
+    return jsvLockAgain(array);
+
+  /* Lock every element (the name, so we don't need more than one lock on any value
+   * that's in the array more than once) into a buffer, sort the buffer, and then
+   * write the values back in their new order. */
+  size_t n = info.numeric ? jsvGetArrayBufferLength(array) : (size_t)jsvGetChildren(array);
+  if (n<2) return jsvLockAgain(array);
+  JsVar *buffer = jsvNewFlatStringOfLength((unsigned int)((n*2+1)*sizeof(JswSortItem)));
+  if (!buffer) {
+    // not enough memory for the merge sort's buffer - sort in place instead
+    JsvIterator it;
     jsvIteratorNew(&it, array);
-    while (jsvIteratorHasElement(&it)) {
-      n++;
-      jsvIteratorNext(&it);
-    }
+    _jswrap_array_sort_inplace(&it, (int)n, &info);
     jsvIteratorFree(&it);
+    return jsvLockAgain(array);
+  }
+  // flat string data isn't always aligned, so leave space to align it
+  JswSortItem *items = (JswSortItem*)(((size_t)jsvGetFlatStringPointer(buffer) + sizeof(void*)-1) & ~(sizeof(void*)-1));
+  size_t i = 0;
+  if (info.numeric) {
+    JsvArrayBufferIterator it;
+    jsvArrayBufferIteratorNew(&it, array, 0);
+    while (i<n && jsvArrayBufferIteratorHasElement(&it)) {
+      items[i].var = jsvArrayBufferIteratorGetValue(&it);
+      items[i++].key = 0;
+      jsvArrayBufferIteratorNext(&it);
+    }
+    jsvArrayBufferIteratorFree(&it);
   } else {
-    n = (int)jsvGetLength(array);
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, array);
+    while (i<n && jsvObjectIteratorHasValue(&it)) {
+      items[i].var = jsvObjectIteratorGetKey(&it);
+      items[i].key = 0;
+      if (!info.compareFn) {
+        // work out the string to compare with now, rather than on every comparison
+        JsVar *v = jsvSkipName(items[i].var);
+        if (!jsvIsString(v)) items[i].key = jsvAsString(v, false);
+        jsvUnLock(v);
+      }
+      i++;
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
   }
+  n = i;
 
-  jsvIteratorNew(&it, array);
-  _jswrap_array_sort(&it, n, compareFn);
-  jsvIteratorFree(&it);
+  _jswrap_array_sort_items(items, &items[n], n, &info);
+
+  if (info.numeric) {
+    JsvArrayBufferIterator it;
+    jsvArrayBufferIteratorNew(&it, array, 0);
+    for (i=0; i<n && jsvArrayBufferIteratorHasElement(&it); i++) {
+      jsvArrayBufferIteratorSetValue(&it, items[i].var);
+      jsvArrayBufferIteratorNext(&it);
+    }
+    jsvArrayBufferIteratorFree(&it);
+  } else {
+    /* Reference all the values in their new order (the second half of the buffer is free
+     * now) so none get freed as we overwrite them, then put them back into the names in
+     * their original order. Values that were stored in the name itself (small ints) are
+     * new vars that nothing else can reach, so they're kept locked instead - otherwise
+     * they could be garbage collected if we run out of memory while making the others. */
+    JsVarRef *values = (JsVarRef*)&items[n];
+    for (i=0; i<n; i++) {
+      jsvUnLock(items[i].key);
+      items[i].key = 0;
+      JsVar *v = jsvSkipName(items[i].var);
+      if (v && jsvIsNameWithValue(items[i].var)) {
+        items[i].key = v;
+      } else {
+        values[i] = v ? jsvGetRef(jsvRef(v)) : 0;
+        jsvUnLock(v);
+      }
+    }
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, array);
+    for (i=0; i<n; i++) {
+      JsVar *v = items[i].key ? items[i].key : (values[i] ? jsvLock(values[i]) : 0);
+      if (jsvObjectIteratorHasValue(&it)) {
+        JsVar *name = jsvObjectIteratorGetKey(&it);
+        jsvSetValueOfName(name, v);
+        jsvUnLock(name);
+        jsvObjectIteratorNext(&it);
+      }
+      if (v && !items[i].key) jsvUnRef(v);
+      jsvUnLock(v);
+      items[i].key = 0;
+    }
+    jsvObjectIteratorFree(&it);
+  }
+  for (i=0; i<n; i++)
+    jsvUnLock2(items[i].var, items[i].key);
+  jsvUnLock(buffer);
   return jsvLockAgain(array);
 }
 
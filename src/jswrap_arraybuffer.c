@@ -147,7 +147,7 @@ Instantiate this in order to efficiently store arrays of data (Espruino's normal
 Create an Array Buffer object
  */
 JsVar *jswrap_arraybuffer_constructor(JsVarInt byteLength) {
-  if (byteLength < 0 || byteLength>65535) {
+  if (byteLength < 0) {
     jsExceptionHere(JSET_ERROR, "Invalid length for ArrayBuffer\n");
     return 0;
   }
@@ -155,11 +155,11 @@ JsVar *jswrap_arraybuffer_constructor(JsVarInt byteLength) {
     jsExceptionHere(JSET_ERROR, "ArrayBuffer too long\n");
     return 0;
   }
-  // try and use a flat string - which will be faster
+  // try and use a flat string - which will be faster, as elements can be accessed directly
   JsVar *arrData = 0;
-  /* if the bytes could fit into 1 or 2 normal string blocks, do that.
-   * It's faster to allocate and can use less memory (if it fits into one block) */
-  if (byteLength > (JSVAR_DATA_STRING_LEN+JSVAR_DATA_STRING_MAX_LEN))
+  /* if the bytes could fit into a normal string block, do that.
+   * It's faster to allocate and uses less memory */
+  if (byteLength > JSVAR_DATA_STRING_LEN)
     arrData = jsvNewFlatStringOfLength((unsigned int)byteLength);
   // if we haven't found one, spread it out
   if (!arrData)
@@ -338,14 +338,21 @@ JsVar *jswrap_typedarray_constructor(JsVarDataArrayBufferViewType type, JsVar *a
     return 0;
   }
   if (length==0) length = (JsVarInt)(jsvGetArrayBufferLength(arrayBuffer) / JSV_ARRAYBUFFER_GET_SIZE(type));
+  if (length > JSV_ARRAYBUFFER_MAX_LENGTH) {
+    jsExceptionHere(JSET_ERROR, "Typed array too long\n");
+    jsvUnLock(arrayBuffer);
+    return 0;
+  }
   JsVar *typedArr = jsvNewWithFlags(JSV_ARRAYBUFFER);
   if (typedArr) {
     typedArr->varData.arraybuffer.type = type;
-    typedArr->varData.arraybuffer.byteOffset = (unsigned short)byteOffset;
-    typedArr->varData.arraybuffer.length = (unsigned short)length;
+    typedArr->varData.arraybuffer.byteOffset = (JsVarArrayBufferIdx)byteOffset;
+    typedArr->varData.arraybuffer.length = (JsVarArrayBufferIdx)length & JSV_ARRAYBUFFER_MAX_LENGTH; // checked above - the mask just tells the compiler it fits
     jsvSetFirstChild(typedArr, jsvGetRef(jsvRef(arrayBuffer)));
 
-    if (copyData) {
+    if (copyData && jsvIsArrayBuffer(arr)) {
+      jswrap_arraybufferview_set(typedArr, arr, 0);
+    } else if (copyData) {
       // if we were given an array, populate this ArrayBuffer
       JsvIterator it;
       jsvIteratorNew(&it, arr);
@@ -390,7 +397,7 @@ The length, in bytes, of the view
   "type" : "property",
   "class" : "ArrayBufferView",
   "name" : "byteOffset",
-  "generate_full" : "parent->varData.arraybuffer.byteOffset",
+  "generate_full" : "(JsVarInt)parent->varData.arraybuffer.byteOffset",
   "return" : ["int","The byte Offset"]
 }
 The offset, in bytes, to the first byte of the view within the ArrayBuffer
@@ -413,6 +420,25 @@ void jswrap_arraybufferview_set(JsVar *parent, JsVar *arr, int offset) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to be an array, not %t", arr);
     return;
   }
+  if (jsvIsArrayBuffer(arr) && offset>=0 &&
+      JSV_ARRAYBUFFER_GET_SIZE(arr->varData.arraybuffer.type)==JSV_ARRAYBUFFER_GET_SIZE(parent->varData.arraybuffer.type) &&
+      (arr->varData.arraybuffer.type & ~ARRAYBUFFERVIEW_CLAMPED)==(parent->varData.arraybuffer.type & ~ARRAYBUFFERVIEW_CLAMPED)) {
+    // Same type of data, and both flat - just copy the bytes (memmove, as they may share a buffer)
+    char *src = jsvGetArrayBufferPointer(arr);
+    char *dst = jsvGetArrayBufferPointer(parent);
+    size_t srcLen = jsvGetArrayBufferLength(arr);
+    size_t dstLen = jsvGetArrayBufferLength(parent);
+    if (src && dst) {
+      if ((size_t)offset < dstLen) {
+        size_t n = dstLen-(size_t)offset;
+        if (n > srcLen) n = srcLen;
+        size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(parent->varData.arraybuffer.type);
+        memmove(dst + (size_t)offset*elementSize, src, n*elementSize);
+      }
+      return;
+    }
+  }
+
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
   JsvArrayBufferIterator itdst;
@@ -473,32 +499,26 @@ JsVar *jswrap_arraybufferview_map(JsVar *parent, JsVar *funcVar, JsVar *thisVar)
   if (!array) return 0;
 
   // now iterate
-  JsvIterator it; // TODO: if we really are limited to ArrayBuffers, this could be an ArrayBufferIterator.
-  jsvIteratorNew(&it, parent);
+  JsvArrayBufferIterator it;
+  jsvArrayBufferIteratorNew(&it, parent, 0);
   JsvArrayBufferIterator itdst;
   jsvArrayBufferIteratorNew(&itdst, array, 0);
 
-  while (jsvIteratorHasElement(&it)) {
-    JsVar *index = jsvIteratorGetKey(&it);
-    if (jsvIsInt(index)) {
-      JsVarInt idxValue = jsvGetInteger(index);
-
-      JsVar *args[3], *mapped;
-      args[0] = jsvIteratorGetValue(&it);
-      args[1] = jsvNewFromInteger(idxValue); // child is a variable name, create a new variable for the index
-      args[2] = parent;
-      mapped = jspeFunctionCall(funcVar, 0, thisVar, false, 3, args);
-      jsvUnLockMany(2,args);
-      if (mapped) {
-        jsvArrayBufferIteratorSetValue(&itdst, mapped);
-        jsvUnLock(mapped);
-      }
+  while (jsvArrayBufferIteratorHasElement(&it)) {
+    JsVar *args[3], *mapped;
+    args[0] = jsvArrayBufferIteratorGetValue(&it);
+    args[1] = jsvArrayBufferIteratorGetIndex(&it);
+    args[2] = parent;
+    mapped = jspeFunctionCall(funcVar, 0, thisVar, false, 3, args);
+    jsvUnLockMany(2,args);
+    if (mapped) {
+      jsvArrayBufferIteratorSetValue(&itdst, mapped);
+      jsvUnLock(mapped);
     }
-    jsvUnLock(index);
-    jsvIteratorNext(&it);
+    jsvArrayBufferIteratorNext(&it);
     jsvArrayBufferIteratorNext(&itdst);
   }
-  jsvIteratorFree(&it);
+  jsvArrayBufferIteratorFree(&it);
   jsvArrayBufferIteratorFree(&itdst);
 
   return array;
@@ -545,7 +565,7 @@ Join all elements of this array together into one string, using 'separator' betw
   "return" : ["JsVar","This array object"],
   "return_object" : "ArrayBufferView"
 }
-Do an in-place quicksort of the array
+Do an in-place sort of the array. With no compare function, elements are sorted numerically.
  */
 /*JSON{
   "type" : "method",
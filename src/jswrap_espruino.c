@@ -21,6 +21,7 @@
 #include "jswrapper.h"
 #include "jsinteractive.h"
 #include "jstimer.h"
+#include "jsprofile.h"
 
 /*JSON{
   "type" : "class",
@@ -190,6 +191,120 @@ JsVarFloat jswrap_espruino_clip(JsVarFloat x, JsVarFloat min, JsVarFloat max) {
 }
 
 
+/* Kernels for typed arrays whose data is in a flat string. These work straight on the
+ * raw data rather than going through JsvIterator and a JsVar for every element */
+
+typedef enum {
+  JSWK_SUM,      ///< sum of d[i]
+  JSWK_VARIANCE, ///< sum of (d[i]-mean)^2
+  JSWK_DOT,      ///< sum of d[i]*b[i]
+} JswKernelOp;
+
+#if defined(LINUX) && defined(__GNUC__)
+/// 4 floats that GCC does arithmetic on with SSE/NEON where it can
+typedef JsVarFloat JswFloat4 __attribute__((vector_size(4*sizeof(JsVarFloat))));
+
+#define JSW_KERNEL_SIMD(T) \
+  JswFloat4 acc = {0,0,0,0}; \
+  JswFloat4 m = {mean,mean,mean,mean}; \
+  for (;i+4<=n;i+=4) { \
+    JswFloat4 v = {(JsVarFloat)d[i],(JsVarFloat)d[i+1],(JsVarFloat)d[i+2],(JsVarFloat)d[i+3]}; \
+    if (op==JSWK_VARIANCE) { \
+      v -= m; \
+      v *= v; \
+    } else if (op==JSWK_DOT) { \
+      JswFloat4 bv; \
+      memcpy(&bv, &b[i], sizeof(bv)); \
+      v *= bv; \
+    } \
+    acc += v; \
+  } \
+  total = (acc[0]+acc[1]) + (acc[2]+acc[3]);
+#else
+#define JSW_KERNEL_SIMD(T)
+#endif
+
+/// Create the kernels for one element type
+#define JSW_KERNELS(T) \
+static JsVarFloat jswrap_espruino_reduce_##T(const T *d, size_t n, JswKernelOp op, JsVarFloat mean, const JsVarFloat *b) { \
+  JsVarFloat total = 0; \
+  size_t i = 0; \
+  JSW_KERNEL_SIMD(T) \
+  for (;i<n;i++) { \
+    JsVarFloat v = (JsVarFloat)d[i]; \
+    if (op==JSWK_VARIANCE) { \
+      v -= mean; \
+      v *= v; \
+    } else if (op==JSWK_DOT) \
+      v *= b[i]; \
+    total += v; \
+  } \
+  return total; \
+}
+
+JSW_KERNELS(uint8_t)
+JSW_KERNELS(int8_t)
+JSW_KERNELS(uint16_t)
+JSW_KERNELS(int16_t)
+JSW_KERNELS(uint32_t)
+JSW_KERNELS(int32_t)
+JSW_KERNELS(float)
+JSW_KERNELS(double)
+
+/// Call CALL(T) with the C type of the elements in a typed array of the given type
+#define JSW_KERNEL_SWITCH(TYPE, CALL) \
+  switch ((TYPE) & (ARRAYBUFFERVIEW_MASK_SIZE|ARRAYBUFFERVIEW_SIGNED|ARRAYBUFFERVIEW_FLOAT)) { \
+  case ARRAYBUFFERVIEW_UINT8: CALL(uint8_t); break; \
+  case ARRAYBUFFERVIEW_INT8: CALL(int8_t); break; \
+  case ARRAYBUFFERVIEW_UINT16: CALL(uint16_t); break; \
+  case ARRAYBUFFERVIEW_INT16: CALL(int16_t); break; \
+  case ARRAYBUFFERVIEW_UINT32: CALL(uint32_t); break; \
+  case ARRAYBUFFERVIEW_INT32: CALL(int32_t); break; \
+  case ARRAYBUFFERVIEW_FLOAT32: CALL(float); break; \
+  case ARRAYBUFFERVIEW_FLOAT64: CALL(double); break; \
+  default: assert(0); break; \
+  }
+
+/// Work out the sum (or variance/dot product - see JswKernelOp) of n elements of typed array data
+static JsVarFloat jswrap_espruino_reduce(const char *data, JsVarDataArrayBufferViewType type, size_t n, JswKernelOp op, JsVarFloat mean, const JsVarFloat *b) {
+  JsVarFloat total = 0;
+#define JSW_REDUCE(T) total = jswrap_espruino_reduce_##T((const T*)data, n, op, mean, b)
+  JSW_KERNEL_SWITCH(type, JSW_REDUCE);
+#undef JSW_REDUCE
+  return total;
+}
+
+/// If arr is a typed array with its data in a flat string, return a pointer to it
+static char *jswrap_espruino_getFlatData(JsVar *arr) {
+  return jsvIsArrayBuffer(arr) ? jsvGetArrayBufferPointer(arr) : 0;
+}
+
+#ifdef USE_MATH
+/** If arr is a typed array with its data in a flat string, copy its elements into out and return true */
+static bool jswrap_espruino_load(JsVar *arr, double *out) {
+  char *data = jswrap_espruino_getFlatData(arr);
+  if (!data) return false;
+  size_t i, n = jsvGetArrayBufferLength(arr);
+#define JSW_LOAD(T) for (i=0;i<n;i++) out[i] = (double)((const T*)data)[i]
+  JSW_KERNEL_SWITCH(arr->varData.arraybuffer.type, JSW_LOAD);
+#undef JSW_LOAD
+  return true;
+}
+
+/** If arr is a Float32Array or Float64Array with its data in a flat string, copy v into it and return true.
+ * Integer arrays go through JsvIterator so that they are rounded/clamped in the normal way */
+static bool jswrap_espruino_store(JsVar *arr, const double *v) {
+  char *data = jswrap_espruino_getFlatData(arr);
+  if (!data) return false;
+  size_t i, n = jsvGetArrayBufferLength(arr);
+  switch (arr->varData.arraybuffer.type) {
+  case ARRAYBUFFERVIEW_FLOAT32: for (i=0;i<n;i++) ((float*)data)[i] = (float)v[i]; return true;
+  case ARRAYBUFFERVIEW_FLOAT64: for (i=0;i<n;i++) ((double*)data)[i] = v[i]; return true;
+  default: return false;
+  }
+}
+#endif
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -209,6 +324,9 @@ JsVarFloat jswrap_espruino_sum(JsVar *arr) {
     return NAN;
   }
   JsVarFloat sum = 0;
+  char *data = jswrap_espruino_getFlatData(arr);
+  if (data)
+    return jswrap_espruino_reduce(data, arr->varData.arraybuffer.type, jsvGetArrayBufferLength(arr), JSWK_SUM, 0, 0);
 
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
@@ -240,6 +358,9 @@ JsVarFloat jswrap_espruino_variance(JsVar *arr, JsVarFloat mean) {
     return NAN;
   }
   JsVarFloat variance = 0;
+  char *data = jswrap_espruino_getFlatData(arr);
+  if (data)
+    return jswrap_espruino_reduce(data, arr->varData.arraybuffer.type, jsvGetArrayBufferLength(arr), JSWK_VARIANCE, mean, 0);
 
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
@@ -275,6 +396,37 @@ JsVarFloat jswrap_espruino_convolve(JsVar *arr1, JsVar *arr2, int offset) {
     return NAN;
   }
   JsVarFloat conv = 0;
+  int l = (int)jsvGetLength(arr2);
+  if (l<=0) return 0;
+  offset = offset % l;
+  if (offset<0) offset += l;
+
+  char *data1 = jswrap_espruino_getFlatData(arr1);
+  if (data1 && jsuGetFreeStack() > 256+sizeof(JsVarFloat)*(size_t)l) {
+    /* Load arr2 into b, rotated by offset. Then each l elements of arr1 are just multiplied by b.
+     * arr2 is normally much smaller than arr1 */
+    JsVarFloat *b = (JsVarFloat*)alloca(sizeof(JsVarFloat)*(size_t)l);
+    JsvIterator it;
+    jsvIteratorNew(&it, arr2);
+    int i = 0;
+    while (jsvIteratorHasElement(&it) && i<l) {
+      b[(i+l-offset) % l] = jsvIteratorGetFloatValue(&it);
+      i++;
+      jsvIteratorNext(&it);
+    }
+    jsvIteratorFree(&it);
+    while (i<l) b[(i++ +l-offset) % l] = 0;
+    JsVarDataArrayBufferViewType type = arr1->varData.arraybuffer.type;
+    size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(type);
+    size_t n = jsvGetArrayBufferLength(arr1);
+    size_t start;
+    for (start=0;start<n;start+=(size_t)l) {
+      size_t count = n-start;
+      if (count>(size_t)l) count = (size_t)l;
+      conv += jswrap_espruino_reduce(data1 + start*elementSize, type, count, JSWK_DOT, 0, b);
+    }
+    return conv;
+  }
 
   JsvIterator it1;
   jsvIteratorNew(&it1, arr1);
@@ -282,9 +434,6 @@ JsVarFloat jswrap_espruino_convolve(JsVar *arr1, JsVar *arr2, int offset) {
   jsvIteratorNew(&it2, arr2);
 
   // get iterator2 at the correct offset
-  int l = (int)jsvGetLength(arr2);
-  offset = offset % l;
-  if (offset<0) offset += l;
   while (offset-->0)
     jsvIteratorNext(&it2);
 
@@ -428,15 +577,19 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
 
   // load data
   JsvIterator it;
-  jsvIteratorNew(&it, arrReal);
-  i=0;
-  while (jsvIteratorHasElement(&it)) {
-    vReal[i++] = jsvIteratorGetFloatValue(&it);
-    jsvIteratorNext(&it);
+  if (!jswrap_espruino_load(arrReal, vReal)) {
+    jsvIteratorNew(&it, arrReal);
+    i=0;
+    while (jsvIteratorHasElement(&it)) {
+      vReal[i++] = jsvIteratorGetFloatValue(&it);
+      jsvIteratorNext(&it);
+    }
+    jsvIteratorFree(&it);
   }
-  jsvIteratorFree(&it);
 
-  if (jsvIsIterable(arrImag)) {
+  if (jsvIsArrayBuffer(arrImag) && jsvGetArrayBufferLength(arrImag)<=pow2 && jswrap_espruino_load(arrImag, vImag)) {
+    // loaded directly
+  } else if (jsvIsIterable(arrImag)) {
     jsvIteratorNew(&it, arrImag);
     i=0;
     while (i<pow2 && jsvIteratorHasElement(&it)) {
@@ -451,22 +604,24 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
 
   // Put the results back
   bool useModulus = jsvIsIterable(arrImag);
+  if (useModulus) {
+    for (i=0;i<l;i++)
+      vReal[i] = jswrap_math_sqrt(vReal[i]*vReal[i] + vImag[i]*vImag[i]);
+  }
 
-  jsvIteratorNew(&it, arrReal);
-  i=0;
-  while (jsvIteratorHasElement(&it)) {
-    JsVarFloat f;
-    if (useModulus)
-      f = jswrap_math_sqrt(vReal[i]*vReal[i] + vImag[i]*vImag[i]);
-    else
-      f = vReal[i];
-
-    jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(f)));
-    i++;
-    jsvIteratorNext(&it);
+  if (!jswrap_espruino_store(arrReal, vReal)) {
+    jsvIteratorNew(&it, arrReal);
+    i=0;
+    while (jsvIteratorHasElement(&it)) {
+      jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(vReal[i])));
+      i++;
+      jsvIteratorNext(&it);
+    }
+    jsvIteratorFree(&it);
   }
-  jsvIteratorFree(&it);
-  if (jsvIsIterable(arrImag)) {
+  if (jsvIsArrayBuffer(arrImag) && jsvGetArrayBufferLength(arrImag)<=pow2 && jswrap_espruino_store(arrImag, vImag)) {
+    // stored directly
+  } else if (jsvIsIterable(arrImag)) {
     jsvIteratorNew(&it, arrImag);
     i=0;
     while (jsvIteratorHasElement(&it)) {
@@ -810,6 +965,96 @@ JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth) {
   return jsvNewFromInteger((JsVarInt)jsvCountJsVarsUsed(v));
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setGCSliceTime",
+  "generate" : "jswrap_espruino_setGCSliceTime",
+  "params" : [
+    ["time","float","The maximum time in milliseconds, or 0 to always collect all garbage in one go"]
+  ]
+}
+On builds with plenty of memory (eg. Linux), Espruino collects garbage a little
+at a time while it is idle, so that timers and events aren't delayed for too long.
+This sets how long (in milliseconds) each piece of work can take - the default is 1ms.
+
+`process.memory().gcmaxpause` returns the longest that Espruino has been paused for.
+ */
+void jswrap_espruino_setGCSliceTime(JsVarFloat time) {
+#ifdef JSVAR_INCREMENTAL_GC
+  if (!(time>0)) time = 0;
+  jsvSetGarbageCollectSliceTime(jshGetTimeFromMilliseconds(time));
+#else
+  NOT_USED(time);
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "resetProfile",
+  "generate" : "jswrap_espruino_resetProfile",
+  "params" : [
+    ["enable","JsVar","If `false`, stop profiling and free the memory used. Otherwise start profiling"]
+  ]
+}
+Clear the profile and start profiling (see `E.getProfile()`). Profiling
+uses some memory and makes calls to built-in functions a little slower,
+so call `E.resetProfile(false)` when you're done.
+ */
+void jswrap_espruino_resetProfile(JsVar *enable) {
+#ifdef JSPARSE_PROFILER
+  if (!jsvIsUndefined(enable) && !jsvGetBool(enable)) {
+    jsprofStop();
+  } else if (!jsprofStart()) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory to profile");
+  }
+#else
+  NOT_USED(enable);
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getProfile",
+  "generate" : "jswrap_espruino_getProfile",
+  "return" : ["JsVar","An object describing where time was spent, or undefined if `E.resetProfile()` hasn't been called"]
+}
+Get the profile that has been recorded since `E.resetProfile()` was called:
+
+```
+{
+  time : 1.23,    // seconds since profiling started
+  samples : 120,  // how many samples were taken
+  lines : [       // lines that code was running on when samples were taken, most first
+    { line : 12, code : "for (var i=0;i<n;i++) s", samples : 80 },
+    ...
+  ],
+  functions : [   // built-in functions that were called, most time first
+    { name : "Math.sin", calls : 5000, time : 0.21 },
+    ...
+  ]
+}
+```
+
+Samples are taken 100 times a second of CPU time on Linux, and on each SysTick on
+other devices. Line numbers are only right for code that was sent with line numbers
+(eg. from the Web IDE) - otherwise lines in functions are counted from the start of the
+function, so use `code` (the start of the line) to find them. A function's `time`
+includes any JavaScript callbacks that it ran.
+ */
+JsVar *jswrap_espruino_getProfile() {
+#ifdef JSPARSE_PROFILER
+  return jsprofGetProfile();
+#else
+  return 0;
+#endif
+}
+
 /*JSON{
   "type" : "staticmethod",
     "ifndef" : "SAVE_ON_FLASH",
@@ -38,6 +38,9 @@ JsVar *jswrap_espruino_toString(JsVar *args);
 int jswrap_espruino_reverseByte(int v);
 void jswrap_espruino_dumpTimers();
 JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth);
+void jswrap_espruino_setGCSliceTime(JsVarFloat time);
+void jswrap_espruino_resetProfile(JsVar *enable);
+JsVar *jswrap_espruino_getProfile();
 void jswrap_espruino_mapInPlace(JsVar *from, JsVar *to, JsVar *map, JsVarInt bits);
 JsVar *jswrap_e_dumpStr();
 JsVarInt jswrap_espruino_HSBtoRGB(JsVarFloat hue, JsVarFloat sat, JsVarFloat bri);
@@ -151,48 +151,415 @@ JsVar *jswrap_flash_read(int length, int addr) {
   return arr;
 }
 
-
 // ------------------------------------------------------------------------
 // ------------------------------------------------------------------------
 //                                                Simple RLE EncoderDecoder
 // ------------------------------------------------------------------------
 // ------------------------------------------------------------------------
 
-// gets data from array, writes to callback
-void rle_encode(unsigned char *data, size_t dataLen, void (*callback)(unsigned char ch, uint32_t *cbdata), uint32_t *cbdata) {
-  int lastCh = -1; // not a valid char
-  while (dataLen) {
-    unsigned char ch = *(data++);
-    dataLen--;
-    callback(ch, cbdata);
+/* gets data from callback, writes it into the first 'count' variables (only used for
+ * loading saves from older firmwares). Variables may be in more than one block, so
+ * we can't just write them as one big array */
+void rle_decode(int (*callback)(uint32_t *cbdata), uint32_t *cbdata, unsigned int count) {
+  size_t pos = 0, len = count*sizeof(JsVar);
+  int lastCh = -256; // not a valid char
+  while (pos<len) {
+    int ch = callback(cbdata);
+    if (ch<0) return;
+    int cnt = 1;
     if (ch==lastCh) {
-      int cnt = 0;
-      while (dataLen && lastCh==*data && cnt<255) {
-        data++;
-        dataLen--;
-        cnt++;
-      }
-      callback((unsigned char)cnt, cbdata);
+      int more = callback(cbdata);
+      if (more>0) cnt += more;
     }
     lastCh = ch;
+    while (cnt-->0 && pos<len) {
+      ((unsigned char*)_jsvGetAddressOf((JsVarRef)(1+pos/sizeof(JsVar))))[pos%sizeof(JsVar)] = (unsigned char)ch;
+      pos++;
+    }
   }
 }
 
-// gets data from callback, writes it into array
-void rle_decode(int (*callback)(uint32_t *cbdata), uint32_t *cbdata, unsigned char *data) {
-  int lastCh = -256; // not a valid char
-  while (true) {
-    int ch = callback(cbdata);
-    if (ch<0) return;
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+//                                                    LZ EncoderDecoder
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+/* LZSS: a control byte says whether each of the next 8 items (LSB first) is
+ * a literal byte (0) or a 2 byte back-reference into the last LZ_WINDOW bytes (1).
+ * A back-reference is (offset-1)&255, then ((offset-1)>>8)<<7 | (length-LZ_MIN_MATCH) */
+#define LZ_WINDOW 512 // must be a power of 2
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH+127)
+#define LZ_BUFFER 1024 // must be a power of 2, and at least LZ_WINDOW+LZ_MAX_MATCH
+#define LZ_HASH 256
+#ifdef RESIZABLE_JSVARS
+#define LZ_CHAIN 16 // how many earlier matches to check - only when we have plenty of RAM for the table
+#else
+#define LZ_CHAIN 1
+#endif
+
+typedef struct {
+  unsigned char buf[LZ_BUFFER]; ///< Ring buffer of the window and the bytes still to encode
+  uint16_t head[LZ_HASH]; ///< Most recent position (+1) of each hash of 3 bytes, or 0
+#if LZ_CHAIN>1
+  uint16_t prev[LZ_WINDOW]; ///< Position (+1) before this one with the same hash
+#endif
+  uint32_t inPos; ///< Number of bytes we've been given
+  uint32_t pos; ///< Number of bytes we've encoded
+  unsigned char ctrl; ///< Control byte for the items in 'items'
+  unsigned char itemCount;
+  unsigned char itemBytes;
+  unsigned char items[16];
+  uint32_t outBytes; ///< Number of bytes we've sent to the callback
+  void (*callback)(unsigned char ch, uint32_t *cbdata);
+  uint32_t *cbdata;
+} LzEncoder;
+
+typedef struct {
+  unsigned char window[LZ_WINDOW];
+  uint32_t pos; ///< Number of bytes we've decoded
+  unsigned char ctrl;
+  unsigned char ctrlBits; ///< How many more items 'ctrl' has bits for
+  unsigned char matchLeft; ///< How many more bytes to copy from the current back-reference
+  uint16_t matchOffset;
+  int (*callback)(uint32_t *cbdata);
+  uint32_t *cbdata;
+} LzDecoder;
+
+/* These are too big to put on the stack on small devices, and we never save and
+ * load at the same time, so they share some static RAM (about 1.6KB, or 2.6KB
+ * with LZ_CHAIN) */
+static union {
+  LzEncoder encoder;
+  LzDecoder decoder;
+} lzState;
+
+static void lz_encoder_init(LzEncoder *lz, void (*callback)(unsigned char ch, uint32_t *cbdata), uint32_t *cbdata) {
+  memset(lz, 0, sizeof(LzEncoder));
+  lz->callback = callback;
+  lz->cbdata = cbdata;
+}
+
+static void lz_output(LzEncoder *lz, unsigned char ch) {
+  lz->callback(ch, lz->cbdata);
+  lz->outBytes++;
+}
+
+static void lz_flush_items(LzEncoder *lz) {
+  if (!lz->itemCount) return;
+  lz_output(lz, lz->ctrl);
+  int i;
+  for (i=0;i<lz->itemBytes;i++)
+    lz_output(lz, lz->items[i]);
+  lz->ctrl = 0;
+  lz->itemCount = 0;
+  lz->itemBytes = 0;
+}
+
+static ALWAYS_INLINE unsigned int lz_hash(LzEncoder *lz, uint32_t p) {
+  return (unsigned int)(lz->buf[p&(LZ_BUFFER-1)]*33 ^ lz->buf[(p+1)&(LZ_BUFFER-1)]*5 ^ lz->buf[(p+2)&(LZ_BUFFER-1)]) & (LZ_HASH-1);
+}
+
+/// Remember that the 3 bytes at 'p' can be matched
+static void lz_insert(LzEncoder *lz, uint32_t p) {
+  unsigned int h = lz_hash(lz, p);
+#if LZ_CHAIN>1
+  lz->prev[p&(LZ_WINDOW-1)] = lz->head[h];
+#endif
+  lz->head[h] = (uint16_t)(p+1);
+}
+
+/// Encode the item at lz->pos
+static void lz_encode_one(LzEncoder *lz) {
+  uint32_t avail = lz->inPos - lz->pos;
+  unsigned int maxLen = avail<LZ_MAX_MATCH ? avail : LZ_MAX_MATCH;
+  unsigned int bestLen = 0, bestOffset = 0;
+  if (maxLen >= LZ_MIN_MATCH) {
+    // Positions are stored as 16 bits, so a stale one may point anywhere - but
+    // we check the bytes anyway, so that's fine as long as it's in the window
+    uint16_t cand = lz->head[lz_hash(lz, lz->pos)];
+    unsigned int lastOffset = 0;
+    int chain = LZ_CHAIN;
+    while (cand && chain--) {
+      unsigned int offset = (uint16_t)(lz->pos+1-cand);
+      if (offset<=lastOffset || offset>LZ_WINDOW || offset==0) break;
+      lastOffset = offset;
+      uint32_t c = lz->pos-offset;
+      unsigned int len = 0;
+      while (len<maxLen && lz->buf[(c+len)&(LZ_BUFFER-1)]==lz->buf[(lz->pos+len)&(LZ_BUFFER-1)])
+        len++;
+      if (len>bestLen) {
+        bestLen = len;
+        bestOffset = offset;
+      }
+      if (bestLen==maxLen) break;
+#if LZ_CHAIN>1
+      cand = lz->prev[c&(LZ_WINDOW-1)];
+#endif
+    }
+  }
+  if (bestLen >= LZ_MIN_MATCH) {
+    lz->ctrl |= (unsigned char)(1<<lz->itemCount);
+    lz->items[lz->itemBytes++] = (unsigned char)(bestOffset-1);
+    lz->items[lz->itemBytes++] = (unsigned char)((((bestOffset-1)>>8)<<7) | (bestLen-LZ_MIN_MATCH));
+  } else {
+    bestLen = 1;
+    lz->items[lz->itemBytes++] = lz->buf[lz->pos&(LZ_BUFFER-1)];
+  }
+  if (++lz->itemCount == 8) lz_flush_items(lz);
+  // add everything we just encoded to the hash table
+  while (bestLen--) {
+    if (lz->pos+LZ_MIN_MATCH <= lz->inPos) lz_insert(lz, lz->pos);
+    lz->pos++;
+  }
+}
+
+static void lz_encode(LzEncoder *lz, const unsigned char *data, size_t len) {
+  while (len--) {
+    lz->buf[(lz->inPos++)&(LZ_BUFFER-1)] = *(data++);
+    if (lz->inPos - lz->pos >= LZ_MAX_MATCH)
+      lz_encode_one(lz);
+  }
+}
+
+static void lz_encoder_finish(LzEncoder *lz) {
+  while (lz->pos < lz->inPos)
+    lz_encode_one(lz);
+  lz_flush_items(lz);
+}
+
+static void lz_decoder_init(LzDecoder *lz, int (*callback)(uint32_t *cbdata), uint32_t *cbdata) {
+  memset(lz, 0, sizeof(LzDecoder));
+  lz->callback = callback;
+  lz->cbdata = cbdata;
+}
+
+/// Return the next decoded byte, or -1 if the data ended or is corrupt
+static int lz_decode_byte(LzDecoder *lz) {
+  if (!lz->matchLeft) {
+    if (!lz->ctrlBits) {
+      int c = lz->callback(lz->cbdata);
+      if (c<0) return -1;
+      lz->ctrl = (unsigned char)c;
+      lz->ctrlBits = 8;
+    }
+    bool isMatch = lz->ctrl&1;
+    lz->ctrl >>= 1;
+    lz->ctrlBits--;
+    if (!isMatch) {
+      int c = lz->callback(lz->cbdata);
+      if (c<0) return -1;
+      lz->window[(lz->pos++)&(LZ_WINDOW-1)] = (unsigned char)c;
+      return c;
+    }
+    int b0 = lz->callback(lz->cbdata);
+    int b1 = lz->callback(lz->cbdata);
+    if (b0<0 || b1<0) return -1;
+    lz->matchOffset = (uint16_t)((b0 | ((b1&0x80)<<1)) + 1);
+    lz->matchLeft = (unsigned char)((b1&0x7F) + LZ_MIN_MATCH);
+    if (lz->matchOffset > lz->pos) return -1; // before the start of the data
+  }
+  lz->matchLeft--;
+  unsigned char ch = lz->window[(lz->pos-lz->matchOffset)&(LZ_WINDOW-1)];
+  lz->window[(lz->pos++)&(LZ_WINDOW-1)] = ch;
+  return ch;
+}
+
+static bool lz_decode(LzDecoder *lz, unsigned char *data, size_t len) {
+  while (len--) {
+    int ch = lz_decode_byte(lz);
+    if (ch<0) return false;
     *(data++) = (unsigned char)ch;
-    if (ch==lastCh) {
-      int cnt = callback(cbdata);
-      while (cnt-->0) {
-        *(data++) = (unsigned char)ch;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+//                                                      Variable snapshots
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+/* A snapshot is SNAPSHOT_MAGIC, sizeof(JsVar), the number of variables (4 bytes, LSB first)
+ * and then an LZ-compressed list of [unused count][used count][used variables...] (counts are
+ * varints). Unused variables aren't stored at all, and refs in the used ones are stored relative
+ * to the variable's own index, as linked variables are usually allocated close together. */
+#define SNAPSHOT_MAGIC "JSZ\x01" // last char is the format version
+#define SNAPSHOT_MAGIC_LEN 4
+
+#ifdef JSVARREF_PACKED_BITS
+#define SNAPSHOT_REF_MASK ((JsVarRef)((1<<(JSVARREF_PACKED_BITS+8))-1))
+#else
+#define SNAPSHOT_REF_MASK ((JsVarRef)~0)
+#endif
+
+/* Make refs relative. Relative ref 0 must still mean 'no ref', so a ref to
+ * ourselves (which would be 0) is swapped with the one that would be 0-idx. */
+static JsVarRef snapshot_ref_encode(JsVarRef ref, JsVarRef idx) {
+  if (!ref) return 0;
+  return (JsVarRef)((ref==idx) ? (0-idx) : (ref-idx)) & SNAPSHOT_REF_MASK;
+}
+
+static JsVarRef snapshot_ref_decode(JsVarRef ref, JsVarRef idx) {
+  if (!ref) return 0;
+  ref = (JsVarRef)(ref+idx) & SNAPSHOT_REF_MASK;
+  return ref ? ref : idx;
+}
+
+/// Convert all the refs in a variable to or from relative refs (not for flat string data blocks!)
+static void snapshot_transform(JsVar *v, JsVarRef idx, bool encode) {
+  JsVarRef (*fn)(JsVarRef, JsVarRef) = encode ? snapshot_ref_encode : snapshot_ref_decode;
+  if (jsvIsName(v)) {
+    jsvSetNextSibling(v, fn(jsvGetNextSibling(v), idx));
+    jsvSetPrevSibling(v, fn(jsvGetPrevSibling(v), idx));
+  }
+  if (jsvHasChildren(v) || jsvHasSingleChild(v))
+    jsvSetFirstChild(v, fn(jsvGetFirstChild(v), idx));
+  if (jsvHasChildren(v) || jsvHasCharacterData(v))
+    jsvSetLastChild(v, fn(jsvGetLastChild(v), idx));
+}
+
+static bool snapshot_var_is_unused(JsVarRef i) {
+  return (_jsvGetAddressOf(i)->flags&JSV_VARTYPEMASK) == JSV_UNUSED;
+}
+
+/// How many blocks the variable takes up (including flat string data)
+static unsigned int snapshot_var_blocks(JsVarRef i) {
+  JsVar *v = _jsvGetAddressOf(i);
+  return 1 + (jsvIsFlatString(v) ? (unsigned int)jsvGetFlatStringBlocks(v) : 0);
+}
+
+static void snapshot_encode_varint(LzEncoder *lz, unsigned int n) {
+  while (n >= 0x80) {
+    unsigned char ch = (unsigned char)(0x80 | (n&0x7F));
+    lz_encode(lz, &ch, 1);
+    n >>= 7;
+  }
+  unsigned char ch = (unsigned char)n;
+  lz_encode(lz, &ch, 1);
+}
+
+static bool snapshot_decode_varint(LzDecoder *lz, unsigned int *n) {
+  *n = 0;
+  int shift = 0;
+  while (shift < 32) {
+    int ch = lz_decode_byte(lz);
+    if (ch<0) return false;
+    *n |= (unsigned int)(ch&0x7F) << shift;
+    if (!(ch&0x80)) return true;
+    shift += 7;
+  }
+  return false;
+}
+
+/// Write a snapshot of all variables to the callback. Returns the number of bytes written
+static uint32_t snapshot_save(void (*callback)(unsigned char ch, uint32_t *cbdata), uint32_t *cbdata) {
+  unsigned int count = jsvGetMemoryTotal();
+  unsigned int i;
+  for (i=0;i<SNAPSHOT_MAGIC_LEN;i++)
+    callback((unsigned char)SNAPSHOT_MAGIC[i], cbdata);
+  callback((unsigned char)sizeof(JsVar), cbdata);
+  for (i=0;i<4;i++)
+    callback((unsigned char)(count>>(i*8)), cbdata);
+
+  LzEncoder *lz = &lzState.encoder;
+  lz_encoder_init(lz, callback, cbdata);
+  JsVarRef ref = 1;
+  while (ref<=count) {
+    unsigned int unused = 0;
+    while (ref<=count && snapshot_var_is_unused(ref)) {
+      unused++;
+      ref++;
+    }
+    JsVarRef start = ref;
+    unsigned int used = 0;
+    while (ref<=count && !snapshot_var_is_unused(ref)) {
+      unsigned int blocks = snapshot_var_blocks(ref);
+      used += blocks;
+      ref = (JsVarRef)(ref + blocks);
+    }
+    snapshot_encode_varint(lz, unused);
+    snapshot_encode_varint(lz, used);
+    ref = start;
+    while (ref < start+used) {
+      unsigned int blocks = snapshot_var_blocks(ref);
+      JsVar v = *_jsvGetAddressOf(ref);
+      snapshot_transform(&v, ref, true);
+      lz_encode(lz, (unsigned char*)&v, sizeof(JsVar));
+      // flat string data blocks are always contiguous
+      if (blocks>1) lz_encode(lz, (unsigned char*)_jsvGetAddressOf((JsVarRef)(ref+1)), sizeof(JsVar)*(blocks-1));
+      ref = (JsVarRef)(ref + blocks);
+    }
+  }
+  lz_encoder_finish(lz);
+  return SNAPSHOT_MAGIC_LEN + 5 + lz->outBytes;
+}
+
+/// Read a snapshot (after SNAPSHOT_MAGIC) from the callback into our variables. On failure, all variables are cleared
+static bool snapshot_load(int (*callback)(uint32_t *cbdata), uint32_t *cbdata) {
+  unsigned int count = 0;
+  int i;
+  bool ok = callback(cbdata) == (int)sizeof(JsVar);
+  for (i=0;i<4;i++) {
+    int ch = callback(cbdata);
+    if (ch<0) ok = false;
+    count |= (unsigned int)(ch&0xFF) << (i*8);
+  }
+#ifdef RESIZABLE_JSVARS
+  if (ok) jsvSetMemoryTotal(count);
+#endif
+  if (ok && count > jsvGetMemoryTotal()) {
+    jsiConsolePrintf("\nSaved state needs %d variables but only %d are available\n", count, jsvGetMemoryTotal());
+    ok = false;
+  }
+
+  LzDecoder *lz = &lzState.decoder;
+  lz_decoder_init(lz, callback, cbdata);
+  JsVarRef ref = 1;
+  while (ok && ref<=count) {
+    unsigned int unused, used;
+    if (!snapshot_decode_varint(lz, &unused) ||
+        !snapshot_decode_varint(lz, &used) ||
+        unused+used > count+1-ref) {
+      ok = false;
+      break;
+    }
+    while (unused--) {
+      memset(_jsvGetAddressOf(ref), 0, sizeof(JsVar));
+      ref++;
+    }
+    JsVarRef end = (JsVarRef)(ref+used);
+    while (ok && ref<end) {
+      JsVar *v = _jsvGetAddressOf(ref);
+      if (!lz_decode(lz, (unsigned char*)v, sizeof(JsVar))) {
+        ok = false;
+        break;
       }
+      snapshot_transform(v, ref, false);
+      unsigned int blocks = snapshot_var_blocks(ref);
+      if (ref+blocks > end ||
+          (blocks>1 && !lz_decode(lz, (unsigned char*)_jsvGetAddressOf((JsVarRef)(ref+1)), sizeof(JsVar)*(blocks-1))))
+        ok = false;
+      ref = (JsVarRef)(ref + blocks);
     }
-    lastCh = ch;
   }
+  // clear anything that wasn't in the snapshot (or everything if it was corrupt)
+  unsigned int total = jsvGetMemoryTotal();
+  for (ref=(JsVarRef)(ok ? count+1 : 1); ref && ref<=total; ref++)
+    memset(_jsvGetAddressOf(ref), 0, sizeof(JsVar));
+  if (!ok) jsiConsolePrint("\nSaved state is corrupt - not loaded\n");
+  return ok;
+}
+
+/// Read SNAPSHOT_MAGIC_LEN bytes from the callback and return true if they are SNAPSHOT_MAGIC
+static bool snapshot_check_magic(int (*callback)(uint32_t *cbdata), uint32_t *cbdata) {
+  int i;
+  bool match = true;
+  for (i=0;i<SNAPSHOT_MAGIC_LEN;i++)
+    if (callback(cbdata) != (unsigned char)SNAPSHOT_MAGIC[i])
+      match = false;
+  return match;
 }
 
 #ifndef LINUX
@@ -232,6 +599,21 @@ int jsfLoadFromFlash_readcb(uint32_t *cbdata) {
 void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
   fwrite(&ch,1,1,(FILE*)cbdata);
 }
+
+#ifdef DEBUG
+typedef struct {
+  FILE *f;
+  uint32_t errors;
+} JsfCheckData;
+
+// cbdata = JsfCheckData
+void jsfSaveToFlash_checkcb(unsigned char ch, uint32_t *cbdata) {
+  JsfCheckData *check = (JsfCheckData*)cbdata;
+  unsigned char data;
+  if (fread(&data,1,1,check->f)!=1 || data!=ch)
+    check->errors++;
+}
+#endif
 #endif
 
 
@@ -245,32 +627,24 @@ void jsfSaveToFlash() {
 #ifdef LINUX
   FILE *f = fopen("espruino.state","wb");
   if (f) {
-    unsigned int jsVarCount = jsvGetMemoryTotal();
-    jsiConsolePrintf("\nSaving %d bytes...", jsVarCount*sizeof(JsVar));
-    fwrite(&jsVarCount, sizeof(unsigned int), 1, f);
-    /*JsVarRef i;
-    for (i=1;i<=jsVarCount;i++) {
-      fwrite(_jsvGetAddressOf(i),1,sizeof(JsVar),f);
-    }*/
-    rle_encode((unsigned char*)_jsvGetAddressOf(1), jsVarCount*sizeof(JsVar), jsfSaveToFlash_writecb, (uint32_t*)f);
+    unsigned int dataSize = jsvGetMemoryTotal()*(unsigned int)sizeof(JsVar);
+    jsiConsolePrintf("\nSaving %d bytes...", dataSize);
+    uint32_t writtenBytes = snapshot_save(jsfSaveToFlash_writecb, (uint32_t*)f);
     fclose(f);
+    jsiConsolePrintf("\nCompressed %d bytes to %d", dataSize, writtenBytes);
     jsiConsolePrint("\nDone!\n");
 
 #ifdef DEBUG
     jsiConsolePrint("Checking...\n");
-    FILE *f = fopen("espruino.state","rb");
-    fread(&jsVarCount, sizeof(unsigned int), 1, f);
-    if (jsVarCount != jsvGetMemoryTotal())
-      jsiConsolePrint("Error: memory sizes different\n");
-    unsigned char *decomp = (unsigned char*)malloc(jsVarCount*sizeof(JsVar));
-    rle_decode(jsfLoadFromFlash_readcb, f, decomp);
-    fclose(f);
-    unsigned char *comp = _jsvGetAddressOf(1);
-    int j;
-    for (j=0;j<jsVarCount*sizeof(JsVar);j++)
-      if (decomp[j]!=comp[j])
-        jsiConsolePrintf("Error at %d: original %d, decompressed %d\n", j, comp[j], decomp[j]);  
-    free(decomp);
+    JsfCheckData check;
+    check.f = fopen("espruino.state","rb");
+    check.errors = 0;
+    if (check.f) {
+      snapshot_save(jsfSaveToFlash_checkcb, (uint32_t*)&check);
+      fclose(check.f);
+    } else check.errors++;
+    if (check.errors)
+      jsiConsolePrintf("There were %d errors!\n", check.errors);
     jsiConsolePrint("Done!\n>");
 #endif
   } else {
@@ -278,7 +652,6 @@ void jsfSaveToFlash() {
   }
 #else // !LINUX
   unsigned int dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
-  uint32_t *basePtr = (uint32_t *)_jsvGetAddressOf(1);
   uint32_t pageStart, pageLength;
 
   jsiConsolePrint("Erasing Flash...");
@@ -294,12 +667,12 @@ void jsfSaveToFlash() {
     }
   }
   uint32_t cbData[3];
-  uint32_t rleStart = FLASH_SAVED_CODE_START+4;
+  uint32_t dataStart = FLASH_SAVED_CODE_START+4;
   cbData[0] = FLASH_MAGIC_LOCATION; // end of available flash
-  cbData[1] = rleStart;
+  cbData[1] = dataStart;
   cbData[2] = 0; // word data (can only save a word ata a time)
   jsiConsolePrint("\nWriting...");
-  rle_encode((unsigned char*)basePtr, dataSize, jsfSaveToFlash_writecb, cbData);
+  snapshot_save(jsfSaveToFlash_writecb, cbData);
   uint32_t endOfData = cbData[1];
   uint32_t writtenBytes = endOfData - FLASH_SAVED_CODE_START;
   // make sure we write everything in buffer
@@ -317,9 +690,9 @@ void jsfSaveToFlash() {
     jshFlashWrite(&magic, FLASH_MAGIC_LOCATION, 4);
 
     jsiConsolePrint("\nChecking...");
-    cbData[0] = rleStart;
+    cbData[0] = dataStart;
     cbData[1] = 0; // increment if fails
-    rle_encode((unsigned char*)basePtr, dataSize, jsfSaveToFlash_checkcb, cbData);
+    snapshot_save(jsfSaveToFlash_checkcb, cbData);
     uint32_t errors = cbData[1];
 
     if (!jsfFlashContainsCode()) {
@@ -339,16 +712,19 @@ void jsfLoadFromFlash() {
 #ifdef LINUX
   FILE *f = fopen("espruino.state","rb");
   if (f) {
-    unsigned int jsVarCount;
-    fread(&jsVarCount, sizeof(unsigned int), 1, f);
-
-    jsiConsolePrintf("\nDecompressing to %d bytes...", jsVarCount*sizeof(JsVar));
-    jsvSetMemoryTotal(jsVarCount);
-    /*JsVarRef i;
-    for (i=1;i<=jsVarCount;i++) {
-      fread(_jsvGetAddressOf(i),1,sizeof(JsVar),f);
-    }*/
-    rle_decode(jsfLoadFromFlash_readcb, (uint32_t*)f, (unsigned char*)_jsvGetAddressOf(1));
+    if (snapshot_check_magic(jsfLoadFromFlash_readcb, (uint32_t*)f)) {
+      jsiConsolePrint("\nDecompressing...");
+      snapshot_load(jsfLoadFromFlash_readcb, (uint32_t*)f);
+    } else {
+      // saved by an older version - just the variable count and RLE
+      fseek(f, 0, SEEK_SET);
+      unsigned int jsVarCount;
+      fread(&jsVarCount, sizeof(unsigned int), 1, f);
+      jsiConsolePrintf("\nDecompressing to %d bytes...", jsVarCount*sizeof(JsVar));
+      jsvSetMemoryTotal(jsVarCount);
+      if (jsVarCount > jsvGetMemoryTotal()) jsVarCount = jsvGetMemoryTotal();
+      rle_decode(jsfLoadFromFlash_readcb, (uint32_t*)f, jsVarCount);
+    }
     fclose(f);
   } else {
     jsiConsolePrint("\nFile Open Failed... \n");
@@ -359,14 +735,17 @@ void jsfLoadFromFlash() {
     return;
   }
 
-  //  unsigned int dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
-  uint32_t *basePtr = (uint32_t *)_jsvGetAddressOf(1);
-
   uint32_t cbData[2];
   jshFlashRead(&cbData[0], FLASH_SAVED_CODE_START, 4); // end address
   cbData[1] = FLASH_SAVED_CODE_START+4; // start address
   jsiConsolePrintf("Loading %d bytes from flash...\n", cbData[0]-FLASH_SAVED_CODE_START);
-  rle_decode(jsfLoadFromFlash_readcb, cbData, (unsigned char*)basePtr);
+  if (snapshot_check_magic(jsfLoadFromFlash_readcb, cbData)) {
+    snapshot_load(jsfLoadFromFlash_readcb, cbData);
+  } else {
+    // saved by an older firmware - just RLE
+    cbData[1] = FLASH_SAVED_CODE_START+4;
+    rle_decode(jsfLoadFromFlash_readcb, cbData, jsvGetMemoryTotal());
+  }
 #endif
 }
 
@@ -327,6 +327,8 @@ Set the current system time in seconds (to the nearest second)
  */
 void jswrap_interactive_setTime(JsVarFloat time) {
   JsSysTime stime = jshGetTimeFromMilliseconds(time*1000);
+  // timers are stored as system times, so move them too
+  jsiTimersShift(stime - jsiLastIdleTime);
   jsiLastIdleTime = stime;
   jshSetSystemTime(stime);
 }
@@ -442,7 +444,7 @@ JsVar *_jswrap_interface_setTimeoutOrInterval(JsVar *func, JsVarFloat interval,
     JsVar *timerPtr = jsvNewWithFlags(JSV_OBJECT);
     if (interval<TIMER_MIN_INTERVAL) interval=TIMER_MIN_INTERVAL;
     JsSysTime intervalInt = jshGetTimeFromMilliseconds(interval);
-    jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger((jshGetSystemTime() - jsiLastIdleTime) + intervalInt));
+    jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(jshGetSystemTime() + intervalInt));
     if (!isTimeout) {
       jsvObjectSetChildAndUnLock(timerPtr, "interval", jsvNewFromLongInteger(intervalInt));
     }
@@ -499,13 +501,12 @@ If no argument is supplied, all timers and intervals are stopped
 void _jswrap_interface_clearTimeoutOrInterval(JsVar *idVar, bool isTimeout) {
   JsVar *timerArrayPtr = jsvLock(timerArray);
   if (jsvIsUndefined(idVar)) {
-    jsvRemoveAllChildren(timerArrayPtr);
+    jsiTimerRemove(0);
   } else {
     JsVar *child = jsvIsBasic(idVar) ? jsvFindChildFromVar(timerArrayPtr, idVar, false) : 0;
     if (child) {
-      JsVar *timerArrayPtr = jsvLock(timerArray);
-      jsvRemoveChild(timerArrayPtr, child);
-      jsvUnLock2(child, timerArrayPtr);
+      jsiTimerRemove(child);
+      jsvUnLock(child);
     } else {
       jsExceptionHere(JSET_ERROR, isTimeout ? "Unknown Timeout" : "Unknown Interval");
     }
@@ -547,8 +548,8 @@ void jswrap_interface_changeInterval(JsVar *idVar, JsVarFloat interval) {
     JsVarInt intervalInt = (JsVarInt)jshGetTimeFromMilliseconds(interval);
     v = jsvNewFromInteger(intervalInt);
     jsvUnLock2(jsvSetNamedChild(timer, v, "interval"), v);
-    v = jsvNewFromInteger((JsVarInt)(jshGetSystemTime()-jsiLastIdleTime) + intervalInt);
-    jsvUnLock3(jsvSetNamedChild(timer, v, "time"), v, timer);
+    jsiTimerSetTime(timer, jshGetSystemTime() + intervalInt);
+    jsvUnLock(timer);
     // timerName already unlocked
     jsiTimersChanged(); // mark timers as changed
   } else {
@@ -547,7 +547,7 @@ void jswrap_io_shiftOut(JsVar *pins, JsVar *options, JsVar *data) {
   "params" : [
     ["function", "JsVar", "A Function or String to be executed"],
     ["pin", "pin", "The pin to watch"],
-    ["options", "JsVar",[ "If this is a boolean or integer, it determines whether to call this once (false = default) or every time a change occurs (true)","If this is an object, it can contain the following information: ```{ repeat: true/false(default), edge:'rising'/'falling'/'both'(default), debounce:10}```. `debounce` is the time in ms to wait for bounces to subside, or 0."]]
+    ["options", "JsVar",[ "If this is a boolean or integer, it determines whether to call this once (false = default) or every time a change occurs (true)","If this is an object, it can contain the following information: ```{ repeat: true/false(default), edge:'rising'/'falling'/'both'(default), debounce:10, batch:false}```. `debounce` is the time in ms to wait for bounces to subside, or 0. `batch` is described below."]]
   ],
   "return" : ["JsVar","An ID that can be passed to clearWatch"]
 }
@@ -568,6 +568,12 @@ native function `void (bool state)` then you can add `irq:true` to options, whic
 function to be called from within the IRQ. When doing this, interrupts will happen on both edges 
 and there will be no debouncing.
 
+If the pin changes quickly (for instance with rotary encoders or pulse counters) you can add
+`batch:true` to options. If several changes of the pin are waiting to be processed, the function
+is then called once for all of them, with an extra `times` field - a `Float64Array` of the time
+(in seconds) of each edge. `time` and `state` are for the last edge. This only applies if
+`debounce` isn't set and there are no other watches on the same pin.
+
 **Note:** The STM32 chip (used in the [Espruino Board](/EspruinoBoard) and [Pico](/Pico)) cannot
 watch two pins with the same number - eg `A0` and `B0`.
 
@@ -591,6 +597,7 @@ JsVar *jswrap_interface_setWatch(
   JsVarFloat debounce = 0;
   int edge = 0;
   bool isIRQ = false;
+  bool batch = false;
   if (jsvIsObject(repeatOrObject)) {
     JsVar *v;
     repeat = jsvGetBoolAndUnLock(jsvObjectGetChild(repeatOrObject, "repeat", 0));
@@ -606,6 +613,7 @@ JsVar *jswrap_interface_setWatch(
       jsWarn("'edge' in setWatch should be a string - either 'rising', 'falling' or 'both'");
     jsvUnLock(v);
     isIRQ = jsvGetBoolAndUnLock(jsvObjectGetChild(repeatOrObject, "irq", 0));
+    batch = jsvGetBoolAndUnLock(jsvObjectGetChild(repeatOrObject, "batch", 0));
   } else
     repeat = jsvGetBool(repeatOrObject);
 
@@ -626,6 +634,7 @@ JsVar *jswrap_interface_setWatch(
       if (repeat) jsvObjectSetChildAndUnLock(watchPtr, "recur", jsvNewFromBool(repeat));
       if (debounce>0) jsvObjectSetChildAndUnLock(watchPtr, "debounce", jsvNewFromInteger((JsVarInt)jshGetTimeFromMilliseconds(debounce)));
       if (edge) jsvObjectSetChildAndUnLock(watchPtr, "edge", jsvNewFromInteger(edge));
+      if (batch) jsvObjectSetChildAndUnLock(watchPtr, "batch", jsvNewFromBool(batch));
       jsvObjectSetChild(watchPtr, "callback", func); // no unlock intentionally
     }
 
@@ -652,6 +661,7 @@ JsVar *jswrap_interface_setWatch(
     JsVar *watchArrayPtr = jsvLock(watchArray);
     itemIndex = jsvArrayAddToEnd(watchArrayPtr, watchPtr, 1) - 1;
     jsvUnLock2(watchArrayPtr, watchPtr);
+    jsiWatchesChanged();
 
 
   }
@@ -685,6 +695,7 @@ void jswrap_interface_clearWatch(JsVar *idVar) {
     // remove all items
     jsvRemoveAllChildren(watchArrayPtr);
     jsvUnLock(watchArrayPtr);
+    jsiWatchesChanged();
   } else {
     JsVar *watchArrayPtr = jsvLock(watchArray);
     JsVar *watchNamePtr = jsvFindChildFromVar(watchArrayPtr, idVar, false);
@@ -697,6 +708,7 @@ void jswrap_interface_clearWatch(JsVar *idVar) {
       JsVar *watchArrayPtr = jsvLock(watchArray);
       jsvRemoveChild(watchArrayPtr, watchNamePtr);
       jsvUnLock2(watchNamePtr, watchArrayPtr);
+      jsiWatchesChanged();
 
       // Now check if this pin is still being watched
       if (!jsiIsWatchingPin(pin))
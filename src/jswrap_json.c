@@ -17,6 +17,7 @@
 #include "jsparse.h"
 #include "jsinteractive.h"
 #include "jswrapper.h"
+#include "jswrap_pipe.h"
 
 const unsigned int JSON_LIMIT_AMOUNT = 15; // how big does an array get before we start to limit what we show
 const unsigned int JSON_LIMITED_AMOUNT = 5; // When limited, how many items do we show at the beginning and end
@@ -52,81 +53,464 @@ JsVar *jswrap_json_stringify(JsVar *v) {
   return result;
 }
 
+/*JSON{
+  "type" : "class",
+  "class" : "JSONStringifier",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+A stream that the JSON for an object can be read from a bit at a time. `JSON.stringifyTo`
+pipes one of these to a destination.
+ */
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "JSON",
+  "name" : "stringifyTo",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_json_stringifyTo",
+  "params" : [
+    ["data","JsVar","The data to be converted to JSON"],
+    ["destination","JsVar","The stream to write the JSON to (for instance `Serial1`, a socket or a `File`)"],
+    ["options","JsVar",["An optional object `{ chunkSize : int=64, end : bool=true, complete : function }` - see `fs.pipe`"]]
+  ],
+  "return" : ["JsVar","The JSONStringifier the JSON is being read from"],
+  "return_object" : "JSONStringifier"
+}
+Write the same JSON as `JSON.stringify` would return to `destination`, a chunk at
+a time. The JSON is created as it is written (in the idle loop), so the whole
+string never has to be in memory at once - and if `destination.write` returns
+`false`, nothing more is created until it emits `drain`.
+
+Chunks end after a value, so one may be bigger than `chunkSize` if the data
+contains a long string.
+ */
+#ifndef SAVE_ON_FLASH
+#define JSONSTRINGIFIER_DATA_NAME JS_HIDDEN_CHAR_STR"data" ///< The data, until we've started on it
+#define JSONSTRINGIFIER_STACK_NAME JS_HIDDEN_CHAR_STR"stack" ///< Objects of {v:container, p:position, i:next child name} for the arrays/objects we're inside
+#define JSONSTRINGIFIER_FLAGS (JSON_IGNORE_FUNCTIONS|JSON_NO_UNDEFINED) ///< The same as JSON.stringify
+
+JsVar *jswrap_json_stringifyTo(JsVar *data, JsVar *destination, JsVar *options) {
+  JsVar *source = jspNewObject(0, "JSONStringifier");
+  if (!source) return 0;
+  jsvObjectSetChild(source, JSONSTRINGIFIER_DATA_NAME, data);
+  jsvObjectSetChildAndUnLock(source, JSONSTRINGIFIER_STACK_NAME, jsvNewWithFlags(JSV_ARRAY));
+  jswrap_pipe(source, destination, options);
+  return source;
+}
+
+/** Set the position (the name of the next child to look at) of a stack frame. This links
+ * straight to the name - jsvSetValueOfName would store an integer name's value instead */
+static void jswrap_jsonstringifier_setpos(JsVar *frame, JsVarRef childRef) {
+  JsVar *posName = jsvFindChildFromString(frame, "i", true);
+  if (!posName) return;
+  if (jsvGetFirstChild(posName)) jsvUnRefRef(jsvGetFirstChild(posName));
+  if (childRef) jsvUnLock(jsvRef(jsvLock(childRef)));
+  jsvSetFirstChild(posName, childRef);
+  jsvUnLock(posName);
+}
+
+/** Output a value. Arrays and objects just get their opening bracket output and are pushed onto
+ * the stack so their contents can be done a bit at a time. Everything else is output completely */
+static void jswrap_jsonstringifier_value(JsVar *stack, JsVar *v, JsvStringIterator *out) {
+  if ((jsvIsArray(v) || jsvIsObject(v)) && !jsvIsArrayBuffer(v)) {
+    bool recursing = false;
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, stack);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *frame = jsvObjectIteratorGetValue(&it);
+      JsVar *container = jsvObjectGetChild(frame, "v", 0);
+      if (container == v) recursing = true;
+      jsvUnLock2(container, frame);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    if (recursing) {
+      jsvStringIteratorPrintfCallback(" ... ", out);
+      return;
+    }
+    JsVar *frame = jsvNewWithFlags(JSV_OBJECT);
+    if (!frame) return;
+    jsvObjectSetChild(frame, "v", v);
+    jsvObjectSetChildAndUnLock(frame, "p", jsvNewFromInteger(0));
+    jswrap_jsonstringifier_setpos(frame, jsvGetFirstChild(v));
+    jsvArrayPushAndUnLock(stack, frame);
+    jsvStringIteratorPrintfCallback(jsvIsArray(v) ? "[" : "{", out);
+  } else {
+    jsfGetJSONWithCallback(v, JSONSTRINGIFIER_FLAGS, (vcbprintf_callback)&jsvStringIteratorPrintfCallback, out);
+  }
+}
+
+/** Output the next item in the array/object at the top of the stack (or its closing bracket).
+ * Returns false if there was nothing left to do */
+static bool jswrap_jsonstringifier_next(JsVar *stack, JsvStringIterator *out) {
+  JsVarInt depth = jsvGetArrayLength(stack);
+  if (depth<=0) return false;
+  JsVar *frame = jsvGetArrayItem(stack, depth-1);
+  JsVar *container = jsvObjectGetChild(frame, "v", 0);
+  // position is (index of the next array item << 1) | (whether we've output an item yet)
+  JsVarInt pos = jsvGetIntegerAndUnLock(jsvObjectGetChild(frame, "p", 0));
+  JsVarInt index = pos>>1;
+  bool first = !(pos&1);
+  /* The name of the next child to look at, so we can carry on from where we were without
+   * searching. If it gets removed from the container its siblings are cleared, so we just stop */
+  JsVar *posName = jsvFindChildFromString(frame, "i", false);
+  JsVarRef childRef = posName ? jsvGetFirstChild(posName) : 0;
+  jsvUnLock(posName);
+  JsVar *item = 0;
+  bool found = false;
+  if (jsvIsArray(container)) {
+    if (index < jsvGetArrayLength(container)) {
+      found = true;
+      // skip anything that isn't an element, or that we've already passed
+      JsVar *child = childRef ? jsvLock(childRef) : 0;
+      while (child && (!jsvIsInt(child) || jsvGetInteger(child) < index)) {
+        childRef = jsvGetNextSibling(child);
+        jsvUnLock(child);
+        child = childRef ? jsvLock(childRef) : 0;
+      }
+      if (child && jsvGetInteger(child) == index) {
+        item = jsvSkipName(child);
+        childRef = jsvGetNextSibling(child);
+      } // else it's a gap in the array, which is output as null
+      jsvUnLock(child);
+      index++;
+      if (jsvIsUndefined(item)) item = jsvNewWithFlags(JSV_NULL);
+      if (!first) jsvStringIteratorPrintfCallback(",", out);
+    }
+  } else {
+    while (!found && childRef) {
+      JsVar *key = jsvLock(childRef);
+      item = jsvSkipName(key);
+      childRef = jsvGetNextSibling(key);
+      if (jsvIsInternalObjectKey(key) || jsvIsFunction(item) || jsvIsUndefined(item)) {
+        jsvUnLock(item);
+        item = 0;
+      } else {
+        found = true;
+        cbprintf((vcbprintf_callback)&jsvStringIteratorPrintfCallback, out, first?"%q:":",%q:", key);
+      }
+      jsvUnLock(key);
+    }
+  }
+  if (found) {
+    jsvObjectSetChildAndUnLock(frame, "p", jsvNewFromInteger((index<<1) | 1));
+    jswrap_jsonstringifier_setpos(frame, childRef);
+    jswrap_jsonstringifier_value(stack, item, out);
+  } else {
+    jsvStringIteratorPrintfCallback(jsvIsArray(container) ? "]" : "}", out);
+    jsvUnLock(jsvArrayPop(stack));
+  }
+  jsvUnLock(item);
+  jsvUnLock2(container, frame);
+  return true;
+}
+#endif
+
+/*JSON{
+  "type" : "method",
+  "class" : "JSONStringifier",
+  "name" : "read",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_jsonstringifier_read",
+  "params" : [
+    ["chars","int","The number of characters to read"]
+  ],
+  "return" : ["JsVar","The next chunk of JSON (at least `chars` long, unless it is the end), or `undefined` when it is all done"]
+}
+Get the next chunk of JSON. This is what `fs.pipe` uses to read the JSON.
+ */
+JsVar *jswrap_jsonstringifier_read(JsVar *parent, int chars) {
+#ifndef SAVE_ON_FLASH
+  JsVar *stack = jsvObjectGetChild(parent, JSONSTRINGIFIER_STACK_NAME, 0);
+  if (!stack) return 0; // finished
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) {
+    jsvUnLock(stack);
+    return 0;
+  }
+  JsvStringIterator out;
+  jsvStringIteratorNew(&out, str, 0);
+  JsVar *dataName = jsvFindChildFromString(parent, JSONSTRINGIFIER_DATA_NAME, false);
+  if (dataName) {
+    // starting off
+    JsVar *data = jsvSkipName(dataName);
+    jsvRemoveChild(parent, dataName);
+    jsvUnLock(dataName);
+    jswrap_jsonstringifier_value(stack, data, &out);
+    jsvUnLock(data);
+  }
+  while ((int)jsvStringIteratorGetIndex(&out) < chars &&
+         jswrap_jsonstringifier_next(stack, &out) &&
+         !jspIsInterrupted());
+  jsvStringIteratorFree(&out);
+  if (jsvGetArrayLength(stack)==0 || jspIsInterrupted())
+    jsvRemoveNamedChild(parent, JSONSTRINGIFIER_STACK_NAME);
+  jsvUnLock(stack);
+  return str;
+#else
+  NOT_USED(parent);
+  NOT_USED(chars);
+  return 0;
+#endif
+}
+
+
+/// State for parsing JSON straight from a string (without using the JS lexer)
+typedef struct {
+  JsvStringIterator it;
+  int ch; ///< The current character, or -1 at the end of the string
+  const char *error; ///< Set if there was an error
+  unsigned short depth; ///< How many arrays/objects we're inside
+} JsonParser;
+
+#define JSON_MAX_NUMBER_LENGTH 64 ///< Numbers with more characters than this are an error
+#ifdef RESIZABLE_JSVARS
+#define JSON_MAX_DEPTH 1000 ///< Arrays/objects nested deeper than this are an error (each level uses some stack)
+#else
+#define JSON_MAX_DEPTH 64 ///< Arrays/objects nested deeper than this are an error (each level uses some stack)
+#endif
 
-JsVar *jswrap_json_parse_internal(JsLex *lex) {
-  switch (lex->tk) {
-  case LEX_R_TRUE:  jslGetNextToken(lex); return jsvNewFromBool(true);
-  case LEX_R_FALSE: jslGetNextToken(lex); return jsvNewFromBool(false);
-  case LEX_R_NULL:  jslGetNextToken(lex); return jsvNewWithFlags(JSV_NULL);
-  case '-': {
-    jslGetNextToken(lex);
-    if (lex->tk!=LEX_INT && lex->tk!=LEX_FLOAT) return 0;
-    JsVar *v = jswrap_json_parse_internal(lex);
-    JsVar *zero = jsvNewFromInteger(0);
-    JsVar *r = jsvMathsOp(zero, v, '-');
-    jsvUnLock2(v, zero);
-    return r;
+static void jsonParserNew(JsonParser *p, JsVar *str, size_t startIdx) {
+  jsvStringIteratorNew(&p->it, str, startIdx);
+  p->ch = jsvStringIteratorGetCharOrMinusOne(&p->it);
+  p->error = 0;
+  p->depth = 0;
+}
+
+static void jsonParserFree(JsonParser *p) {
+  jsvStringIteratorFree(&p->it);
+}
+
+static ALWAYS_INLINE void jsonNextCh(JsonParser *p) {
+  jsvStringIteratorNextInline(&p->it);
+  p->ch = jsvStringIteratorGetCharOrMinusOne(&p->it);
+}
+
+static void jsonSkipWhitespace(JsonParser *p) {
+  while (p->ch==' ' || p->ch=='\t' || p->ch=='\n' || p->ch=='\r')
+    jsonNextCh(p);
+}
+
+static JsVar *jsonParseError(JsonParser *p, const char *error) {
+  if (!p->error) p->error = error;
+  return 0;
+}
+
+static int jsonHexValue(int ch) {
+  if (ch>='0' && ch<='9') return ch-'0';
+  if (ch>='a' && ch<='f') return ch+10-'a';
+  if (ch>='A' && ch<='F') return ch+10-'A';
+  return -1;
+}
+
+/// Parse a quoted string (of any length) - 'p->ch' is the quote
+static JsVar *jsonParseString(JsonParser *p) {
+  int delim = p->ch;
+  jsonNextCh(p);
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return jsonParseError(p, "Out of memory");
+  JsvStringIterator out;
+  jsvStringIteratorNew(&out, str, 0);
+  while (p->ch>=0 && p->ch!=delim) {
+    char ch = (char)p->ch;
+    jsonNextCh(p);
+    if (ch=='\\') {
+      ch = (char)p->ch;
+      jsonNextCh(p);
+      switch (ch) {
+      case 'n' : ch = 0x0A; break;
+      case 'b' : ch = 0x08; break;
+      case 'f' : ch = 0x0C; break;
+      case 'r' : ch = 0x0D; break;
+      case 't' : ch = 0x09; break;
+      case 'u' : { // We don't support unicode, so we just take the bottom 8 bits (like the lexer)
+        int i, v = 0;
+        for (i=0;i<4;i++) {
+          int h = jsonHexValue(p->ch);
+          if (h<0) {
+            jsvStringIteratorFree(&out);
+            jsvUnLock(str);
+            return jsonParseError(p, "Bad escape");
+          }
+          v = (v<<4) | h;
+          jsonNextCh(p);
+        }
+        ch = (char)v;
+      } break;
+      default: break; // '"', '\\', '/' and anything else just get passed through
+      }
+    }
+    jsvStringIteratorAppend(&out, ch);
+  }
+  jsvStringIteratorFree(&out);
+  if (p->ch!=delim) {
+    jsvUnLock(str);
+    return jsonParseError(p, "Unterminated string");
+  }
+  jsonNextCh(p);
+  return str;
+}
+
+/// Add the digits at the current position to buf, returning how many there were
+static size_t jsonParseDigits(JsonParser *p, char *buf, size_t *len) {
+  size_t count = 0;
+  while (p->ch>='0' && p->ch<='9') {
+    if (*len < JSON_MAX_NUMBER_LENGTH) buf[(*len)++] = (char)p->ch;
+    else p->error = "Number too long";
+    jsonNextCh(p);
+    count++;
   }
-  case LEX_INT: {
-    long long v = stringToInt(jslGetTokenValueAsString(lex));
-    jslGetNextToken(lex);
-    return jsvNewFromLongInteger(v);
+  return count;
+}
+
+static JsVar *jsonParseNumber(JsonParser *p) {
+  char buf[JSON_MAX_NUMBER_LENGTH+1];
+  size_t len = 0;
+  bool isFloat = false;
+  if (p->ch=='-') {
+    buf[len++] = '-';
+    jsonNextCh(p);
   }
-  case LEX_FLOAT: {
-    JsVarFloat v = stringToFloat(jslGetTokenValueAsString(lex));
-    jslGetNextToken(lex);
-    return jsvNewFromFloat(v);
+  bool ok = jsonParseDigits(p, buf, &len)>0;
+  if (ok && p->ch=='.') {
+    buf[len++] = '.';
+    jsonNextCh(p);
+    ok = jsonParseDigits(p, buf, &len)>0;
+    isFloat = true;
   }
-  case LEX_STR: {
-    JsVar *a = jslGetTokenValueAsVar(lex);
-    jslGetNextToken(lex);
-    return a;
+  if (ok && (p->ch=='e' || p->ch=='E')) {
+    if (len < JSON_MAX_NUMBER_LENGTH) buf[len++] = 'e';
+    jsonNextCh(p);
+    if ((p->ch=='-' || p->ch=='+') && len < JSON_MAX_NUMBER_LENGTH) {
+      buf[len++] = (char)p->ch;
+      jsonNextCh(p);
+    }
+    ok = jsonParseDigits(p, buf, &len)>0;
+    isFloat = true;
   }
+  if (p->error) return 0;
+  if (!ok) return jsonParseError(p, "Bad number");
+  buf[len] = 0;
+  // anything too big for a long long is done as a float
+  if (isFloat || len>18) return jsvNewFromFloat(stringToFloat(buf));
+  return jsvNewFromLongInteger(stringToIntWithRadix(buf, 10, 0));
+}
+
+/// Check that the next characters are 'word' (for true/false/null)
+static bool jsonMatchWord(JsonParser *p, const char *word) {
+  while (*word) {
+    if (p->ch != *word) return false;
+    jsonNextCh(p);
+    word++;
+  }
+  return !isAlpha((char)p->ch);
+}
+
+static JsVar *jsonParseValue(JsonParser *p) {
+  jsonSkipWhitespace(p);
+  switch (p->ch) {
+  case 't': return jsonMatchWord(p, "true") ? jsvNewFromBool(true) : jsonParseError(p, "Unexpected token");
+  case 'f': return jsonMatchWord(p, "false") ? jsvNewFromBool(false) : jsonParseError(p, "Unexpected token");
+  case 'n': return jsonMatchWord(p, "null") ? jsvNewWithFlags(JSV_NULL) : jsonParseError(p, "Unexpected token");
+  case '"':
+  case '\'': return jsonParseString(p);
   case '[': {
-    JsVar *arr = jsvNewWithFlags(JSV_ARRAY); if (!arr) return 0;
-    jslGetNextToken(lex); // [
-    while (lex->tk != ']') {
-      JsVar *value = jswrap_json_parse_internal(lex);
-      if (!value ||
-          (lex->tk!=']' && !jslMatch(lex, ','))) {
-        jsvUnLock2(value, arr);
+    if (p->depth >= JSON_MAX_DEPTH) return jsonParseError(p, "Too deeply nested");
+    JsVar *arr = jsvNewWithFlags(JSV_ARRAY);
+    if (!arr) return jsonParseError(p, "Out of memory");
+    p->depth++; // not decremented on errors, as we stop parsing then
+    jsonNextCh(p); // [
+    jsonSkipWhitespace(p);
+    while (p->ch != ']') {
+      JsVar *value = jsonParseValue(p);
+      if (!value) {
+        jsvUnLock(arr);
         return 0;
       }
       jsvArrayPush(arr, value);
       jsvUnLock(value);
+      jsonSkipWhitespace(p);
+      if (p->ch==',') {
+        jsonNextCh(p);
+      } else if (p->ch!=']') {
+        jsvUnLock(arr);
+        return jsonParseError(p, "Expected , or ]");
+      }
     }
-    if (!jslMatch(lex, ']')) {
-      jsvUnLock(arr);
-      return 0;
-    }
+    jsonNextCh(p); // ]
+    p->depth--;
     return arr;
   }
   case '{': {
-    JsVar *obj = jsvNewWithFlags(JSV_OBJECT); if (!obj) return 0;
-    jslGetNextToken(lex); // {
-    while (lex->tk == LEX_STR) {
-      JsVar *key = jsvAsArrayIndexAndUnLock(jslGetTokenValueAsVar(lex));
-      jslGetNextToken(lex);
+    if (p->depth >= JSON_MAX_DEPTH) return jsonParseError(p, "Too deeply nested");
+    JsVar *obj = jsvNewWithFlags(JSV_OBJECT);
+    if (!obj) return jsonParseError(p, "Out of memory");
+    p->depth++;
+    jsonNextCh(p); // {
+    jsonSkipWhitespace(p);
+    while (p->ch != '}') {
+      if (p->ch!='"' && p->ch!='\'') {
+        jsvUnLock(obj);
+        return jsonParseError(p, "Expected string");
+      }
+      JsVar *key = jsonParseString(p);
+      if (!key) {
+        jsvUnLock(obj);
+        return 0;
+      }
+      key = jsvAsArrayIndexAndUnLock(key);
+      jsonSkipWhitespace(p);
       JsVar *value = 0;
-      if (!jslMatch(lex, ':') ||
-          !(value=jswrap_json_parse_internal(lex)) ||
-          (lex->tk!='}' && !jslMatch(lex, ','))) {
-        jsvUnLock3(key, value, obj);
+      if (p->ch!=':') {
+        jsonParseError(p, "Expected :");
+      } else {
+        jsonNextCh(p);
+        value = jsonParseValue(p);
+      }
+      if (!value) {
+        jsvUnLock2(key, obj);
         return 0;
       }
       jsvAddName(obj, jsvMakeIntoVariableName(key, value));
       jsvUnLock2(value, key);
+      jsonSkipWhitespace(p);
+      if (p->ch==',') {
+        jsonNextCh(p);
+        jsonSkipWhitespace(p);
+      } else if (p->ch!='}') {
+        jsvUnLock(obj);
+        return jsonParseError(p, "Expected , or }");
+      }
     }
-    if (!jslMatch(lex, '}')) {
-      jsvUnLock(obj);
-      return 0;
-    }
+    jsonNextCh(p); // }
+    p->depth--;
     return obj;
   }
-  default: return 0; // undefined = error
+  default:
+    if (p->ch=='-' || (p->ch>='0' && p->ch<='9'))
+      return jsonParseNumber(p);
+    return jsonParseError(p, (p->ch<0) ? "Unexpected end of input" : "Unexpected token");
   }
 }
 
+/** Parse the JSON value in str that starts at startIdx. Anything but whitespace
+ * after it is an error. On error, returns 0 and sets *error */
+static JsVar *jsonParse(JsVar *str, size_t startIdx, const char **error, size_t *errorPos) {
+  JsonParser p;
+  jsonParserNew(&p, str, startIdx);
+  JsVar *v = jsonParseValue(&p);
+  if (v) {
+    jsonSkipWhitespace(&p);
+    if (p.ch>=0) {
+      jsvUnLock(v);
+      v = jsonParseError(&p, "Unexpected data after JSON");
+    }
+  }
+  *error = p.error;
+  *errorPos = jsvStringIteratorGetIndex(&p.it);
+  jsonParserFree(&p);
+  return v;
+}
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "JSON",
@@ -137,20 +521,253 @@ JsVar *jswrap_json_parse_internal(JsLex *lex) {
   ],
   "return" : ["JsVar","The JavaScript object created by parsing the data string"]
 }
-Parse the given JSON string into a JavaScript object
+Parse the given JSON string into a JavaScript object. If the string isn't valid JSON, a `SyntaxError` is thrown.
 
-NOTE: This implementation uses eval() internally, and as such it is unsafe as it can allow arbitrary JS commands to be executed.
+To parse JSON as it arrives (for instance on a Serial port or socket) see `JSON.parser()`.
  */
 JsVar *jswrap_json_parse(JsVar *v) {
-  JsLex lex;
   JsVar *str = jsvAsString(v, false);
-  jslInit(&lex, str);
+  if (!str) return 0;
+  const char *error;
+  size_t errorPos;
+  JsVar *res = jsonParse(str, 0, &error, &errorPos);
   jsvUnLock(str);
-  JsVar *res = jswrap_json_parse_internal(&lex);
-  jslKill(&lex);
+  if (error) jsExceptionHere(JSET_SYNTAXERROR, "%s in JSON at position %d", error, errorPos);
   return res;
 }
 
+/*JSON{
+  "type" : "class",
+  "class" : "JSONParser",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Parses JSON as it arrives, a bit at a time. Create one with `JSON.parser()`
+ */
+/*JSON{
+  "type" : "event",
+  "class" : "JSONParser",
+  "name" : "value",
+  "params" : [
+    ["value","JsVar","The value that was parsed"]
+  ]
+}
+Called for each complete top-level JSON value. Values can follow each other
+directly (`{"a":1}{"a":2}`), or be separated by whitespace, newlines or commas.
+Numbers, `true`, `false` and `null` at the top level must be followed by one
+of those, or `JSONParser.end()` must be called.
+ */
+/*JSON{
+  "type" : "event",
+  "class" : "JSONParser",
+  "name" : "error",
+  "params" : [
+    ["message","JsVar","A String describing the error"]
+  ]
+}
+Called when a value that isn't valid JSON is found. The invalid value is thrown away,
+and parsing carries on with whatever comes after it.
+ */
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "JSON",
+  "name" : "parser",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_json_parser",
+  "return" : ["JsVar","A JSONParser"],
+  "return_object" : "JSONParser"
+}
+Create a `JSONParser`, which parses JSON that is written to it a bit at a time
+and calls its `value` event for each complete value. For example to handle
+newline-delimited JSON on a Serial port:
+
+```
+var p = JSON.parser();
+p.on('value', function(v) { print(v); });
+Serial1.on('data', function(d) { p.write(d); });
+```
+ */
+#ifndef SAVE_ON_FLASH
+#define JSONPARSER_BUFFER_NAME JS_HIDDEN_CHAR_STR"buf" ///< Data we haven't made into values yet
+#define JSONPARSER_STATE_NAME JS_HIDDEN_CHAR_STR"st" ///< Where we are in the data we have (see JSONPARSER_*)
+#define JSONPARSER_DEPTH_MASK 0xFFFF ///< How many {/[ we're inside
+#define JSONPARSER_QUOTE_SHIFT 16 ///< The quote character, if we're in a string
+#define JSONPARSER_ESCAPE 0x1000000 ///< The last character was a backslash in a string
+#define JSONPARSER_STARTED 0x2000000 ///< We're part way through a value
+#define JSONPARSER_SKIP 0x4000000 ///< The value is nested too deeply, so we're ignoring the rest of it
+
+JsVar *jswrap_json_parser() {
+  return jspNewObject(0, "JSONParser");
+}
+
+/// Queue an 'error' event
+static void jswrap_jsonparser_error(JsVar *parser, const char *error) {
+  JsVar *msg = jsvVarPrintf("%s in JSON", error);
+  jsiQueueObjectCallbacks(parser, JS_EVENT_PREFIX"error", &msg, 1);
+  jsvUnLock(msg);
+}
+
+/// Parse the value in buf from start to end, and queue a 'value' or 'error' event
+static void jswrap_jsonparser_emit(JsVar *parser, JsVar *buf, size_t start) {
+  const char *error;
+  size_t errorPos;
+  JsVar *value = jsonParse(buf, start, &error, &errorPos);
+  if (error) {
+    jswrap_jsonparser_error(parser, error);
+  } else {
+    jsiQueueObjectCallbacks(parser, JS_EVENT_PREFIX"value", &value, 1);
+  }
+  jsvUnLock(value);
+}
+
+/** Look through buf from 'from', using and updating 'state', and emit every value we
+ * find. Returns the index of the first character we haven't used */
+static size_t jswrap_jsonparser_scan(JsVar *parser, JsVar *buf, size_t from, JsVarInt *state) {
+  JsVarInt st = *state;
+  size_t start = 0; // where the current value starts
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, buf, from);
+  while (jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    size_t idx = jsvStringIteratorGetIndex(&it);
+    jsvStringIteratorNext(&it);
+    JsVarInt depth = st & JSONPARSER_DEPTH_MASK;
+    char quote = (char)((st >> JSONPARSER_QUOTE_SHIFT) & 0xFF);
+    bool valueEnded = false;
+    if (quote) {
+      if (st & JSONPARSER_ESCAPE) st &= ~JSONPARSER_ESCAPE;
+      else if (ch=='\\') st |= JSONPARSER_ESCAPE;
+      else if (ch==quote) {
+        st &= ~(0xFF << JSONPARSER_QUOTE_SHIFT);
+        valueEnded = depth==0;
+      }
+      if (!valueEnded) continue;
+      idx++; // the quote is part of the value
+    } else if (ch==' ' || ch=='\t' || ch=='\r' || ch=='\n' || ch==',') {
+      if (depth) continue;
+      if (!(st & JSONPARSER_STARTED)) {
+        start = idx+1; // nothing yet - skip it
+        continue;
+      }
+      valueEnded = true; // end of a number/true/false/null
+    } else {
+      if (!(st & JSONPARSER_STARTED) && depth==0) {
+        start = idx;
+        st |= JSONPARSER_STARTED;
+      }
+      if (ch=='"' || ch=='\'') {
+        st |= (JsVarInt)(unsigned char)ch << JSONPARSER_QUOTE_SHIFT;
+      } else if (ch=='{' || ch=='[') {
+        if (depth==JSON_MAX_DEPTH && !(st & JSONPARSER_SKIP)) {
+          // jsonParse would refuse it anyway - so say so now, and don't store the rest
+          jswrap_jsonparser_error(parser, "Too deeply nested");
+          st |= JSONPARSER_SKIP;
+        }
+        if (depth<JSONPARSER_DEPTH_MASK) depth++;
+        st = (st & ~JSONPARSER_DEPTH_MASK) | depth;
+      } else if (ch=='}' || ch==']') {
+        st = (st & ~JSONPARSER_DEPTH_MASK) | (depth ? depth-1 : 0);
+        valueEnded = depth<=1;
+        idx++; // the bracket is part of the value
+      }
+      if (!valueEnded) continue;
+    }
+    // we have a whole value from start to idx
+    if (!(st & JSONPARSER_SKIP)) {
+      JsVar *value = jsvNewFromStringVar(buf, start, idx-start);
+      if (value) {
+        jswrap_jsonparser_emit(parser, value, 0);
+        jsvUnLock(value);
+      }
+    }
+    st = 0;
+    start = idx;
+  }
+  jsvStringIteratorFree(&it);
+  if (!(st & (JSONPARSER_STARTED|JSONPARSER_DEPTH_MASK)) || (st & JSONPARSER_SKIP)) {
+    // nothing in progress (or we are ignoring it) - we don't need any of it
+    start = jsvStringIteratorGetIndex(&it);
+  }
+  *state = st;
+  return start;
+}
+#endif
+
+/*JSON{
+  "type" : "method",
+  "class" : "JSONParser",
+  "name" : "write",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_jsonparser_write",
+  "params" : [
+    ["data","JsVar","The next piece of JSON text"]
+  ]
+}
+Add more JSON text. A `value` event will be queued for every value it completes.
+ */
+void jswrap_jsonparser_write(JsVar *parent, JsVar *data) {
+#ifndef SAVE_ON_FLASH
+  JsVar *str = jsvAsString(data, false);
+  if (!str) return;
+  JsVar *buf = jsvObjectGetChild(parent, JSONPARSER_BUFFER_NAME, 0);
+  size_t from = 0;
+  if (buf) {
+    from = jsvGetStringLength(buf);
+    jsvAppendStringVarComplete(buf, str);
+    jsvUnLock(str);
+  } else {
+    buf = str;
+  }
+  JsVarInt state = jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, JSONPARSER_STATE_NAME, 0));
+  size_t used = jswrap_jsonparser_scan(parent, buf, from, &state);
+  // only keep what we haven't used yet
+  if (used >= jsvGetStringLength(buf)) {
+    jsvUnLock(buf);
+    buf = 0;
+  } else if (used) {
+    JsVar *rest = jsvNewFromStringVar(buf, used, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    jsvUnLock(buf);
+    buf = rest;
+  } else if (buf==str) {
+    // it's not ours - we'll be appending to it
+    JsVar *copy = jsvNewFromStringVar(buf, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    jsvUnLock(buf);
+    buf = copy;
+  }
+  if (buf) jsvObjectSetChild(parent, JSONPARSER_BUFFER_NAME, buf);
+  else jsvRemoveNamedChild(parent, JSONPARSER_BUFFER_NAME);
+  jsvObjectSetChildAndUnLock(parent, JSONPARSER_STATE_NAME, jsvNewFromInteger(state));
+  jsvUnLock(buf);
+#else
+  NOT_USED(parent);
+  NOT_USED(data);
+#endif
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "JSONParser",
+  "name" : "end",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_jsonparser_end"
+}
+Say there is no more data. A value that was still in progress (like a number
+with nothing after it) is finished off, and anything that is incomplete causes an
+`error` event.
+ */
+void jswrap_jsonparser_end(JsVar *parent) {
+#ifndef SAVE_ON_FLASH
+  JsVar *buf = jsvObjectGetChild(parent, JSONPARSER_BUFFER_NAME, 0);
+  if (buf) {
+    jswrap_jsonparser_emit(parent, buf, 0);
+    jsvUnLock(buf);
+  }
+  jsvRemoveNamedChild(parent, JSONPARSER_BUFFER_NAME);
+  jsvRemoveNamedChild(parent, JSONPARSER_STATE_NAME);
+#else
+  NOT_USED(parent);
+#endif
+}
+
 /* This is like jsfGetJSONWithCallback, but handles ONLY functions (and does not print the initial 'function' text) */
 void jsfGetJSONForFunctionWithCallback(JsVar *var, JSONFlags flags, vcbprintf_callback user_callback, void *user_data) {
   assert(jsvIsFunction(var));
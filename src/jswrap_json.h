@@ -14,7 +14,12 @@
 #include "jsvar.h"
 
 JsVar *jswrap_json_stringify(JsVar *v);
+JsVar *jswrap_json_stringifyTo(JsVar *data, JsVar *destination, JsVar *options);
+JsVar *jswrap_jsonstringifier_read(JsVar *parent, int chars);
 JsVar *jswrap_json_parse(JsVar *v);
+JsVar *jswrap_json_parser();
+void jswrap_jsonparser_write(JsVar *parent, JsVar *data);
+void jswrap_jsonparser_end(JsVar *parent);
 
 typedef enum {
   JSON_NONE,
@@ -542,9 +542,14 @@ void jswrap_object_on(JsVar *parent, JsVar *event, JsVar *listener) {
     if (jsvIsString(buf)) {
       jsiQueueObjectCallbacks(parent, STREAM_CALLBACK_NAME, &buf, 1);
       jsvRemoveNamedChild(parent, STREAM_BUFFER_NAME);
+      jswrap_stream_bufferEmptied(parent);
     }
     jsvUnLock(buf);
   }
+  /* Similarly if the stream has ended and its buffer has been read, but
+   * there was no 'end' listener at the time */
+  if (jsvIsStringEqual(event, "end") && !jswrap_stream_available(parent))
+    jswrap_stream_bufferEmptied(parent);
 }
 
 /*JSON{
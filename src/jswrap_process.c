@@ -111,6 +111,12 @@ total : Total memory
 
 history : Memory used for command history - that is freed if memory is low. Note that this is INCLUDED in the figure for 'free'
 
+gc : Memory freed during the GC pass
+
+gctime : Time taken for GC pass (in milliseconds)
+
+gcmaxpause : The longest time (in milliseconds) that Espruino has been paused for while collecting garbage. See `E.setGCSliceTime`
+
 stackEndAddress : (on ARM) the address (that can be used with peek/poke/etc) of the END of the stack. The stack grows down, so unless you do a lot of recursion the bytes above this can be used.
 
 Memory units are specified in 'blocks', which are around 16 bytes each (depending on your device). See http://www.espruino.com/Performance for more information.
@@ -120,7 +126,9 @@ extern int LINKER_END_VAR; // end of ram used (variables)
 extern int LINKER_ETEXT_VAR; // end of flash text (binary) section
 #endif
 JsVar *jswrap_process_memory() {
-  jsvGarbageCollect();
+  int gc = jsvGarbageCollect();
+  JsvGarbageCollectStats gcStats;
+  jsvGetGarbageCollectStats(&gcStats);
   JsVar *obj = jsvNewWithFlags(JSV_OBJECT);
   if (obj) {
     unsigned int history = 0;
@@ -135,6 +143,9 @@ JsVar *jswrap_process_memory() {
     jsvObjectSetChildAndUnLock(obj, "usage", jsvNewFromInteger((JsVarInt)usage));
     jsvObjectSetChildAndUnLock(obj, "total", jsvNewFromInteger((JsVarInt)total));
     jsvObjectSetChildAndUnLock(obj, "history", jsvNewFromInteger((JsVarInt)history));
+    jsvObjectSetChildAndUnLock(obj, "gc", jsvNewFromInteger((JsVarInt)gc));
+    jsvObjectSetChildAndUnLock(obj, "gctime", jsvNewFromFloat(jshGetMillisecondsFromTime(gcStats.time)));
+    jsvObjectSetChildAndUnLock(obj, "gcmaxpause", jsvNewFromFloat(jshGetMillisecondsFromTime(gcStats.maxPause)));
 
 #ifdef ARM
     jsvObjectSetChildAndUnLock(obj, "stackEndAddress", jsvNewFromInteger((JsVarInt)(unsigned int)&LINKER_END_VAR));
@@ -49,6 +49,7 @@ JsVar *jswrap_stream_read(JsVar *parent, JsVarInt chars) {
       data = buf;
       buf = 0;
       jsvRemoveNamedChild(parent, STREAM_BUFFER_NAME);
+      jswrap_stream_bufferEmptied(parent);
     } else {
       // return just part of the buffer, and shorten it accordingly
       data = jsvNewFromStringVar(buf, 0, (size_t)chars);
@@ -98,10 +99,36 @@ bool jswrap_stream_pushData(JsVar *parent, JsVar *dataString, bool force) {
         // jsWarn("String buffer overflowed maximum size (%d)", STREAM_MAX_BUFFER_SIZE);
         ok = false;
       }
-      if ((ok || force) && (bufLen < STREAM_MAX_BUFFER_SIZE))
-        jsvAppendStringVar(buf, dataString, 0, STREAM_MAX_BUFFER_SIZE-bufLen);
+      if ((ok || force) && (bufLen < STREAM_MAX_BUFFER_SIZE)) {
+        if (jsvIsFlatString(buf)) {
+          // flat strings can't be appended to, so make a normal copy first
+          JsVar *newBuf = jsvNewFromStringVar(buf, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+          jsvUnLock(buf);
+          buf = newBuf;
+          jsvObjectSetChild(parent, STREAM_BUFFER_NAME, buf);
+        }
+        if (buf) jsvAppendStringVar(buf, dataString, 0, STREAM_MAX_BUFFER_SIZE-bufLen);
+      }
       jsvUnLock(buf);
     }
   }
   return ok;
 }
+
+void jswrap_stream_endWhenRead(JsVar *parent) {
+  if (jswrap_stream_available(parent))
+    jsvObjectSetChildAndUnLock(parent, STREAM_END_NAME, jsvNewFromBool(true));
+  else
+    jsiQueueObjectCallbacks(parent, JS_EVENT_PREFIX"end", &parent, 1);
+}
+
+void jswrap_stream_bufferEmptied(JsVar *parent) {
+  if (!jsvGetBoolAndUnLock(jsvObjectGetChild(parent, STREAM_END_NAME, 0))) return;
+  // if there's no 'end' listener yet, keep the flag so jswrap_object_on can fire it when one is added
+  JsVar *listener = jsvObjectGetChild(parent, JS_EVENT_PREFIX"end", 0);
+  if (listener) {
+    jsvRemoveNamedChild(parent, STREAM_END_NAME);
+    jsiQueueObjectCallbacks(parent, JS_EVENT_PREFIX"end", &parent, 1);
+    jsvUnLock(listener);
+  }
+}
@@ -16,6 +16,7 @@
 
 #define STREAM_BUFFER_NAME JS_HIDDEN_CHAR_STR"buf" // the buffer to store data in when no listener is defined
 #define STREAM_CALLBACK_NAME JS_EVENT_PREFIX"data"
+#define STREAM_END_NAME JS_HIDDEN_CHAR_STR"end" // set if 'end' should be emitted when the buffer has been read
 #define STREAM_MAX_BUFFER_SIZE 512
 
 JsVarInt jswrap_stream_available(JsVar *parent);
@@ -32,3 +33,9 @@ JsVar *jswrap_stream_read(JsVar *parent, JsVarInt chars);
  */
 bool jswrap_stream_pushData(JsVar *parent, JsVar *dataString, bool force);
 
+/** Emit 'end' on this stream once everything in its buffer has been read
+ * (or right now if the buffer is empty). To be used by Espruino (not a user). */
+void jswrap_stream_endWhenRead(JsVar *parent);
+
+/// Call after removing a stream's buffer - emits 'end' if jswrap_stream_endWhenRead was waiting for it
+void jswrap_stream_bufferEmptied(JsVar *parent);
@@ -158,7 +158,6 @@ Return the last index of substring in this string, or -1 if not found
  */
 int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, bool lastIndexOf) {
   if (!jsvIsString(parent)) return 0;
-  // slow, but simple!
   substring = jsvAsString(substring, false);
   if (!substring) return 0; // out of memory
   int parentLength = (int)jsvGetStringLength(parent);
@@ -168,35 +167,33 @@ int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, boo
     return -1;
   }
   int lastPossibleSearch = parentLength - subStringLength;
-  int idx, dir, end;
+  int idx;
   if (!lastIndexOf) { // normal indexOf
-    dir = 1;
-    end = lastPossibleSearch+1;
     idx = 0;
     if (jsvIsNumeric(fromIndex)) {
       idx = (int)jsvGetInteger(fromIndex);
       if (idx<0) idx=0;
-      if (idx>end) idx=end;
+      if (idx>lastPossibleSearch) {
+        jsvUnLock(substring);
+        return subStringLength ? -1 : parentLength;
+      }
     }
+    JsvStringSearch ss;
+    jsvStringSearchNew(&ss, substring);
+    idx = jsvStringSearchFind(&ss, parent, (size_t)idx, (size_t)lastPossibleSearch);
   } else {
-    dir = -1;
-    end = -1;
-    idx = lastPossibleSearch;
+    int end = lastPossibleSearch;
     if (jsvIsNumeric(fromIndex)) {
-      idx = (int)jsvGetInteger(fromIndex);
-      if (idx<0) idx=0;
-      if (idx>lastPossibleSearch) idx=lastPossibleSearch;
-    }
-  }
-
-  for (;idx!=end;idx+=dir) {
-    if (jsvCompareString(parent, substring, (size_t)idx, 0, true)==0) {
-      jsvUnLock(substring);
-      return idx;
+      end = (int)jsvGetInteger(fromIndex);
+      if (end<0) end=0;
+      if (end>lastPossibleSearch) end=lastPossibleSearch;
     }
+    JsvStringSearch ss;
+    jsvStringSearchNew(&ss, substring);
+    idx = jsvStringSearchFindLast(&ss, parent, 0, (size_t)end);
   }
   jsvUnLock(substring);
-  return -1;
+  return idx;
 }
 
 /*JSON{
@@ -334,20 +331,28 @@ JsVar *jswrap_string_split(JsVar *parent, JsVar *split) {
   int splitlen = jsvIsUndefined(split) ? 0 : (int)jsvGetStringLength(split);
   int l = (int)jsvGetStringLength(parent) + 1 - splitlen;
 
-  for (idx=0;idx<=l;idx++) {
-    if (splitlen==0 && idx==0) continue; // special case for where split string is ""
-    if (idx==l || splitlen==0 || jsvCompareString(parent, split, (size_t)idx, 0, true)==0) {
-      if (idx==l) {
-        idx=l+splitlen; // if the last element, do to the end of the string
-        if (splitlen==0) break;
-      }
-
-      JsVar *part = jsvNewFromStringVar(parent, (size_t)last, (size_t)(idx-last));
+  if (splitlen) {
+    JsvStringSearch ss;
+    jsvStringSearchNew(&ss, split);
+    while (true) {
+      // skip straight to the next separator
+      idx = (last<l) ? jsvStringSearchFind(&ss, parent, (size_t)last, (size_t)(l-1)) : -1;
+      JsVar *part = jsvNewFromStringVar(parent, (size_t)last, (idx<0) ? JSVAPPENDSTRINGVAR_MAXLENGTH : (size_t)(idx-last));
       if (!part) break; // out of memory
       jsvArrayPush(array, part);
       jsvUnLock(part);
+      if (idx<0) break; // that was the last one
       last = idx+splitlen;
     }
+  } else {
+    // special case for where split string is "" - one character per element
+    for (idx=1;idx<l;idx++) {
+      JsVar *part = jsvNewFromStringVar(parent, (size_t)last, (size_t)(idx-last));
+      if (!part) break; // out of memory
+      jsvArrayPush(array, part);
+      jsvUnLock(part);
+      last = idx;
+    }
   }
   jsvUnLock(split);
   return array;
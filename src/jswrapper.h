@@ -75,6 +75,13 @@ bool jswIsBuiltInObject(const char *name);
   pointer of the object's constructor */
 void *jswGetBuiltInLibrary(const char *name);
 
+#ifdef JSPARSE_PROFILER
+/** Given a native function pointer, find the name of the built-in function it
+ * is (eg. className="Array.prototype", name="push"). className is 0 for global
+ * functions. Returns false if it isn't in the symbol tables */
+bool jswGetBuiltInFunctionName(void *functionPtr, const char **className, const char **name);
+#endif
+
 /** Given a variable, return the basic object name of it */
 const char *jswGetBasicObjectName(JsVar *var);
 
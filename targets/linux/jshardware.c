@@ -30,6 +30,9 @@
 #include "jsutils.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
+#ifdef USE_NET
+#include "network_linux.h"
+#endif
 
 #include <pthread.h>
 
@@ -48,6 +51,13 @@
 int ioDevices[EV_DEVICE_MAX+1]; // list of open IO devices (or 0)
 JshPinState gpioState[JSH_PIN_COUNT]; // will be set to UNDEFINED if it isn't exported
 
+#if !defined(SYSFS_GPIO_DIR) && !defined(USE_WIRINGPI)
+/* No real GPIO, so pins just remember what was written to them (and watches
+ * get events when that changes) so that setWatch can be tested */
+#define GPIO_SIMULATED
+bool gpioSimulatedValue[JSH_PIN_COUNT];
+#endif
+
 #ifdef SYSFS_GPIO_DIR
 
 #include <unistd.h>
@@ -221,8 +231,8 @@ int getch()
 {
     int r;
     unsigned char c;
-    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) < 0) {
-        return r;
+    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) <= 0) {
+        return -1; // error, or end of file
     } else {
         return c;
     }
@@ -335,6 +345,10 @@ void jshInit() {
     gpioShouldWatch[i] = false;    
   }
 #endif
+#ifdef GPIO_SIMULATED
+  for (i=0;i<JSH_PIN_COUNT;i++)
+    gpioSimulatedValue[i] = false;
+#endif
 
   isInitialised = true;
   int err = pthread_create(&inputThread, NULL, &jshInputThread, NULL);
@@ -465,6 +479,13 @@ void jshPinSetValue(Pin pin, bool value) {
 #ifdef USE_WIRINGPI
   digitalWrite(pin,value);
 #endif
+#ifdef GPIO_SIMULATED
+  if (gpioSimulatedValue[pin] != value) {
+    gpioSimulatedValue[pin] = value;
+    if (gpioEventFlags[pin])
+      jshPushIOEvent(gpioEventFlags[pin] | (value?EV_EXTI_IS_HIGH:0), jshGetSystemTime());
+  }
+#endif
 }
 
 bool jshPinGetValue(Pin pin) {
@@ -476,7 +497,7 @@ bool jshPinGetValue(Pin pin) {
 #elif defined(USE_WIRINGPI)
   return digitalRead(pin);
 #else
-  return false;
+  return gpioSimulatedValue[pin];
 #endif
 }
 
@@ -767,8 +788,13 @@ bool jshSleep(JsSysTime timeUntilWake) {
     usecs=1000; // don't sleep much if we have watches - we need to keep polling them
   if (usecs > 50000)
     usecs = 50000; // don't want to sleep too much (user input/HTTP/etc)
-  if (usecs >= 1000)  
-    usleep(usecs); 
+  if (usecs >= 1000) {
+#ifdef USE_NET
+    // wake up as soon as there's network activity
+    if (!net_linux_sleep(usecs))
+#endif
+      usleep(usecs);
+  }
   return true;
 }
 
@@ -4,6 +4,10 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <dirent.h> // for readdir
+#include <unistd.h> // for dup/fork
+#ifndef __MINGW32__
+#include <sys/wait.h>
+#endif
 
 #include "jslex.h"
 #include "jsvar.h"
@@ -13,9 +17,15 @@
 #include "jsinteractive.h"
 #include "jshardware.h"
 #include "jswrapper.h"
+#ifdef USE_NET
+#include "socketserver.h"
+#endif
 
 
 #define TEST_DIR "tests/"
+#define BENCH_RUNS 5 // default number of times to run each benchmark
+#define BENCH_TOLERANCE 20 // default % that a benchmark can be worse than the baseline before we fail
+#define BENCH_TIME_SLACK 1 // ms that a benchmark's time can always be worse by (short benchmarks are noisy)
 
 bool isRunning = true;
 
@@ -32,6 +42,14 @@ void nativeInterrupt() {
   jspSetInterrupted(true);
 }
 
+/// Is there anything left that could make code run later (so we shouldn't exit yet)?
+bool hasPendingWork() {
+#ifdef USE_NET
+  if (socketHasConnections()) return true;
+#endif
+  return jsiHasTimers();
+}
+
 char *read_file(const char *filename) {
   struct stat results;
   if (!stat(filename, &results) == 0) {
@@ -70,7 +88,7 @@ bool run_test(const char *filename) {
 
   isRunning = true;
   bool isBusy = true;
-  while (isRunning && (jsiHasTimers() || isBusy))
+  while (isRunning && (hasPendingWork() || isBusy))
     isBusy = jsiLoop();
 
   JsVar *result = jsvObjectGetChild(execInfo.root, "result", 0/*no create*/);
@@ -218,6 +236,10 @@ void show_help() {
     printf("   --test-mem-all          Run all Exhaustive Memory crash tests\n");
     printf("   --test-mem test.js      Run the supplied Exhaustive Memory crash test\n");
     printf("   --test-mem-n test.js #  Run the supplied Exhaustive Memory crash test with # vars\n");
+  printf("   --bench dir             Run all benchmarks (dir/*.js) and output the results as JSON\n");
+  printf("   --bench-runs #          Run each benchmark # times (default %d)\n", BENCH_RUNS);
+  printf("   --bench-baseline f.json Fail if results are worse than the JSON from an earlier --bench\n");
+  printf("   --bench-tolerance #     Allow results to be #%% worse than the baseline (default %d)\n", BENCH_TOLERANCE);
 }
 
 void die(const char *txt) {
@@ -243,8 +265,243 @@ int handleErrors() {
   return e;
 }
 
+typedef struct {
+  char *name; ///< filename of the benchmark, without the directory
+  bool ok; ///< false if there was an error running it
+  double time; ///< fastest time (ms)
+  double timeAvg; ///< average time (ms)
+  unsigned int vars; ///< memory records allocated
+  unsigned int peakVars; ///< most memory records in use at once
+  unsigned int gc; ///< garbage collections completed
+  double gcTime; ///< average time spent garbage collecting (ms)
+  double gcMaxPause; ///< longest garbage collection pause (ms)
+  unsigned int tokens; ///< tokens lexed
+} BenchResult;
+
+/// Run the given benchmark file 'runs' times, and fill in 'r' - see run_benchmarks
+bool run_benchmark(const char *filename, int runs, BenchResult *r) {
+  char *buffer = read_file(filename);
+  if (!buffer) return false;
+  r->ok = true;
+  r->time = 0;
+  r->timeAvg = 0;
+  r->gcTime = 0;
+  r->gcMaxPause = 0;
+  int run;
+  for (run=0;run<runs;run++) {
+    jshInit();
+    jsvInit();
+    jsiInit(false /* do not autoload!!! */);
+    addNativeFunction("quit", nativeQuit);
+
+    JsvMemoryStats memStart, memEnd;
+    JsvGarbageCollectStats gcStart, gcEnd;
+    jsvGetMemoryStats(&memStart);
+    jsvGetGarbageCollectStats(&gcStart);
+    unsigned int tokenStart = jslGetTokenCount();
+    JsSysTime timeStart = jshGetSystemTime();
+
+    jsvUnLock(jspEvaluate(buffer));
+    if (handleErrors()) r->ok = false;
+    isRunning = r->ok;
+    bool isBusy = true;
+    while (isRunning && (hasPendingWork() || isBusy))
+      isBusy = jsiLoop();
+    if (handleErrors()) r->ok = false;
+
+    double time = jshGetMillisecondsFromTime(jshGetSystemTime()-timeStart);
+    jsvGetMemoryStats(&memEnd);
+    jsvGetGarbageCollectStats(&gcEnd);
+    // the counts should all be the same each time, so just use the last
+    r->vars = memEnd.allocations - memStart.allocations;
+    r->peakVars = memEnd.peak;
+    r->gc = gcEnd.collections - gcStart.collections;
+    r->tokens = jslGetTokenCount() - tokenStart;
+    if (run==0 || time<r->time) r->time = time;
+    r->timeAvg += time / runs;
+    r->gcTime += jshGetMillisecondsFromTime(gcEnd.totalTime - gcStart.totalTime) / runs;
+    if (gcEnd.maxPause > gcStart.maxPause) {
+      double pause = jshGetMillisecondsFromTime(gcEnd.maxPause);
+      if (pause > r->gcMaxPause) r->gcMaxPause = pause;
+    }
+
+    jsiKill();
+    jsvKill();
+    jshKill();
+  }
+  free(buffer);
+  return r->ok;
+}
+
+/// Get a number from a benchmark in the baseline JSON, or -1 if it isn't there
+double get_baseline_value(JsVar *baseline, const char *name, const char *key) {
+  double v = -1;
+  JsVar *results = jsvObjectGetChild(baseline, "results", 0);
+  JsVar *result = jsvIsObject(results) ? jsvObjectGetChild(results, name, 0) : 0;
+  JsVar *value = jsvIsObject(result) ? jsvObjectGetChild(result, key, 0) : 0;
+  if (jsvIsNumeric(value)) v = jsvGetFloat(value);
+  jsvUnLock(value);
+  jsvUnLock(result);
+  jsvUnLock(results);
+  return v;
+}
+
+/// Is the new value worse than the baseline? If so, print a message
+bool check_baseline_value(JsVar *baseline, BenchResult *r, const char *key, double value, double slack, int tolerance) {
+  double base = get_baseline_value(baseline, r->name, key);
+  if (base<0) return true; // not in the baseline, so nothing to compare against
+  if (value <= base*(100+tolerance)/100 + slack) return true;
+  fprintf(stderr, "REGRESSION %s: %s was %g, now %g (+%d%%)\n", r->name, key, base, value, (int)(100*(value-base)/base));
+  return false;
+}
+
+/// Check the results against the JSON from a previous run. Returns false if any are worse
+bool check_baseline(const char *baselineFile, BenchResult *results, int count, int tolerance) {
+  char *buffer = read_file(baselineFile);
+  if (!buffer) return false;
+  jshInit();
+  jsvInit();
+  jsiInit(false /* do not autoload!!! */);
+  JsVar *json = jsvNewFromString(buffer);
+  JsVar *baseline = jswrap_json_parse(json);
+  jsvUnLock(json);
+  free(buffer);
+  bool ok = true;
+  if (handleErrors() || !jsvIsObject(baseline)) {
+    fprintf(stderr, "Baseline %s isn't valid benchmark JSON\n", baselineFile);
+    jsvUnLock(baseline);
+    baseline = 0;
+    ok = false;
+  }
+
+  int i;
+  for (i=0;baseline && i<count;i++) {
+    BenchResult *r = &results[i];
+    if (!r->ok) continue;
+    if (get_baseline_value(baseline, r->name, "time")<0) {
+      fprintf(stderr, "%s isn't in the baseline\n", r->name);
+      continue;
+    }
+    // check everything, so we report all regressions at once
+    ok &= check_baseline_value(baseline, r, "time", r->time, BENCH_TIME_SLACK, tolerance);
+    ok &= check_baseline_value(baseline, r, "vars", r->vars, 0, tolerance);
+    ok &= check_baseline_value(baseline, r, "peakVars", r->peakVars, 0, tolerance);
+    ok &= check_baseline_value(baseline, r, "tokens", r->tokens, 0, tolerance);
+  }
+
+  jsvUnLock(baseline);
+  jsiKill();
+  jsvKill();
+  jshKill();
+  return ok;
+}
+
+/** Like run_benchmark, but in a separate process - so if the benchmark
+ * crashes or asserts we can still carry on with the others */
+bool run_benchmark_isolated(const char *filename, int runs, BenchResult *r) {
+#ifndef __MINGW32__
+  int fds[2];
+  if (pipe(fds)==0) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid==0) {
+      close(fds[0]);
+      run_benchmark(filename, runs, r);
+      if (write(fds[1], r, sizeof(BenchResult)) != sizeof(BenchResult)) _exit(1);
+      _exit(0);
+    }
+    close(fds[1]);
+    bool ok = pid>0 && read(fds[0], r, sizeof(BenchResult))==sizeof(BenchResult);
+    close(fds[0]);
+    if (pid>0) waitpid(pid, 0, 0);
+    if (!ok) r->ok = false;
+    return r->ok;
+  }
+#endif
+  return run_benchmark(filename, runs, r);
+}
+
+int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/** Run all the benchmarks in 'benchDir', output the results as JSON, and
+ * compare against the results in baselineFile (if it isn't 0) */
+bool run_benchmarks(const char *benchDir, int runs, const char *baselineFile, int tolerance) {
+  char **files = 0;
+  int count = 0;
+  DIR *dir = opendir(benchDir);
+  if (!dir) {
+    fprintf(stderr, "%s directory not found\n", benchDir);
+    return false;
+  }
+  struct dirent *pDir=NULL;
+  while((pDir = readdir(dir)) != NULL) {
+    char *fn = (*pDir).d_name;
+    size_t l = strlen(fn);
+    if (l>3 && fn[l-3]=='.' && fn[l-2]=='j' && fn[l-1]=='s') {
+      files = (char **)realloc(files, sizeof(char*)*(size_t)(count+1));
+      files[count++] = strdup(fn);
+    }
+  }
+  closedir(dir);
+  // always in the same order, so runs can be compared by eye
+  qsort(files, (size_t)count, sizeof(char*), compare_strings);
+
+  /* Anything the benchmarks print goes to stderr, so stdout only
+   * has the JSON results in it */
+  fflush(stdout);
+  FILE *out = fdopen(dup(1), "w");
+  dup2(2, 1);
+
+  bool ok = true;
+  BenchResult *results = (BenchResult *)calloc((size_t)(count ? count : 1), sizeof(BenchResult));
+  int i;
+  for (i=0;i<count;i++) {
+    char *fullName = (char *)malloc(strlen(benchDir)+strlen(files[i])+2);
+    sprintf(fullName, "%s/%s", benchDir, files[i]);
+    if (!run_benchmark_isolated(fullName, runs, &results[i])) {
+      fprintf(stderr, "%s FAILED\n", fullName);
+      ok = false;
+    }
+    results[i].name = files[i]; // set after, as it'd be wrong if it came from another process
+    free(fullName);
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"runs\" : %d,\n", runs);
+  fprintf(out, "  \"results\" : {");
+  for (i=0;i<count;i++) {
+    BenchResult *r = &results[i];
+    fprintf(out, "%s\n    \"%s\" : { \"ok\" : %s, \"time\" : %.3f, \"timeAvg\" : %.3f, \"vars\" : %u, \"peakVars\" : %u, "
+           "\"gc\" : %u, \"gcTime\" : %.3f, \"gcMaxPause\" : %.3f, \"tokens\" : %u }",
+           i ? "," : "", r->name, r->ok ? "true" : "false", r->time, r->timeAvg, r->vars, r->peakVars,
+           r->gc, r->gcTime, r->gcMaxPause, r->tokens);
+  }
+  fprintf(out, "\n  }\n}\n");
+  fflush(out);
+
+  if (baselineFile && !check_baseline(baselineFile, results, count, tolerance))
+    ok = false;
+
+  fflush(stdout);
+  dup2(fileno(out), 1);
+  fclose(out);
+
+  for (i=0;i<count;i++)
+    free(files[i]);
+  free(files);
+  free(results);
+  return ok;
+}
+
 int main(int argc, char **argv) {
   int i;
+  const char *benchDir = 0;
+  const char *benchBaseline = 0;
+  int benchRuns = BENCH_RUNS;
+  int benchTolerance = BENCH_TOLERANCE;
   for (i=1;i<argc;i++) {
     if (argv[i][0]=='-') {
       // option
@@ -262,7 +519,7 @@ int main(int argc, char **argv) {
         int errCode = handleErrors();
         isRunning = !errCode;
         bool isBusy = true;
-        while (isRunning && (jsiHasTimers() || isBusy))
+        while (isRunning && (hasPendingWork() || isBusy))
           isBusy = jsiLoop();
         jsiKill();
         jsvKill();
@@ -286,6 +543,19 @@ int main(int argc, char **argv) {
         if (i+2>=argc) die("Expecting an extra 2 arguments\n");
         bool ok = run_memory_test(argv[i+1], atoi(argv[i+2]));
         exit(ok ? 0 : 1);
+      } else if (!strcmp(a,"--bench")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        benchDir = argv[++i];
+      } else if (!strcmp(a,"--bench-runs")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        benchRuns = atoi(argv[++i]);
+        if (benchRuns<1) die("Expecting at least one run\n");
+      } else if (!strcmp(a,"--bench-baseline")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        benchBaseline = argv[++i];
+      } else if (!strcmp(a,"--bench-tolerance")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        benchTolerance = atoi(argv[++i]);
       } else {
         printf("Unknown Argument %s\n", a);
         show_help();
@@ -294,6 +564,13 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (benchDir) {
+    bool ok = run_benchmarks(benchDir, benchRuns, benchBaseline, benchTolerance);
+    exit(ok ? 0 : 1);
+  } else if (benchBaseline) {
+    die("--bench-baseline needs --bench\n");
+  }
+
   if (argc==1) {
     printf("Interactive mode.\n");
   } else if (argc==2) {
@@ -315,7 +592,7 @@ int main(int argc, char **argv) {
     free(buffer);
     isRunning = !errCode;
     bool isBusy = true;
-    while (isRunning && (jsiHasTimers() || isBusy))
+    while (isRunning && (hasPendingWork() || isBusy))
       isBusy = jsiLoop();
     jsiKill();
     jsvKill();
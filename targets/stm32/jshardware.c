@@ -28,6 +28,7 @@
 #include "jsparse.h"
 #include "jsinteractive.h"
 #include "jswrap_io.h"
+#include "jsprofile.h"
 
 #ifdef ESPRUINOBOARD
 // STM32F1 boards should work with this - but for some reason they crash on init
@@ -685,6 +686,9 @@ void jshDoSysTick() {
     execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C_WAIT) | EXEC_INTERRUPTED;
   if (execInfo.execute & EXEC_CTRL_C)
     execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C) | EXEC_CTRL_C_WAIT;
+#ifdef JSPARSE_PROFILER
+  jsprofTick();
+#endif
 
   if (ticksSinceStart!=0xFFFFFFFF)
     ticksSinceStart++;
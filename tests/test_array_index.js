@@ -0,0 +1,61 @@
+// Check that indexed access to big arrays still works as they change
+
+var r = [];
+function check(a, fn) {
+  for (var i=0;i<a.length;i++) if (a[i]!==fn(i)) return false;
+  return true;
+}
+
+var a = [];
+for (var i=0;i<300;i++) a.push(i);
+r.push(check(a, function(i) { return i; }));
+for (var i=0;i<a.length;i++) a[i] = a[i]*2;
+r.push(check(a, function(i) { return i*2; }));
+// grow past where the index was
+for (var i=300;i<3000;i++) a.push(i*2);
+r.push(a.length==3000 && check(a, function(i) { return i*2; }));
+a.pop();
+r.push(a.length==2999 && a[2998]==5996 && a[2999]===undefined);
+// holes
+delete a[100];
+r.push(a[99]==198 && a[100]===undefined && a[101]==202 && a[2000]==4000);
+a[100] = 200;
+r.push(check(a, function(i) { return i*2; }));
+// renumbering
+a.splice(10,5);
+r.push(a.length==2994 && a[9]==18 && a[10]==30 && a[2000]==4010);
+a.splice(10,0,"x","y");
+r.push(a[9]==18 && a[10]=="x" && a[11]=="y" && a[12]==30 && a[2002]==4010);
+a.reverse();
+r.push(a[0]==5996 && a[a.length-1]==0 && a[a.length-11]=="x");
+a.shift();
+r.push(a[0]==5994 && a[a.length-1]==0);
+a.unshift("z");
+r.push(a[0]=="z" && a[1]==5994 && a[a.length-1]==0);
+// non-numeric keys
+var b = [];
+for (var i=0;i<100;i++) b.push(i);
+b.foo = "bar";
+b[100] = 100;
+r.push(b.foo=="bar" && b[50]==50 && b[100]==100 && b.length==101 && b["foo"]=="bar");
+delete b.foo;
+b.sort(function(x,y) { return y-x; });
+r.push(b[0]==100 && b[100]==0 && b[50]==50);
+// lots of arrays at once
+var arrs = [];
+for (var j=0;j<12;j++) {
+  var c = [];
+  for (var i=0;i<50;i++) c.push(i+j);
+  arrs.push(c);
+}
+var ok = true;
+for (var n=0;n<3;n++)
+  for (var j=0;j<12;j++)
+    for (var i=0;i<50;i+=7)
+      if (arrs[j][i]!=i+j) ok = false;
+arrs = undefined;
+r.push(ok);
+process.memory();
+r.push(check(a.slice(1,100), function(i) { return 5994-i*2; }));
+
+result = r.every(function(x) { return x; });
@@ -0,0 +1,37 @@
+// Sorting is stable, handles sorted input, and sorts typed arrays numerically
+
+var ok = true;
+// stable with a compare function
+var a = [];
+for (var i=0;i<50;i++) a.push({k:i%5, i:i});
+a.sort(function(x,y) { return x.k-y.k; });
+for (i=1;i<a.length;i++)
+  ok &= a[i-1].k<a[i].k || (a[i-1].k==a[i].k && a[i-1].i<a[i].i);
+
+// already sorted and reversed input
+var s = [], r = [];
+for (i=0;i<300;i++) { s.push(i); r.push(300-i); }
+s.sort(function(x,y) { return x-y; });
+r.sort(function(x,y) { return x-y; });
+ok &= s[0]==0 && s[299]==299 && r[0]==1 && r[299]==300;
+
+// default sort compares as strings
+ok &= [10,9,1,100,"a",true].sort().toString()=="1,10,100,9,a,true";
+// the same object more than once
+var o = {n:1};
+var d = [];
+for (i=0;i<20;i++) d.push(i&1 ? o : "b");
+d.sort();
+ok &= d[0]===o && d[9]===o && d[10]=="b";
+
+// typed arrays are sorted numerically
+var t = new Int16Array(1000);
+for (i=0;i<t.length;i++) t[i] = (i*7919)%2001 - 1000;
+t.sort();
+for (i=1;i<t.length;i++) ok &= t[i-1]<=t[i];
+var f = new Float32Array([3.5,-1,NaN,10,2]).sort();
+ok &= f[0]==-1 && f[1]==2 && f[2]==3.5 && f[3]==10 && isNaN(f[4]);
+var u = new Uint8Array([30,4,200,4]).sort(function(x,y) { return y-x; });
+ok &= u.toString()=="200,30,4,4";
+
+result = ok;
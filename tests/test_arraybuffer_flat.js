@@ -0,0 +1,42 @@
+// Typed arrays stored in flat strings are read and written directly
+
+var ok = true;
+[Uint8Array,Int8Array,Uint16Array,Int16Array,Uint32Array,Int32Array,Float32Array,Float64Array].forEach(function(T) {
+  var a = new T(200);
+  for (var i=0;i<a.length;i++) a[i] = i*3-100;
+  var b = new T(a); // same type - copied directly
+  var c = new Float64Array(a); // different type
+  var m = a.map(function(v,i) { return v+i; });
+  for (i=0;i<a.length;i++) {
+    var expected = new T([i*3-100])[0];
+    ok &= a[i]==expected && b[i]==expected && c[i]==expected;
+    ok &= m[i]==new T([expected+i])[0];
+  }
+});
+
+// overlapping set() copies as if the source was copied first
+var o = new Int16Array(100);
+for (var i=0;i<100;i++) o[i] = i;
+o.set(new Int16Array(o.buffer, 0, 50), 10);
+ok &= o[9]==9 && o[10]==0 && o[59]==49 && o[60]==60;
+
+// views with an odd byteOffset
+var buf = new ArrayBuffer(101);
+var u8 = new Uint8Array(buf);
+var u16 = new Uint16Array(buf, 1, 50);
+u16[0] = 0x1234;
+u16[49] = 0xABCD;
+ok &= u8[1]==0x34 && u8[2]==0x12 && u8[99]==0xCD && u8[100]==0xAB;
+
+// clamped arrays still clamp when set from another array
+var cl = new Uint8ClampedArray(100);
+cl.set(new Int16Array([-5, 300, 20]));
+ok &= cl[0]==0 && cl[1]==255 && cl[2]==20;
+
+// E.mapInPlace
+var from = new Uint8Array(100), to = new Uint8Array(100);
+for (i=0;i<100;i++) from[i] = i;
+E.mapInPlace(from, to, function(v) { return v*2; });
+ok &= to[0]==0 && to[99]==198;
+
+result = ok;
@@ -0,0 +1,29 @@
+// Typed arrays bigger than 65535 elements (on builds with a wide ArrayBuffer view)
+
+var a = new Uint8Array(100000);
+a[0] = 1;
+a[99999] = 2;
+var r1 = a.length==100000 && a[0]==1 && a[99999]==2 && a[100000]===undefined;
+
+// 1 second of 48kHz audio
+var s = new Int16Array(48000);
+for (var i=0;i<s.length;i+=1000) s[i] = i-24000;
+var r2 = s.length==48000 && s.byteLength==96000 && s[47000]==23000;
+
+// a view with a byte offset past 65535
+var v = new Uint8Array(a.buffer, 70000, 30000);
+var r3 = v.byteOffset==70000 && v.length==30000 && v[29999]==2;
+v[0] = 42;
+var r4 = a[70000]==42;
+
+// a framebuffer that wouldn't have fitted before
+var g = Graphics.createArrayBuffer(400,300,16);
+g.setColor(0xF800);
+g.fillRect(398,298,399,299);
+var r5 = new Uint8Array(g.buffer).length==240000 && g.getPixel(399,299)==0xF800 && g.getPixel(0,0)==0;
+
+// views too long to store are an error, not silently truncated
+var r6 = false;
+try { new Uint8Array(a.buffer, 0, 0x1000001); } catch (e) { r6 = true; }
+
+result = r1 && r2 && r3 && r4 && r5 && r6;
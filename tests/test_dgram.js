@@ -0,0 +1,32 @@
+// Send datagrams between two UDP sockets
+
+var result = 0;
+var dgram = require("dgram");
+var COUNT = 20;
+var got = [];
+var sent = 0, listening = false, closed = false;
+
+var server = dgram.createSocket("udp4", function(msg, rinfo) {
+  got.push(msg);
+  if (rinfo.address!="127.0.0.1" || rinfo.size!=msg.length || rinfo.family!="IPv4") got.push("bad rinfo");
+  if (got.length==COUNT+1) {
+    server.close();
+    client.close();
+  }
+});
+server.on('listening', function() { listening = true; });
+server.on('close', function() {
+  closed = true;
+  var ok = listening && sent==COUNT+1 && got.length==COUNT+1;
+  for (var i=0;i<COUNT;i++)
+    if (got.indexOf("metric"+i)<0) ok = false;
+  // typed arrays go as raw bytes
+  if (got.indexOf("\x01\x02\xFF")<0) ok = false;
+  result = ok;
+});
+server.bind(4448);
+
+var client = dgram.createSocket("udp4");
+for (var i=0;i<COUNT;i++)
+  client.send("metric"+i, 4448, "localhost", function() { sent++; });
+client.send(new Uint8Array([1,2,255]), 4448, "127.0.0.1", function() { sent++; });
@@ -0,0 +1,34 @@
+// E.sum/variance/convolve/FFT on big typed arrays (which work on the raw data) should match normal arrays
+
+function fill(a) {
+  for (var i=0;i<a.length;i++) a[i] = ((i*37)%101) - 50;
+  return a;
+}
+function near(a,b) { return Math.abs(a-b) < 0.0001*(1+Math.abs(a)); }
+
+var plain = fill(new Array(1001));
+var kernel = fill(new Array(7));
+var ok = true;
+[Int8Array,Int16Array,Int32Array,Float32Array,Float64Array].forEach(function(T) {
+  var typed = fill(new T(1001));
+  ok &= near(E.sum(typed), E.sum(plain));
+  ok &= near(E.variance(typed, 3.5), E.variance(plain, 3.5));
+  ok &= near(E.convolve(typed, kernel, 2), E.convolve(plain, kernel, 2));
+  ok &= near(E.convolve(typed, fill(new Int8Array(7)), -9), E.convolve(plain, kernel, -9));
+  ok &= near(E.convolve(typed, kernel, 0), E.convolve(plain, kernel, 7));
+});
+// unsigned types
+var words = new Uint32Array(100);
+var total = 0;
+for (var i=0;i<words.length;i++) { words[i] = i*40000000; total += words[i]; }
+ok &= E.sum(words) == total;
+
+// FFT straight into a Float32Array
+var re = new Float32Array(64), im = new Float32Array(64);
+var reA = [], imA = [];
+for (i=0;i<64;i++) { re[i] = Math.sin(i/4); reA[i] = re[i]; imA[i] = 0; }
+E.FFT(re, im);
+E.FFT(reA, imA);
+for (i=0;i<64;i++) ok &= near(re[i], reA[i]) && near(im[i], imA[i]);
+
+result = ok;
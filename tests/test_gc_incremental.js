@@ -0,0 +1,44 @@
+// Check that collecting garbage a bit at a time while JS runs in between doesn't free anything still in use
+
+E.setGCSliceTime(0.01); // tiny slices, so JS gets to run in the middle of collections
+
+var keep = [];
+function make(n) {
+  var a = { n : n };
+  var b = { a : a, s : "Item "+n };
+  a.b = b; // a reference loop, so only the GC can free it
+  return a;
+}
+function ok(a, n) {
+  return a.n==n && a.b.a===a && a.b.s=="Item "+n;
+}
+// more items than fit in the GC's stack
+for (var i=0;i<2000;i++) keep.push(make(i));
+
+var steps = 0;
+function step() {
+  // make some garbage loops
+  for (var i=0;i<50;i++) make(-i);
+  // move live objects about, so they're referenced from somewhere new
+  var moved = {};
+  for (var i=0;i<20;i++) moved[i] = keep.shift();
+  for (var i=0;i<20;i++) keep.push(moved[i]);
+  keep.push(make(keep.length));
+  if (++steps < 20) setTimeout(step, 20);
+  else done();
+}
+setTimeout(step, 20);
+
+function done() {
+  var good = keep.length==2020;
+  var seen = [];
+  for (var i=0;i<keep.length;i++) {
+    var n = keep[i].n;
+    if (!ok(keep[i], n) || seen[n]) good = false;
+    seen[n] = true;
+  }
+  for (var i=0;i<2020;i++) if (!seen[i]) good = false;
+  var m = process.memory();
+  E.setGCSliceTime(1);
+  result = good && m.gc>=0 && m.gctime>=0 && m.gcmaxpause>=0;
+}
@@ -0,0 +1,33 @@
+// Objects with lots of keys get a hash index - check lookups, adds and deletes still work
+
+var o = {};
+for (var i=0;i<200;i++) o["key"+i] = i;
+o[5] = "five"; // integer keys aren't indexed
+var r1 = o.key0==0 && o.key150==150 && o["key"+199]==199 && o.nothere===undefined && o[5]=="five" && o["5"]=="five";
+
+// delete every third key, then add some back
+for (i=0;i<200;i+=3) delete o["key"+i];
+var ok = true;
+for (i=0;i<200;i++) if (o["key"+i] !== ((i%3)?i:undefined)) ok = false;
+for (i=0;i<200;i+=6) o["key"+i] = -i;
+for (i=0;i<200;i+=3) if (o["key"+i] !== ((i%6)?undefined:-i)) ok = false;
+var r2 = ok && Object.keys(o).length == 200-67+34+1 && ("key3" in o)==false && ("key6" in o);
+
+// lots of big objects at once, some of which become garbage
+var objs = [];
+for (var j=0;j<12;j++) {
+  var b = {};
+  for (i=0;i<50;i++) b["k"+i] = j*100+i;
+  b.self = b;
+  objs.push(b);
+  if (b.k49 != j*100+49) ok = false;
+}
+for (j=0;j<12;j+=2) objs[j] = undefined;
+for (j=1;j<12;j+=2) if (objs[j].k25 != j*100+25 || objs[j].k50 !== undefined) ok = false;
+var r3 = ok;
+
+// lots of globals
+for (i=0;i<100;i++) eval("var glob"+i+"="+i);
+var r4 = glob0==0 && glob99==99 && typeof glob100=="undefined";
+
+result = r1 && r2 && r3 && r4;
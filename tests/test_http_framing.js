@@ -0,0 +1,110 @@
+// HTTP bodies delimited by Content-Length and chunked encoding, on connections that stay open
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+var results = {};
+var connections = 0, rawConnection;
+
+function check() {
+  if (results.chunked && results.length && results.again && results.post && results.pipelined) {
+    result = connections==1;
+    rawConnection.end(); // the client would keep it open for the next request
+    rawServer.close();
+    httpServer.close();
+  }
+}
+
+// a server that replies without closing the connection
+var rawServer = net.createServer(function(c) {
+  connections++;
+  rawConnection = c;
+  var req = "";
+  c.on('data', function(d) {
+    req += d;
+    if (req.indexOf("\r\n\r\n")<0) return;
+    var parts;
+    if (req.indexOf("/chunked")>=0)
+      parts = ["HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nHel", "lo\r\n7;ext=1\r\n, World\r\n", "0\r\n\r\n"];
+    else
+      parts = ["HTTP/1.1 200 OK\r\nContent-Length: 12\r\n", "\r\nHello", " World!"];
+    req = "";
+    parts.forEach(function(p, i) {
+      setTimeout(function() { c.write(p); }, i*20);
+    });
+  });
+});
+rawServer.listen(4449);
+
+function get(path, expected, callback) {
+  http.get("http://localhost:4449"+path, function(res) {
+    var body = "", ended = false;
+    res.on('data', function(d) { body += d; });
+    res.on('end', function() { ended = true; });
+    res.on('close', function() {
+      console.log(path, JSON.stringify(body), ended);
+      callback(ended && body==expected);
+    });
+  });
+}
+// one after the other, so they all use the same (kept alive) connection
+get("/chunked", "Hello, World", function(ok) {
+  results.chunked = ok;
+  get("/length", "Hello World!", function(ok) {
+    results.length = ok;
+    get("/chunked", "Hello, World", function(ok) {
+      results.again = ok;
+      check();
+    });
+  });
+});
+
+// a server getting a request body in pieces, with a Content-Length, and then another request
+var httpServer = http.createServer(function(req, res) {
+  var body = "";
+  req.on('data', function(d) { body += d; });
+  req.on('end', function() {
+    res.writeHead(200);
+    res.end(req.url+":"+body.toUpperCase());
+  });
+});
+httpServer.listen(4450);
+
+var client = net.connect({port: 4450}, function() {
+  var reply = "", sentAgain = false;
+  client.on('data', function(d) {
+    reply += d;
+    if (!sentAgain && reply.indexOf("0\r\n\r\n")>=0) {
+      sentAgain = true;
+      client.write("GET /again HTTP/1.1\r\n\r\n");
+    }
+    if (reply.split("0\r\n\r\n").length==3) {
+      console.log("POST", JSON.stringify(reply));
+      results.post = reply.indexOf("\r\n\r\nc\r\n/post:ABCDEF\r\n0\r\n\r\n")>0 &&
+                     reply.indexOf("\r\n\r\n7\r\n/again:\r\n0\r\n\r\n")>0;
+      client.end();
+      check();
+    }
+  });
+  ["POST /post HTTP/1.1\r\nContent-Len", "gth: 6\r\n\r\nab", "cd", "ef"].forEach(function(p, i) {
+    setTimeout(function() { client.write(p); }, i*20);
+  });
+});
+
+// several requests sent in one go, before any replies - each must be answered in turn
+var pipeClient = net.connect({port: 4450}, function() {
+  var reply = "";
+  pipeClient.on('data', function(d) {
+    reply += d;
+    if (reply.split("0\r\n\r\n").length==4) {
+      console.log("PIPELINED", JSON.stringify(reply));
+      var a = reply.indexOf("\r\n\r\n3\r\n/a:\r\n0\r\n\r\n");
+      var c = reply.indexOf("\r\n\r\n6\r\n/c:XYZ\r\n0\r\n\r\n");
+      var b = reply.indexOf("\r\n\r\n3\r\n/b:\r\n0\r\n\r\n");
+      results.pipelined = a>0 && c>a && b>c;
+      pipeClient.end();
+      check();
+    }
+  });
+  pipeClient.write("GET /a HTTP/1.1\r\n\r\nPOST /c HTTP/1.1\r\nContent-Length: 3\r\n\r\nxyzGET /b HTTP/1.1\r\n\r\n");
+});
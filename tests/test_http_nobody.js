@@ -0,0 +1,32 @@
+// Replies to HEAD requests, and 204/304 responses, on a kept-alive connection must not have a body (or chunked framing)
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var server = http.createServer(function(req, res) {
+  if (req.url=="/nocontent") res.writeHead(204);
+  else if (req.url=="/notmodified") res.writeHead(304);
+  else res.writeHead(200);
+  res.end("body"+req.url);
+});
+server.listen(4451);
+
+var client = net.connect({port: 4451}, function() {
+  var reply = "";
+  client.on('data', function(d) {
+    reply += d;
+    if (reply.indexOf("0\r\n\r\n")<0) return;
+    console.log(JSON.stringify(reply));
+    var replies = reply.split("HTTP/1.1 ");
+    result = replies.length==5 &&
+             replies[1].indexOf("200")==0 && replies[1].indexOf("\r\n\r\n")==replies[1].length-4 &&
+             replies[2].indexOf("204")==0 && replies[2].indexOf("\r\n\r\n")==replies[2].length-4 &&
+             replies[3].indexOf("304")==0 && replies[3].indexOf("\r\n\r\n")==replies[3].length-4 &&
+             replies[1].indexOf("Transfer-Encoding")<0 && replies[2].indexOf("Transfer-Encoding")<0 &&
+             replies[4].indexOf("\r\n\r\n9\r\nbody/last\r\n0\r\n\r\n")>0;
+    client.end();
+    server.close();
+  });
+  client.write("HEAD /head HTTP/1.1\r\n\r\nGET /nocontent HTTP/1.1\r\n\r\nGET /notmodified HTTP/1.1\r\n\r\nGET /last HTTP/1.1\r\n\r\n");
+});
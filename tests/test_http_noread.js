@@ -0,0 +1,24 @@
+// HTTP client on a keep-alive connection that never reads the body - 'close' must still fire
+
+var result = 0;
+var http = require("http");
+var server = http.createServer(function (req, res) {
+  res.writeHead(200);
+  res.end("hello");
+});
+server.listen(8080);
+
+var body = "", ended = false;
+http.get("http://localhost:8080/", function(res) {
+  res.on('close', function() {
+    server.close();
+    // the body is still buffered, and 'end' only comes once it has been read
+    setTimeout(function() {
+      res.on('data', function(d) { body += d; });
+      res.on('end', function() { ended = true; });
+    }, 10);
+    setTimeout(function() {
+      result = body=="hello" && ended;
+    }, 50);
+  });
+});
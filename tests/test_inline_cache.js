@@ -0,0 +1,69 @@
+// Check that cached lookups of built-in functions notice when things change
+
+var r = [];
+var a = [];
+for (var i=0;i<3;i++) a.push(i);
+r.push(a.length==3);
+
+// override on the object itself
+var called = 0;
+a.push = function(x) { called++; };
+for (var i=0;i<3;i++) a.push(i);
+r.push(a.length==3 && called==3);
+delete a.push;
+for (var i=0;i<3;i++) a.push(i);
+r.push(a.length==6);
+
+// override in the prototype after the lookup has been cached
+var b = [];
+function add() { for (var i=0;i<3;i++) b.push(i); }
+add();
+Array.prototype.push = function(x) { called++; };
+add();
+r.push(b.length==3 && called==6);
+delete Array.prototype.push;
+add();
+r.push(b.length==6);
+
+// adding to a prototype further up the chain
+function last(x) { return x.lastOne(); }
+r.push((function() { try { last("ab"); return false; } catch (e) { return true; } })());
+Object.prototype.lastOne = function() { return this[this.length-1]; };
+r.push(last("ab")=="b");
+delete Object.prototype.lastOne;
+
+// a built-in class's prototype being replaced
+var str = "abc";
+function chr() { var v = {}; return str.charAt(1); }
+r.push(chr()=="b");
+var oldProto = String.prototype;
+String.prototype = { charAt : function() { return "x"; } };
+r.push(chr()=="x");
+String.prototype = oldProto;
+r.push(chr()=="b");
+// adding to a replacement prototype (which has no 'constructor')
+function idx() { return "abc".indexOf("b"); }
+r.push(idx()==1);
+String.prototype = { x : 1 };
+String.prototype.indexOf = function() { return 42; };
+r.push(idx()==42);
+String.prototype = oldProto;
+r.push(idx()==1);
+
+// replacing an object that has built-in functions
+var s = 0;
+function sins() { for (var i=0;i<3;i++) s = Math.abs(-i); return s; }
+r.push(sins()==2);
+var oldMath = Math;
+Math = { abs : function(x) { return 42; } };
+r.push(sins()==42);
+Math = oldMath;
+r.push(sins()==2);
+
+// same code, different types
+function first(x) { return x.slice(-1)[0]; }
+r.push(first([0,1])==1 && first("01")=="1" && first(new Uint8Array([0,0,2]))==2);
+function sub(x) { return (typeof x=="string") ? x.substr(1).length : x.slice(1).length; }
+r.push(sub(new Uint8Array(4))==3 && sub(new Float32Array(5))==4 && sub("abc")==2);
+
+result = r.every(function(x) { return x; });
@@ -0,0 +1,61 @@
+// Native JSON.parse, and JSON.parser() for JSON that arrives a bit at a time
+
+var ok = true;
+ok &= JSON.stringify(JSON.parse('{"a":[1,-2,3.5,-1e3,true,false,null,"x\\ny\\u0041"],"b":{}, "2":[]}')) ==
+      '{"a":[1,-2,3.5,-1000,true,false,null,"x\\nyA"],"b":{},"2":[]}';
+ok &= JSON.parse(' "\\t\\"\\\\\\/" ') == '\t"\\/';
+
+var errors = 0;
+['{"a":}', '[1 2]', '[1] x', '"abc', 'tru', '{a:1}', '-', '1.'].forEach(function(s) {
+  try { JSON.parse(s); } catch (e) { if (e instanceof SyntaxError) errors++; }
+});
+ok &= errors==8;
+
+// strings longer than the lexer could handle
+var long = "";
+for (var i=0;i<1000;i++) long += "0123456789";
+ok &= JSON.parse(JSON.stringify({s:long})).s == long;
+
+// nesting too deep for the stack is an error, not a crash
+var opening = "[[[[[[[[[[", closing = "]]]]]]]]]]";
+var deep = "", deepEnd = "";
+for (i=0;i<20000;i++) { deep += opening; deepEnd += closing; }
+var deepError = false;
+try { JSON.parse(deep); } catch (e) { deepError = e instanceof SyntaxError; }
+ok &= deepError;
+var nested = "", nestedEnd = "";
+for (i=0;i<50;i++) { nested += "[{\"a\":"; nestedEnd += "}]"; }
+ok &= JSON.stringify(JSON.parse(nested+"1"+nestedEnd)) == nested+"1"+nestedEnd;
+
+var values = [];
+var parser = JSON.parser();
+parser.on('value', function(v) { values.push(JSON.stringify(v)); });
+parser.on('error', function(e) { values.push("error"); });
+parser.write('{"a":1}[2');
+parser.write(',3]  "he\\"');
+parser.write('llo" 42');
+parser.write('\n7,8 {"x":}{"y":"}"}');
+parser.write(' -5');
+parser.end();
+
+var longValues = [];
+var longParser = JSON.parser();
+longParser.on('value', function(v) { longValues.push(v); });
+var json = JSON.stringify({s:long});
+for (i=0;i<json.length;i+=7) longParser.write(json.substr(i,7));
+
+var deepValues = [];
+var deepParser = JSON.parser();
+deepParser.on('value', function(v) { deepValues.push(JSON.stringify(v)); });
+deepParser.on('error', function(e) { deepValues.push("error"); });
+// (the parser only counts up to 65535 levels)
+for (i=0;i<60000;i+=10000) deepParser.write(deep.substr(i,10000));
+for (i=0;i<60000;i+=10000) deepParser.write(deepEnd.substr(i,10000));
+deepParser.write(" [1] ");
+
+setTimeout(function() {
+  result = ok &&
+    deepValues.join("|") == 'error|[1]' &&
+    values.join("|") == '{"a":1}|[2,3]|"he\\"llo"|42|7|8|error|{"y":"}"}|-5' &&
+    longValues.length==1 && longValues[0].s==long;
+}, 10);
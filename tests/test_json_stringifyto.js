@@ -0,0 +1,33 @@
+// JSON.stringifyTo writes the same JSON as JSON.stringify, a chunk at a time
+
+var data = {a:[1,2,{b:"hello\n",c:undefined,f:function(){}}],d:null,e:[],g:{},h:"x",i:[undefined,3.5]};
+data.self = data;
+for (var n=0;n<50;n++) data.e.push({n:n,s:"item "+n});
+
+var chunks = [];
+var biggest = 0;
+var waiting = false;
+var dest = { write : function(d) {
+  chunks.push(d);
+  if (d.length>biggest) biggest = d.length;
+  // tell the pipe to wait every few chunks
+  waiting = chunks.length%3==0;
+  return !waiting;
+}};
+var drains = setInterval(function() {
+  if (waiting) { waiting = false; dest.emit('drain', dest); }
+}, 1);
+
+var completed = false;
+JSON.stringifyTo(data, dest, {chunkSize:16, complete:function() { completed = true; }});
+
+var scalar = [];
+JSON.stringifyTo("str", { write : function(d) { scalar.push(d); } });
+
+setTimeout(function() {
+  clearInterval(drains);
+  result = completed &&
+    chunks.join("") == JSON.stringify(data) &&
+    chunks.length > 50 && biggest < 40 &&
+    scalar.join("") == '"str"';
+}, 500);
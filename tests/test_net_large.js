@@ -0,0 +1,35 @@
+// Send lots of data over a socket and echo it back
+
+var result = 0;
+var net = require("net");
+var CHUNKS = 100;
+var chunk = "";
+for (var i=0;i<1000;i++) chunk += String.fromCharCode(33+(i%90));
+var sent = CHUNKS*chunk.length;
+var got = "";
+var gotLength = 0, ok = true;
+
+var server = net.createServer(function(c) {
+  c.on('data', function(data) {
+    c.write(data);
+  });
+});
+server.listen(4446);
+
+var client = net.connect({port: 4446}, function() {
+  client.on('data', function(d) {
+    got += d;
+    // check what we got a chunk at a time so we don't need to keep it all
+    while (got.length >= chunk.length) {
+      if (got.substr(0,chunk.length)!=chunk) ok = false;
+      got = got.substr(chunk.length);
+    }
+    gotLength += d.length;
+    if (gotLength>=sent) {
+      client.end();
+      server.close();
+      result = ok && gotLength==sent && got=="";
+    }
+  });
+  for (var i=0;i<CHUNKS;i++) client.write(chunk);
+});
@@ -0,0 +1,30 @@
+// Lots of socket connections at once
+
+var result = 0;
+var net = require("net");
+var COUNT = 50;
+var received = 0;
+
+var server = net.createServer(function(c) {
+  c.on('data', function(data) {
+    c.write("<"+data+">");
+    c.end();
+  });
+});
+server.listen(4445);
+
+function connect(n) {
+  var client = net.connect({port: 4445}, function() {
+    var data = "";
+    client.on('data', function(d) { data += d; });
+    client.on('close', function() {
+      if (data=="<"+n+">") received++;
+      if (received==COUNT) {
+        result = 1;
+        server.close();
+      }
+    });
+    client.write(n);
+  });
+}
+for (var i=0;i<COUNT;i++) connect(i);
@@ -0,0 +1,52 @@
+// Write typed arrays and big strings to a socket, and check the bytes arrive as they are
+
+var result = 0;
+var net = require("net");
+var bytes = new Uint8Array(20000);
+for (var i=0;i<bytes.length;i++) bytes[i] = i&255;
+var str = "";
+for (var i=0;i<1000;i++) str += String.fromCharCode(33+(i%90));
+var words = new Uint16Array([1, 0x0302]);
+
+// what we expect to get, in order
+var parts = [
+  { str : "A" },
+  { arr : bytes },
+  { str : "B" },
+  { str : str },
+  { str : "C" },
+  { arr : new Uint8Array(words.buffer) }, // little-endian
+  { arr : new Uint8Array(bytes.buffer, 100, 10) } // a view on part of the buffer
+];
+var part = 0, idx = 0, ok = true, drains = 0;
+
+function check(d) {
+  for (var i=0;i<d.length;i++) {
+    if (part>=parts.length) { ok = false; return; }
+    var p = parts[part];
+    var c = p.str===undefined ? p.arr[idx] : p.str.charCodeAt(idx);
+    if (d.charCodeAt(i)!=c) ok = false;
+    if (++idx >= (p.str===undefined ? p.arr.length : p.str.length)) { part++; idx=0; }
+  }
+}
+
+var server = net.createServer(function(c) {
+  c.on('data', check);
+  c.on('close', function() {
+    server.close();
+    result = ok && part==parts.length && drains>0;
+  });
+});
+server.listen(4447);
+
+var client = net.connect({port: 4447}, function() {
+  client.on('drain', function() { drains++; });
+  client.write("A");
+  client.write(bytes);
+  client.write("B");
+  client.write(str);
+  client.write("C");
+  client.write(words);
+  client.write(new Uint8Array(bytes.buffer, 100, 10));
+  client.end();
+});
@@ -0,0 +1,14 @@
+// Check that the profiler counts calls to built-in functions, and can be turned off
+
+E.resetProfile();
+var s = 0;
+for (var i=0;i<100;i++) s += Math.sqrt(i);
+var p = E.getProfile();
+var sqrt = p.functions.filter(function(f) { return f.name=="Math.sqrt"; })[0];
+
+E.resetProfile(false);
+var stopped = E.getProfile();
+
+result = sqrt && sqrt.calls==100 && sqrt.time>=0 &&
+         p.time>=0 && p.samples>=0 && Array.isArray(p.lines) &&
+         stopped===undefined;
@@ -0,0 +1,10 @@
+// Recursion deeper than the old limit of 15 locks on a variable
+function a(x) {
+  if (x>1)
+    return x+a(x-1);
+  return 1;
+}
+var o = {
+  sum : function(x) { return x>1 ? x+this.sum(x-1) : 1; }
+};
+result = a(40)==820 && o.sum(40)==820;
@@ -0,0 +1,41 @@
+// Check that save() and load() get back everything that was there (via espruino.state on Linux)
+
+var fs = require("fs");
+var MARKER = "test_save_load.tmp";
+function hasMarker() { return fs.readdir(".").indexOf(MARKER)>=0; }
+
+// enough variables that they're spread over more than one block
+var strings = [];
+for (var i=0;i<500;i++) strings.push("String number "+i);
+var typed = new Uint16Array(300);
+for (var i=0;i<typed.length;i++) typed[i] = i*7;
+var obj = { a : 1, b : [1,2,3], c : { d : "hello", e : 3.5 } };
+function makeCounter() { var n = 10; return function() { return n++; }; }
+var counter = makeCounter();
+
+function check() {
+  var ok = strings.length==500 && strings[0]=="String number 0" && strings[499]=="String number 499";
+  for (var i=0;i<typed.length;i++) if (typed[i]!=((i*7)&65535)) ok = false;
+  return ok && JSON.stringify(obj)=='{"a":1,"b":[1,2,3],"c":{"d":"hello","e":3.5}}' &&
+         counter()==10 && counter()==11;
+}
+
+/* onInit is called both after saving and after loading, and what was saved
+ * can't know which - so use a file to tell */
+function onInit() {
+  if (!hasMarker()) {
+    // we just saved - mess everything up, then load
+    fs.writeFile(MARKER, "saved");
+    strings = undefined;
+    typed = undefined;
+    obj.b = "changed";
+    load();
+  } else {
+    fs.unlink(MARKER);
+    fs.unlink("espruino.state");
+    result = check();
+  }
+}
+
+if (hasMarker()) fs.unlink(MARKER);
+save();
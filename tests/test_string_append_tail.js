@@ -0,0 +1,32 @@
+// Appending to lots of strings at once, with strings being freed and reused, must still give the right result
+
+var strs = ["","","","","","",""];
+var expected = [0,0,0,0,0,0,0];
+var ok = true;
+for (var i=0;i<400;i++) {
+  var n = (i*3)%strs.length;
+  strs[n] += "abc"+i;
+  expected[n] += ("abc"+i).length;
+  if (i%50==49) {
+    // throw one away and start again, so its vars get reused
+    strs[i%strs.length] = "";
+    expected[i%strs.length] = 0;
+    E.getSizeOf(strs); // allocate some vars
+  }
+}
+strs.forEach(function(s,n) {
+  if (s.length != expected[n]) ok = false;
+});
+
+var a = "";
+for (i=0;i<100;i++) a += String.fromCharCode(65+(i%26));
+var b = a;
+b += "!"; // a is referenced twice, so this must make a copy
+ok = ok && a.length==100 && b.length==101 && a[99]=="V" && b[100]=="!";
+
+var obj = {};
+obj[a] = 1; // use a long string as a name
+a += "Z";
+ok = ok && obj[a.substr(0,100)]==1 && a.length==101 && a[100]=="Z";
+
+result = ok;
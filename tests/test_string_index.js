@@ -0,0 +1,36 @@
+// Random access into long (non-flat) strings, including after they have been appended to
+
+function make(n, seed) {
+  var s = "";
+  for (var i=0;i<n;i++) s += String.fromCharCode(33+((i*seed)%90));
+  return s;
+}
+function expected(i, seed) { return 33+((i*seed)%90); }
+
+var ok = true;
+var strs = [];
+for (var k=1;k<=6;k++) strs.push(make(600+k*100, k*7));
+// access them in a mixed-up order so indexes get thrown away and rebuilt
+for (var n=0;n<3;n++) {
+  strs.forEach(function(s, k) {
+    for (var i=s.length-1;i>=0;i-=13)
+      if (s.charCodeAt(i) != expected(i, (k+1)*7)) ok = false;
+  });
+}
+
+// append after it was indexed
+var s = make(1000, 11);
+if (s.charCodeAt(900) != expected(900, 11)) ok = false;
+for (var i=1000;i<3000;i++) s += String.fromCharCode(33+((i*11)%90));
+for (i=0;i<3000;i+=7)
+  if (s.charCodeAt(i) != expected(i, 11)) ok = false;
+ok = ok && s[2999].charCodeAt(0)==expected(2999, 11) && s[3000]===undefined && s.charCodeAt(5000)==0;
+ok = ok && s.substr(2990,3).length==3 && s.substr(2990,3).charCodeAt(2)==expected(2992, 11);
+
+// free it and reuse the memory for another string
+s = undefined;
+var t = make(2000, 13);
+for (i=0;i<2000;i+=11)
+  if (t.charCodeAt(i) != expected(i, 13)) ok = false;
+
+result = ok;
@@ -0,0 +1,38 @@
+// indexOf/lastIndexOf/split on normal and flat strings, compared with a simple search written in JS
+
+function naiveIndexOf(s, f, from) {
+  for (var i=from;i<=s.length-f.length;i++)
+    if (s.substr(i,f.length)==f) return i;
+  return -1;
+}
+function naiveLastIndexOf(s, f, from) {
+  for (var i=Math.min(from,s.length-f.length);i>=0;i--)
+    if (s.substr(i,f.length)==f) return i;
+  return -1;
+}
+
+var ok = true;
+var text = "";
+for (var i=0;i<600;i++) text += "ab"[(i*i+3*i)%7>3?1:0] + (i%37==0?"\r\n":"") + (i%53==0?"abba":"");
+var flat = E.toString(text);
+var searches = ["a","b","ab","ba","abba","bbb","aab","\r\n","\r\nb","abab","xyz", "b\r\na", text.substr(100,40)];
+[text, flat].forEach(function(s) {
+  searches.forEach(function(f) {
+    [0,1,50,333,s.length-3].forEach(function(from) {
+      if (s.indexOf(f, from) != naiveIndexOf(s, f, from)) ok = false;
+      if (s.lastIndexOf(f, from) != naiveLastIndexOf(s, f, from)) ok = false;
+    });
+    if (s.indexOf(f) != naiveIndexOf(s, f, 0)) ok = false;
+    if (s.lastIndexOf(f) != naiveLastIndexOf(s, f, s.length)) ok = false;
+  });
+  var lines = s.split("\r\n");
+  if (lines.length!=18 || lines.join("\r\n")!=text) ok = false;
+});
+
+ok = ok && "a,b,,c".split(",").length==4 && "a,b,,c".split(",")[2]=="" &&
+     ",a,".split(",").length==3 && "abc".split("").length==3 &&
+     "aaaa".split("aa").length==3 && "x".split("xyz")[0]=="x" &&
+     "hello world".replace("o","0")=="hell0 world" &&
+     "abc".indexOf("")==0 && "abc".indexOf("c",5)==-1;
+
+result = ok;
@@ -0,0 +1,49 @@
+// Check that lots of timers all run in the right order, and can be changed/cleared while others are pending
+
+var order = [];
+var delays = [];
+for (var i=0;i<40;i++) delays.push(((i*37)%40)*5 + 10);
+delays.forEach(function(d) {
+  setTimeout(function() { order.push(d); }, d);
+});
+
+// cleared before it runs
+var cleared = false;
+var id = setTimeout(function() { cleared = true; }, 50);
+clearTimeout(id);
+
+// one timeout clearing another
+var killed = false;
+var victim = setTimeout(function() { killed = true; }, 120);
+setTimeout(function() { clearTimeout(victim); }, 60);
+
+// an interval that clears itself
+var ticks = 0;
+var tick = setInterval(function() {
+  if (++ticks == 5) clearInterval(tick);
+}, 20);
+
+// an interval that gets slower
+var slowTicks = 0;
+var slow = setInterval(function() {
+  slowTicks++;
+}, 10);
+setTimeout(function() { changeInterval(slow, 1000); }, 55);
+
+// lots of timers added and cleared from inside a timer, so the heap has to grow
+var late = 0, lateIds = [];
+setTimeout(function() {
+  for (var i=0;i<100;i++)
+    lateIds.push(setTimeout(function() { late++; }, 20 + (i%10)));
+  for (var i=0;i<100;i+=2)
+    clearTimeout(lateIds[i]);
+}, 100);
+
+setTimeout(function() {
+  clearInterval(slow);
+  var sorted = true;
+  for (var i=1;i<order.length;i++)
+    if (order[i]<order[i-1]) sorted = false;
+  result = order.length==40 && sorted && !cleared && !killed &&
+           ticks==5 && slowTicks>=4 && slowTicks<=6 && late==50;
+}, 400);
@@ -0,0 +1,12 @@
+// An interval that takes longer to run than its period shouldn't stop other timers from running
+var runs = 0;
+var iv = setInterval(function() {
+  runs++;
+  var end = getTime()+0.005;
+  while (getTime()<end);
+}, 1);
+setTimeout(function() {
+  clearInterval(iv);
+  // it can only run about once every 5ms, so about 20 times
+  result = runs>5 && runs<50;
+}, 100);
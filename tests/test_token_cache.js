@@ -0,0 +1,27 @@
+// Function and loop bodies are replayed from pre-lexed tokens - check they behave the same as before
+
+var long = "";
+var fns = [];
+for (var i=0;i<3;i++) {
+  /* a comment
+     that spans lines */
+  long += "This string is quite a lot longer than the 64 characters a token can hold"; // comment
+  fns.push(function(a) { return a+"\0"+i; });
+  if (i==1) continue;
+}
+
+function f(n) {
+  var s = 0;
+  while (n) {
+    s += n--;
+    if (s > 100) break;
+  }
+  return s + ":" + 'xAy';
+}
+
+var r1 = long.length == 3*73;
+var r2 = fns[0](5) == "5\u00003" && fns[2].toString() == 'function (a) { return a+"\\0"+i; }';
+var r3 = f(5) == "15:xAy" && f(5) == f(5) && f(50) == "147:xAy";
+var r4 = f.toString().indexOf("\xFFtok") < 0 && Object.keys(f).length == 0;
+
+result = r1 && r2 && r3 && r4;
@@ -0,0 +1,21 @@
+// Check that `batch:true` watches get all the pending edges in one call
+// (on Linux without GPIO, pins just remember what was written to them)
+
+var batched = [];
+setWatch(function(e) { batched.push(e); }, D5, { repeat:true, batch:true });
+var rising = [];
+setWatch(function(e) { rising.push(e); }, D6, { repeat:true, batch:true, edge:"rising" });
+var single = [];
+setWatch(function(e) { single.push(e); }, D7, { repeat:true });
+
+digitalWrite(D5,1); digitalWrite(D5,0); digitalWrite(D5,1);
+digitalWrite(D6,1); digitalWrite(D6,0); digitalWrite(D6,1); digitalWrite(D6,0);
+digitalWrite(D7,1); digitalWrite(D7,0);
+
+setTimeout(function() {
+  var b = batched[0], r = rising[0];
+  result = batched.length==1 && b.times instanceof Float64Array && b.times.length==3 &&
+           b.state==true && b.time==b.times[2] && b.times[0]<=b.times[1] && b.times[1]<=b.times[2] &&
+           rising.length==1 && r.times.length==2 && r.state==true && r.time==r.times[1] &&
+           single.length==2 && single[0].times===undefined && single[1].state==false;
+}, 50);